@@ -2,6 +2,7 @@
 // This code is licensed under MIT license (see LICENSE file for details)
 
 using System;
+using System.Collections.Generic;
 using System.Linq;
 using System.Windows;
 using System.Windows.Controls;
@@ -12,8 +13,12 @@ using Timeline;
 using TimelineControls;
 using System.Windows.Controls.Primitives;
 using System.Windows.Media;
+using System.Threading;
 using System.Threading.Tasks;
 using System.Windows.Input;
+using System.Windows.Threading;
+using System.Net;
+using System.Net.Sockets;
 using VisualReplayDebugger.Panels;
 
 using FontAwesomeIcon = FontAwesome.Sharp.IconChar;
@@ -282,24 +287,36 @@ public partial class MainWindow : Window
 
     public void LoadReplay(string path)
     {
+        if (path.StartsWith("tcp:") || path.StartsWith("unix:"))
+        {
+            FollowReplay(path);
+            return;
+        }
+        StopFollowing();
+
         string pathName = path;
         this.Cursor = Cursors.AppStarting;
         this.Title = $"Visual Replay Debugger - {pathName} (loading...)";
         Task.Run(() =>
         {
+            // Replays with a summary footer show their entities and timeline first, while the whole replay loads
+            var summary = ReplayCaptureReader.LoadSummary(path);
+            if (summary != null)
+            {
+                Application.Current.Dispatcher.Invoke(new Action(() =>
+                {
+                    SetReplay(summary, null);
+                }));
+            }
+
             var replay = new ReplayCaptureReader(path);
             Application.Current.Dispatcher.Invoke(new Action(() =>
             {
                 this.Title = $"Visual Replay Debugger - {pathName} (prepping...)";
 
-                Replay = replay;
-                ReplayChanged?.Invoke(replay);
-
-                EntitySelection.Clear();
-                EntitySelection.Add(Replay.Entities.Values.FirstOrDefault());
-                HiddenEntities.Clear();
-
-                this.TimelineWindow.Fill();
+                // Entities selected from the summary stay selected
+                var selectedIds = summary != null ? EntitySelection.SelectionSet.Where(x => x != null).Select(x => x.Id).ToList() : null;
+                SetReplay(replay, selectedIds);
 
                 this.Title = $"Visual Replay Debugger - {pathName}";
                 this.Cursor = Cursors.Arrow;
@@ -307,6 +324,136 @@ public partial class MainWindow : Window
         });
     }
 
+    // Live captures streamed to "tcp:<port>" (localhost) or "unix:<socket path>", the names the capture is created with:
+    // the viewer listens there and shows the frames as they arrive.
+    private const int FollowRefreshMs = 500;
+    private Socket followListener;
+    private Socket followConnection;
+    private CancellationTokenSource followCancel;
+    private readonly object followLock = new object();
+
+    public void FollowReplay(string address)
+    {
+        StopFollowing();
+        Socket listener = null;
+        try
+        {
+            EndPoint endPoint = address.StartsWith("unix:") ? new UnixDomainSocketEndPoint(address.Substring(5)) : new IPEndPoint(IPAddress.Loopback, int.Parse(address.Substring(4)));
+            if (endPoint is UnixDomainSocketEndPoint) System.IO.File.Delete(address.Substring(5));
+            listener = new Socket(endPoint.AddressFamily, SocketType.Stream, ProtocolType.Unspecified);
+            listener.Bind(endPoint);
+            listener.Listen(1);
+        }
+        catch (Exception e) when (e is SocketException || e is FormatException || e is System.IO.IOException)
+        {
+            listener?.Dispose();
+            MessageBox.Show($"Cannot listen on {address}: {e.Message}", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+            return;
+        }
+        var cancel = new CancellationTokenSource();
+        followListener = listener;
+        followCancel = cancel;
+        this.Title = $"Visual Replay Debugger - {address} (waiting for capture...)";
+
+        var replay = ReplayCaptureReader.Follow();
+        var received = new System.Collections.Concurrent.ConcurrentQueue<byte[]>();
+        var token = cancel.Token;
+        var connection = Task.Run(async () =>
+        {
+            using var socket = await listener.AcceptAsync(token);
+            lock (followLock)
+            {
+                if (cancel.IsCancellationRequested) return;
+                followConnection = socket; // Closed by StopFollowing
+            }
+            using var stream = new NetworkStream(socket, ownsSocket: false);
+            var buffer = new byte[64 << 10];
+            int count;
+            while ((count = await stream.ReadAsync(buffer, token)) > 0) received.Enqueue(buffer[..count]);
+        }, token);
+        // Stopped connections end with a cancellation or a disposed socket, observed here so they are not reported later
+        connection.ContinueWith(t => System.Diagnostics.Debug.WriteLine($"Stopped following {address}: {t.Exception.InnerException?.Message}"),
+            TaskContinuationOptions.OnlyOnFaulted);
+
+        // Fed on the UI thread, the panels read the replay there
+        var timer = new DispatcherTimer() { Interval = TimeSpan.FromMilliseconds(FollowRefreshMs) };
+        timer.Tick += (o, e) =>
+        {
+            if (followListener != listener)
+            {
+                timer.Stop(); // Another replay was loaded
+                return;
+            }
+
+            bool appended = false;
+            try
+            {
+                while (received.TryDequeue(out var bytes)) appended |= replay.Feed(bytes, 0, bytes.Length);
+            }
+            catch (InvalidOperationException ex)
+            {
+                timer.Stop();
+                StopFollowing();
+                this.Title = $"Visual Replay Debugger - {address} (stopped)";
+                MessageBox.Show($"Invalid data from {address}: {ex.Message}", "Error", MessageBoxButton.OK, MessageBoxImage.Error);
+                return;
+            }
+            if (appended && Replay != replay)
+            {
+                SetReplay(replay, null);
+                this.Title = $"Visual Replay Debugger - {address} (live)";
+            }
+            else if (appended)
+            {
+                RefreshReplay();
+            }
+
+            if (connection.IsCompleted && received.IsEmpty)
+            {
+                timer.Stop();
+                StopFollowing();
+                string lost = connection.IsFaulted ? $" (connection lost: {connection.Exception.InnerException?.Message})" : "";
+                this.Title = $"Visual Replay Debugger - {address}{lost}";
+            }
+        };
+        timer.Start();
+    }
+
+    private void StopFollowing()
+    {
+        lock (followLock)
+        {
+            followCancel?.Cancel();
+            followConnection?.Dispose();
+            followConnection = null;
+        }
+        followCancel?.Dispose();
+        followCancel = null;
+        followListener?.Dispose();
+        followListener = null;
+    }
+
+    // Panels rebuild from the replay, the entities selected and hidden stay so
+    private void RefreshReplay()
+    {
+        ReplayChanged?.Invoke(Replay);
+        this.TimelineWindow.Fill();
+    }
+
+    private void SetReplay(ReplayCaptureReader replay, List<int> selectedIds)
+    {
+        Replay = replay;
+        ReplayChanged?.Invoke(replay);
+
+        EntitySelection.Clear();
+        var selected = selectedIds?.Select(id => Replay.Entities.GetValueOrDefault(id)).Where(x => x != null).ToList();
+        if (selected != null && selected.Count > 0) EntitySelection.Add(selected);
+        else EntitySelection.Add(Replay.Entities.Values.FirstOrDefault());
+        HiddenEntities.Clear();
+
+        this.TimelineWindow.Fill();
+    }
+
     public void stepFrameForward()
     {
         TimelineController.Stop();
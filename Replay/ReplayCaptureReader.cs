@@ -25,42 +25,63 @@ public class ReplayCaptureReader
     {
         private List<(int frame, T val)> baking_list = new();
 
-        private int[] internal_frames = new int[0];
-        private T[] internal_values = new T[0];
+        private List<int> internal_frames = new();
+        private List<T> internal_values = new();
+        private bool unordered = false; // Value series add frames before the last one
 
         public void AddForBake(int frame, T entry)
         {
-            // TODO: Assert that times are monotonic
+            if (baking_list.Count > 0 && frame < baking_list[baking_list.Count - 1].frame) unordered = true;
             baking_list.Add((frame, entry));
         }
 
+        // Entries are added after the ones already baked, followed live streams bake after every chunk received
         public void Bake()
         {
-            internal_frames = baking_list.Select(x => x.frame).ToArray();
-            internal_values = baking_list.Select(x => x.val).ToArray();
-            baking_list.Clear();
-            baking_list = null;
+            if (unordered) baking_list = baking_list.OrderBy(x => x.frame).ToList(); // stable, entries of a frame keep their order
+
+            // Value series can add frames before the last baked one, the baked entries past them are merged back in
+            int kept = internal_frames.Count;
+            if (baking_list.Count > 0)
+            {
+                while (kept > 0 && internal_frames[kept - 1] > baking_list[0].frame) --kept;
+            }
+            if (kept < internal_frames.Count)
+            {
+                var baked = Enumerable.Range(kept, internal_frames.Count - kept).Select(i => (internal_frames[i], internal_values[i]));
+                baking_list = baked.Concat(baking_list).OrderBy(x => x.Item1).ToList(); // stable, baked entries of a frame stay first
+                internal_frames.RemoveRange(kept, internal_frames.Count - kept);
+                internal_values.RemoveRange(kept, internal_values.Count - kept);
+            }
+
+            internal_frames.EnsureCapacity(internal_frames.Count + baking_list.Count);
+            internal_values.EnsureCapacity(internal_values.Count + baking_list.Count);
+            internal_frames.AddRange(baking_list.Select(x => x.frame));
+            internal_values.AddRange(baking_list.Select(x => x.val));
+            baking_list = new();
+            unordered = false;
         }
 
         public void Load(IEnumerable<(int frame,T val)> values)
         {
             // TODO: Assert that times are monotonic
-            internal_frames = values.Select(x => x.frame).ToArray();
-            internal_values = values.Select(x => x.val).ToArray();
-            baking_list.Clear();
-            baking_list = null;
+            internal_frames = values.Select(x => x.frame).ToList();
+            internal_values = values.Select(x => x.val).ToList();
+            baking_list = new();
         }
 
         public int FirstIndexFor(int frame)
         {
             if (Count == 0) return -1;
-            // Note: Could be optimized with a binary search.
-            int index = 0;
-            for (; index < Count; ++index)
+            int first = 0;
+            int last = Count;
+            while (first < last)
             {
-                if (internal_frames[index] >= frame) break;
+                int middle = (first + last) / 2;
+                if (internal_frames[middle] >= frame) last = middle;
+                else first = middle + 1;
             }
-            return index >= Count ? (Count - 1) : index;
+            return first >= Count ? (Count - 1) : first;
         }
 
         public T FirstAtFrame(int frame)
@@ -71,7 +92,7 @@ public class ReplayCaptureReader
 
         public IEnumerable<(int frame, T val)> SubRange(FrameRange range)
         {
-            for (int index = FirstIndexFor(range.Start); index < internal_frames.Length; ++index)
+            for (int index = FirstIndexFor(range.Start); index < internal_frames.Count; ++index)
             {
                 int frame = internal_frames[index];
                 if (range.InRange(frame))
@@ -116,7 +137,7 @@ public class ReplayCaptureReader
 
         public IEnumerable<T> AllValues => internal_values;
 
-        public int Count => internal_values.Length;
+        public int Count => internal_values.Count;
 
         public (int frame, T val) this[int index] => (internal_frames[index],internal_values[index]);
     }
@@ -366,10 +387,44 @@ public class ReplayCaptureReader
 
     public ReplayCaptureReader(string filePath)
     {
-        LoadCapture(filePath);
+        LoadCapture(filePath, null);
     }
 
-    private void LoadCapture(string filePath)
+    private ReplayCaptureReader()
+    {
+    }
+
+    // Entities and their lifetimes, log frames, categories, colors and frame times of chunked replays captured with a summary footer,
+    // without decoding any chunk: shown while the replay loads. Null for other replays.
+    public static ReplayCaptureReader? LoadSummary(string filePath)
+    {
+        if (!File.Exists(filePath)) return null;
+        using Stream file = File.OpenRead(filePath);
+        var fileReader = new BinaryReader(file);
+        if (file.Length < 4 || fileReader.ReadInt32() != ChunkedReplayStream.Magic) return null;
+        var chunked = new ChunkedReplayStream(file, null);
+        if (chunked.SummaryOffset < 0) return null;
+
+        file.Seek(chunked.SummaryOffset, SeekOrigin.Begin);
+        var summary = new ReplayCaptureReader();
+        try
+        {
+            summary.LoadSummary(new BinaryReaderEx(new MemoryStream(fileReader.ReadBytes((int)chunked.SummarySize), false), BinaryReplayWriter.StringEncoding));
+        }
+        catch (EndOfStreamException)
+        {
+            return null;
+        }
+        return summary;
+    }
+
+    // Chunked replays only decode the chunks overlapping the range, other replays are loaded whole.
+    public ReplayCaptureReader(string filePath, FrameRange frames)
+    {
+        LoadCapture(filePath, frames);
+    }
+
+    private void LoadCapture(string filePath, FrameRange? frames)
     {
         if (File.Exists(filePath))
         {
@@ -377,7 +432,20 @@ public class ReplayCaptureReader
             
             // Auto-detect compression
             int header = (new BinaryReader(stream)).ReadInt32();
-            if (header == (int)BlockType.ReplayHeader)
+            if (header == ChunkedReplayStream.Magic)
+            {
+                stream = new ChunkedReplayStream(stream, frames);
+            }
+            else if (header == ReplayCodecs.StreamMagic)
+            {
+                var reader = new BinaryReader(stream);
+                int version = reader.ReadInt32();
+                if (version > ReplayCodecs.StreamVersion) throw new InvalidOperationException($"Unsupported replay version ({version}), the replay was written by a newer version.");
+                var (codec, dictionary) = ReplayCodecs.ReadHeader(reader);
+                stream = ReplayCodecs.Decode(codec, stream, dictionary);
+                stream = new BufferedStream(stream, 64<<10);
+            }
+            else if (header == (int)BlockType.ReplayHeader)
             {
                 // uncompressed
             }
@@ -402,16 +470,242 @@ public class ReplayCaptureReader
         }
     }
 
-    private void LoadCapture(BinaryReaderEx reader)
+    // Live streams (the tcp:, unix: and callback sinks of the capture) are followed: bytes are fed as they are received,
+    // and the frames of every complete chunk are appended to the replay, without reading it again from the start.
+    public static ReplayCaptureReader Follow() => new() { follow = new() };
+
+    private class FollowState
+    {
+        public byte[] received = new byte[64 << 10];
+        public int size; // Bytes received, from the next chunk on
+        public bool headerRead;
+        public ReplayCodec codec;
+        public byte[] dictionary;
+        public int gapFrame; // First frame the stream dropped
+        public HashSet<EntityEx>? gapEntities; // Live before the gap, until the keyframe after it redefines them
+    }
+    private FollowState? follow;
+
+    // Not undefined, or defined again since
+    private bool IsLive(EntityEx entity) => !EntityLifeTimes.TryGetValue(entity, out var lifeTime) || Math.Max(entity.CreationFrame, entity.RegistrationFrame) > lifeTime.End;
+
+    // Throws InvalidOperationException if the bytes are not a live stream. The data of the chunks completed by these bytes is
+    // visible when it returns, returns false if none was.
+    public bool Feed(byte[] data, int offset, int count)
+    {
+        if (follow == null) throw new InvalidOperationException("Only followed replays are fed.");
+        if (follow.size + count > follow.received.Length) Array.Resize(ref follow.received, Math.Max(follow.received.Length * 2, follow.size + count));
+        Buffer.BlockCopy(data, offset, follow.received, follow.size, count);
+        follow.size += count;
+
+        int position = 0;
+        if (!follow.headerRead)
+        {
+            // Same header as chunked files: magic, version, then codec, level, dictionary size and dictionary
+            const int HeaderSize = 20;
+            if (follow.size >= 4 && BitConverter.ToInt32(follow.received, 0) != ChunkedReplayStream.Magic) throw new InvalidOperationException("Not a live replay stream.");
+            if (follow.size < HeaderSize) return false;
+            int dictionarySize = BitConverter.ToInt32(follow.received, 16);
+            if (dictionarySize < 0) throw new InvalidOperationException("Invalid live stream header.");
+            if (follow.size < HeaderSize + dictionarySize) return false;
+            var reader = new BinaryReader(new MemoryStream(follow.received, 4, follow.size - 4, false));
+            int version = reader.ReadInt32();
+            if (version > ChunkedReplayStream.Version || version < 2) throw new InvalidOperationException($"Unsupported live stream version ({version}).");
+            (follow.codec, follow.dictionary) = ReplayCodecs.ReadHeader(reader);
+            position = 4 + (int)reader.BaseStream.Position;
+            follow.headerRead = true;
+        }
+
+        bool appended = false;
+        while (follow.size - position >= ChunkedReplayStream.ChunkHeaderSize)
+        {
+            int firstFrame = BitConverter.ToInt32(follow.received, position);
+            int rawSize = BitConverter.ToInt32(follow.received, position + 8);
+            int storedSize = BitConverter.ToInt32(follow.received, position + 12);
+            if (rawSize < 0 || storedSize < 0) throw new InvalidOperationException("Invalid chunk. Probably not a valid live stream.");
+            if (follow.size - position - ChunkedReplayStream.ChunkHeaderSize < storedSize) break;
+            position += ChunkedReplayStream.ChunkHeaderSize;
+
+            if (rawSize == 0 && storedSize == 0)
+            {
+                // Gap marker: entities may have been undefined in the frames dropped, the keyframe of the next chunk defines the live ones
+                if (follow.gapEntities == null)
+                {
+                    follow.gapFrame = firstFrame;
+                    follow.gapEntities = Entities.Values.Where(x => x.Id != CaptureStatsEntityId && IsLive(x)).ToHashSet();
+                }
+                keyframe_applied = false;
+                continue;
+            }
+
+            byte[]? raw = ReplayCodecs.DecodeChunk(follow.codec, follow.received[position..(position + storedSize)], rawSize, follow.dictionary);
+            if (raw == null) throw new InvalidOperationException("Truncated chunk. Probably not a valid live stream.");
+            position += storedSize;
+            ReadBlocks(new BinaryReaderEx(new MemoryStream(raw, false), BinaryReplayWriter.StringEncoding));
+            if (follow.gapEntities != null)
+            {
+                foreach (var entity in follow.gapEntities) EntityLifeTimes[entity] = new FrameRange() { Start = entity.CreationFrame, End = follow.gapFrame };
+                follow.gapEntities = null;
+            }
+            appended = true;
+        }
+
+        // Chunks read are dropped
+        Buffer.BlockCopy(follow.received, position, follow.received, 0, follow.size - position);
+        follow.size -= position;
+        if (appended) BakeCapture();
+        return appended;
+    }
+
+    // Ids given to undefined entities whose id was recycled, above any id a capture hands out
+    private const int RetiredEntityIdBase = 1 << 30;
+
+    // Entity holding the capture stats blocks as numeric values, so they can be plotted like any other.
+    // Negative, so never a capture entity id (ids are keys + 1 or mapped from 1, and negative ids already mean no parent).
+    private const int CaptureStatsEntityId = int.MinValue;
+
+    // Summary footer entity flags
+    private const int SummaryEntityRegistered = 1 << 0;
+
+    // Entities are matched like LoadCapture does with their def, undef and log blocks.
+    private void LoadSummary(BinaryReaderEx reader)
     {
-        var frametimes = new List<float>() { 0 };
+        bool recycled_ids = ((ReplayFormatFlags)reader.Read7BitEncodedInt()).HasFlag(ReplayFormatFlags.RecycledIds);
+        int frameCount = reader.Read7BitEncodedInt();
+        var frametimes = new List<float>(frameCount + 1) { 0 };
         var framesForTimes = new List<int>() { 0 };
-        try
+        for (int i = 0; i < frameCount; ++i)
         {
+            float totalTime = reader.ReadSingle();
+            frametimes.Add(totalTime);
+            if (Math.Abs(totalTime) > framesForTimes.Count) { framesForTimes.Add(frametimes.Count); }
+        }
 
+        foreach (var colors in new[] { LogColors, DrawColors })
+        {
+            for (int word = 0; word < 8; ++word)
+            {
+                uint bits = reader.ReadUInt32();
+                for (int bit = 0; bit < 32; ++bit)
+                {
+                    if ((bits & (1u << bit)) != 0) colors.Add((Color)(word * 32 + bit));
+                }
+            }
+        }
+        foreach (var categories in new[] { LogCategories, DrawCategories })
+        {
+            int count = reader.Read7BitEncodedInt();
+            for (int i = 0; i < count; ++i) categories.Add(reader.ReadString());
+        }
 
+        int entityCount = reader.Read7BitEncodedInt();
+        int retired_id_count = 0;
+        for (int i = 0; i < entityCount; ++i)
+        {
+            int id = reader.Read7BitEncodedInt();
+            bool registered = (reader.Read7BitEncodedInt() & SummaryEntityRegistered) != 0;
+            int defFrame = reader.Read7BitEncodedInt();
+            int undefFrame = reader.Read7BitEncodedInt() - 1;
+
+            EntityEx? entity;
+            if (registered)
+            {
+                var entitydef = new EntityEx() { Id = id, InitialTransform = Transform.Identity, CreationFrame = defFrame };
+                entitydef.Name = reader.ReadString();
+                entitydef.Path = reader.ReadString();
+                entitydef.TypeName = reader.ReadString();
+                entitydef.CategoryName = reader.ReadString();
+                entity = entitydef;
+                if (recycled_ids && Entities.TryGetValue(id, out var undefinedEntity) && EntityLifeTimes.ContainsKey(undefinedEntity))
+                {
+                    Entities.Remove(id);
+                    undefinedEntity.Id = RetiredEntityIdBase + retired_id_count++;
+                    Entities.Add(undefinedEntity.Id, undefinedEntity);
+                }
+                if (Entities.TryGetValue(id, out var previouslyDefinedEntity))
+                {
+                    previouslyDefinedEntity.Name = entitydef.Name;
+                    previouslyDefinedEntity.Path = entitydef.Path;
+                    previouslyDefinedEntity.CategoryName = entitydef.CategoryName;
+                    previouslyDefinedEntity.TypeName = entitydef.TypeName;
+                    previouslyDefinedEntity.RegistrationFrame = entitydef.CreationFrame;
+                    entity = previouslyDefinedEntity;
+                }
+                else
+                {
+                    Entities.Add(id, entitydef);
+                }
+                EntityCategories.Add(entitydef.CategoryName);
+            }
+            else if (!Entities.TryGetValue(id, out entity))
+            {
+                // Placeholder entity
+                entity = new();
+                entity.Id = id;
+                Entities.Add(id, entity);
+            }
+            if (undefFrame >= 0) EntityLifeTimes[entity] = new FrameRange() { Start = entity.CreationFrame, End = undefFrame };
+
+            int logCount = reader.Read7BitEncodedInt();
+            if (logCount > 0)
+            {
+                entity.HasLogs = true;
+                if (!LogEntityFrameMarkers.TryGetValue(entity, out var framesWithLogs))
+                {
+                    framesWithLogs = new();
+                    LogEntityFrameMarkers.Add(entity, framesWithLogs);
+                }
+                int frame = 0;
+                for (int j = 0; j < logCount; ++j)
+                {
+                    frame += reader.Read7BitEncodedInt();
+                    entity.HasLogsPastFirstFrame |= frame > entity.CreationFrame;
+                    if (framesWithLogs.Count == 0 || framesWithLogs.Last() != frame) { framesWithLogs.Add(frame); }
+                }
+            }
+        }
+
+        this.FrameTimes = frametimes.ToArray();
+        this.FramesForTimes = framesForTimes.ToArray();
+        EntitiesGraph = EntityGraphNode.BuildGraph(Entities.Values);
+    }
+
+    // Block stream state, kept from one chunk to the next when following a live stream
+    private List<float> frametimes = new() { 0 };
+    private List<int> framesForTimes = new() { 0 };
+    private Dictionary<Entity, Transform> last_xforms = new();
+    private Dictionary<Entity, (int X, int Y, int Z)> last_qpositions = new();
+    private float position_quantum = 0;
+    private bool recycled_ids = false;
+    private int retired_id_count = 0;
+    private bool keyframe_applied = false;
+    private Dictionary<int, Point[]> meshes = new(); // Shared by all the draws referencing them
+    private bool entities_changed = false; // Since EntitiesGraph was built
+
+    private EntityEx GetEntity(int id)
+    {
+        if (!Entities.TryGetValue(id, out var entity))
+        {
+            // Placeholder entity
+            entity = new();
+            entity.Id = id;
+            Entities.Add(id, entity);
+            entities_changed = true;
+        }
+        return entity;
+    }
+
+    private void LoadCapture(BinaryReaderEx reader)
+    {
+        ReadBlocks(reader);
+        BakeCapture();
+    }
+
+    private void ReadBlocks(BinaryReaderEx reader)
+    {
+        try
+        {
             int blockCount = 0;
-            Dictionary<Entity, Transform> last_xforms = new();
             while(true)
             {
                 ++blockCount;
@@ -425,6 +719,119 @@ public class ReplayCaptureReader
                 {
                     // empty
                 }
+                else if (blockType == BlockType.ReplayFormat)
+                {
+                    var formatFlags = (ReplayFormatFlags)reader.Read7BitEncodedInt();
+                    if ((formatFlags & ~ReplayFormatFlags.Supported) != 0) throw new InvalidOperationException($"Unsupported replay format ({formatFlags}), the replay was written by a newer version.");
+                    reader.StringTable = formatFlags.HasFlag(ReplayFormatFlags.StringTable) ? new() { string.Empty } : null;
+                    if (formatFlags.HasFlag(ReplayFormatFlags.DeltaTransforms)) position_quantum = reader.ReadSingle();
+                    recycled_ids = formatFlags.HasFlag(ReplayFormatFlags.RecycledIds);
+                    meshes.Clear();
+                }
+                else if (blockType == BlockType.StringDef)
+                {
+                    int stringId = reader.Read7BitEncodedInt();
+                    reader.DefineString(stringId, reader.ReadString());
+                }
+                else if (blockType == BlockType.MeshDef)
+                {
+                    int meshId = reader.Read7BitEncodedInt();
+                    int vertexCount = reader.Read7BitEncodedInt();
+                    Point[] verts = new Point[vertexCount];
+                    for (int i = 0; i < vertexCount; ++i) { reader.Read(out Point p); verts[i] = p; }
+                    meshes[meshId] = verts;
+                }
+                else if (blockType == BlockType.Keyframe)
+                {
+                    int keyframeFrame = reader.Read7BitEncodedInt();
+                    float keyframeTime = reader.ReadSingle();
+                    int keyframeLength = reader.ReadInt32();
+                    if (keyframe_applied)
+                    {
+                        // Only the first chunk read restores the live entities, the others carry on from the previous chunk
+                        reader.ReadBytes(keyframeLength);
+                    }
+                    else
+                    {
+                        keyframe_applied = true;
+                        while (frametimes.Count <= keyframeFrame)
+                        {
+                            frametimes.Add(keyframeTime);
+                            if (Math.Abs(keyframeTime) > framesForTimes.Count) { framesForTimes.Add(frametimes.Count); }
+                        }
+                    }
+                }
+                else if (blockType == BlockType.CaptureStats)
+                {
+                    int frame = reader.Read7BitEncodedInt();
+                    if (!Entities.TryGetValue(CaptureStatsEntityId, out var statsEntity))
+                    {
+                        statsEntity = new() { Id = CaptureStatsEntityId, Name = "Capture stats", Path = string.Empty, TypeName = string.Empty, CategoryName = "Capture", CreationFrame = frame };
+                        Entities.Add(CaptureStatsEntityId, statsEntity);
+                        entities_changed = true;
+                        EntityCategories.Add(statsEntity.CategoryName);
+                    }
+                    var values = EntityDynamicValues.For(statsEntity);
+                    int typeCount = reader.Read7BitEncodedInt();
+                    for (int i = 0; i < typeCount; ++i)
+                    {
+                        var statsType = (BlockType)reader.Read7BitEncodedInt();
+                        values?.AddForBake(frame, ($"{statsType} calls", reader.Read7BitEncodedInt64()));
+                        values?.AddForBake(frame, ($"{statsType} bytes", reader.Read7BitEncodedInt64()));
+                    }
+                    values?.AddForBake(frame, ("Flushed bytes", reader.Read7BitEncodedInt64()));
+                    values?.AddForBake(frame, ("Stored bytes", reader.Read7BitEncodedInt64()));
+                    values?.AddForBake(frame, ("Compression ms", reader.Read7BitEncodedInt64() / 1000.0f));
+                    values?.AddForBake(frame, ("I/O ms", reader.Read7BitEncodedInt64() / 1000.0f));
+                    statsEntity.HasNumericParameters = true;
+                }
+                else if (blockType == BlockType.EntitySetPosBatch || blockType == BlockType.EntitySetTransformBatch || blockType == BlockType.EntityLineBatch || blockType == BlockType.EntitySphereBatch)
+                {
+                    // Same as one block per entity: ids are deltas from the previous one, then each float component packed for all entities
+                    int frame = reader.Read7BitEncodedInt();
+                    string category = string.Empty;
+                    Color color = default;
+                    if (blockType == BlockType.EntityLineBatch || blockType == BlockType.EntitySphereBatch)
+                    {
+                        category = reader.ReadLabel();
+                        reader.Read(out color);
+                    }
+                    int count = reader.Read7BitEncodedInt();
+                    var batchEntities = new EntityEx[count];
+                    int id = 0;
+                    for (int i = 0; i < count; ++i)
+                    {
+                        uint zigzag = (uint)reader.Read7BitEncodedInt();
+                        id += (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+                        batchEntities[i] = GetEntity(id);
+                    }
+                    int components = blockType switch { BlockType.EntitySetPosBatch => 3, BlockType.EntitySphereBatch => 4, BlockType.EntityLineBatch => 6, _ => 7 };
+                    var f = new float[count * components];
+                    for (int i = 0; i < f.Length; ++i) f[i] = reader.ReadSingle();
+                    for (int i = 0; i < count; ++i)
+                    {
+                        var entity = batchEntities[i];
+                        var p1 = new Point() { X = f[i], Y = f[count + i], Z = f[2 * count + i] };
+                        if (blockType == BlockType.EntitySetPosBatch || blockType == BlockType.EntitySetTransformBatch)
+                        {
+                            if (!last_xforms.TryGetValue(entity, out Transform xform)) { xform = new Transform(); xform.Rotation.W = 1; }
+                            xform.Translation = p1;
+                            if (blockType == BlockType.EntitySetTransformBatch) xform.Rotation = new Quaternion() { X = f[3 * count + i], Y = f[4 * count + i], Z = f[5 * count + i], W = f[6 * count + i] };
+                            EntitySetTransforms.For(entity)?.AddForBake(frame, xform);
+                            entity.HasTransforms = true;
+                            last_xforms[entity] = xform;
+                        }
+                        else if (blockType == BlockType.EntityLineBatch)
+                        {
+                            var p2 = new Point() { X = f[3 * count + i], Y = f[4 * count + i], Z = f[5 * count + i] };
+                            AddDrawCommand(frame, new EntityDrawCommand() { entity = entity, category = category, type = EntityDrawCommandType.Line, color = color, frame = frame, xform = new Transform() { Translation = p1 }, p2 = p2, scale = 1 });
+                        }
+                        else
+                        {
+                            AddDrawCommand(frame, new EntityDrawCommand() { entity = entity, category = category, type = EntityDrawCommandType.Sphere, color = color, frame = frame, xform = new Transform() { Translation = p1 }, scale = f[3 * count + i] });
+                        }
+                    }
+                }
                 else if (blockType == BlockType.FrameStep)
                 {
                     float totalTime = reader.ReadSingle();
@@ -448,6 +855,14 @@ public class ReplayCaptureReader
                         reader.Read(out EntityEx entitydef);
                         entitydef.ParentId = parentId;
                         entity = entitydef;
+                        entities_changed = true;
+                        if (recycled_ids && Entities.TryGetValue(id, out var undefinedEntity) && EntityLifeTimes.ContainsKey(undefinedEntity))
+                        {
+                            // The id was reused by the capture, the undefined entity keeps its history under a retired id
+                            Entities.Remove(id);
+                            undefinedEntity.Id = RetiredEntityIdBase + retired_id_count++;
+                            Entities.Add(undefinedEntity.Id, undefinedEntity);
+                        }
                         if (Entities.TryGetValue(id, out var previouslyDefinedEntity))
                         {
                             // Overrides
@@ -465,18 +880,10 @@ public class ReplayCaptureReader
                             Entities.Add(id, entitydef);
                         }
                         EntityCategories.Add(entitydef.CategoryName);
+                        follow?.gapEntities?.Remove(entity);
                     }
 
-                    if (entity == null)
-                    {
-                        if (!Entities.TryGetValue(id, out entity))
-                        {
-                            // Placeholder entity
-                            entity = new();
-                            entity.Id = id;
-                            Entities.Add(id, entity);
-                        }
-                    }
+                    entity ??= GetEntity(id);
 
                     switch (blockType)
                     {
@@ -503,13 +910,52 @@ public class ReplayCaptureReader
                                 last_xforms[entity] = xform;
                             }
                             break;
+                        case BlockType.EntityTransformDelta:
+                            {
+                                var flags = (TransformDeltaFlags)reader.ReadByte();
+                                last_qpositions.TryGetValue(entity, out var qpos);
+                                if (flags.HasFlag(TransformDeltaFlags.Full))
+                                {
+                                    qpos = (reader.ReadZigZag(), reader.ReadZigZag(), reader.ReadZigZag());
+                                }
+                                else
+                                {
+                                    if (flags.HasFlag(TransformDeltaFlags.X)) qpos.X += reader.ReadZigZag();
+                                    if (flags.HasFlag(TransformDeltaFlags.Y)) qpos.Y += reader.ReadZigZag();
+                                    if (flags.HasFlag(TransformDeltaFlags.Z)) qpos.Z += reader.ReadZigZag();
+                                }
+                                last_qpositions[entity] = qpos;
+
+                                if (!last_xforms.TryGetValue(entity, out Transform xform)) { xform = new Transform(); xform.Rotation.W = 1; }
+                                xform.Translation = new Point() { X = qpos.X * position_quantum, Y = qpos.Y * position_quantum, Z = qpos.Z * position_quantum };
+                                if (flags.HasFlag(TransformDeltaFlags.Rotation))
+                                {
+                                    reader.ReadSmallestThree((int)(flags & TransformDeltaFlags.RotationIndexMask) >> 4, out xform.Rotation);
+                                }
+                                EntitySetTransforms.For(entity)?.AddForBake(frame, xform);
+                                entity.HasTransforms = true;
+                                last_xforms[entity] = xform;
+                            }
+                            break;
                         case BlockType.EntityLog:
+                        case BlockType.EntityLogFormat:
                             {
-                                string category = reader.ReadString();
-                                string msg = reader.ReadString();
+                                string category = reader.ReadLabel();
+                                string msg;
+                                Color color;
+                                if (blockType == BlockType.EntityLogFormat)
+                                {
+                                    string format = reader.ReadLabel();
+                                    reader.Read(out color);
+                                    msg = LogFormatter.Format(format, reader.ReadBytes(reader.Read7BitEncodedInt()));
+                                }
+                                else
+                                {
+                                    msg = reader.ReadString();
+                                    reader.Read(out color);
+                                }
                                 msg = msg.Replace('\r',' '); // newlines stripped
                                 msg = msg.Replace('\n',' '); // newlines stripped
-                                reader.Read(out Color color);
                                 List<int>? framesWithLogs = null;
                                 if (entity != null)
                                 {
@@ -536,7 +982,7 @@ public class ReplayCaptureReader
                             break;
                         case BlockType.EntityParameter:
                             {
-                                string label = reader.ReadString();
+                                string label = reader.ReadLabel();
                                 string val = reader.ReadString();
                                 entity.HasParameters = true;
                                 AddToDynamicPropertiesTable(entity, frame, label, val);
@@ -544,15 +990,30 @@ public class ReplayCaptureReader
                             break;
                         case BlockType.EntityValue:
                             {
-                                string label = reader.ReadString();
+                                string label = reader.ReadLabel();
                                 float val = reader.ReadSingle();
                                 entity.HasNumericParameters = true;
                                 EntityDynamicValues.For(entity)?.AddForBake(frame, (label, val));
                             }
                             break;
+                        case BlockType.EntityValueSeries:
+                            {
+                                string label = reader.ReadLabel();
+                                int count = reader.Read7BitEncodedInt();
+                                int firstFrame = frame - reader.Read7BitEncodedInt();
+                                byte[] bits = reader.ReadBytes(reader.Read7BitEncodedInt());
+                                entity.HasNumericParameters = true;
+                                var values = EntityDynamicValues.For(entity);
+                                var series = ValueSeriesDecoder.Decode(bits, count, firstFrame);
+                                for (int i = 0; i < count; ++i)
+                                {
+                                    values?.AddForBake(series.frames[i], (label, series.values[i]));
+                                }
+                            }
+                            break;
                         case BlockType.EntityLine:
                             {
-                                string category = reader.ReadString();
+                                string category = reader.ReadLabel();
                                 reader.Read(out Point p1);
                                 reader.Read(out Point p2);
                                 reader.Read(out Color color);
@@ -561,7 +1022,7 @@ public class ReplayCaptureReader
                             break;
                         case BlockType.EntityCircle:
                             {
-                                string category = reader.ReadString();
+                                string category = reader.ReadLabel();
                                 reader.Read(out Point center);
                                 reader.Read(out Point up);
                                 float radius = reader.ReadSingle();
@@ -571,7 +1032,7 @@ public class ReplayCaptureReader
                             break;
                         case BlockType.EntitySphere:
                             {
-                                string category = reader.ReadString();
+                                string category = reader.ReadLabel();
                                 reader.Read(out Point center);
                                 float radius = reader.ReadSingle();
                                 reader.Read(out Color color);
@@ -580,7 +1041,7 @@ public class ReplayCaptureReader
                             break;
                         case BlockType.EntityBox:
                             {
-                                string category = reader.ReadString();
+                                string category = reader.ReadLabel();
                                 reader.Read(out Transform xform);
                                 reader.Read(out Point dimensions);
                                 reader.Read(out Color color);
@@ -589,7 +1050,7 @@ public class ReplayCaptureReader
                             break;
                         case BlockType.EntityCapsule:
                             {
-                                string category = reader.ReadString();
+                                string category = reader.ReadLabel();
                                 reader.Read(out Point p1);
                                 reader.Read(out Point p2);
                                 float radius = reader.ReadSingle();
@@ -599,13 +1060,26 @@ public class ReplayCaptureReader
                             break;
                         case BlockType.EntityMesh:
                             {
-                                string category = reader.ReadString();
+                                string category = reader.ReadLabel();
                                 int vertexCount = reader.ReadInt32();
                                 Point[] verts = new Point[vertexCount];
                                 for(int i = 0; i < vertexCount; ++i) { reader.Read(out Point p); verts[i] = p; }
                                 reader.Read(out Color color);
                                 entity.HasMesh = true;
-                                AddDrawCommand(frame, new EntityDrawCommand() { entity = entity, category = category, type = EntityDrawCommandType.Mesh, verts = verts, color = color, frame = frame });
+                                AddDrawCommand(frame, new EntityDrawCommand() { entity = entity, category = category, type = EntityDrawCommandType.Mesh, verts = verts, color = color, frame = frame, xform = new Transform() { Rotation = new Quaternion() { W = 1 } }, scale = 1 });
+                            }
+                            break;
+                        case BlockType.EntityMeshRef:
+                            {
+                                string category = reader.ReadLabel();
+                                int meshRef = reader.Read7BitEncodedInt();
+                                Transform xform = new Transform();
+                                xform.Rotation.W = 1;
+                                if ((meshRef & 1) != 0) reader.Read(out xform);
+                                reader.Read(out Color color);
+                                if (!meshes.TryGetValue(meshRef >> 1, out var verts)) throw new InvalidOperationException("Undefined mesh. Probably not a valid replay file.");
+                                entity.HasMesh = true;
+                                AddDrawCommand(frame, new EntityDrawCommand() { entity = entity, category = category, type = EntityDrawCommandType.Mesh, verts = verts, color = color, frame = frame, xform = xform, scale = 1 });
                             }
                             break;
                     }
@@ -616,6 +1090,11 @@ public class ReplayCaptureReader
         {
             // EOF
         }
+    }
+
+    // Makes the blocks read so far visible, followed live streams bake again after every chunk received
+    private void BakeCapture()
+    {
         this.FrameTimes = frametimes.ToArray();
         this.FramesForTimes = framesForTimes.ToArray();
         LogEntries.Bake();
@@ -624,7 +1103,11 @@ public class ReplayCaptureReader
         EntityDynamicParamsCombined.Bake();
         EntityDynamicValues.Bake();
 
-        EntitiesGraph = EntityGraphNode.BuildGraph(Entities.Values);
+        if (entities_changed)
+        {
+            EntitiesGraph = EntityGraphNode.BuildGraph(Entities.Values);
+            entities_changed = false;
+        }
 
         foreach (var entity in Entities.Values)
         {
@@ -761,9 +1244,9 @@ internal static class BinaryIOExtensionsRead
         entity = new EntityEx();
         entity.Id = r.Read7BitEncodedInt();
         entity.Name = r.ReadString();
-        entity.Path = r.ReadString();
-        entity.TypeName = r.ReadString();
-        entity.CategoryName = r.ReadString();
+        entity.Path = r.ReadLabel();
+        entity.TypeName = r.ReadLabel();
+        entity.CategoryName = r.ReadLabel();
         r.Read(out entity.InitialTransform);
         r.Read(out entity.StaticParameters);
         entity.CreationFrame = r.Read7BitEncodedInt();
@@ -790,6 +1273,21 @@ internal static class BinaryIOExtensionsRead
         };
     }
 
+    // Quaternion with its largest component dropped, the others quantized from [-1/sqrt(2), 1/sqrt(2)]
+    public static void ReadSmallestThree(this BinaryReader r, int largestIndex, out Quaternion quat)
+    {
+        Span<float> c = stackalloc float[4];
+        float sum = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (i == largestIndex) continue;
+            c[i] = (r.ReadUInt16() / 65535.0f - 0.5f) * MathF.Sqrt(2);
+            sum += c[i] * c[i];
+        }
+        c[largestIndex] = MathF.Sqrt(Math.Max(0, 1 - sum));
+        quat = new Quaternion() { X = c[0], Y = c[1], Z = c[2], W = c[3] };
+    }
+
     public static void Read(this BinaryReader r, out Transform xform)
     {
         r.Read(out Point t);
@@ -814,9 +1312,462 @@ internal static class BinaryIOExtensionsRead
     }
 }
 
+// Decoders of the codecs a replay can be compressed with.
+internal static class ReplayCodecs
+{
+    public const int StreamMagic = 0x53445256; // "VRDS", LZ4 and zstd single stream replays
+    public const int StreamVersion = 1;
+
+    // Codec, level, then the zstd dictionary
+    public static (ReplayCodec codec, byte[] dictionary) ReadHeader(BinaryReader reader)
+    {
+        var codec = (ReplayCodec)reader.ReadInt32();
+        reader.ReadInt32(); // level
+        int dictionarySize = reader.ReadInt32();
+        if (!Enum.IsDefined(codec)) throw new InvalidOperationException($"Unsupported replay codec ({(int)codec}), the replay was written by a newer version.");
+        return (codec, reader.ReadBytes(dictionarySize));
+    }
+
+    public static Stream Decode(ReplayCodec codec, Stream stream, byte[] dictionary)
+    {
+        switch (codec)
+        {
+            case ReplayCodec.Deflate:
+                return new System.IO.Compression.DeflateStream(stream, System.IO.Compression.CompressionMode.Decompress);
+            case ReplayCodec.LZ4:
+                return K4os.Compression.LZ4.Streams.LZ4Stream.Decode(stream);
+            case ReplayCodec.Zstd:
+                var zstd = new ZstdSharp.DecompressionStream(stream, leaveOpen: false);
+                if (dictionary.Length > 0) zstd.LoadDictionary(dictionary);
+                return zstd;
+            default:
+                return stream;
+        }
+    }
+
+    // Returns null if the chunk is truncated
+    public static byte[]? DecodeChunk(ReplayCodec codec, byte[] stored, int rawSize, byte[] dictionary)
+    {
+        if (codec == ReplayCodec.None) return stored;
+        byte[] raw = new byte[rawSize];
+        using var decoder = Decode(codec, new MemoryStream(stored), dictionary);
+        int read = 0;
+        while (read < rawSize)
+        {
+            int n = decoder.Read(raw, read, rawSize - read);
+            if (n <= 0) return null;
+            read += n;
+        }
+        return raw;
+    }
+}
+
+// Messages of VRD_SetLogf, formatted like printf from the arguments written by the capture (see VRD_Internal_WriteLogArgs).
+internal static class LogFormatter
+{
+    private static readonly System.Globalization.CultureInfo Invariant = System.Globalization.CultureInfo.InvariantCulture;
+
+    public static string Format(string format, byte[] args)
+    {
+        var sb = new System.Text.StringBuilder(format.Length + args.Length);
+        using var r = new BinaryReaderEx(new MemoryStream(args), BinaryReplayWriter.StringEncoding);
+        int i = 0;
+        try
+        {
+            while (i < format.Length)
+            {
+                char ch = format[i];
+                if (ch != '%' || i + 1 == format.Length || format[i + 1] == '%')
+                {
+                    sb.Append(ch);
+                    i += (ch == '%' && i + 1 < format.Length) ? 2 : 1; // %%
+                    continue;
+                }
+
+                int conversion = i++;
+                bool left = false, plus = false, space = false, alternate = false, zero = false;
+                for (; i < format.Length; ++i)
+                {
+                    if (format[i] == '-') left = true;
+                    else if (format[i] == '+') plus = true;
+                    else if (format[i] == ' ') space = true;
+                    else if (format[i] == '#') alternate = true;
+                    else if (format[i] == '0') zero = true;
+                    else break;
+                }
+                int width = 0, precision = -1;
+                if (i < format.Length && format[i] == '*')
+                {
+                    width = r.ReadZigZag();
+                    if (width < 0) { left = true; width = -width; }
+                    ++i;
+                }
+                else while (i < format.Length && char.IsAsciiDigit(format[i])) width = width * 10 + (format[i++] - '0');
+                if (i < format.Length && format[i] == '.')
+                {
+                    ++i;
+                    precision = 0;
+                    if (i < format.Length && format[i] == '*') { precision = Math.Max(-1, r.ReadZigZag()); ++i; }
+                    else while (i < format.Length && char.IsAsciiDigit(format[i])) precision = precision * 10 + (format[i++] - '0');
+                }
+                while (i < format.Length && "hlLzjt".IndexOf(format[i]) >= 0) ++i;
+                if (i == format.Length) break;
+
+                char type = format[i++];
+                string sign = string.Empty, prefix = string.Empty, body;
+                bool numeric = true;
+                switch (type)
+                {
+                    case 'd':
+                    case 'i':
+                        {
+                            ulong bits = ReadUnsigned(r);
+                            long value = (long)(bits >> 1) ^ -(long)(bits & 1);
+                            sign = (value < 0) ? "-" : plus ? "+" : space ? " " : string.Empty;
+                            body = FormatInteger((value < 0) ? (ulong)(-(value + 1)) + 1 : (ulong)value, precision, v => v.ToString(Invariant));
+                            break;
+                        }
+                    case 'u':
+                        body = FormatInteger(ReadUnsigned(r), precision, v => v.ToString(Invariant));
+                        break;
+                    case 'o':
+                        body = FormatInteger(ReadUnsigned(r), precision, v => Convert.ToString((long)v, 8));
+                        if (alternate && !body.StartsWith('0')) body = "0" + body;
+                        break;
+                    case 'x':
+                    case 'X':
+                        {
+                            ulong value = ReadUnsigned(r);
+                            body = FormatInteger(value, precision, v => v.ToString(type == 'x' ? "x" : "X", Invariant));
+                            if (alternate && value != 0) prefix = (type == 'x') ? "0x" : "0X";
+                            break;
+                        }
+                    case 'p':
+                        prefix = "0x";
+                        body = ReadUnsigned(r).ToString("x", Invariant);
+                        break;
+                    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                        {
+                            double value = r.ReadDouble();
+                            sign = (value < 0 || (value == 0 && double.IsNegative(value))) ? "-" : plus ? "+" : space ? " " : string.Empty;
+                            body = FormatFloat(Math.Abs(value), type, precision, alternate);
+                            if (!double.IsFinite(value)) zero = false;
+                            break;
+                        }
+                    case 'c':
+                        numeric = false;
+                        body = ((char)ReadUnsigned(r)).ToString();
+                        break;
+                    case 's':
+                        numeric = false;
+                        body = r.ReadString();
+                        if (precision >= 0 && precision < body.Length) body = body.Substring(0, precision);
+                        break;
+                    case 'n':
+                        continue;
+                    default:
+                        // Unknown conversion, the capture stopped writing arguments there: the rest is written as is
+                        sb.Append(format, conversion, format.Length - conversion);
+                        return sb.ToString();
+                }
+
+                int padding = width - sign.Length - prefix.Length - body.Length;
+                bool integer = type != 'f' && type != 'F' && type != 'e' && type != 'E' && type != 'g' && type != 'G' && type != 'a' && type != 'A';
+                if (padding > 0 && !left && !(numeric && zero && !(integer && precision >= 0))) sb.Append(' ', padding);
+                sb.Append(sign).Append(prefix);
+                if (padding > 0 && !left && numeric && zero && !(integer && precision >= 0)) sb.Append('0', padding);
+                sb.Append(body);
+                if (padding > 0 && left) sb.Append(' ', padding);
+            }
+        }
+        catch (EndOfStreamException)
+        {
+            // Truncated arguments, keep what was formatted
+        }
+        return sb.ToString();
+    }
+
+    private static ulong ReadUnsigned(BinaryReaderEx r) => (ulong)r.Read7BitEncodedInt64();
+
+    // Precision is the minimum number of digits, none at all for a 0 of precision 0
+    private static string FormatInteger(ulong value, int precision, Func<ulong, string> digits)
+    {
+        if (precision == 0 && value == 0) return string.Empty;
+        string s = digits(value);
+        return (precision > s.Length) ? s.PadLeft(precision, '0') : s;
+    }
+
+    private static string FormatFloat(double value, char type, int precision, bool alternate)
+    {
+        bool upper = char.IsUpper(type);
+        if (double.IsNaN(value)) return upper ? "NAN" : "nan";
+        if (double.IsInfinity(value)) return upper ? "INF" : "inf";
+        if (precision < 0) precision = 6;
+        string s;
+        switch (char.ToLowerInvariant(type))
+        {
+            case 'f':
+                s = value.ToString("F" + precision, Invariant);
+                if (alternate && precision == 0) s += ".";
+                return s;
+            case 'g':
+                {
+                    int p = Math.Max(precision, 1);
+                    string rounded = value.ToString("E" + (p - 1), Invariant);
+                    int exponent = int.Parse(rounded.Substring(rounded.IndexOf('E') + 1), Invariant);
+                    s = (exponent < p && exponent >= -4) ? value.ToString("F" + (p - 1 - exponent), Invariant) : FormatExponent(value, p - 1, alternate);
+                    if (!alternate && s.Contains('.'))
+                    {
+                        int e = s.IndexOf('e');
+                        string mantissa = (e < 0) ? s : s.Substring(0, e);
+                        mantissa = mantissa.TrimEnd('0').TrimEnd('.');
+                        s = (e < 0) ? mantissa : mantissa + s.Substring(e);
+                    }
+                    break;
+                }
+            default: // e, and a approximated by e
+                s = FormatExponent(value, precision, alternate);
+                break;
+        }
+        return upper ? s.ToUpperInvariant() : s;
+    }
+
+    // C exponents have at least two digits
+    private static string FormatExponent(double value, int precision, bool alternate)
+    {
+        string s = value.ToString("E" + precision, Invariant);
+        int e = s.IndexOf('E');
+        string mantissa = s.Substring(0, e);
+        if (alternate && precision == 0) mantissa += ".";
+        int exponent = int.Parse(s.Substring(e + 1), Invariant);
+        return mantissa + (exponent < 0 ? "e-" : "e+") + Math.Abs(exponent).ToString("00", Invariant);
+    }
+}
+
+// Samples of an EntityValueSeries block: delta of delta frames and XOR compressed values (see VRD_Internal_EncodeValueSeries).
+internal static class ValueSeriesDecoder
+{
+    // Bits are packed from the least significant bit of each byte, reads past the end are zeros
+    private struct BitReader
+    {
+        private readonly byte[] data;
+        private int position;
+        private ulong bits;
+        private int count;
+
+        public BitReader(byte[] data) { this.data = data; position = 0; bits = 0; count = 0; }
+
+        public uint Read(int n)
+        {
+            while (count < n)
+            {
+                if (position < data.Length) bits |= (ulong)data[position++] << count;
+                count += 8;
+            }
+            uint value = (uint)(bits & ((1UL << n) - 1));
+            bits >>= n;
+            count -= n;
+            return value;
+        }
+    }
+
+    public static (int[] frames, float[] values) Decode(byte[] data, int count, int firstFrame)
+    {
+        var frames = new int[count];
+        var values = new float[count];
+        if (count == 0) return (frames, values);
+        var r = new BitReader(data);
+        uint previous = r.Read(32);
+        frames[0] = firstFrame;
+        values[0] = BitConverter.UInt32BitsToSingle(previous);
+        int delta = 1;
+        int leading = 0, trailing = 0;
+        for (int i = 1; i < count; ++i)
+        {
+            if (r.Read(1) != 0)
+            {
+                if (r.Read(1) == 0) delta += (int)r.Read(7) - 63;
+                else if (r.Read(1) == 0) delta += (int)r.Read(9) - 255;
+                else if (r.Read(1) == 0) delta += (int)r.Read(12) - 2047;
+                else delta += (int)r.Read(32);
+            }
+            frames[i] = frames[i - 1] + delta;
+
+            if (r.Read(1) != 0)
+            {
+                if (r.Read(1) != 0)
+                {
+                    leading = (int)r.Read(5);
+                    trailing = Math.Max(0, 32 - leading - ((int)r.Read(5) + 1));
+                }
+                previous ^= r.Read(32 - leading - trailing) << trailing;
+            }
+            values[i] = BitConverter.UInt32BitsToSingle(previous);
+        }
+        return (frames, values);
+    }
+}
+
+// Block stream of a chunked replay: chunks are decoded one at a time, starting from the one holding the first frame of the range.
+public class ChunkedReplayStream : Stream
+{
+    public const int Magic = 0x43445256; // "VRDC"
+    public const int IndexMagic = 0x49445256; // "VRDI"
+    public const int SummaryMagic = 0x46445256; // "VRDF"
+    public const int Version = 3;
+    private const int DeflateFlag = 1 << 0; // Version 1 flags, before the codec header
+    internal const int ChunkHeaderSize = 16;
+
+    private readonly Stream file;
+    private readonly BinaryReader fileReader;
+    private readonly ReplayCodec codec;
+    private readonly byte[] dictionary = Array.Empty<byte>();
+    private readonly long chunksEnd;
+    private readonly int lastFrame;
+    private MemoryStream chunk = new();
+
+    // Summary footer, between the chunks and the index (-1 without)
+    public long SummaryOffset { get; private set; } = -1;
+    public long SummarySize { get; private set; }
+
+    // The file is positioned after the magic
+    public ChunkedReplayStream(Stream file, ReplayCaptureReader.FrameRange? frames)
+    {
+        this.file = file;
+        fileReader = new BinaryReader(file);
+        int version = fileReader.ReadInt32();
+        if (version > Version) throw new InvalidOperationException($"Unsupported chunked replay version ({version}), the replay was written by a newer version.");
+        if (version < 2) codec = (fileReader.ReadInt32() & DeflateFlag) != 0 ? ReplayCodec.Deflate : ReplayCodec.None;
+        else (codec, dictionary) = ReplayCodecs.ReadHeader(fileReader);
+        long chunksStart = file.Position;
+        lastFrame = frames?.End ?? int.MaxValue;
+
+        // Footer index, missing if the capture did not end cleanly
+        chunksEnd = file.Length;
+        List<(int firstFrame, int frameCount, long offset)>? index = null;
+        if (file.Length >= chunksStart + 16)
+        {
+            file.Seek(-16, SeekOrigin.End);
+            long indexOffset = fileReader.ReadInt64();
+            int count = fileReader.ReadInt32();
+            if (fileReader.ReadInt32() == IndexMagic && indexOffset >= chunksStart && indexOffset + count * 16L + 16 == file.Length)
+            {
+                chunksEnd = indexOffset;
+                file.Seek(indexOffset, SeekOrigin.Begin);
+                index = new(count);
+                for (int i = 0; i < count; ++i) index.Add((fileReader.ReadInt32(), fileReader.ReadInt32(), fileReader.ReadInt64()));
+
+                if (version >= 3 && indexOffset - chunksStart >= 12)
+                {
+                    file.Seek(indexOffset - 12, SeekOrigin.Begin);
+                    long summaryOffset = fileReader.ReadInt64();
+                    if (fileReader.ReadInt32() == SummaryMagic && summaryOffset >= chunksStart && summaryOffset <= indexOffset - 12)
+                    {
+                        SummaryOffset = summaryOffset;
+                        SummarySize = indexOffset - 12 - summaryOffset;
+                        chunksEnd = summaryOffset;
+                    }
+                }
+            }
+        }
+        file.Seek(chunksStart, SeekOrigin.Begin);
+
+        if (frames is ReplayCaptureReader.FrameRange range)
+        {
+            if (index != null)
+            {
+                int first = index.FindIndex(x => x.firstFrame + x.frameCount > range.Start);
+                if (first > 0) file.Seek(index[first].offset, SeekOrigin.Begin);
+            }
+            else
+            {
+                // Skip chunks ending before the range by their headers, without decoding them
+                while (file.Position + ChunkHeaderSize <= chunksEnd)
+                {
+                    long chunkStart = file.Position;
+                    int firstFrame = fileReader.ReadInt32();
+                    int frameCount = fileReader.ReadInt32();
+                    fileReader.ReadInt32();
+                    int storedSize = fileReader.ReadInt32();
+                    if (firstFrame + frameCount > range.Start)
+                    {
+                        file.Seek(chunkStart, SeekOrigin.Begin);
+                        break;
+                    }
+                    file.Seek(storedSize, SeekOrigin.Current);
+                }
+            }
+        }
+    }
+
+    private bool NextChunk()
+    {
+        if (file.Position + ChunkHeaderSize > chunksEnd) return false;
+        int firstFrame = fileReader.ReadInt32();
+        fileReader.ReadInt32(); // frame count
+        int rawSize = fileReader.ReadInt32();
+        int storedSize = fileReader.ReadInt32();
+        if (firstFrame > lastFrame || rawSize < 0 || storedSize < 0 || file.Position + storedSize > chunksEnd) return false;
+
+        byte[]? raw = ReplayCodecs.DecodeChunk(codec, fileReader.ReadBytes(storedSize), rawSize, dictionary);
+        if (raw == null) return false;
+        chunk = new MemoryStream(raw, false);
+        return true;
+    }
+
+    public override int Read(byte[] buffer, int offset, int count)
+    {
+        int read = chunk.Read(buffer, offset, count);
+        while (read == 0 && count > 0 && NextChunk())
+        {
+            read = chunk.Read(buffer, offset, count);
+        }
+        return read;
+    }
+
+    public override bool CanRead => true;
+    public override bool CanSeek => false;
+    public override bool CanWrite => false;
+    public override long Length => throw new NotSupportedException();
+    public override long Position { get => throw new NotSupportedException(); set => throw new NotSupportedException(); }
+    public override void Flush() { }
+    public override long Seek(long offset, SeekOrigin origin) => throw new NotSupportedException();
+    public override void SetLength(long value) => throw new NotSupportedException();
+    public override void Write(byte[] buffer, int offset, int count) => throw new NotSupportedException();
+
+    protected override void Dispose(bool disposing)
+    {
+        if (disposing) file.Dispose();
+        base.Dispose(disposing);
+    }
+}
+
 // 7BitEncodedInt marked protected in prior versions of .net
 public class BinaryReaderEx : BinaryReader
 {
     public BinaryReaderEx(Stream input, System.Text.Encoding encoding) : base(input, encoding) { }
     public new int Read7BitEncodedInt() => base.Read7BitEncodedInt();
+
+    public int ReadZigZag()
+    {
+        uint v = (uint)Read7BitEncodedInt();
+        return (int)(v >> 1) ^ -(int)(v & 1);
+    }
+
+    // Set when the replay interns its labels, index 0 is reserved for inline strings.
+    public List<string> StringTable;
+
+    public void DefineString(int id, string s)
+    {
+        while (StringTable.Count <= id) { StringTable.Add(string.Empty); }
+        StringTable[id] = s;
+    }
+
+    // Labels are shared string instances when interned
+    public string ReadLabel()
+    {
+        if (StringTable == null) return ReadString();
+        int id = Read7BitEncodedInt();
+        return (id == 0) ? ReadString() : StringTable[id];
+    }
 }
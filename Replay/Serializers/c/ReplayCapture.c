@@ -1,8 +1,16 @@
 // SPDX-License-Identifier: MIT
 #include "ReplayCapture.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
 
 #ifndef VRD_ZLIB_COMPRESSION_LEVEL
 #define VRD_ZLIB_COMPRESSION_LEVEL 1
@@ -12,8 +20,104 @@
 #define VRD_ZLIB_COMPRESSION_BUFFER_SIZE (128<<10)
 #endif
 
+#ifndef VRD_LZ4_COMPRESSION_LEVEL
+#define VRD_LZ4_COMPRESSION_LEVEL 0
+#endif
+
+#ifndef VRD_ZSTD_COMPRESSION_LEVEL
+#define VRD_ZSTD_COMPRESSION_LEVEL 3
+#endif
+
+// Blocks are encoded in a per-context staging buffer, and only handed to the compressor/file on flush.
+#ifndef VRD_STAGING_BUFFER_INITIAL_SIZE
+#define VRD_STAGING_BUFFER_INITIAL_SIZE (64<<10)
+#endif
+
+// Default flush policy: staged bytes threshold (0 to only flush on frame steps), and frames between flushes.
+#ifndef VRD_STAGING_FLUSH_THRESHOLD
+#define VRD_STAGING_FLUSH_THRESHOLD (256<<10)
+#endif
+
+#ifndef VRD_STAGING_FLUSH_FRAME_INTERVAL
+#define VRD_STAGING_FLUSH_FRAME_INTERVAL 1
+#endif
+
+// Chunked files keep a copy of every live entity def, which starts this small and grows with its static params.
+#ifndef VRD_ENTITY_DEF_INITIAL_SIZE
+#define VRD_ENTITY_DEF_INITIAL_SIZE 256
+#endif
+
+// Lanes of threads that never called VRD_SetThreadLane start here, after all explicit lanes.
+#ifndef VRD_AUTO_THREAD_LANE_BASE
+#define VRD_AUTO_THREAD_LANE_BASE (1<<24)
+#endif
+#define VRD_AUTO_THREAD_LANE (-1)
+#define VRD_CONTEXT_THREAD_LANE (-2) // The thread that created the context is spliced first
+
+// Interned label strings. Past the limit, new labels are written inline.
+#ifndef VRD_STRING_TABLE_MAX_COUNT
+#define VRD_STRING_TABLE_MAX_COUNT (64<<10)
+#endif
+
+// Direct-mapped cache of label pointers, so that string literals skip hashing.
+#ifndef VRD_STRING_POINTER_CACHE_SIZE
+#define VRD_STRING_POINTER_CACHE_SIZE 256
+#endif
+
+#ifndef VRD_DEFAULT_POSITION_QUANTUM
+#define VRD_DEFAULT_POSITION_QUANTUM (1.0f/1024)
+#endif
+
+#ifndef VRD_DEFAULT_TRANSFORM_KEYFRAME_INTERVAL
+#define VRD_DEFAULT_TRANSFORM_KEYFRAME_INTERVAL 300
+#endif
+
+#ifndef VRD_ASYNC_DEFAULT_QUEUE_LENGTH
+#define VRD_ASYNC_DEFAULT_QUEUE_LENGTH 8
+#endif
+
+// Category filters of a context, including the default one.
+#ifndef VRD_CATEGORY_FILTER_MAX_COUNT
+#define VRD_CATEGORY_FILTER_MAX_COUNT 64
+#endif
+
+// Live streams: bytes queued for the consumer by default, and frames per chunk unless chunkFrames is set.
+#ifndef VRD_STREAM_DEFAULT_BUFFER_SIZE
+#define VRD_STREAM_DEFAULT_BUFFER_SIZE (4<<20)
+#endif
+
+#ifndef VRD_STREAM_DEFAULT_CHUNK_FRAMES
+#define VRD_STREAM_DEFAULT_CHUNK_FRAMES 1
+#endif
+
+// Spilled chunks are read back and sent in pieces of this size.
+#ifndef VRD_STREAM_SPILL_READ_SIZE
+#define VRD_STREAM_SPILL_READ_SIZE (64<<10)
+#endif
+
+// Flight recorder: entity defs are kept in fixed slots, chained per def. Without ringDefBytes, the slots take this share of ringBufferBytes, and at least the minimum.
+#ifndef VRD_RING_DEF_SHARE
+#define VRD_RING_DEF_SHARE 8
+#endif
+
+#ifndef VRD_RING_DEF_MIN_BYTES
+#define VRD_RING_DEF_MIN_BYTES (16<<10)
+#endif
+
+#ifndef VRD_RING_DEF_SLOT_SIZE
+#define VRD_RING_DEF_SLOT_SIZE 64
+#endif
+
+// Chunk size when a compression pool is requested without one.
+#ifndef VRD_DEFAULT_CHUNK_FRAMES
+#define VRD_DEFAULT_CHUNK_FRAMES 60
+#endif
+
 #ifdef VRD_USE_ZLIB
-#include "ThirdParty/zlib/zlib-1.2.5/Inc/zlib.h"
+#ifndef VRD_ZLIB_HEADER
+#define VRD_ZLIB_HEADER "ThirdParty/zlib/zlib-1.2.5/Inc/zlib.h"
+#endif
+#include VRD_ZLIB_HEADER
 #if defined(MSDOS) || defined(OS2) || defined(WIN32) || defined(__CYGWIN__)
 #  include <fcntl.h>
 #  include <io.h>
@@ -23,490 +127,4784 @@
 #endif
 #endif //VRD_USE_ZLIB
 
-struct VRD_EntityMapItem { entityKeyType address; };
+#ifdef VRD_USE_LZ4
+#ifndef VRD_LZ4_HEADER
+#define VRD_LZ4_HEADER <lz4frame.h>
+#endif
+#include VRD_LZ4_HEADER
+#endif //VRD_USE_LZ4
+
+#ifdef VRD_USE_ZSTD
+#ifndef VRD_ZSTD_HEADER
+#define VRD_ZSTD_HEADER <zstd.h>
+#endif
+#include VRD_ZSTD_HEADER
+#endif //VRD_USE_ZSTD
+
+#ifdef VRD_USE_SOCKETS
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+typedef SOCKET VRD_Socket;
+#define VRD_INVALID_SOCKET INVALID_SOCKET
+#define VRD_CloseSocket closesocket
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+typedef int VRD_Socket;
+#define VRD_INVALID_SOCKET (-1)
+#define VRD_CloseSocket close
+#endif
+#ifdef MSG_NOSIGNAL
+#define VRD_SEND_FLAGS MSG_NOSIGNAL // A closed viewer is a send error, not a SIGPIPE
+#else
+#define VRD_SEND_FLAGS 0
+#endif
+#endif //VRD_USE_SOCKETS
+
+// fopen_s is only in the MSVC runtime
+static inline int VRD_Internal_OpenFile(FILE** fp, const char* filename, const char* mode)
+{
+#ifdef _MSC_VER
+	return fopen_s(fp, filename, mode);
+#else
+	*fp = fopen(filename, mode);
+	return *fp ? 0 : 1;
+#endif
+}
+
+// fseek takes a long, 32 bits on Windows, and spill files can grow past 2 GB
+static inline int VRD_Internal_SeekFile(FILE* fp, long long offset)
+{
+#ifdef _WIN32
+	return _fseeki64(fp, offset, SEEK_SET);
+#else
+	return fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+}
+
+struct VRD_EntityMapItem { entityKeyType address; int id; }; // id 0 marks an empty slot
+
+struct VRD_EntityIdList
+{
+	int* ids;
+	int count;
+	int capacity;
+};
+
+struct VRD_StagingBuffer
+{
+	unsigned char* data;
+	int size;
+	int capacity;
+	int failed;
+};
+
+struct VRD_AsyncSlot
+{
+	VRD_StagingBuffer buffer;
+	int first_frame; // Chunk range, for chunked files
+	int frame_count;
+
+	// Compression pool: the compressed chunk, waiting for the chunks before it to be written
+	VRD_StagingBuffer compressed;
+	const unsigned char* stored; // 0 if compression failed
+	int stored_size;
+	std::atomic<bool> ready;
+};
+
+// One compressor of the context codec: the stream of a single stream file, or the chunks of a chunked file.
+struct VRD_Encoder
+{
+	enum VRD_Codec codec;
+	int level;
+	int started; // LZ4 frame header written
+#ifdef VRD_USE_ZLIB
+	z_stream z_strm;
+#endif
+#ifdef VRD_USE_LZ4
+	LZ4F_cctx* lz4;
+	LZ4F_preferences_t lz4_prefs;
+#endif
+#ifdef VRD_USE_ZSTD
+	ZSTD_CCtx* zstd;
+#endif
+	VRD_StagingBuffer out; // Compressed bytes. A pool worker swaps it with the slot compressed buffer
+};
+
+struct VRD_CompressWorker
+{
+	std::thread thread;
+	VRD_Encoder encoder;
+};
+
+// Single producer (capture thread) / single consumer (writer thread) ring of staging buffers.
+// Buffers are swapped in and out of the ring, so nothing is copied or allocated in steady state.
+struct VRD_AsyncWriter
+{
+	VRD_AsyncSlot* slots;
+	unsigned int slot_count;
+	std::atomic<unsigned int> head; // next slot filled by the producer
+	std::atomic<unsigned int> tail; // next slot drained by the writer thread
+	std::atomic<bool> stop;
+	std::mutex wake_mutex;
+	std::condition_variable wake_writer;
+	std::condition_variable wake_producer;
+	std::thread thread;
+
+	// Chunk compression pool, replaces the writer thread. Workers claim slots in order, and whoever completes the oldest chunk writes it out.
+	VRD_CompressWorker* workers;
+	int worker_count;
+	std::atomic<unsigned int> claim; // next slot compressed by a worker
+	std::mutex write_mutex;
+};
+
+struct VRD_StringTableItem
+{
+	unsigned int hash;
+	int id;
+	int len;
+	char* str;
+};
+
+struct VRD_StringTable
+{
+	VRD_StringTableItem* items; // open addressing, id 0 marks an empty slot
+	int capacity;
+	int count;
+	VRD_StagingBuffer defs; // StringDef and MeshDef blocks not flushed yet, always written before the staged blocks
+};
+
+// Vertex data written once in a MeshDef block, then referenced by id. Keyed by a hash of the verts, or by the caller's mesh key.
+struct VRD_MeshCacheItem
+{
+	unsigned long long key;
+	int handle; // key is a caller mesh key, verts are not compared
+	int id; // 0 marks an empty slot
+	int vert_count;
+	VRD_Point* verts;
+	int referenced; // Drawn since the clock hand last passed
+};
+
+struct VRD_MeshCache
+{
+	VRD_MeshCacheItem* items; // open addressing
+	int capacity;
+	int count;
+	long long bytes; // Vertex data kept
+	long long budget; // 0 when meshes are not cached
+	int next_id; // Ids are never reused, so a def flushed later than an eviction still matches its references
+	int hand; // Next slot the eviction clock looks at
+};
+
+struct VRD_StringCacheItem
+{
+	const char* ptr;
+	const char* str; // interned copy, to validate the pointer still holds the same string
+	int id;
+};
+
+struct VRD_StringCache
+{
+	VRD_StringCacheItem items[VRD_STRING_POINTER_CACHE_SIZE];
+};
+
+struct VRD_EntityParam
+{
+	char* key;
+	char* str; // 0 for float values
+	float value;
+};
+
+// Flight recorder: an EntityDef block, in a chain of ring def slots.
+struct VRD_RingDef
+{
+	int first_slot;
+	int size; // 0 for none
+};
+
+// Per live entity: last written transform, quantized, for delta encoding, and what chunk keyframes need to restore it.
+struct VRD_EntityState
+{
+	int id; // 0 marks an empty slot
+	int full_frame;
+	int qpos[3];
+	unsigned short qrot[3];
+	unsigned char qrot_index;
+	unsigned char has_rotation;
+
+	VRD_StagingBuffer def; // EntityDef block, labels inline
+	VRD_RingDef ring_def; // Same, in the ring def slots of flight recorder contexts
+	int def_frame;
+	VRD_Transform xform;
+	int has_xform;
+	VRD_EntityParam* params;
+	int param_count;
+	int param_capacity;
+	int summary_entity; // Index + 1 in the summary entity table, 0 for none
+};
+
+struct VRD_EntityStates
+{
+	VRD_EntityState* items; // open addressing, keyed by entity id
+	int capacity;
+	int count;
+};
+
+// Samples of a dynamic float param, since its last series block.
+struct VRD_ValueSeries
+{
+	char* key;
+	int key_id; // Label of the last sample, string ids only change between chunks, which end the series
+	int count;
+	int capacity;
+	int* frames;
+	float* values;
+};
+
+// Series of an entity, written every valueSeriesFrames frames, and before the entity is defined again or undefined.
+struct VRD_EntitySeries
+{
+	int id; // 0 marks an empty slot
+	int active; // Had samples since the series were last written, entities without are dropped then
+	VRD_ValueSeries* series;
+	int series_count;
+	int series_capacity;
+	int cursor; // Keys mostly come in the same order every frame, the search starts after the previous one
+};
+
+struct VRD_ValueSeriesTable
+{
+	VRD_EntitySeries* items; // open addressing, keyed by entity id
+	VRD_EntitySeries* spare; // Same capacity, the table is rebuilt in it at the end of every series window
+	int capacity;
+	int count;
+	int frames; // 0 when values are written when set
+	int first_frame;
+};
+
+// Flight recorder: a def that was replaced (unregistered or registered again), kept while the ring may still hold blocks of that entity.
+struct VRD_RetiredEntityDef
+{
+	int def_frame;
+	int undef_frame;
+	VRD_RingDef def;
+};
+
+// Header of each frame record in the ring, followed by the blocks of the frame (ending with its frame step).
+struct VRD_RingFrame
+{
+	int size;
+	int frame;
+	float start_time; // time of the previous frame step
+};
+
+// Flight recorder: whole frames in a fixed byte ring, oldest evicted first. Records wrap around the end of the ring.
+struct VRD_FrameRing
+{
+	unsigned char* data;
+	int capacity;
+	int begin; // oldest record
+	int used;
+	int frame_count;
+	int first_frame; // of the oldest record
+	float first_frame_time;
+	// Defs of the entities the ring may hold blocks of, allocated with the ring. Each retired def holds a slot, so retired has room for them all.
+	unsigned char* def_slots;
+	int* def_next; // Next slot of each def, or of the free list, -1 at the end
+	int def_slot_count;
+	int def_free; // First free slot
+	int def_free_count;
+	VRD_RetiredEntityDef* retired;
+	int retired_count;
+	VRD_StagingBuffer scratch; // Dump prologue, and defs while encoded
+};
+
+struct VRD_CategoryCounter
+{
+	unsigned int hash;
+	int len;
+	char* name; // 0 marks an empty slot
+	long long calls;
+	long long bytes;
+	int kinds; // VRD_SummaryKind bits of the blocks counted
+};
+
+// Category blocks, as the summary footer sets them apart.
+enum VRD_SummaryKind
+{
+	VRD_SummaryKind_Log,
+	VRD_SummaryKind_Draw,
+	VRD_SummaryKind_Count,
+};
+
+// Summary footer entity flags
+enum VRD_SummaryEntityFlags
+{
+	VRD_SummaryEntity_Registered = 1 << 0, // Followed by its name, path, type and category
+};
+
+// Logs of an entity in a frame, matched with the summary entities when the footer is written.
+struct VRD_LogMarker
+{
+	int entity_id;
+	int frame;
+};
+
+// Blocks encoded per type and per draw/log category. Per context, and per thread lane for multithreaded contexts, only touched by the thread that stages the blocks.
+struct VRD_CaptureCounters
+{
+	long long calls[VRD_STATS_BLOCK_TYPE_COUNT];
+	long long bytes[VRD_STATS_BLOCK_TYPE_COUNT];
+	VRD_CategoryCounter* categories; // open addressing
+	int category_capacity;
+	int category_count;
+	const char* last_ptr; // Last category looked up, repeated labels skip hashing
+	VRD_CategoryCounter* last_category;
+
+	// Block being encoded, between VRD_Internal_BeginBlock and VRD_Internal_EndBlock
+	int block_type;
+	int block_start;
+	VRD_CategoryCounter* block_category;
+	int block_color; // -1 for blocks without color
+
+	// For the summary footer
+	unsigned int colors[VRD_SummaryKind_Count][8]; // VRD_Color bit sets
+	int uncategorized; // VRD_SummaryKind bits of the blocks without category
+	VRD_LogMarker* log_markers; // Consecutive logs of an entity in a frame are kept once
+	int log_marker_count;
+	int log_marker_capacity;
+};
+
+// Read by all capture threads, only changed between frames.
+struct VRD_CategoryFilter
+{
+	unsigned int hash;
+	int len;
+	char* name; // 0 marks an empty slot
+	int enabled;
+	int max_per_frame;
+	int sample_every;
+	std::atomic<int> frame_calls;
+	std::atomic<unsigned int> sample_calls;
+};
+
+struct VRD_CategoryFilters
+{
+	VRD_CategoryFilter items[VRD_CATEGORY_FILTER_MAX_COUNT * 2]; // open addressing, never grown
+	int count;
+	VRD_CategoryFilter fallback; // Categories without a filter, and calls without category
+};
+
+// Live stream: a bounded byte ring between whoever writes chunks and the stream thread, which hands them to the socket or callback.
+// Chunks that do not fit are spilled to a file or dropped, so writing a chunk never waits on the consumer.
+struct VRD_Stream
+{
+#ifdef VRD_USE_SOCKETS
+	VRD_Socket socket;
+#endif
+	VRD_StreamCallback callback; // 0 for the socket
+	void* user_data;
+
+	unsigned char* data;
+	int capacity;
+	long long head; // Bytes queued, in total
+	long long tail; // Bytes sent, in total
+
+	// Spill policy: chunks queued while the ring was full, and all chunks after them until they are sent
+	char* spill_path;
+	FILE* spill;
+	FILE* spill_reader; // Owned by the stream thread
+	long long spill_written;
+	long long spill_read;
+	unsigned char* spill_buffer;
+
+	// Drop policy: frames dropped since the last chunk queued, reported by a gap marker before the next one
+	int gap_first_frame;
+	int gap_frame_count;
+
+	bool closed; // The consumer is gone, everything is discarded
+	bool stop;
+	std::mutex mutex; // Guards everything above
+	std::condition_variable wake;
+	std::thread thread;
+};
+
+// Updated by whichever thread compresses and writes, read by VRD_GetStats.
+struct VRD_WriteCounters
+{
+	std::atomic<long long> flushed_bytes;
+	std::atomic<long long> stored_bytes;
+	std::atomic<long long> compress_ns;
+	std::atomic<long long> io_ns;
+};
+
+struct VRD_ChunkIndexEntry
+{
+	int first_frame;
+	int frame_count;
+	long long offset;
+};
+
+struct VRD_ChunkIndex
+{
+	VRD_ChunkIndexEntry* entries;
+	int count;
+	int capacity;
+	int failed;
+};
+
+// Entity def of the summary footer.
+struct VRD_SummaryEntity
+{
+	int id;
+	int def_frame;
+	int undef_frame; // -1 while registered
+	int strings;     // Name, path, type and category in VRD_Summary::strings, -1 for entities that were logged to but never registered
+	int strings_size;
+};
+
+// Aggregates of the summary footer, kept as the capture goes. The entity table is guarded by the thread lanes lock, if any.
+struct VRD_Summary
+{
+	VRD_SummaryEntity* entities; // In def order
+	int entity_count;
+	int entity_capacity;
+	VRD_StagingBuffer strings;
+	float* frame_times; // totalTime of each frame step
+	int frame_count;
+	int frame_capacity;
+	std::atomic<int> failed; // Out of memory, the footer is not written
+};
+
+// Per-thread staging, for multithreaded contexts.
+struct VRD_ThreadLane
+{
+	int lane;
+	VRD_StagingBuffer staging;
+	VRD_StringCache string_cache;
+	VRD_CaptureCounters counters;
+	VRD_ThreadLane* next; // sorted by lane
+};
+
+struct VRD_ThreadLanes
+{
+	std::mutex mutex; // guards the lane list, and the entity map
+	VRD_ThreadLane* first;
+	int next_auto_lane;
+};
+
+// Capture threads cache their lane, keyed by the context serial so that a stale lane of a released context is never used.
+struct VRD_ThreadLaneCache
+{
+	unsigned int context_serial;
+	VRD_ThreadLane* lane;
+};
+static thread_local VRD_ThreadLaneCache VRD_TlsLane = { 0, 0 };
+static std::atomic<unsigned int> VRD_ContextSerial(0);
 
 struct VRD_replay_context
 {
 	int status;
 	FILE* fp;
 	int frame;
-	VRD_EntityMapItem* entity_map;
+	VRD_EntityMapItem* entity_map; // open addressing, keyed by address
 	int entity_map_capacity;
 	int entity_map_count;
+	int entity_map_next_id;
+	VRD_EntityIdList free_entity_ids;
+	VRD_EntityIdList released_entity_ids; // freed at the next frame step, once their undef blocks are spliced
 
-#ifdef VRD_USE_ZLIB
-	z_stream z_strm;
-	void* z_compression_buffer;
-#endif
+	VRD_StagingBuffer staging;
+	int flush_threshold;
+	int flush_frame_interval;
+	int frames_since_flush;
+	float last_frame_time;
+
+	VRD_AsyncWriter* async_writer; // When set, encoder and fp are owned by the writer thread
+	enum VRD_BackpressurePolicy backpressure;
+	int keep_dropped; // Dropped frames keep their def, undef and frame step blocks
+	VRD_StagingBuffer kept; // Copies of those staged since the last flush, guarded by the thread lanes lock, if any
+
+	unsigned int serial;
+	VRD_ThreadLanes* thread_lanes; // Only for multithreaded contexts
+
+	int intern_strings;
+	VRD_StringTable strings;
+	VRD_StringCache string_cache;
+	VRD_MeshCache meshes;
+
+	int delta_transforms;
+	float position_quantum;
+	float inv_position_quantum;
+	int transform_keyframe_interval;
+	VRD_EntityStates entity_states; // Only for delta transforms and chunked files
+	VRD_ValueSeriesTable value_series;
+
+	int chunk_frames; // 0 for a single stream
+	int chunk_first_frame;
+	long long file_offset; // Chunked files, owned by the writer thread when async
+	VRD_ChunkIndex chunk_index;
+
+	VRD_Encoder encoder;
+	VRD_StagingBuffer dictionary; // Zstd dictionary, for the pool workers encoders
 
+	VRD_FrameRing* ring; // Flight recorder contexts, fp is only set while dumping
+	VRD_Stream* stream; // Live stream contexts, written instead of fp
+
+	VRD_CaptureCounters counters;
+	VRD_WriteCounters* write_counters;
+	int stats_frame_interval;
+	VRD_CaptureStats last_stats; // Totals written in the last CaptureStats block
+
+	VRD_CategoryFilters* category_filters; // 0 until a filter is set, so unfiltered contexts skip the lookup
+	VRD_Summary* summary; // Only for the summary footer
 };
 
 int VRD_Internal_EntityMap(VRD_replay_context* ctx, entityKeyType entityAddr);
-void VRD_Internal_WriteReplayHeader(VRD_replay_context* ctx);
+int VRD_Internal_EntityMapLocked(VRD_replay_context* ctx, entityKeyType entityAddr);
+void VRD_Internal_ReleaseEntityId(VRD_replay_context* ctx, entityKeyType entityAddr);
+void VRD_Internal_RecycleEntityIds(VRD_replay_context* ctx);
+bool VRD_Internal_Flush(VRD_replay_context* ctx, bool drain);
+void VRD_Internal_StartAsyncWriter(VRD_replay_context* ctx, int queueLength, int compressionThreads);
+void VRD_Internal_StopAsyncWriter(VRD_replay_context* ctx);
+VRD_ThreadLane* VRD_Internal_GetThreadLane(VRD_replay_context* ctx, int lane);
+void VRD_Internal_SpliceThreadLanes(VRD_replay_context* ctx);
+void VRD_Internal_ReleaseThreadLanes(VRD_replay_context* ctx);
+void VRD_Internal_WriteReplayHeader(VRD_replay_context* ctx, VRD_StagingBuffer* buf);
+int VRD_Internal_FormatFlags(VRD_replay_context* ctx);
+void VRD_Internal_WriteReplayFormat(VRD_replay_context* ctx, VRD_StagingBuffer* buf);
+void VRD_Internal_WriteChunkedHeader(VRD_replay_context* ctx);
+void VRD_Internal_WriteStreamHeader(VRD_replay_context* ctx);
+void VRD_Internal_FinishStream(VRD_replay_context* ctx);
+void VRD_Internal_BeginChunk(VRD_replay_context* ctx);
+void VRD_Internal_WriteChunkIndex(VRD_replay_context* ctx);
+bool VRD_Internal_IsStreamAddress(const char* filename);
+VRD_Stream* VRD_Internal_CreateStream(const char* address, const VRD_ContextOptions* options);
+void VRD_Internal_ReleaseStream(VRD_Stream* stream);
+VRD_FrameRing* VRD_Internal_CreateRing(int capacity, int defBytes);
+void VRD_Internal_FreeRing(VRD_FrameRing* ring);
+void VRD_Internal_PushRingFrame(VRD_replay_context* ctx, int frame, float startTime);
+void VRD_Internal_RetireEntityDef(VRD_replay_context* ctx, int entityId, int frame);
+void VRD_Internal_ReleaseRing(VRD_replay_context* ctx);
+int VRD_Internal_DumpRing(VRD_replay_context* ctx);
+void VRD_Internal_ReleaseCounters(VRD_CaptureCounters* counters);
+void VRD_Internal_MergeLaneCounters(VRD_replay_context* ctx);
+void VRD_Internal_WriteCaptureStats(VRD_replay_context* ctx);
+VRD_CategoryFilter* VRD_Internal_AddCategoryFilter(VRD_CategoryFilters* filters, const char* category);
+bool VRD_Internal_AcceptCategory(VRD_CategoryFilters* filters, const char* category);
+void VRD_Internal_ResetCategoryFilters(VRD_CategoryFilters* filters);
+void VRD_Internal_ReleaseCategoryFilters(VRD_replay_context* ctx);
+int VRD_Internal_InternString(VRD_replay_context* ctx, const char* s);
+void VRD_Internal_ReleaseStringTable(VRD_replay_context* ctx);
+void VRD_Internal_RemoveEntityState(VRD_replay_context* ctx, int entityId);
+void VRD_Internal_ReleaseEntityStates(VRD_replay_context* ctx);
 void VRD_Internal_WriteEntityDef(VRD_replay_context* ctx, int entityId, int frame, const char* name, const char* path, const char* type_name, const char* category_name, VRD_Transform* xform, VRD_StringDictPair* staticParams, int staticParamsCount);
 void VRD_Internal_WriteEntityUndef(VRD_replay_context* ctx, int entityId, int frame);
 void VRD_Internal_WriteEntityPosition(VRD_replay_context* ctx, int entityId, int frame, VRD_Point* pos);
 void VRD_Internal_WriteEntityTransform(VRD_replay_context* ctx, int entityId, int frame, VRD_Transform* xform);
-void VRD_Internal_WriteEntityLog(VRD_replay_context* ctx, int entityId, int frame, const char* log, const char* category, enum VRD_Color color);
-void VRD_Internal_SetDynamicParamString(VRD_replay_context* ctx, int entityId, int frame, const char* key, const char* val);
+void VRD_Internal_WriteEntityLog(VRD_replay_context* ctx, int entityId, int frame, const char* log, int logLength, const char* category, enum VRD_Color color);
+void VRD_Internal_WriteEntityLogFormat(VRD_replay_context* ctx, int entityId, int frame, const char* category, enum VRD_Color color, const char* format, va_list args);
+void VRD_Internal_SetDynamicParamString(VRD_replay_context* ctx, int entityId, int frame, const char* key, const char* val, int valLength);
 void VRD_Internal_SetDynamicParamFloat(VRD_replay_context* ctx, int entityId, int frame, const char* key, float val);
+bool VRD_Internal_PushValueSample(VRD_replay_context* ctx, int entityId, int frame, const char* key, int keyId, float value);
+void VRD_Internal_WriteEntityValueSeries(VRD_replay_context* ctx, int entityId, int frame);
+void VRD_Internal_WriteValueSeries(VRD_replay_context* ctx);
+void VRD_Internal_ReleaseValueSeries(VRD_replay_context* ctx);
+int VRD_Internal_AddSummaryEntity(VRD_replay_context* ctx, int entityId, int frame, const char* name, const char* path, const char* type_name, const char* category_name);
+void VRD_Internal_PushFrameTime(VRD_replay_context* ctx, float totalTime);
+void VRD_Internal_PushLogMarker(VRD_replay_context* ctx, int entityId, int frame);
+void VRD_Internal_WriteSummary(VRD_replay_context* ctx);
+void VRD_Internal_ReleaseSummary(VRD_replay_context* ctx);
 void VRD_Internal_DrawSphere(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* pos, float radius, enum VRD_Color color);
 void VRD_Internal_DrawBox(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Transform* xform, VRD_Point* dimensions, enum VRD_Color color);
 void VRD_Internal_DrawCapsule(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* p1, VRD_Point* p2, float radius, enum VRD_Color color);
 void VRD_Internal_DrawMesh(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* verts, int vertCount, enum VRD_Color color);
+void VRD_Internal_DrawMeshRef(VRD_replay_context* ctx, int entityId, int frame, const char* category, unsigned long long meshKey, VRD_Point* verts, int vertCount, VRD_Transform* xform, enum VRD_Color color);
+void VRD_Internal_ReleaseMeshCache(VRD_replay_context* ctx);
 void VRD_Internal_DrawLine(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* p1, VRD_Point* p2, enum VRD_Color color);
 void VRD_Internal_DrawCircle(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* position, VRD_Point* up, float radius, enum VRD_Color color);
 void VRD_Internal_WriteFrameStep(VRD_replay_context* ctx, float totalTime);
+void VRD_Internal_WritePositionBatch(VRD_replay_context* ctx, int frame, const entityKeyType* entityIds, const VRD_Point* positions, int count);
+void VRD_Internal_WriteTransformBatch(VRD_replay_context* ctx, int frame, const entityKeyType* entityIds, const VRD_Transform* xforms, int count);
+void VRD_Internal_DrawLineBatch(VRD_replay_context* ctx, int frame, const entityKeyType* entityIds, const char* category, const VRD_Point* p1, const VRD_Point* p2, int count, enum VRD_Color color);
+void VRD_Internal_DrawSphereBatch(VRD_replay_context* ctx, int frame, const entityKeyType* entityIds, const char* category, const VRD_Point* centers, const float* radii, int count, enum VRD_Color color);
 
-VRD_replay_context* VRD_CreateContext(const char* filename, int compressed)
+// Rejected calls return before their entity is mapped, or anything is encoded.
+static inline bool VRD_Internal_FilterCategory(VRD_replay_context* ctx, const char* category)
 {
-	FILE* fp;
-	if (fopen_s(&fp, filename, "wb") != 0) return 0;
-
-	VRD_replay_context* ctx = (VRD_replay_context*)malloc(sizeof(VRD_replay_context));
-	if (ctx)
-	{
-		memset(ctx, 0, sizeof(VRD_replay_context));
-		ctx->status = 1;
-		ctx->fp = fp;
+	return ctx->category_filters == 0 || VRD_Internal_AcceptCategory(ctx->category_filters, category);
+}
 
+enum VRD_Codec VRD_Internal_SupportedCodec(int codec)
+{
 #ifdef VRD_USE_ZLIB
-		ctx->z_strm.zalloc = 0;
-		ctx->z_strm.zfree = 0;
-		ctx->z_strm.opaque = 0;
-		deflateInit2(&ctx->z_strm, VRD_ZLIB_COMPRESSION_LEVEL, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY); // -15 for raw stream, without zlib header
-		ctx->z_compression_buffer = malloc(VRD_ZLIB_COMPRESSION_BUFFER_SIZE);
+	if (codec == VRD_Codec_Deflate) return VRD_Codec_Deflate;
+#endif
+#ifdef VRD_USE_LZ4
+	if (codec == VRD_Codec_LZ4) return VRD_Codec_LZ4;
 #endif
+#ifdef VRD_USE_ZSTD
+	if (codec == VRD_Codec_Zstd) return VRD_Codec_Zstd;
+#endif
+	(void)codec; // Unused without codecs
+	return VRD_Codec_None;
+}
 
-		VRD_Internal_WriteReplayHeader(ctx);
+// Level 0 picks the codec default. Returns false if the codec could not be initialized.
+bool VRD_Internal_InitEncoder(VRD_Encoder* enc, enum VRD_Codec codec, int level, const void* dictionary, int dictionarySize)
+{
+	enc->codec = codec;
+	enc->level = 0;
+	switch (codec)
+	{
+#ifdef VRD_USE_ZLIB
+	case VRD_Codec_Deflate:
+		enc->level = level > 0 ? level : VRD_ZLIB_COMPRESSION_LEVEL;
+		enc->z_strm.zalloc = 0;
+		enc->z_strm.zfree = 0;
+		enc->z_strm.opaque = 0;
+		return deflateInit2(&enc->z_strm, enc->level, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) == Z_OK; // -15 for raw stream, without zlib header
+#endif
+#ifdef VRD_USE_LZ4
+	case VRD_Codec_LZ4:
+		enc->level = level > 0 ? level : VRD_LZ4_COMPRESSION_LEVEL;
+		memset(&enc->lz4_prefs, 0, sizeof(LZ4F_preferences_t));
+		enc->lz4_prefs.compressionLevel = enc->level;
+		return !LZ4F_isError(LZ4F_createCompressionContext(&enc->lz4, LZ4F_VERSION));
+#endif
+#ifdef VRD_USE_ZSTD
+	case VRD_Codec_Zstd:
+		enc->level = level > 0 ? level : VRD_ZSTD_COMPRESSION_LEVEL;
+		enc->zstd = ZSTD_createCCtx();
+		if (enc->zstd == 0) return false;
+		if (ZSTD_isError(ZSTD_CCtx_setParameter(enc->zstd, ZSTD_c_compressionLevel, enc->level))) return false;
+		return dictionarySize <= 0 || !ZSTD_isError(ZSTD_CCtx_loadDictionary(enc->zstd, dictionary, dictionarySize)); // Used by all frames
+#endif
+	default:
+		(void)level; // Only used by the codecs compiled in
+		(void)dictionary;
+		(void)dictionarySize;
+		return true;
 	}
-	return ctx;
 }
 
-void VRD_ReleaseContext(VRD_replay_context* ctx)
+void VRD_Internal_ReleaseEncoder(VRD_Encoder* enc)
 {
-	if (ctx != 0)
+	switch (enc->codec)
 	{
 #ifdef VRD_USE_ZLIB
-		ctx->z_strm.avail_out = VRD_ZLIB_COMPRESSION_BUFFER_SIZE;
-		ctx->z_strm.next_out = ctx->z_compression_buffer;
-		if (deflate(&ctx->z_strm, Z_FINISH) != Z_STREAM_ERROR)
-		{
-			int writeCount = VRD_ZLIB_COMPRESSION_BUFFER_SIZE - ctx->z_strm.avail_out;
-			fwrite(ctx->z_compression_buffer, writeCount, 1, ctx->fp);
-		}
+	case VRD_Codec_Deflate: deflateEnd(&enc->z_strm); break;
+#endif
+#ifdef VRD_USE_LZ4
+	case VRD_Codec_LZ4: LZ4F_freeCompressionContext(enc->lz4); break;
+#endif
+#ifdef VRD_USE_ZSTD
+	case VRD_Codec_Zstd: ZSTD_freeCCtx(enc->zstd); break;
+#endif
+	default: break;
+	}
+	free(enc->out.data);
+	memset(enc, 0, sizeof(VRD_Encoder));
+}
 
-		deflateEnd(&ctx->z_strm);
-		free(ctx->z_compression_buffer);
+// Starts a new stream, with the same codec settings and dictionary.
+void VRD_Internal_ResetEncoder(VRD_Encoder* enc)
+{
+	switch (enc->codec)
+	{
+#ifdef VRD_USE_ZLIB
+	case VRD_Codec_Deflate: deflateReset(&enc->z_strm); break;
 #endif
-		fclose(ctx->fp);
-		free(ctx->entity_map);
-		memset(ctx, 0, sizeof(VRD_replay_context));
-		free(ctx);
+#ifdef VRD_USE_LZ4
+	case VRD_Codec_LZ4: enc->started = 0; break;
+#endif
+#ifdef VRD_USE_ZSTD
+	case VRD_Codec_Zstd: ZSTD_CCtx_reset(enc->zstd, ZSTD_reset_session_only); break;
+#endif
+	default: break;
 	}
 }
 
-void VRD_RegisterEntity(VRD_replay_context* ctx, entityKeyType entityId, const char* name, const char* path, const char* type_name, const char* category_name, VRD_Transform* transform, VRD_StringDictPair* staticParams, int staticParamsCount)
+void VRD_InitContextOptions(VRD_ContextOptions* options)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_WriteEntityDef(ctx, id, ctx->frame, name, path, type_name, category_name, transform, staticParams, staticParamsCount);
+	if (options == 0) return;
+	memset(options, 0, sizeof(VRD_ContextOptions));
+	options->compressed = 1;
+	options->asyncQueueLength = VRD_ASYNC_DEFAULT_QUEUE_LENGTH;
+	options->backpressure = VRD_Backpressure_Block;
+	options->internStrings = 1;
+	options->positionQuantum = VRD_DEFAULT_POSITION_QUANTUM;
+	options->transformKeyframeInterval = VRD_DEFAULT_TRANSFORM_KEYFRAME_INTERVAL;
+	options->streamBufferBytes = VRD_STREAM_DEFAULT_BUFFER_SIZE;
+	options->streamOverflow = VRD_StreamOverflow_Drop;
 }
 
-void VRD_UnRegisterEntity(VRD_replay_context* ctx, entityKeyType entityId)
+VRD_replay_context* VRD_CreateContext(const char* filename, int compressed)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_WriteEntityUndef(ctx, id, ctx->frame);
+	VRD_ContextOptions options;
+	VRD_InitContextOptions(&options);
+	options.compressed = compressed;
+	options.internStrings = 0; // Same files as before the options, older viewers read them
+	return VRD_CreateContextWithOptions(filename, &options);
 }
 
-void VRD_SetLog(VRD_replay_context* ctx, entityKeyType entityId, const char* log, const char* category, enum VRD_Color color)
+VRD_replay_context* VRD_CreateContextWithOptions(const char* filename, const VRD_ContextOptions* options)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_WriteEntityLog(ctx, id, ctx->frame, log, category, color);
+	VRD_ContextOptions defaultOptions;
+	if (options == 0)
+	{
+		VRD_InitContextOptions(&defaultOptions);
+		options = &defaultOptions;
+	}
+
+	// Flight recorder contexts only open a file when dumped
+	VRD_FrameRing* ring = 0;
+	VRD_Stream* stream = 0;
+	FILE* fp = 0;
+	if (options->ringBufferBytes > 0)
+	{
+		int defBytes = options->ringDefBytes > 0 ? options->ringDefBytes : options->ringBufferBytes / VRD_RING_DEF_SHARE;
+		if (options->ringDefBytes <= 0 && defBytes < VRD_RING_DEF_MIN_BYTES) defBytes = VRD_RING_DEF_MIN_BYTES;
+		ring = VRD_Internal_CreateRing(options->ringBufferBytes, defBytes);
+		if (ring == 0) return 0;
+	}
+	else if (options->streamCallback || VRD_Internal_IsStreamAddress(filename))
+	{
+		stream = VRD_Internal_CreateStream(filename, options);
+		if (stream == 0) return 0;
+	}
+	else if (VRD_Internal_OpenFile(&fp, filename, "wb") != 0)
+	{
+		return 0;
+	}
+
+	VRD_replay_context* ctx = (VRD_replay_context*)malloc(sizeof(VRD_replay_context));
+	if (ctx)
+	{
+		memset(ctx, 0, sizeof(VRD_replay_context));
+		ctx->status = 1;
+		ctx->write_counters = new (std::nothrow) VRD_WriteCounters(); // Before anything is written
+		ctx->fp = fp;
+		ctx->ring = ring;
+		ctx->stream = stream;
+		ctx->chunk_frames = (options->chunkFrames > 0 && !ring) ? options->chunkFrames : stream ? VRD_STREAM_DEFAULT_CHUNK_FRAMES : 0; // Streams resume at the next keyframe after dropped chunks
+		if (options->compressionThreads > 1 && ctx->chunk_frames == 0 && !ring) ctx->chunk_frames = VRD_DEFAULT_CHUNK_FRAMES;
+		if (options->summaryFooter && !ring && !stream)
+		{
+			ctx->summary = new (std::nothrow) VRD_Summary(); // Out of memory, written without summary
+			if (ctx->summary && ctx->chunk_frames == 0) ctx->chunk_frames = VRD_DEFAULT_CHUNK_FRAMES;
+		}
+
+		ctx->staging.data = static_cast<unsigned char*>(malloc(VRD_STAGING_BUFFER_INITIAL_SIZE));
+		ctx->staging.capacity = ctx->staging.data ? VRD_STAGING_BUFFER_INITIAL_SIZE : 0;
+		ctx->flush_threshold = (ctx->chunk_frames || ring) ? 0 : VRD_STAGING_FLUSH_THRESHOLD; // Chunks and ring records are only flushed whole
+		ctx->flush_frame_interval = VRD_STAGING_FLUSH_FRAME_INTERVAL;
+
+		enum VRD_Codec codec = VRD_Internal_SupportedCodec(options->compressed);
+		if (codec == VRD_Codec_Zstd && options->dictionary && options->dictionarySize > 0)
+		{
+			ctx->dictionary.data = static_cast<unsigned char*>(malloc(options->dictionarySize));
+			if (ctx->dictionary.data) memcpy(ctx->dictionary.data, options->dictionary, options->dictionarySize);
+			ctx->dictionary.size = ctx->dictionary.capacity = ctx->dictionary.data ? options->dictionarySize : 0;
+		}
+		if (!VRD_Internal_InitEncoder(&ctx->encoder, codec, options->compressionLevel, ctx->dictionary.data, ctx->dictionary.size))
+		{
+			VRD_Internal_ReleaseEncoder(&ctx->encoder); // Fallback to an uncompressed file
+			ctx->dictionary.size = 0;
+		}
+
+		ctx->backpressure = options->backpressure;
+		ctx->serial = ++VRD_ContextSerial;
+		ctx->intern_strings = options->internStrings;
+		ctx->delta_transforms = options->deltaTransforms && !options->multithreaded && !ring; // Lanes are spliced after encoding, and evicted frames would break the chain
+		ctx->position_quantum = options->positionQuantum > 0 ? options->positionQuantum : VRD_DEFAULT_POSITION_QUANTUM;
+		ctx->inv_position_quantum = 1.0f / ctx->position_quantum;
+		ctx->transform_keyframe_interval = options->transformKeyframeInterval > 0 ? options->transformKeyframeInterval : VRD_DEFAULT_TRANSFORM_KEYFRAME_INTERVAL;
+		ctx->stats_frame_interval = options->statsFrameInterval > 0 ? options->statsFrameInterval : 0;
+		ctx->meshes.budget = (options->meshCacheBytes > 0 && !ring) ? options->meshCacheBytes : 0; // Dumps would need the evicted defs of the oldest frames
+		ctx->value_series.frames = (options->valueSeriesFrames > 0 && !ring) ? options->valueSeriesFrames : 0; // Ring frames are evicted one by one
+		if (options->multithreaded)
+		{
+			ctx->thread_lanes = new VRD_ThreadLanes();
+			ctx->thread_lanes->first = 0;
+			ctx->thread_lanes->next_auto_lane = VRD_AUTO_THREAD_LANE_BASE;
+			VRD_Internal_GetThreadLane(ctx, VRD_CONTEXT_THREAD_LANE);
+		}
+		if (ring)
+		{
+			// Headers are written with each dump
+		}
+		else if (ctx->chunk_frames)
+		{
+			VRD_Internal_WriteChunkedHeader(ctx); // Before the writer thread owns the file
+		}
+		else
+		{
+			VRD_Internal_WriteStreamHeader(ctx);
+		}
+		if ((options->async || options->compressionThreads > 1) && !ring)
+		{
+			VRD_Internal_StartAsyncWriter(ctx, options->asyncQueueLength, options->compressionThreads);
+		}
+		ctx->keep_dropped = ctx->async_writer && ctx->backpressure == VRD_Backpressure_DropFrame && !ctx->chunk_frames;
+
+		if (ring)
+		{
+			ring->first_frame = ctx->frame;
+		}
+		else if (ctx->chunk_frames)
+		{
+			VRD_Internal_BeginChunk(ctx);
+		}
+		else
+		{
+			VRD_Internal_WriteReplayHeader(ctx, &ctx->staging);
+			if (VRD_Internal_FormatFlags(ctx) != 0) VRD_Internal_WriteReplayFormat(ctx, &ctx->staging); // Without any, older viewers still read the file
+			VRD_Internal_Flush(ctx, true); // Nothing can be written before the header
+		}
+	}
+	else
+	{
+		if (fp) fclose(fp);
+		VRD_Internal_ReleaseStream(stream);
+		if (ring) VRD_Internal_FreeRing(ring);
+	}
+	return ctx;
+}
+
+void VRD_ReleaseContext(VRD_replay_context* ctx)
+{
+	if (ctx != 0)
+	{
+		VRD_Internal_SpliceThreadLanes(ctx);
+		if (ctx->value_series.frames) VRD_Internal_WriteValueSeries(ctx);
+		if (ctx->fp || ctx->stream) VRD_Internal_Flush(ctx, true); // Flight recorder frames are dropped, unless dumped
+		VRD_Internal_StopAsyncWriter(ctx); // Drains all queued frames
+		if (ctx->summary) VRD_Internal_WriteSummary(ctx); // After the last chunk, before the lanes and their log markers are released
+		VRD_Internal_ReleaseThreadLanes(ctx);
+		VRD_Internal_ReleaseStringTable(ctx);
+		VRD_Internal_ReleaseMeshCache(ctx);
+		VRD_Internal_ReleaseEntityStates(ctx);
+		VRD_Internal_ReleaseValueSeries(ctx);
+		VRD_Internal_ReleaseSummary(ctx);
+		VRD_Internal_ReleaseRing(ctx);
+		if (ctx->chunk_frames && !ctx->stream) VRD_Internal_WriteChunkIndex(ctx); // Streams are never seeked
+
+		if (ctx->fp && !ctx->chunk_frames) VRD_Internal_FinishStream(ctx); // Chunks are finished one by one
+		VRD_Internal_ReleaseEncoder(&ctx->encoder);
+		if (ctx->fp) fclose(ctx->fp);
+		VRD_Internal_ReleaseStream(ctx->stream); // Sends everything queued
+		VRD_Internal_ReleaseCounters(&ctx->counters);
+		VRD_Internal_ReleaseCategoryFilters(ctx);
+		delete ctx->write_counters;
+		free(ctx->staging.data);
+		free(ctx->kept.data);
+		free(ctx->entity_map);
+		free(ctx->free_entity_ids.ids);
+		free(ctx->released_entity_ids.ids);
+		free(ctx->chunk_index.entries);
+		free(ctx->dictionary.data);
+		memset(ctx, 0, sizeof(VRD_replay_context));
+		free(ctx);
+	}
+}
+
+void VRD_SetFlushPolicy(VRD_replay_context* ctx, int flushThresholdBytes, int flushFrameInterval)
+{
+	if (ctx != 0 && (ctx->chunk_frames || ctx->ring)) return; // Chunked files flush once per chunk, flight recorders once per frame
+	if (ctx == 0 || ctx->status == 0) return;
+	ctx->flush_threshold = flushThresholdBytes > 0 ? flushThresholdBytes : 0;
+	ctx->flush_frame_interval = flushFrameInterval > 0 ? flushFrameInterval : 1;
+}
+
+void VRD_SetThreadLane(VRD_replay_context* ctx, int lane)
+{
+	if (ctx == 0 || ctx->status == 0 || ctx->thread_lanes == 0) return;
+	VRD_Internal_GetThreadLane(ctx, lane < 0 ? 0 : lane);
+}
+
+void VRD_SetCategoryFilter(VRD_replay_context* ctx, const char* category, int enabled, int maxPerFrame, int sampleEvery)
+{
+	if (ctx == 0 || ctx->status == 0) return;
+	if (ctx->category_filters == 0)
+	{
+		ctx->category_filters = new (std::nothrow) VRD_CategoryFilters();
+		if (ctx->category_filters == 0) return;
+		ctx->category_filters->fallback.enabled = 1;
+	}
+	VRD_CategoryFilter* filter = VRD_Internal_AddCategoryFilter(ctx->category_filters, category);
+	if (filter == 0) return;
+	filter->enabled = enabled;
+	filter->max_per_frame = maxPerFrame > 0 ? maxPerFrame : 0;
+	filter->sample_every = sampleEvery > 1 ? sampleEvery : 0;
+	filter->frame_calls.store(0, std::memory_order_relaxed);
+	filter->sample_calls.store(0, std::memory_order_relaxed);
+}
+
+int VRD_LoadCategoryFilters(VRD_replay_context* ctx, const char* filename)
+{
+	if (ctx == 0 || ctx->status == 0) return -1;
+	FILE* fp;
+	if (VRD_Internal_OpenFile(&fp, filename, "r") != 0) return -1;
+
+	int count = 0;
+	char line[512];
+	while (fgets(line, sizeof(line), fp))
+	{
+		char* tokens[8];
+		int tokenCount = 0;
+		for (char* it = line; *it && *it != '#' && tokenCount < 8;)
+		{
+			while (*it == ' ' || *it == '\t' || *it == '\r' || *it == '\n') *it++ = 0;
+			if (*it == 0 || *it == '#') break;
+			tokens[tokenCount++] = it;
+			while (*it && *it != ' ' && *it != '\t' && *it != '\r' && *it != '\n') ++it;
+		}
+		if (tokenCount == 0) continue;
+
+		int enabled = 1, maxPerFrame = 0, sampleEvery = 0;
+		bool valid = true;
+		for (int i = 1; i < tokenCount && valid; ++i)
+		{
+			if (strcmp(tokens[i], "on") == 0) enabled = 1;
+			else if (strcmp(tokens[i], "off") == 0) enabled = 0;
+			else if (strncmp(tokens[i], "max=", 4) == 0) maxPerFrame = atoi(tokens[i] + 4);
+			else if (strncmp(tokens[i], "every=", 6) == 0) sampleEvery = atoi(tokens[i] + 6);
+			else valid = false; // Malformed lines are skipped
+		}
+		if (!valid) continue;
+		VRD_SetCategoryFilter(ctx, strcmp(tokens[0], "*") == 0 ? 0 : tokens[0], enabled, maxPerFrame, sampleEvery);
+		count += 1;
+	}
+	fclose(fp);
+	return count;
+}
+
+void VRD_RegisterEntity(VRD_replay_context* ctx, entityKeyType entityId, const char* name, const char* path, const char* type_name, const char* category_name, VRD_Transform* transform, VRD_StringDictPair* staticParams, int staticParamsCount)
+{
+	if (ctx == 0 || ctx->status == 0) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_WriteEntityDef(ctx, id, ctx->frame, name, path, type_name, category_name, transform, staticParams, staticParamsCount);
+}
+
+void VRD_UnRegisterEntity(VRD_replay_context* ctx, entityKeyType entityId)
+{
+	if (ctx == 0 || ctx->status == 0) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_WriteEntityUndef(ctx, id, ctx->frame);
+	VRD_Internal_ReleaseEntityId(ctx, entityId);
+}
+
+void VRD_SetLog(VRD_replay_context* ctx, entityKeyType entityId, const char* log, const char* category, enum VRD_Color color)
+{
+	if (ctx == 0 || ctx->status == 0 || !VRD_Internal_FilterCategory(ctx, category)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_WriteEntityLog(ctx, id, ctx->frame, log, log ? (int)strlen(log) : 0, category, color);
+}
+
+void VRD_SetLogN(VRD_replay_context* ctx, entityKeyType entityId, const char* log, int logLength, const char* category, enum VRD_Color color)
+{
+	if (ctx == 0 || ctx->status == 0 || !VRD_Internal_FilterCategory(ctx, category)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_WriteEntityLog(ctx, id, ctx->frame, log, logLength > 0 ? logLength : 0, category, color);
+}
+
+void VRD_SetLogf(VRD_replay_context* ctx, entityKeyType entityId, const char* category, enum VRD_Color color, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	VRD_SetLogv(ctx, entityId, category, color, format, args);
+	va_end(args);
+}
+
+void VRD_SetLogv(VRD_replay_context* ctx, entityKeyType entityId, const char* category, enum VRD_Color color, const char* format, va_list args)
+{
+	if (ctx == 0 || ctx->status == 0 || format == 0 || !VRD_Internal_FilterCategory(ctx, category)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_WriteEntityLogFormat(ctx, id, ctx->frame, category, color, format, args);
+}
+
+void VRD_SetPosition(VRD_replay_context* ctx, entityKeyType entityId, VRD_Point* pos)
+{
+	if (ctx == 0 || ctx->status == 0) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_WriteEntityPosition(ctx, id, ctx->frame, pos);
+}
+
+void VRD_SetTransform(VRD_replay_context* ctx, entityKeyType entityId, VRD_Transform* xform)
+{
+	if (ctx == 0 || ctx->status == 0) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_WriteEntityTransform(ctx, id, ctx->frame, xform);
+}
+
+void VRD_SetDynamicParamString(VRD_replay_context* ctx, entityKeyType entityId, const char* key, const char* val)
+{
+	if (ctx == 0 || ctx->status == 0 || !VRD_Internal_FilterCategory(ctx, key)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_SetDynamicParamString(ctx, id, ctx->frame, key, val, val ? (int)strlen(val) : 0);
+}
+
+void VRD_SetDynamicParamStringN(VRD_replay_context* ctx, entityKeyType entityId, const char* key, const char* val, int valLength)
+{
+	if (ctx == 0 || ctx->status == 0 || !VRD_Internal_FilterCategory(ctx, key)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_SetDynamicParamString(ctx, id, ctx->frame, key, val, valLength > 0 ? valLength : 0);
+}
+
+void VRD_SetDynamicParamFloat(VRD_replay_context* ctx, entityKeyType entityId, const char* key, float val)
+{
+	if (ctx == 0 || ctx->status == 0 || !VRD_Internal_FilterCategory(ctx, key)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_SetDynamicParamFloat(ctx, id, ctx->frame, key, val);
+}
+
+void VRD_DrawSphere(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* pos, float radius, enum VRD_Color color)
+{
+	if (ctx == 0 || ctx->status == 0 || !VRD_Internal_FilterCategory(ctx, category)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_DrawSphere(ctx, id, ctx->frame, category, pos, radius, color);
+}
+
+void VRD_DrawBox(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Transform* xform, VRD_Point* dimensions, enum VRD_Color color)
+{
+	if (ctx == 0 || ctx->status == 0 || !VRD_Internal_FilterCategory(ctx, category)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_DrawBox(ctx, id, ctx->frame, category, xform, dimensions, color);
+}
+
+void VRD_DrawCapsule(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* p1, VRD_Point* p2, float radius, enum VRD_Color color)
+{
+	if (ctx == 0 || ctx->status == 0 || !VRD_Internal_FilterCategory(ctx, category)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_DrawCapsule(ctx, id, ctx->frame, category, p1, p2, radius, color);
+}
+
+void VRD_DrawMesh(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* verts, int vertCount, enum VRD_Color color)
+{
+	if (ctx == 0 || ctx->status == 0 || !VRD_Internal_FilterCategory(ctx, category)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	if (ctx->meshes.budget > 0) VRD_Internal_DrawMeshRef(ctx, id, ctx->frame, category, 0, verts, vertCount, 0, color);
+	else VRD_Internal_DrawMesh(ctx, id, ctx->frame, category, verts, vertCount, color);
+}
+
+void VRD_DrawMeshInstance(VRD_replay_context* ctx, entityKeyType entityId, const char* category, unsigned long long meshKey, VRD_Point* verts, int vertCount, VRD_Transform* xform, enum VRD_Color color)
+{
+	if (ctx == 0 || ctx->status == 0 || verts == 0 || vertCount <= 0 || !VRD_Internal_FilterCategory(ctx, category)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_DrawMeshRef(ctx, id, ctx->frame, category, meshKey, verts, vertCount, xform, color);
+}
+
+void VRD_DrawLine(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* p1, VRD_Point* p2, enum VRD_Color color)
+{
+	if (ctx == 0 || ctx->status == 0 || !VRD_Internal_FilterCategory(ctx, category)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_DrawLine(ctx, id, ctx->frame, category, p1, p2, color);
+}
+
+void VRD_DrawCircle(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* position, VRD_Point* up, float radius, enum VRD_Color color)
+{
+	if (ctx == 0 || ctx->status == 0 || !VRD_Internal_FilterCategory(ctx, category)) return;
+	int id = VRD_Internal_EntityMap(ctx, entityId);
+	VRD_Internal_DrawCircle(ctx, id, ctx->frame, category, position, up, radius, color);
+}
+
+void VRD_SetPositions(VRD_replay_context* ctx, const entityKeyType* entityIds, const VRD_Point* positions, int count)
+{
+	if (ctx == 0 || ctx->status == 0 || entityIds == 0 || positions == 0 || count <= 0) return;
+	VRD_Internal_WritePositionBatch(ctx, ctx->frame, entityIds, positions, count);
+}
+
+void VRD_SetTransforms(VRD_replay_context* ctx, const entityKeyType* entityIds, const VRD_Transform* xforms, int count)
+{
+	if (ctx == 0 || ctx->status == 0 || entityIds == 0 || xforms == 0 || count <= 0) return;
+	VRD_Internal_WriteTransformBatch(ctx, ctx->frame, entityIds, xforms, count);
+}
+
+void VRD_DrawLines(VRD_replay_context* ctx, const entityKeyType* entityIds, const char* category, const VRD_Point* p1, const VRD_Point* p2, int count, enum VRD_Color color)
+{
+	if (ctx == 0 || ctx->status == 0 || entityIds == 0 || p1 == 0 || p2 == 0 || count <= 0 || !VRD_Internal_FilterCategory(ctx, category)) return; // One call for the whole batch
+	VRD_Internal_DrawLineBatch(ctx, ctx->frame, entityIds, category, p1, p2, count, color);
+}
+
+void VRD_DrawSpheres(VRD_replay_context* ctx, const entityKeyType* entityIds, const char* category, const VRD_Point* centers, const float* radii, int count, enum VRD_Color color)
+{
+	if (ctx == 0 || ctx->status == 0 || entityIds == 0 || centers == 0 || radii == 0 || count <= 0 || !VRD_Internal_FilterCategory(ctx, category)) return;
+	VRD_Internal_DrawSphereBatch(ctx, ctx->frame, entityIds, category, centers, radii, count, color);
+}
+
+void VRD_StepFrame(VRD_replay_context* ctx, float totalTime)
+{
+	if (ctx == 0 || ctx->status == 0) return;
+	VRD_Internal_SpliceThreadLanes(ctx);
+	VRD_Internal_RecycleEntityIds(ctx);
+	if (ctx->stats_frame_interval > 0 && (ctx->frame + 1) % ctx->stats_frame_interval == 0) VRD_Internal_WriteCaptureStats(ctx);
+	if (ctx->value_series.frames)
+	{
+		// Series end with the chunk, whose keyframe restores the last values
+		bool chunkEnd = ctx->chunk_frames && ctx->frame + 1 - ctx->chunk_first_frame >= ctx->chunk_frames;
+		if (chunkEnd || ctx->frame + 1 - ctx->value_series.first_frame >= ctx->value_series.frames) VRD_Internal_WriteValueSeries(ctx);
+	}
+	VRD_Internal_WriteFrameStep(ctx, totalTime);
+	if (ctx->summary) VRD_Internal_PushFrameTime(ctx, totalTime);
+	if (ctx->category_filters) VRD_Internal_ResetCategoryFilters(ctx->category_filters);
+	float frameStartTime = ctx->last_frame_time;
+	ctx->frame += 1;
+	ctx->last_frame_time = totalTime;
+
+	ctx->frames_since_flush += 1;
+	if (ctx->ring)
+	{
+		VRD_Internal_PushRingFrame(ctx, ctx->frame - 1, frameStartTime);
+	}
+	else if (ctx->chunk_frames)
+	{
+		// A chunk held back by backpressure keeps growing until it can be handed off
+		if (ctx->frame - ctx->chunk_first_frame >= ctx->chunk_frames && VRD_Internal_Flush(ctx, false))
+		{
+			VRD_Internal_BeginChunk(ctx);
+		}
+	}
+	else if (ctx->frames_since_flush >= ctx->flush_frame_interval)
+	{
+		VRD_Internal_Flush(ctx, false);
+	}
+}
+
+int VRD_DumpRing(VRD_replay_context* ctx, const char* filename)
+{
+	if (ctx == 0 || ctx->status == 0 || ctx->ring == 0) return 0;
+	FILE* fp;
+	if (VRD_Internal_OpenFile(&fp, filename, "wb") != 0) return 0;
+
+	ctx->fp = fp;
+	int ok = VRD_Internal_DumpRing(ctx);
+	fclose(fp);
+	ctx->fp = 0;
+	return ok;
+}
+
+int VRD_GetStats(VRD_replay_context* ctx, VRD_CaptureStats* stats, VRD_CategoryStats* categories, int maxCategories)
+{
+	if (ctx == 0 || stats == 0) return 0;
+	VRD_Internal_MergeLaneCounters(ctx);
+	memset(stats, 0, sizeof(VRD_CaptureStats));
+	VRD_WriteCounters* written = ctx->write_counters;
+	if (written)
+	{
+		stats->flushedBytes = written->flushed_bytes.load(std::memory_order_relaxed);
+		stats->storedBytes = written->stored_bytes.load(std::memory_order_relaxed);
+		stats->compressSeconds = written->compress_ns.load(std::memory_order_relaxed) * 1e-9;
+		stats->ioSeconds = written->io_ns.load(std::memory_order_relaxed) * 1e-9;
+	}
+
+	VRD_CaptureCounters* counters = &ctx->counters;
+	double ratio = stats->flushedBytes > 0 ? (double)stats->storedBytes / stats->flushedBytes : 0;
+	for (int i = 0; i < VRD_STATS_BLOCK_TYPE_COUNT; ++i)
+	{
+		stats->blocks[i].calls = counters->calls[i];
+		stats->blocks[i].rawBytes = counters->bytes[i];
+		stats->blocks[i].compressedBytes = (long long)(counters->bytes[i] * ratio);
+	}
+
+	int count = 0;
+	for (int i = 0; i < counters->category_capacity && count < maxCategories && categories; ++i)
+	{
+		VRD_CategoryCounter* item = &counters->categories[i];
+		if (item->name == 0) continue;
+		categories[count].category = item->name;
+		categories[count].calls = item->calls;
+		categories[count].rawBytes = item->bytes;
+		++count;
+	}
+	stats->categoryCount = counters->category_count;
+	return counters->category_count;
+}
+
+///
+/// Internal
+///
+
+enum VRD_BlockType
+{
+	None = 0,
+	FrameStep,
+	EntityDef,
+	EntityUndef,
+	EntitySetPos,
+	EntitySetTransform,
+	EntityLog,
+	EntityParameter,
+	EntityValue,
+	EntityLine,
+	EntityCircle,
+	EntitySphere,
+	EntityCapsule,
+	EntityMesh,
+	EntityBox,
+
+	EntityDefWithParent,
+	ReplayFormat,
+	StringDef,
+	EntityTransformDelta,
+	Keyframe,
+	CaptureStats,
+	EntitySetPosBatch,
+	EntitySetTransformBatch,
+	EntityLineBatch,
+	EntitySphereBatch,
+	MeshDef,
+	EntityMeshRef,
+	EntityLogFormat,
+	EntityValueSeries,
+
+	ReplayHeader = 0xFF
+};
+
+// Written in the ReplayFormat block, right after the header.
+enum VRD_FormatFlags
+{
+	VRD_Format_StringTable = 1 << 0,
+	VRD_Format_DeltaTransforms = 1 << 1, // followed by the position quantum
+	VRD_Format_RecycledIds = 1 << 2, // an entity def after an undef is a new entity
+};
+
+// Chunked files: codec header, then chunks (each one an independent block stream starting with a ReplayFormat block and a Keyframe), then the chunk index.
+// Version 1 had a flags word (bit 0 for deflate) instead of the codec header. Version 3 files have the summary footer between the last chunk and the index,
+// files without it are still written as version 2 for older readers.
+// Live streams have the same layout without the index. A chunk without data (raw and stored size 0) marks frames the stream dropped.
+#define VRD_CHUNKED_MAGIC "VRDC"
+#define VRD_CHUNK_INDEX_MAGIC "VRDI"
+#define VRD_SUMMARY_MAGIC "VRDF"
+#define VRD_CHUNKED_VERSION 3
+#define VRD_CHUNKED_VERSION_WITHOUT_SUMMARY 2
+
+// Single stream files compressed with LZ4 or zstd: codec header, then the compressed block stream.
+// Uncompressed and deflate files keep the legacy layout, without a file header.
+#define VRD_STREAM_MAGIC "VRDS"
+#define VRD_STREAM_VERSION 1
+
+// EntityTransformDelta flags byte
+enum VRD_TransformDeltaFlags
+{
+	VRD_TransformDelta_X = 1 << 0,
+	VRD_TransformDelta_Y = 1 << 1,
+	VRD_TransformDelta_Z = 1 << 2,
+	VRD_TransformDelta_Rotation = 1 << 3, // smallest three, largest component index in bits 4-5
+	VRD_TransformDelta_RotationIndexShift = 4,
+	VRD_TransformDelta_Full = 1 << 6, // absolute position, all components
+};
+
+
+static inline unsigned int VRD_Internal_HashKey(entityKeyType key)
+{
+	unsigned long long x = (unsigned long long)key;
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdull;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ull;
+	x ^= x >> 33;
+	return (unsigned int)x;
+}
+
+// Backward shift deletion from an open addressing table whose items are empty with id 0: empties the slot, then moves back
+// the items after it that would no longer be found from their home slot, so that lookups need no tombstones.
+template <typename Item, typename HashOf> static void VRD_Internal_RemoveSlot(Item* items, int mask, int index, HashOf hashOf)
+{
+	memset(&items[index], 0, sizeof(Item));
+	for (int next = (index + 1) & mask; items[next].id != 0; next = (next + 1) & mask)
+	{
+		int home = (int)hashOf(items[next]) & mask;
+		if (((next - home) & mask) >= ((next - index) & mask))
+		{
+			items[index] = items[next];
+			memset(&items[next], 0, sizeof(Item));
+			index = next;
+		}
+	}
+}
+
+bool VRD_Internal_GrowEntityMap(VRD_replay_context* ctx)
+{
+	int capacity = ctx->entity_map_capacity > 0 ? ctx->entity_map_capacity * 2 : (16 << 10);
+	VRD_EntityMapItem* items = static_cast<VRD_EntityMapItem*>(calloc(capacity, sizeof(VRD_EntityMapItem)));
+	if (items == 0) return false;
+	for (int i = 0; i < ctx->entity_map_capacity; ++i)
+	{
+		if (ctx->entity_map[i].id == 0) continue;
+		int index = VRD_Internal_HashKey(ctx->entity_map[i].address) & (capacity - 1);
+		while (items[index].id != 0) index = (index + 1) & (capacity - 1);
+		items[index] = ctx->entity_map[i];
+	}
+	free(ctx->entity_map);
+	ctx->entity_map = items;
+	ctx->entity_map_capacity = capacity;
+	return true;
+}
+
+bool VRD_Internal_PushEntityId(VRD_EntityIdList* list, int id)
+{
+	if (list->count >= list->capacity)
+	{
+		int capacity = list->capacity > 0 ? list->capacity * 2 : 1024;
+		int* ids = static_cast<int*>(realloc(list->ids, capacity * sizeof(int)));
+		if (ids == 0) return false;
+		list->ids = ids;
+		list->capacity = capacity;
+	}
+	list->ids[list->count++] = id;
+	return true;
+}
+
+int VRD_Internal_EntityMap(VRD_replay_context* ctx, entityKeyType entityAddr)
+{
+	if (ctx == 0 || ctx->status == 0) return -1;
+
+	if (sizeof(entityKeyType) == sizeof(int)) return (entityAddr + 1); // No need to map if key is 32 bits
+
+	std::unique_lock<std::mutex> lock;
+	if (ctx->thread_lanes) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+	return VRD_Internal_EntityMapLocked(ctx, entityAddr);
+}
+
+// Caller holds the thread lanes lock, if any (for 64-bit keys).
+int VRD_Internal_EntityMapLocked(VRD_replay_context* ctx, entityKeyType entityAddr)
+{
+	if (sizeof(entityKeyType) == sizeof(int)) return (entityAddr + 1);
+
+	// find id in map
+	int mask = ctx->entity_map_capacity - 1;
+	if (ctx->entity_map_count > 0)
+	{
+		int index = VRD_Internal_HashKey(entityAddr) & mask;
+		while (ctx->entity_map[index].id != 0)
+		{
+			if (ctx->entity_map[index].address == entityAddr) return ctx->entity_map[index].id;
+			index = (index + 1) & mask;
+		}
+	}
+	// Not found
+
+	// Make sure there is room in the map, kept at most half full
+	if ((ctx->entity_map_count + 1) * 2 > ctx->entity_map_capacity)
+	{
+		if (!VRD_Internal_GrowEntityMap(ctx))
+		{
+			ctx->status = 0; // Out of memory, stop capturing
+			return -1;
+		}
+		mask = ctx->entity_map_capacity - 1;
+	}
+
+	// insert in map, reusing the ids of unregistered entities first
+	VRD_EntityIdList* freeIds = &ctx->free_entity_ids;
+	int id = (freeIds->count > 0) ? freeIds->ids[--freeIds->count] : ++ctx->entity_map_next_id;
+	int index = VRD_Internal_HashKey(entityAddr) & mask;
+	while (ctx->entity_map[index].id != 0) index = (index + 1) & mask;
+	ctx->entity_map[index].address = entityAddr;
+	ctx->entity_map[index].id = id;
+	ctx->entity_map_count += 1;
+	return id;
+}
+
+void VRD_Internal_ReleaseEntityId(VRD_replay_context* ctx, entityKeyType entityAddr)
+{
+	if (ctx == 0 || ctx->status == 0) return;
+	if (sizeof(entityKeyType) == sizeof(int)) return;
+
+	std::unique_lock<std::mutex> lock;
+	if (ctx->thread_lanes) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+
+	if (ctx->entity_map_count == 0) return;
+	int mask = ctx->entity_map_capacity - 1;
+	int index = VRD_Internal_HashKey(entityAddr) & mask;
+	while (ctx->entity_map[index].address != entityAddr)
+	{
+		if (ctx->entity_map[index].id == 0) return;
+		index = (index + 1) & mask;
+	}
+	if (ctx->entity_map[index].id == 0) return;
+
+	// Not recycled before the next frame step, other lanes may still have blocks staged for this id
+	VRD_Internal_PushEntityId(&ctx->released_entity_ids, ctx->entity_map[index].id);
+
+	VRD_Internal_RemoveSlot(ctx->entity_map, mask, index, [](const VRD_EntityMapItem& item) { return VRD_Internal_HashKey(item.address); });
+	ctx->entity_map_count -= 1;
+}
+
+void VRD_Internal_RecycleEntityIds(VRD_replay_context* ctx)
+{
+	std::unique_lock<std::mutex> lock;
+	if (ctx->thread_lanes) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+
+	VRD_EntityIdList* released = &ctx->released_entity_ids;
+	for (int i = 0; i < released->count; ++i)
+	{
+		if (!VRD_Internal_PushEntityId(&ctx->free_entity_ids, released->ids[i])) break; // the id is leaked, still valid
+	}
+	released->count = 0;
+}
+
+bool VRD_Internal_GrowStaging(VRD_StagingBuffer* buf, int len)
+{
+	if (buf->failed) return false;
+	int capacity = buf->capacity > 0 ? buf->capacity : VRD_STAGING_BUFFER_INITIAL_SIZE;
+	while (capacity < buf->size + len) capacity *= 2;
+	unsigned char* data = static_cast<unsigned char*>(realloc(buf->data, capacity));
+	if (data == 0)
+	{
+		buf->failed = 1;
+		return false;
+	}
+	buf->data = data;
+	buf->capacity = capacity;
+	return true;
+}
+
+// Returns room for len bytes at the end of the staging buffer, the caller must fill all of it.
+static inline unsigned char* VRD_Internal_Reserve(VRD_StagingBuffer* buf, int len)
+{
+	if (buf->size + len > buf->capacity && !VRD_Internal_GrowStaging(buf, len)) return 0;
+	unsigned char* p = buf->data + buf->size;
+	buf->size += len;
+	return p;
+}
+
+static inline void VRD_Internal_WriteBytes(VRD_StagingBuffer* buf, const void* data, int len)
+{
+	unsigned char* p = VRD_Internal_Reserve(buf, len);
+	if (p) memcpy(p, data, len);
+}
+
+static inline void VRD_Internal_WriteChar(VRD_StagingBuffer* buf, char value)
+{
+	unsigned char* p = VRD_Internal_Reserve(buf, 1);
+	if (p) *p = (unsigned char)value;
+}
+
+static inline void VRD_Internal_WriteInt(VRD_StagingBuffer* buf, int value)
+{
+	VRD_Internal_WriteBytes(buf, &value, 4);
+}
+
+static inline void VRD_Internal_WriteFloat(VRD_StagingBuffer* buf, float value)
+{
+	VRD_Internal_WriteBytes(buf, &value, 4);
+}
+
+// At most 5 bytes, returns the number of bytes written.
+static inline int VRD_Internal_Encode7BitEncodedInt(unsigned char* p, int value)
+{
+	unsigned int num = (unsigned int)value;
+	int len = 0;
+	while (num >= 0x80)
+	{
+		p[len++] = (unsigned char)(num | 0x80);
+		num = num >> 7;
+	}
+	p[len++] = (unsigned char)num;
+	return len;
+}
+
+static inline void VRD_Internal_Write7BitEncodedInt(VRD_StagingBuffer* buf, int value)
+{
+	unsigned char* p = VRD_Internal_Reserve(buf, 5);
+	if (p == 0) return;
+	int len = VRD_Internal_Encode7BitEncodedInt(p, value);
+	buf->size -= 5 - len; // give back unused reserve
+}
+
+static inline void VRD_Internal_WriteColor(VRD_StagingBuffer* buf, enum VRD_Color color)
+{
+	VRD_Internal_Write7BitEncodedInt(buf, color);
+}
+
+static inline void VRD_Internal_WriteString(VRD_StagingBuffer* buf, const char* s)
+{
+	int len = 0;
+	if (s) { len = (int)strlen(s); }
+	VRD_Internal_Write7BitEncodedInt(buf, len);
+	if (len > 0)
+	{
+		VRD_Internal_WriteBytes(buf, s, len);
+	}
+}
+
+static VRD_Point VRD_PointZero = { 0,0,0 };
+static VRD_Transform VRD_Identity = { {0,0,0},{0,0,0,1} };
+
+static inline void VRD_Internal_WritePoint(VRD_StagingBuffer* buf, VRD_Point* point)
+{
+	if (point == 0)
+	{
+		point = &VRD_PointZero;
+	}
+
+	unsigned char* p = VRD_Internal_Reserve(buf, 12);
+	if (p == 0) return;
+	memcpy(p + 0, &point->x, 4);
+	memcpy(p + 4, &point->y, 4);
+	memcpy(p + 8, &point->z, 4);
+}
+
+static inline void VRD_Internal_WriteTransform(VRD_StagingBuffer* buf, VRD_Transform* xform)
+{
+	if (xform == 0)
+	{
+		xform = &VRD_Identity;
+	}
+
+	unsigned char* p = VRD_Internal_Reserve(buf, 28);
+	if (p == 0) return;
+	memcpy(p + 0, &xform->translation.x, 4);
+	memcpy(p + 4, &xform->translation.y, 4);
+	memcpy(p + 8, &xform->translation.z, 4);
+	memcpy(p + 12, &xform->rotation.x, 4);
+	memcpy(p + 16, &xform->rotation.y, 4);
+	memcpy(p + 20, &xform->rotation.z, 4);
+	memcpy(p + 24, &xform->rotation.w, 4);
+}
+
+///
+/// Live streams
+///
+
+bool VRD_Internal_IsStreamAddress(const char* filename)
+{
+	return filename != 0 && (strncmp(filename, "unix:", 5) == 0 || strncmp(filename, "tcp:", 4) == 0);
+}
+
+// Connects to a viewer listening on "unix:<socket path>", or on "tcp:<port>" of localhost.
+bool VRD_Internal_ConnectStream(VRD_Stream* stream, const char* address)
+{
+#ifdef VRD_USE_SOCKETS
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) return false;
+#endif
+	if (strncmp(address, "tcp:", 4) == 0)
+	{
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons((unsigned short)atoi(address + 4));
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		stream->socket = socket(AF_INET, SOCK_STREAM, 0);
+		if (stream->socket == VRD_INVALID_SOCKET) return false;
+		int noDelay = 1; // Frames go out as soon as they are complete
+		setsockopt(stream->socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+		return connect(stream->socket, (const struct sockaddr*)&addr, sizeof(addr)) == 0;
+	}
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	const char* path = address + 5;
+	if (strlen(path) >= sizeof(addr.sun_path)) return false;
+	memcpy(addr.sun_path, path, strlen(path));
+	stream->socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (stream->socket == VRD_INVALID_SOCKET) return false;
+	return connect(stream->socket, (const struct sockaddr*)&addr, sizeof(addr)) == 0;
+#else
+	(void)stream;
+	(void)address;
+	return false; // Built without VRD_USE_SOCKETS
+#endif
+}
+
+// Returns false once the consumer is gone.
+bool VRD_Internal_StreamSend(VRD_Stream* stream, const unsigned char* data, int len)
+{
+	if (stream->callback) return stream->callback(stream->user_data, data, len) != 0;
+#ifdef VRD_USE_SOCKETS
+	while (len > 0)
+	{
+		int sent = (int)send(stream->socket, (const char*)data, len, VRD_SEND_FLAGS);
+		if (sent <= 0) return false;
+		data += sent;
+		len -= sent;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Sends the ring, then the spilled chunks, until stopped with nothing left to send.
+void VRD_Internal_StreamThread(VRD_Stream* stream)
+{
+	while (true)
+	{
+		const unsigned char* data = 0;
+		int len = 0;
+		bool spilled = false;
+		long long spillOffset = 0;
+		{
+			std::unique_lock<std::mutex> lock(stream->mutex);
+			stream->wake.wait(lock, [stream] { return stream->head != stream->tail || stream->spill_written != stream->spill_read || stream->stop; });
+			if (stream->head != stream->tail)
+			{
+				int offset = (int)(stream->tail % stream->capacity);
+				long long pending = stream->head - stream->tail;
+				len = (int)(pending < stream->capacity - offset ? pending : stream->capacity - offset);
+				data = stream->data + offset;
+			}
+			else if (stream->spill_written != stream->spill_read)
+			{
+				long long pending = stream->spill_written - stream->spill_read;
+				len = (int)(pending < VRD_STREAM_SPILL_READ_SIZE ? pending : VRD_STREAM_SPILL_READ_SIZE);
+				spillOffset = stream->spill_read;
+				spilled = true;
+			}
+			else
+			{
+				break; // Stopped, and everything was sent
+			}
+		}
+
+		// Queued bytes are never overwritten before the tail moves past them, so they are sent without the lock
+		bool sent = !stream->closed;
+		if (sent && spilled)
+		{
+			sent = VRD_Internal_SeekFile(stream->spill_reader, spillOffset) == 0 && fread(stream->spill_buffer, len, 1, stream->spill_reader) == 1;
+			data = stream->spill_buffer;
+		}
+		sent = sent && VRD_Internal_StreamSend(stream, data, len);
+
+		{
+			std::lock_guard<std::mutex> lock(stream->mutex);
+			if (!sent)
+			{
+				stream->closed = true;
+				stream->tail = stream->head;
+				stream->spill_written = stream->spill_read = 0;
+			}
+			else if (spilled)
+			{
+				stream->spill_read += len;
+				if (stream->spill_read == stream->spill_written) stream->spill_written = stream->spill_read = 0; // Back to the ring
+			}
+			else
+			{
+				stream->tail += len;
+			}
+		}
+		stream->wake.notify_all();
+	}
+}
+
+VRD_Stream* VRD_Internal_CreateStream(const char* address, const VRD_ContextOptions* options)
+{
+	VRD_Stream* stream = new (std::nothrow) VRD_Stream();
+	if (stream == 0) return 0;
+#ifdef VRD_USE_SOCKETS
+	stream->socket = VRD_INVALID_SOCKET;
+#endif
+	stream->callback = options->streamCallback;
+	stream->user_data = options->streamUserData;
+	stream->capacity = options->streamBufferBytes > 0 ? options->streamBufferBytes : VRD_STREAM_DEFAULT_BUFFER_SIZE;
+	stream->data = static_cast<unsigned char*>(malloc(stream->capacity));
+	bool ok = stream->data != 0 && (stream->callback || VRD_Internal_ConnectStream(stream, address));
+	if (ok && options->streamOverflow == VRD_StreamOverflow_Spill && options->streamSpillFile)
+	{
+		size_t len = strlen(options->streamSpillFile);
+		stream->spill_path = static_cast<char*>(malloc(len + 1));
+		stream->spill_buffer = static_cast<unsigned char*>(malloc(VRD_STREAM_SPILL_READ_SIZE));
+		if (stream->spill_path) memcpy(stream->spill_path, options->streamSpillFile, len + 1);
+		if (stream->spill_path && stream->spill_buffer && VRD_Internal_OpenFile(&stream->spill, stream->spill_path, "w+b") == 0 && VRD_Internal_OpenFile(&stream->spill_reader, stream->spill_path, "rb") != 0)
+		{
+			stream->spill_reader = 0;
+		}
+		ok = stream->spill != 0 && stream->spill_reader != 0;
+	}
+	if (!ok)
+	{
+		VRD_Internal_ReleaseStream(stream);
+		return 0;
+	}
+	stream->thread = std::thread(VRD_Internal_StreamThread, stream);
+	return stream;
+}
+
+// Ends the stream once everything queued was sent, or the consumer is gone.
+void VRD_Internal_ReleaseStream(VRD_Stream* stream)
+{
+	if (stream == 0) return;
+	if (stream->thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(stream->mutex);
+			stream->stop = true;
+		}
+		stream->wake.notify_all();
+		stream->thread.join();
+	}
+#ifdef VRD_USE_SOCKETS
+	if (stream->socket != VRD_INVALID_SOCKET) VRD_CloseSocket(stream->socket);
+#ifdef _WIN32
+	if (stream->callback == 0) WSACleanup();
+#endif
+#endif
+	if (stream->spill) fclose(stream->spill);
+	if (stream->spill_reader) fclose(stream->spill_reader);
+	if (stream->spill && stream->spill_path) remove(stream->spill_path);
+	free(stream->spill_path);
+	free(stream->spill_buffer);
+	free(stream->data);
+	delete stream;
+}
+
+// Copies into the ring, which has room for it. Called with the stream locked.
+static inline void VRD_Internal_StreamPut(VRD_Stream* stream, const void* data, int len)
+{
+	int offset = (int)(stream->head % stream->capacity);
+	int first = len < stream->capacity - offset ? len : stream->capacity - offset;
+	memcpy(stream->data + offset, data, first);
+	memcpy(stream->data, static_cast<const unsigned char*>(data) + first, len - first);
+	stream->head += len;
+}
+
+// Stream header: waits for room, the stream thread has just started sending.
+void VRD_Internal_StreamWrite(VRD_Stream* stream, const void* data, int len)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	while (len > 0)
+	{
+		std::unique_lock<std::mutex> lock(stream->mutex);
+		stream->wake.wait(lock, [stream] { return stream->head - stream->tail < stream->capacity || stream->closed; });
+		if (stream->closed) return;
+		int room = (int)(stream->capacity - (stream->head - stream->tail));
+		int n = len < room ? len : room;
+		VRD_Internal_StreamPut(stream, p, n);
+		p += n;
+		len -= n;
+		lock.unlock();
+		stream->wake.notify_all();
+	}
+}
+
+// Appends the gap marker of the frames dropped so far, and a chunk, at the end of the spill file. Called with the stream locked.
+bool VRD_Internal_SpillChunk(VRD_Stream* stream, const int header[4], const unsigned char* stored, int storedSize)
+{
+	int gap[4] = { stream->gap_first_frame, stream->gap_frame_count, 0, 0 };
+	if (VRD_Internal_SeekFile(stream->spill, stream->spill_written) != 0) return false;
+	if (stream->gap_frame_count > 0 && fwrite(gap, sizeof(gap), 1, stream->spill) != 1) return false;
+	if (fwrite(header, 16, 1, stream->spill) != 1) return false;
+	if (storedSize > 0 && fwrite(stored, storedSize, 1, stream->spill) != 1) return false;
+	if (fflush(stream->spill) != 0) return false; // Read back through the other handle
+	stream->spill_written += (stream->gap_frame_count > 0 ? sizeof(gap) : 0) + 16 + storedSize;
+	return true;
+}
+
+// Queues a chunk with its header, or spills or drops it when the consumer fell behind. Returns the bytes queued or spilled.
+int VRD_Internal_StreamChunk(VRD_Stream* stream, const int header[4], const unsigned char* stored, int storedSize)
+{
+	int queued = 0;
+	{
+		std::lock_guard<std::mutex> lock(stream->mutex);
+		if (stream->closed) return 0;
+		int gapSize = stream->gap_frame_count > 0 ? 16 : 0;
+		bool spilling = stream->spill_written != stream->spill_read; // Later chunks wait behind the spilled ones
+		if (!spilling && stream->head - stream->tail + gapSize + 16 + storedSize <= stream->capacity)
+		{
+			int gap[4] = { stream->gap_first_frame, stream->gap_frame_count, 0, 0 };
+			if (gapSize > 0) VRD_Internal_StreamPut(stream, gap, gapSize);
+			VRD_Internal_StreamPut(stream, header, 16);
+			VRD_Internal_StreamPut(stream, stored, storedSize);
+		}
+		else if (stream->spill == 0 || !VRD_Internal_SpillChunk(stream, header, stored, storedSize))
+		{
+			if (stream->gap_frame_count == 0) stream->gap_first_frame = header[0];
+			stream->gap_frame_count += header[1];
+			return 0;
+		}
+		stream->gap_frame_count = 0;
+		queued = gapSize + 16 + storedSize;
+	}
+	stream->wake.notify_all();
+	return queued;
+}
+
+static inline long long VRD_Internal_Nanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline void VRD_Internal_CountStored(VRD_replay_context* ctx, int storedBytes, long long ioNs)
+{
+	VRD_WriteCounters* counters = ctx->write_counters;
+	if (counters == 0) return;
+	counters->stored_bytes.fetch_add(storedBytes, std::memory_order_relaxed);
+	counters->io_ns.fetch_add(ioNs, std::memory_order_relaxed);
+}
+
+// Every file write goes through here, for the I/O counters. Returns the time spent, in nanoseconds.
+long long VRD_Internal_FileWrite(VRD_replay_context* ctx, const void* data, int len)
+{
+	long long start = VRD_Internal_Nanoseconds();
+	if (len > 0 && ctx->stream) VRD_Internal_StreamWrite(ctx->stream, data, len);
+	else if (len > 0) fwrite(data, len, 1, ctx->fp);
+	long long elapsed = VRD_Internal_Nanoseconds() - start;
+	VRD_Internal_CountStored(ctx, len, elapsed);
+	return elapsed;
+}
+
+static inline void VRD_Internal_CountFlush(VRD_replay_context* ctx, int rawBytes, long long compressNs)
+{
+	VRD_WriteCounters* counters = ctx->write_counters;
+	if (counters == 0) return;
+	counters->flushed_bytes.fetch_add(rawBytes, std::memory_order_relaxed);
+	counters->compress_ns.fetch_add(compressNs, std::memory_order_relaxed);
+}
+
+// Empties the encoder output, with room for at least capacity bytes. Returns 0 when out of memory.
+static inline unsigned char* VRD_Internal_EncoderOutput(VRD_Encoder* enc, int capacity)
+{
+	enc->out.size = 0;
+	enc->out.failed = 0;
+	return VRD_Internal_Reserve(&enc->out, capacity);
+}
+
+// Hands raw bytes to the compressor/file. Only called on flush, never per field.
+void VRD_Internal_Write(VRD_replay_context* ctx, const unsigned char* buffer, int buffer_len)
+{
+	if (buffer_len <= 0) return;
+	long long start = VRD_Internal_Nanoseconds();
+	long long io = 0;
+	VRD_Encoder* enc = &ctx->encoder;
+	switch (enc->codec)
+	{
+#ifdef VRD_USE_ZLIB
+	case VRD_Codec_Deflate:
+	{
+		if (VRD_Internal_EncoderOutput(enc, VRD_ZLIB_COMPRESSION_BUFFER_SIZE) == 0) return;
+		enc->z_strm.avail_in = buffer_len;
+		enc->z_strm.next_in = const_cast<unsigned char*>(buffer);
+		do
+		{
+			enc->z_strm.avail_out = enc->out.capacity;
+			enc->z_strm.next_out = enc->out.data;
+			if (deflate(&enc->z_strm, Z_NO_FLUSH) == Z_STREAM_ERROR) break;
+			int writeCount = enc->out.capacity - enc->z_strm.avail_out;
+			io += VRD_Internal_FileWrite(ctx, enc->out.data, writeCount);
+		} while (enc->z_strm.avail_out == 0);
+		break;
+	}
+#endif
+#ifdef VRD_USE_LZ4
+	case VRD_Codec_LZ4:
+	{
+		int bound = (int)LZ4F_compressBound(buffer_len, &enc->lz4_prefs);
+		if (VRD_Internal_EncoderOutput(enc, bound + LZ4F_HEADER_SIZE_MAX) == 0) return;
+		size_t writeCount = 0;
+		if (!enc->started)
+		{
+			writeCount = LZ4F_compressBegin(enc->lz4, enc->out.data, enc->out.capacity, &enc->lz4_prefs);
+			if (LZ4F_isError(writeCount)) return;
+			enc->started = 1;
+		}
+		size_t ret = LZ4F_compressUpdate(enc->lz4, enc->out.data + writeCount, enc->out.capacity - writeCount, buffer, buffer_len, 0);
+		if (!LZ4F_isError(ret)) writeCount += ret;
+		io += VRD_Internal_FileWrite(ctx, enc->out.data, (int)writeCount);
+		break;
+	}
+#endif
+#ifdef VRD_USE_ZSTD
+	case VRD_Codec_Zstd:
+	{
+		if (VRD_Internal_EncoderOutput(enc, (int)ZSTD_CStreamOutSize()) == 0) return;
+		ZSTD_inBuffer in = { buffer, (size_t)buffer_len, 0 };
+		do
+		{
+			ZSTD_outBuffer out = { enc->out.data, (size_t)enc->out.capacity, 0 };
+			if (ZSTD_isError(ZSTD_compressStream2(enc->zstd, &out, &in, ZSTD_e_continue))) break;
+			io += VRD_Internal_FileWrite(ctx, enc->out.data, (int)out.pos);
+		} while (in.pos < in.size);
+		break;
+	}
+#endif
+	default:
+		io += VRD_Internal_FileWrite(ctx, buffer, buffer_len);
+		break;
+	}
+	VRD_Internal_CountFlush(ctx, buffer_len, VRD_Internal_Nanoseconds() - start - io);
+}
+
+// Ends the compressed stream of a single stream file.
+void VRD_Internal_FinishStream(VRD_replay_context* ctx)
+{
+	long long start = VRD_Internal_Nanoseconds();
+	long long io = 0;
+	VRD_Encoder* enc = &ctx->encoder;
+	switch (enc->codec)
+	{
+#ifdef VRD_USE_ZLIB
+	case VRD_Codec_Deflate:
+	{
+		if (VRD_Internal_EncoderOutput(enc, VRD_ZLIB_COMPRESSION_BUFFER_SIZE) == 0) return;
+		int zret = Z_OK;
+		while (zret != Z_STREAM_END)
+		{
+			enc->z_strm.avail_out = enc->out.capacity;
+			enc->z_strm.next_out = enc->out.data;
+			zret = deflate(&enc->z_strm, Z_FINISH);
+			if (zret == Z_STREAM_ERROR) break;
+			int writeCount = enc->out.capacity - enc->z_strm.avail_out;
+			io += VRD_Internal_FileWrite(ctx, enc->out.data, writeCount);
+		}
+		break;
+	}
+#endif
+#ifdef VRD_USE_LZ4
+	case VRD_Codec_LZ4:
+	{
+		int bound = (int)LZ4F_compressBound(0, &enc->lz4_prefs);
+		if (VRD_Internal_EncoderOutput(enc, bound + LZ4F_HEADER_SIZE_MAX) == 0) return;
+		size_t writeCount = 0;
+		if (!enc->started)
+		{
+			writeCount = LZ4F_compressBegin(enc->lz4, enc->out.data, enc->out.capacity, &enc->lz4_prefs);
+			if (LZ4F_isError(writeCount)) return;
+			enc->started = 1;
+		}
+		size_t ret = LZ4F_compressEnd(enc->lz4, enc->out.data + writeCount, enc->out.capacity - writeCount, 0);
+		if (!LZ4F_isError(ret)) writeCount += ret;
+		io += VRD_Internal_FileWrite(ctx, enc->out.data, (int)writeCount);
+		break;
+	}
+#endif
+#ifdef VRD_USE_ZSTD
+	case VRD_Codec_Zstd:
+	{
+		if (VRD_Internal_EncoderOutput(enc, (int)ZSTD_CStreamOutSize()) == 0) return;
+		ZSTD_inBuffer in = { 0, 0, 0 };
+		size_t remaining = 1;
+		while (remaining != 0)
+		{
+			ZSTD_outBuffer out = { enc->out.data, (size_t)enc->out.capacity, 0 };
+			remaining = ZSTD_compressStream2(enc->zstd, &out, &in, ZSTD_e_end);
+			if (ZSTD_isError(remaining)) break;
+			io += VRD_Internal_FileWrite(ctx, enc->out.data, (int)out.pos);
+		}
+		break;
+	}
+#endif
+	default:
+		return;
+	}
+	VRD_Internal_CountFlush(ctx, 0, VRD_Internal_Nanoseconds() - start - io);
+}
+
+// StringDef blocks must come before the staged blocks referencing them.
+void VRD_Internal_PrependStringDefs(VRD_replay_context* ctx)
+{
+	VRD_StagingBuffer* defs = &ctx->strings.defs;
+	if (defs->size == 0) return;
+	if (ctx->staging.size > 0) VRD_Internal_WriteBytes(defs, ctx->staging.data, ctx->staging.size);
+	if (defs->failed) ctx->staging.failed = 1;
+	VRD_StagingBuffer staging = ctx->staging;
+	ctx->staging = *defs;
+	*defs = staging;
+	defs->size = 0;
+}
+
+bool VRD_Internal_PushChunkIndex(VRD_ChunkIndex* index, int firstFrame, int frameCount, long long offset)
+{
+	if (index->count >= index->capacity)
+	{
+		int capacity = index->capacity > 0 ? index->capacity * 2 : 256;
+		VRD_ChunkIndexEntry* entries = static_cast<VRD_ChunkIndexEntry*>(realloc(index->entries, capacity * sizeof(VRD_ChunkIndexEntry)));
+		if (entries == 0) return false;
+		index->entries = entries;
+		index->capacity = capacity;
+	}
+	VRD_ChunkIndexEntry* entry = &index->entries[index->count++];
+	entry->first_frame = firstFrame;
+	entry->frame_count = frameCount;
+	entry->offset = offset;
+	return true;
+}
+
+// Compresses a whole chunk as an independent stream, in the encoder output (or returns the raw buffer, uncompressed). Returns 0 on failure.
+const unsigned char* VRD_Internal_EncodeChunk(VRD_Encoder* enc, const unsigned char* buffer, int buffer_len, int* storedSize)
+{
+	switch (enc->codec)
+	{
+#ifdef VRD_USE_ZLIB
+	case VRD_Codec_Deflate:
+	{
+		deflateReset(&enc->z_strm);
+		int bound = (int)deflateBound(&enc->z_strm, buffer_len);
+		if (VRD_Internal_EncoderOutput(enc, bound) == 0) return 0;
+		enc->z_strm.avail_in = buffer_len;
+		enc->z_strm.next_in = const_cast<unsigned char*>(buffer);
+		enc->z_strm.avail_out = bound;
+		enc->z_strm.next_out = enc->out.data;
+		if (deflate(&enc->z_strm, Z_FINISH) != Z_STREAM_END) return 0;
+		*storedSize = bound - enc->z_strm.avail_out;
+		return enc->out.data;
+	}
+#endif
+#ifdef VRD_USE_LZ4
+	case VRD_Codec_LZ4:
+	{
+		int bound = (int)LZ4F_compressFrameBound(buffer_len, &enc->lz4_prefs);
+		if (VRD_Internal_EncoderOutput(enc, bound) == 0) return 0;
+		size_t ret = LZ4F_compressFrame(enc->out.data, bound, buffer, buffer_len, &enc->lz4_prefs);
+		if (LZ4F_isError(ret)) return 0;
+		*storedSize = (int)ret;
+		return enc->out.data;
+	}
+#endif
+#ifdef VRD_USE_ZSTD
+	case VRD_Codec_Zstd:
+	{
+		int bound = (int)ZSTD_compressBound(buffer_len);
+		if (VRD_Internal_EncoderOutput(enc, bound) == 0) return 0;
+		size_t ret = ZSTD_compress2(enc->zstd, enc->out.data, bound, buffer, buffer_len);
+		if (ZSTD_isError(ret)) return 0;
+		*storedSize = (int)ret;
+		return enc->out.data;
+	}
+#endif
+	default:
+		*storedSize = buffer_len;
+		return buffer;
+	}
+}
+
+// Writes a chunk with its header: first frame, frame count, raw size, stored size.
+void VRD_Internal_WriteChunkData(VRD_replay_context* ctx, int firstFrame, int frameCount, int rawSize, const unsigned char* stored, int storedSize)
+{
+	if (stored == 0)
+	{
+		ctx->chunk_index.failed = 1; // Out of memory, the chunk is lost
+		return;
+	}
+	int header[4] = { firstFrame, frameCount, rawSize, storedSize };
+	if (ctx->stream)
+	{
+		long long start = VRD_Internal_Nanoseconds();
+		int queued = VRD_Internal_StreamChunk(ctx->stream, header, stored, storedSize);
+		VRD_Internal_CountStored(ctx, queued, VRD_Internal_Nanoseconds() - start);
+		return;
+	}
+	VRD_Internal_FileWrite(ctx, header, sizeof(header));
+	VRD_Internal_FileWrite(ctx, stored, storedSize);
+	if (!VRD_Internal_PushChunkIndex(&ctx->chunk_index, firstFrame, frameCount, ctx->file_offset)) ctx->chunk_index.failed = 1;
+	ctx->file_offset += sizeof(header) + storedSize;
+}
+
+void VRD_Internal_WriteChunk(VRD_replay_context* ctx, const unsigned char* buffer, int buffer_len, int firstFrame, int frameCount)
+{
+	int storedSize = 0;
+	long long start = VRD_Internal_Nanoseconds();
+	const unsigned char* stored = VRD_Internal_EncodeChunk(&ctx->encoder, buffer, buffer_len, &storedSize);
+	VRD_Internal_CountFlush(ctx, buffer_len, VRD_Internal_Nanoseconds() - start);
+	VRD_Internal_WriteChunkData(ctx, firstFrame, frameCount, buffer_len, stored, storedSize);
+}
+
+void VRD_Internal_WriterThread(VRD_replay_context* ctx)
+{
+	VRD_AsyncWriter* writer = ctx->async_writer;
+	while (true)
+	{
+		unsigned int tail = writer->tail.load(std::memory_order_relaxed);
+		if (tail == writer->head.load(std::memory_order_acquire))
+		{
+			if (writer->stop.load(std::memory_order_acquire)) break;
+			std::unique_lock<std::mutex> lock(writer->wake_mutex);
+			writer->wake_writer.wait(lock, [writer, tail] { return writer->head.load(std::memory_order_acquire) != tail || writer->stop.load(std::memory_order_acquire); });
+			continue;
+		}
+
+		VRD_AsyncSlot* slot = &writer->slots[tail % writer->slot_count];
+		if (ctx->chunk_frames) VRD_Internal_WriteChunk(ctx, slot->buffer.data, slot->buffer.size, slot->first_frame, slot->frame_count);
+		else VRD_Internal_Write(ctx, slot->buffer.data, slot->buffer.size);
+		slot->buffer.size = 0;
+		writer->tail.store(tail + 1, std::memory_order_release);
+
+		{ std::lock_guard<std::mutex> lock(writer->wake_mutex); }
+		writer->wake_producer.notify_one();
+	}
+}
+
+void VRD_Internal_CompressWorkerThread(VRD_replay_context* ctx, VRD_CompressWorker* worker)
+{
+	VRD_AsyncWriter* writer = ctx->async_writer;
+	while (true)
+	{
+		unsigned int claim = writer->claim.load(std::memory_order_relaxed);
+		if (claim == writer->head.load(std::memory_order_acquire))
+		{
+			if (writer->stop.load(std::memory_order_acquire)) break;
+			std::unique_lock<std::mutex> lock(writer->wake_mutex);
+			writer->wake_writer.wait(lock, [writer, claim] { return writer->head.load(std::memory_order_acquire) != claim || writer->claim.load(std::memory_order_relaxed) != claim || writer->stop.load(std::memory_order_acquire); });
+			continue;
+		}
+		if (!writer->claim.compare_exchange_weak(claim, claim + 1, std::memory_order_acq_rel)) continue;
+
+		VRD_AsyncSlot* slot = &writer->slots[claim % writer->slot_count];
+		long long start = VRD_Internal_Nanoseconds();
+		slot->stored = VRD_Internal_EncodeChunk(&worker->encoder, slot->buffer.data, slot->buffer.size, &slot->stored_size);
+		VRD_Internal_CountFlush(ctx, slot->buffer.size, VRD_Internal_Nanoseconds() - start);
+		if (slot->stored != slot->buffer.data)
+		{
+			VRD_StagingBuffer compressed = slot->compressed;
+			slot->compressed = worker->encoder.out;
+			worker->encoder.out = compressed;
+		}
+		slot->ready.store(true, std::memory_order_release);
+
+		// Write out every compressed chunk at the tail, in order
+		bool written = false;
+		{
+			std::lock_guard<std::mutex> lock(writer->write_mutex);
+			unsigned int tail = writer->tail.load(std::memory_order_relaxed);
+			while (tail != writer->head.load(std::memory_order_acquire) && writer->slots[tail % writer->slot_count].ready.load(std::memory_order_acquire))
+			{
+				VRD_AsyncSlot* done = &writer->slots[tail % writer->slot_count];
+				VRD_Internal_WriteChunkData(ctx, done->first_frame, done->frame_count, done->buffer.size, done->stored, done->stored_size);
+				done->buffer.size = 0;
+				done->ready.store(false, std::memory_order_relaxed);
+				writer->tail.store(++tail, std::memory_order_release);
+				written = true;
+			}
+		}
+		if (written)
+		{
+			{ std::lock_guard<std::mutex> lock(writer->wake_mutex); }
+			writer->wake_producer.notify_one();
+		}
+	}
+}
+
+void VRD_Internal_StartAsyncWriter(VRD_replay_context* ctx, int queueLength, int compressionThreads)
+{
+	VRD_AsyncWriter* writer = new VRD_AsyncWriter();
+	writer->worker_count = (ctx->chunk_frames && compressionThreads > 1) ? compressionThreads : 0;
+	writer->slot_count = queueLength > 0 ? queueLength : VRD_ASYNC_DEFAULT_QUEUE_LENGTH;
+	if (writer->slot_count < (unsigned int)writer->worker_count * 2) writer->slot_count = writer->worker_count * 2; // Keep all workers busy
+	writer->slots = new (std::nothrow) VRD_AsyncSlot[writer->slot_count]();
+	writer->workers = writer->worker_count ? new (std::nothrow) VRD_CompressWorker[writer->worker_count]() : 0;
+	if (writer->slots == 0 || (writer->worker_count && writer->workers == 0))
+	{
+		delete[] writer->slots;
+		delete writer;
+		return; // Fallback to synchronous writes
+	}
+	writer->head = 0;
+	writer->tail = 0;
+	writer->claim = 0;
+	writer->stop = false;
+	ctx->async_writer = writer;
+	for (int i = 0; i < writer->worker_count; ++i)
+	{
+		if (!VRD_Internal_InitEncoder(&writer->workers[i].encoder, ctx->encoder.codec, ctx->encoder.level, ctx->dictionary.data, ctx->dictionary.size))
+		{
+			// Readers decode every chunk with the file codec, so fallback to the single writer thread
+			for (int j = 0; j <= i; ++j) VRD_Internal_ReleaseEncoder(&writer->workers[j].encoder);
+			delete[] writer->workers;
+			writer->workers = 0;
+			writer->worker_count = 0;
+			break;
+		}
+	}
+	if (writer->worker_count == 0)
+	{
+		writer->thread = std::thread(VRD_Internal_WriterThread, ctx);
+		return;
+	}
+	for (int i = 0; i < writer->worker_count; ++i)
+	{
+		writer->workers[i].thread = std::thread(VRD_Internal_CompressWorkerThread, ctx, &writer->workers[i]);
+	}
+}
+
+void VRD_Internal_StopAsyncWriter(VRD_replay_context* ctx)
+{
+	VRD_AsyncWriter* writer = ctx->async_writer;
+	if (writer == 0) return;
+
+	{
+		std::lock_guard<std::mutex> lock(writer->wake_mutex);
+		writer->stop = true;
+	}
+	writer->wake_writer.notify_all();
+	if (writer->thread.joinable()) writer->thread.join();
+	for (int i = 0; i < writer->worker_count; ++i)
+	{
+		writer->workers[i].thread.join();
+		VRD_Internal_ReleaseEncoder(&writer->workers[i].encoder);
+	}
+
+	for (unsigned int i = 0; i < writer->slot_count; ++i)
+	{
+		free(writer->slots[i].buffer.data);
+		free(writer->slots[i].compressed.data);
+	}
+	delete[] writer->slots;
+	delete[] writer->workers;
+	delete writer;
+	ctx->async_writer = 0;
+}
+
+// Hands the staging buffer over to the writer thread, and takes an empty one from the ring in exchange.
+// Returns false if the staged blocks are held back by the backpressure policy.
+bool VRD_Internal_SubmitAsync(VRD_replay_context* ctx, bool drain)
+{
+	VRD_AsyncWriter* writer = ctx->async_writer;
+	unsigned int head = writer->head.load(std::memory_order_relaxed);
+	if (head - writer->tail.load(std::memory_order_acquire) >= writer->slot_count)
+	{
+		enum VRD_BackpressurePolicy policy = drain ? VRD_Backpressure_Block : ctx->backpressure;
+		if (policy == VRD_Backpressure_Grow || (policy == VRD_Backpressure_DropFrame && ctx->chunk_frames))
+		{
+			// Chunks must stay self-contained, so they are never dropped
+			return false; // Keep accumulating, this goes out with the next flush
+		}
+		else if (policy == VRD_Backpressure_DropFrame)
+		{
+			// Keep entity defs and undefs, so that ids still map to their entities, and frame steps, so that frame numbers still line up with frame times
+			ctx->staging.size = 0;
+			if (ctx->kept.size > 0) VRD_Internal_WriteBytes(&ctx->staging, ctx->kept.data, ctx->kept.size);
+			if (ctx->delta_transforms)
+			{
+				// The dropped deltas broke the chains, the next transform of each entity is a full value
+				VRD_EntityStates* states = &ctx->entity_states;
+				for (int i = 0; i < states->capacity; ++i)
+				{
+					if (states->items[i].id != 0) states->items[i].full_frame = -1;
+				}
+			}
+			return false;
+		}
+
+		std::unique_lock<std::mutex> lock(writer->wake_mutex);
+		writer->wake_producer.wait(lock, [writer, head] { return head - writer->tail.load(std::memory_order_acquire) < writer->slot_count; });
+	}
+
+	VRD_Internal_PrependStringDefs(ctx);
+	VRD_AsyncSlot* slot = &writer->slots[head % writer->slot_count];
+	VRD_StagingBuffer empty = slot->buffer;
+	slot->buffer = ctx->staging;
+	slot->first_frame = ctx->chunk_first_frame;
+	slot->frame_count = ctx->frame - ctx->chunk_first_frame;
+	ctx->staging = empty;
+	ctx->staging.size = 0;
+	ctx->kept.size = 0;
+	writer->head.store(head + 1, std::memory_order_release);
+
+	{ std::lock_guard<std::mutex> lock(writer->wake_mutex); }
+	writer->wake_writer.notify_one();
+	return true;
+}
+
+// Returns false if the staged blocks were held back by the backpressure policy.
+bool VRD_Internal_Flush(VRD_replay_context* ctx, bool drain)
+{
+	ctx->frames_since_flush = 0;
+	if (ctx->async_writer)
+	{
+		if (!VRD_Internal_SubmitAsync(ctx, drain)) return false;
+	}
+	else if (ctx->chunk_frames)
+	{
+		VRD_Internal_PrependStringDefs(ctx);
+		VRD_Internal_WriteChunk(ctx, ctx->staging.data, ctx->staging.size, ctx->chunk_first_frame, ctx->frame - ctx->chunk_first_frame);
+		ctx->staging.size = 0;
+	}
+	else
+	{
+		VRD_Internal_Write(ctx, ctx->strings.defs.data, ctx->strings.defs.size);
+		ctx->strings.defs.size = 0;
+		VRD_Internal_Write(ctx, ctx->staging.data, ctx->staging.size);
+		ctx->staging.size = 0;
+	}
+	return true;
+}
+
+VRD_ThreadLane* VRD_Internal_GetThreadLane(VRD_replay_context* ctx, int lane)
+{
+	VRD_ThreadLanes* lanes = ctx->thread_lanes;
+	std::lock_guard<std::mutex> lock(lanes->mutex);
+
+	VRD_ThreadLane* threadLane = (VRD_TlsLane.context_serial == ctx->serial) ? VRD_TlsLane.lane : 0;
+	if (threadLane)
+	{
+		if (lane == VRD_AUTO_THREAD_LANE || threadLane->lane == lane) return threadLane;
+
+		// Explicit lane change, unlink and re-insert below
+		VRD_ThreadLane** it = &lanes->first;
+		while (*it != threadLane) it = &(*it)->next;
+		*it = threadLane->next;
+	}
+	else
+	{
+		threadLane = static_cast<VRD_ThreadLane*>(calloc(1, sizeof(VRD_ThreadLane)));
+		if (threadLane == 0) return 0;
+	}
+
+	threadLane->lane = (lane != VRD_AUTO_THREAD_LANE) ? lane : lanes->next_auto_lane++;
+	VRD_ThreadLane** it = &lanes->first;
+	while (*it && (*it)->lane <= threadLane->lane) it = &(*it)->next;
+	threadLane->next = *it;
+	*it = threadLane;
+
+	VRD_TlsLane.context_serial = ctx->serial;
+	VRD_TlsLane.lane = threadLane;
+	return threadLane;
+}
+
+// Appends all per-thread blocks to the context staging buffer, in lane order.
+void VRD_Internal_SpliceThreadLanes(VRD_replay_context* ctx)
+{
+	if (ctx->thread_lanes == 0) return;
+	for (VRD_ThreadLane* it = ctx->thread_lanes->first; it != 0; it = it->next)
+	{
+		if (it->staging.failed) ctx->staging.failed = 1;
+		if (it->staging.size > 0) VRD_Internal_WriteBytes(&ctx->staging, it->staging.data, it->staging.size);
+		it->staging.size = 0;
+	}
+}
+
+void VRD_Internal_ReleaseThreadLanes(VRD_replay_context* ctx)
+{
+	if (ctx->thread_lanes == 0) return;
+	VRD_ThreadLane* it = ctx->thread_lanes->first;
+	while (it)
+	{
+		VRD_ThreadLane* next = it->next;
+		free(it->staging.data);
+		VRD_Internal_ReleaseCounters(&it->counters);
+		free(it);
+		it = next;
+	}
+	delete ctx->thread_lanes;
+	ctx->thread_lanes = 0;
+}
+
+static inline unsigned int VRD_Internal_HashString(const char* s, int* len)
+{
+	unsigned int hash = 2166136261u; // FNV-1a
+	const char* it = s;
+	while (*it)
+	{
+		hash = (hash ^ (unsigned char)*it) * 16777619u;
+		++it;
+	}
+	*len = (int)(it - s);
+	return hash;
+}
+
+// Counters of the calling thread: its lane for multithreaded contexts.
+static inline VRD_CaptureCounters* VRD_Internal_Counters(VRD_replay_context* ctx)
+{
+	if (ctx->thread_lanes && VRD_TlsLane.context_serial == ctx->serial && VRD_TlsLane.lane) return &VRD_TlsLane.lane->counters;
+	return &ctx->counters;
+}
+
+static inline void VRD_Internal_CountBlock(VRD_CaptureCounters* counters, int blockType, int size)
+{
+	counters->calls[blockType] += 1;
+	counters->bytes[blockType] += size;
+}
+
+bool VRD_Internal_GrowCategoryCounters(VRD_CaptureCounters* counters)
+{
+	int capacity = counters->category_capacity > 0 ? counters->category_capacity * 2 : 64;
+	VRD_CategoryCounter* items = static_cast<VRD_CategoryCounter*>(calloc(capacity, sizeof(VRD_CategoryCounter)));
+	if (items == 0) return false;
+	for (int i = 0; i < counters->category_capacity; ++i)
+	{
+		VRD_CategoryCounter* item = &counters->categories[i];
+		if (item->name == 0) continue;
+		int index = item->hash & (capacity - 1);
+		while (items[index].name != 0) index = (index + 1) & (capacity - 1);
+		items[index] = *item;
+	}
+	free(counters->categories);
+	counters->categories = items;
+	counters->category_capacity = capacity;
+	counters->last_ptr = 0;
+	return true;
+}
+
+// Returns the counter of a category, added on first use. 0 without category, or when out of memory (the block is only counted per type).
+VRD_CategoryCounter* VRD_Internal_GetCategoryCounter(VRD_CaptureCounters* counters, const char* category)
+{
+	if (category == 0 || *category == 0) return 0;
+	if (counters->last_ptr == category && strcmp(counters->last_category->name, category) == 0) return counters->last_category;
+
+	int len;
+	unsigned int hash = VRD_Internal_HashString(category, &len);
+	VRD_CategoryCounter* item = 0;
+	if (counters->category_capacity > 0)
+	{
+		int index = hash & (counters->category_capacity - 1);
+		while (counters->categories[index].name != 0 && item == 0)
+		{
+			VRD_CategoryCounter* it = &counters->categories[index];
+			if (it->hash == hash && it->len == len && memcmp(it->name, category, len) == 0) item = it;
+			index = (index + 1) & (counters->category_capacity - 1);
+		}
+	}
+	if (item == 0)
+	{
+		if ((counters->category_count + 1) * 2 > counters->category_capacity && !VRD_Internal_GrowCategoryCounters(counters)) return 0;
+		char* name = static_cast<char*>(malloc(len + 1));
+		if (name == 0) return 0;
+		memcpy(name, category, len + 1);
+		int index = hash & (counters->category_capacity - 1);
+		while (counters->categories[index].name != 0) index = (index + 1) & (counters->category_capacity - 1);
+		item = &counters->categories[index];
+		item->hash = hash;
+		item->len = len;
+		item->name = name;
+		counters->category_count += 1;
+	}
+	counters->last_ptr = category;
+	counters->last_category = item;
+	return item;
+}
+
+void VRD_Internal_ReleaseCounters(VRD_CaptureCounters* counters)
+{
+	for (int i = 0; i < counters->category_capacity; ++i)
+	{
+		free(counters->categories[i].name);
+	}
+	free(counters->categories);
+	free(counters->log_markers);
+	memset(counters, 0, sizeof(VRD_CaptureCounters));
+}
+
+// Returns the filter of a category, added on first use. The fallback filter for a null category, 0 when the table is full or out of memory.
+VRD_CategoryFilter* VRD_Internal_AddCategoryFilter(VRD_CategoryFilters* filters, const char* category)
+{
+	if (category == 0) return &filters->fallback;
+	const int capacity = VRD_CATEGORY_FILTER_MAX_COUNT * 2;
+	int len;
+	unsigned int hash = VRD_Internal_HashString(category, &len);
+	int index = hash & (capacity - 1);
+	while (filters->items[index].name != 0)
+	{
+		VRD_CategoryFilter* it = &filters->items[index];
+		if (it->hash == hash && it->len == len && memcmp(it->name, category, len) == 0) return it;
+		index = (index + 1) & (capacity - 1);
+	}
+	if (filters->count >= VRD_CATEGORY_FILTER_MAX_COUNT) return 0;
+	char* name = static_cast<char*>(malloc(len + 1));
+	if (name == 0) return 0;
+	memcpy(name, category, len + 1);
+	VRD_CategoryFilter* item = &filters->items[index];
+	item->hash = hash;
+	item->len = len;
+	item->name = name;
+	filters->count += 1;
+	return item;
+}
+
+// Only hashes the category, counters are atomic since calls can come from any thread of a multithreaded context.
+bool VRD_Internal_AcceptCategory(VRD_CategoryFilters* filters, const char* category)
+{
+	VRD_CategoryFilter* filter = &filters->fallback;
+	if (category != 0 && *category != 0 && filters->count > 0)
+	{
+		const int capacity = VRD_CATEGORY_FILTER_MAX_COUNT * 2;
+		int len;
+		unsigned int hash = VRD_Internal_HashString(category, &len);
+		int index = hash & (capacity - 1);
+		while (filters->items[index].name != 0)
+		{
+			VRD_CategoryFilter* it = &filters->items[index];
+			if (it->hash == hash && it->len == len && memcmp(it->name, category, len) == 0)
+			{
+				filter = it;
+				break;
+			}
+			index = (index + 1) & (capacity - 1);
+		}
+	}
+	if (!filter->enabled) return false;
+	if (filter->sample_every > 0 && filter->sample_calls.fetch_add(1, std::memory_order_relaxed) % filter->sample_every != 0) return false;
+	if (filter->max_per_frame > 0 && filter->frame_calls.fetch_add(1, std::memory_order_relaxed) >= filter->max_per_frame) return false;
+	return true;
+}
+
+void VRD_Internal_ResetCategoryFilters(VRD_CategoryFilters* filters)
+{
+	for (int i = 0; i < VRD_CATEGORY_FILTER_MAX_COUNT * 2; ++i)
+	{
+		if (filters->items[i].name != 0) filters->items[i].frame_calls.store(0, std::memory_order_relaxed);
+	}
+	filters->fallback.frame_calls.store(0, std::memory_order_relaxed);
+}
+
+void VRD_Internal_ReleaseCategoryFilters(VRD_replay_context* ctx)
+{
+	if (ctx->category_filters == 0) return;
+	for (int i = 0; i < VRD_CATEGORY_FILTER_MAX_COUNT * 2; ++i)
+	{
+		free(ctx->category_filters->items[i].name);
+	}
+	delete ctx->category_filters;
+	ctx->category_filters = 0;
+}
+
+// Moves the counters of all thread lanes to the context counters. Same constraints as splicing the lanes.
+void VRD_Internal_MergeLaneCounters(VRD_replay_context* ctx)
+{
+	if (ctx->thread_lanes == 0) return;
+	for (VRD_ThreadLane* it = ctx->thread_lanes->first; it != 0; it = it->next)
+	{
+		VRD_CaptureCounters* counters = &it->counters;
+		for (int i = 0; i < VRD_STATS_BLOCK_TYPE_COUNT; ++i)
+		{
+			ctx->counters.calls[i] += counters->calls[i];
+			ctx->counters.bytes[i] += counters->bytes[i];
+			counters->calls[i] = 0;
+			counters->bytes[i] = 0;
+		}
+		for (int i = 0; i < counters->category_capacity; ++i)
+		{
+			VRD_CategoryCounter* item = &counters->categories[i];
+			if (item->name == 0 || item->calls == 0) continue;
+			VRD_CategoryCounter* merged = VRD_Internal_GetCategoryCounter(&ctx->counters, item->name);
+			if (merged == 0) continue;
+			merged->calls += item->calls;
+			merged->bytes += item->bytes;
+			merged->kinds |= item->kinds;
+			item->calls = 0;
+			item->bytes = 0;
+		}
+		for (int kind = 0; kind < VRD_SummaryKind_Count; ++kind)
+		{
+			for (int i = 0; i < 8; ++i) ctx->counters.colors[kind][i] |= counters->colors[kind][i];
+		}
+		ctx->counters.uncategorized |= counters->uncategorized;
+		if (counters->log_marker_count > 0)
+		{
+			VRD_CaptureCounters* merged = &ctx->counters;
+			int count = merged->log_marker_count + counters->log_marker_count;
+			if (count > merged->log_marker_capacity)
+			{
+				int capacity = merged->log_marker_capacity > 0 ? merged->log_marker_capacity : 1024;
+				while (capacity < count) capacity *= 2;
+				VRD_LogMarker* markers = static_cast<VRD_LogMarker*>(realloc(merged->log_markers, capacity * sizeof(VRD_LogMarker)));
+				if (markers == 0)
+				{
+					if (ctx->summary) ctx->summary->failed = 1;
+					continue;
+				}
+				merged->log_markers = markers;
+				merged->log_marker_capacity = capacity;
+			}
+			memcpy(merged->log_markers + merged->log_marker_count, counters->log_markers, counters->log_marker_count * sizeof(VRD_LogMarker));
+			merged->log_marker_count = count;
+			counters->log_marker_count = 0;
+		}
+	}
+}
+
+bool VRD_Internal_GrowStringTable(VRD_StringTable* table)
+{
+	int capacity = table->capacity > 0 ? table->capacity * 2 : 1024;
+	VRD_StringTableItem* items = static_cast<VRD_StringTableItem*>(calloc(capacity, sizeof(VRD_StringTableItem)));
+	if (items == 0) return false;
+	for (int i = 0; i < table->capacity; ++i)
+	{
+		VRD_StringTableItem* item = &table->items[i];
+		if (item->id == 0) continue;
+		int index = item->hash & (capacity - 1);
+		while (items[index].id != 0) index = (index + 1) & (capacity - 1);
+		items[index] = *item;
+	}
+	free(table->items);
+	table->items = items;
+	table->capacity = capacity;
+	return true;
+}
+
+static inline void VRD_Internal_WriteStringDef(VRD_StagingBuffer* buf, const VRD_StringTableItem* item)
+{
+	VRD_Internal_Write7BitEncodedInt(buf, StringDef);
+	VRD_Internal_Write7BitEncodedInt(buf, item->id);
+	VRD_Internal_Write7BitEncodedInt(buf, item->len);
+	VRD_Internal_WriteBytes(buf, item->str, item->len);
+}
+
+// Returns the id of the string, defining it on first use. Caller holds the thread lanes lock, if any.
+const VRD_StringTableItem* VRD_Internal_LookupString(VRD_replay_context* ctx, const char* s, VRD_CaptureCounters* counters)
+{
+	VRD_StringTable* table = &ctx->strings;
+	int len;
+	unsigned int hash = VRD_Internal_HashString(s, &len);
+	if (table->capacity > 0)
+	{
+		int index = hash & (table->capacity - 1);
+		while (table->items[index].id != 0)
+		{
+			VRD_StringTableItem* item = &table->items[index];
+			if (item->hash == hash && item->len == len && memcmp(item->str, s, len) == 0) return item;
+			index = (index + 1) & (table->capacity - 1);
+		}
+	}
+
+	if (table->count >= VRD_STRING_TABLE_MAX_COUNT) return 0;
+	if ((table->count + 1) * 2 > table->capacity && !VRD_Internal_GrowStringTable(table)) return 0;
+
+	char* str = static_cast<char*>(malloc(len + 1));
+	if (str == 0) return 0;
+	memcpy(str, s, len + 1);
+
+	int index = hash & (table->capacity - 1);
+	while (table->items[index].id != 0) index = (index + 1) & (table->capacity - 1);
+	VRD_StringTableItem* item = &table->items[index];
+	item->hash = hash;
+	item->id = ++table->count;
+	item->len = len;
+	item->str = str;
+
+	int size = table->defs.size;
+	VRD_Internal_WriteStringDef(&table->defs, item);
+	VRD_Internal_CountBlock(counters, StringDef, table->defs.size - size);
+	return item;
+}
+
+// Label id to write with VRD_Internal_WriteLabel: -1 when interning is off, 0 to write inline.
+int VRD_Internal_InternString(VRD_replay_context* ctx, const char* s)
+{
+	if (!ctx->intern_strings) return -1;
+	if (s == 0 || *s == 0) return 0;
+
+	VRD_StringCache* cache = &ctx->string_cache;
+	VRD_CaptureCounters* counters = &ctx->counters;
+	if (ctx->thread_lanes)
+	{
+		VRD_ThreadLane* lane = (VRD_TlsLane.context_serial == ctx->serial) ? VRD_TlsLane.lane : VRD_Internal_GetThreadLane(ctx, VRD_AUTO_THREAD_LANE);
+		if (lane == 0) return 0;
+		cache = &lane->string_cache;
+		counters = &lane->counters;
+	}
+
+	VRD_StringCacheItem* cached = &cache->items[((size_t)s >> 3) & (VRD_STRING_POINTER_CACHE_SIZE - 1)];
+	if (cached->ptr == s && strcmp(cached->str, s) == 0) return cached->id;
+
+	std::unique_lock<std::mutex> lock;
+	if (ctx->thread_lanes) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+	const VRD_StringTableItem* item = VRD_Internal_LookupString(ctx, s, counters);
+	if (item == 0) return 0;
+
+	cached->ptr = s;
+	cached->str = item->str;
+	cached->id = item->id;
+	return item->id;
+}
+
+void VRD_Internal_ReleaseStringTable(VRD_replay_context* ctx)
+{
+	VRD_StringTable* table = &ctx->strings;
+	for (int i = 0; i < table->capacity; ++i)
+	{
+		free(table->items[i].str);
+	}
+	free(table->items);
+	free(table->defs.data);
+	memset(table, 0, sizeof(VRD_StringTable));
+}
+
+///
+/// Mesh cache
+///
+
+// The verts are hashed on every draw: four independent lanes of 8 bytes, so the multiplies overlap.
+static inline unsigned long long VRD_Internal_HashBytes(const void* data, size_t len)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	unsigned long long lanes[4] = { 0x9e3779b97f4a7c15ull ^ len, 0xbf58476d1ce4e5b9ull, 0x94d049bb133111ebull, 0xff51afd7ed558ccdull };
+	for (; len >= 32; p += 32, len -= 32)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			unsigned long long word;
+			memcpy(&word, p + i * 8, 8);
+			lanes[i] = (lanes[i] ^ word) * 0xc4ceb9fe1a85ec53ull;
+			lanes[i] ^= lanes[i] >> 29;
+		}
+	}
+	unsigned long long hash = lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7);
+	for (; len > 0; ++p, --len) hash = (hash ^ *p) * 0x100000001b3ull;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+bool VRD_Internal_GrowMeshCache(VRD_MeshCache* cache)
+{
+	int capacity = cache->capacity > 0 ? cache->capacity * 2 : 64;
+	VRD_MeshCacheItem* items = static_cast<VRD_MeshCacheItem*>(calloc(capacity, sizeof(VRD_MeshCacheItem)));
+	if (items == 0) return false;
+	for (int i = 0; i < cache->capacity; ++i)
+	{
+		VRD_MeshCacheItem* item = &cache->items[i];
+		if (item->id == 0) continue;
+		int index = (int)item->key & (capacity - 1);
+		while (items[index].id != 0) index = (index + 1) & (capacity - 1);
+		items[index] = *item;
+	}
+	free(cache->items);
+	cache->items = items;
+	cache->capacity = capacity;
+	return true;
+}
+
+void VRD_Internal_RemoveMesh(VRD_MeshCache* cache, int index)
+{
+	VRD_MeshCacheItem* item = &cache->items[index];
+	cache->bytes -= (long long)item->vert_count * sizeof(VRD_Point);
+	cache->count -= 1;
+	free(item->verts);
+	VRD_Internal_RemoveSlot(cache->items, cache->capacity - 1, index, [](const VRD_MeshCacheItem& mesh) { return mesh.key; });
+}
+
+// Clock eviction, close to least recently drawn first: the hand spares the meshes drawn since it last passed, once, and evicts the first one that was not.
+// Only runs once the budget is reached.
+void VRD_Internal_EvictMeshes(VRD_MeshCache* cache, long long bytes)
+{
+	while (cache->count > 0 && cache->bytes + bytes > cache->budget)
+	{
+		int index = cache->hand & (cache->capacity - 1);
+		VRD_MeshCacheItem* item = &cache->items[index];
+		if (item->id != 0 && !item->referenced)
+		{
+			VRD_Internal_RemoveMesh(cache, index); // The hand stays, the shift may have moved another mesh into the slot
+			continue;
+		}
+		item->referenced = 0;
+		cache->hand = index + 1;
+	}
+}
+
+static inline void VRD_Internal_WriteMeshDef(VRD_StagingBuffer* buf, const VRD_MeshCacheItem* item)
+{
+	VRD_Internal_Write7BitEncodedInt(buf, MeshDef);
+	VRD_Internal_Write7BitEncodedInt(buf, item->id);
+	VRD_Internal_Write7BitEncodedInt(buf, item->vert_count);
+	VRD_Internal_WriteBytes(buf, item->verts, item->vert_count * (int)sizeof(VRD_Point));
+}
+
+// Returns the id of the mesh, defining it on first use, or 0 if it does not fit in the cache. Caller holds the thread lanes lock, if any.
+int VRD_Internal_LookupMesh(VRD_replay_context* ctx, unsigned long long meshKey, VRD_Point* verts, int vertCount, VRD_CaptureCounters* counters)
+{
+	VRD_MeshCache* cache = &ctx->meshes;
+	long long bytes = (long long)vertCount * sizeof(VRD_Point);
+	if (bytes > cache->budget || bytes > 0x7fffffff) return 0;
+	int handle = meshKey != 0;
+	unsigned long long key = handle ? VRD_Internal_HashBytes(&meshKey, sizeof(meshKey)) : VRD_Internal_HashBytes(verts, (size_t)bytes);
+
+	if (cache->capacity > 0)
+	{
+		int mask = cache->capacity - 1;
+		for (int index = (int)key & mask; cache->items[index].id != 0; index = (index + 1) & mask)
+		{
+			VRD_MeshCacheItem* item = &cache->items[index];
+			if (item->key != key || item->handle != handle) continue;
+			if (handle ? item->vert_count != vertCount : (item->vert_count != vertCount || memcmp(item->verts, verts, (size_t)bytes) != 0)) continue;
+			item->referenced = 1;
+			return item->id;
+		}
+	}
+
+	// Keys are remapped when their verts change, the old mesh ages out
+	VRD_Internal_EvictMeshes(cache, bytes);
+	if ((cache->count + 1) * 2 > cache->capacity && !VRD_Internal_GrowMeshCache(cache)) return 0;
+	VRD_Point* copy = static_cast<VRD_Point*>(malloc((size_t)bytes));
+	if (copy == 0) return 0;
+	memcpy(copy, verts, (size_t)bytes);
+
+	int mask = cache->capacity - 1;
+	int index = (int)key & mask;
+	while (cache->items[index].id != 0) index = (index + 1) & mask;
+	VRD_MeshCacheItem* item = &cache->items[index];
+	item->key = key;
+	item->handle = handle;
+	item->id = ++cache->next_id;
+	item->vert_count = vertCount;
+	item->verts = copy;
+	item->referenced = 0; // Spared once drawn again, so meshes drawn only once go first
+	cache->count += 1;
+	cache->bytes += bytes;
+
+	VRD_StagingBuffer* defs = &ctx->strings.defs;
+	int size = defs->size;
+	VRD_Internal_WriteMeshDef(defs, item);
+	VRD_Internal_CountBlock(counters, MeshDef, defs->size - size);
+	return item->id;
+}
+
+void VRD_Internal_ReleaseMeshCache(VRD_replay_context* ctx)
+{
+	VRD_MeshCache* cache = &ctx->meshes;
+	for (int i = 0; i < cache->capacity; ++i)
+	{
+		free(cache->items[i].verts);
+	}
+	free(cache->items);
+	long long budget = cache->budget;
+	memset(cache, 0, sizeof(VRD_MeshCache));
+	cache->budget = budget;
+}
+
+static inline unsigned int VRD_Internal_HashInt(unsigned int x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+VRD_EntityState* VRD_Internal_FindEntityState(VRD_replay_context* ctx, int entityId)
+{
+	VRD_EntityStates* states = &ctx->entity_states;
+	if (states->count == 0) return 0;
+	int index = VRD_Internal_HashInt(entityId) & (states->capacity - 1);
+	while (states->items[index].id != 0)
+	{
+		if (states->items[index].id == entityId) return &states->items[index];
+		index = (index + 1) & (states->capacity - 1);
+	}
+	return 0;
+}
+
+VRD_EntityState* VRD_Internal_GetEntityState(VRD_replay_context* ctx, int entityId)
+{
+	VRD_EntityStates* states = &ctx->entity_states;
+	if ((states->count + 1) * 2 > states->capacity)
+	{
+		int capacity = states->capacity > 0 ? states->capacity * 2 : 1024;
+		VRD_EntityState* items = static_cast<VRD_EntityState*>(calloc(capacity, sizeof(VRD_EntityState)));
+		if (items == 0) return 0;
+		for (int i = 0; i < states->capacity; ++i)
+		{
+			if (states->items[i].id == 0) continue;
+			int index = VRD_Internal_HashInt(states->items[i].id) & (capacity - 1);
+			while (items[index].id != 0) index = (index + 1) & (capacity - 1);
+			items[index] = states->items[i];
+		}
+		free(states->items);
+		states->items = items;
+		states->capacity = capacity;
+	}
+
+	int index = VRD_Internal_HashInt(entityId) & (states->capacity - 1);
+	while (states->items[index].id != 0)
+	{
+		if (states->items[index].id == entityId) return &states->items[index];
+		index = (index + 1) & (states->capacity - 1);
+	}
+	VRD_EntityState* state = &states->items[index];
+	memset(state, 0, sizeof(VRD_EntityState));
+	state->id = entityId;
+	state->full_frame = -1; // first write is a full value
+	state->xform = VRD_Identity;
+	states->count += 1;
+	return state;
+}
+
+void VRD_Internal_FreeEntityState(VRD_EntityState* state)
+{
+	free(state->def.data);
+	for (int i = 0; i < state->param_count; ++i)
+	{
+		free(state->params[i].key);
+		free(state->params[i].str);
+	}
+	free(state->params);
+}
+
+void VRD_Internal_RemoveEntityState(VRD_replay_context* ctx, int entityId)
+{
+	VRD_EntityStates* states = &ctx->entity_states;
+	if (states->count == 0) return;
+	int mask = states->capacity - 1;
+	int index = VRD_Internal_HashInt(entityId) & mask;
+	while (states->items[index].id != entityId)
+	{
+		if (states->items[index].id == 0) return;
+		index = (index + 1) & mask;
+	}
+
+	VRD_Internal_FreeEntityState(&states->items[index]);
+	VRD_Internal_RemoveSlot(states->items, mask, index, [](const VRD_EntityState& state) { return VRD_Internal_HashInt(state.id); });
+	states->count -= 1;
+}
+
+void VRD_Internal_ReleaseEntityStates(VRD_replay_context* ctx)
+{
+	VRD_EntityStates* states = &ctx->entity_states;
+	for (int i = 0; i < states->capacity; ++i)
+	{
+		if (states->items[i].id != 0) VRD_Internal_FreeEntityState(&states->items[i]);
+	}
+	free(states->items);
+	memset(states, 0, sizeof(VRD_EntityStates));
+}
+
+static inline char* VRD_Internal_CopyString(const char* s, size_t len)
+{
+	char* copy = static_cast<char*>(malloc(len + 1));
+	if (copy == 0) return 0;
+	memcpy(copy, s, len);
+	copy[len] = 0;
+	return copy;
+}
+
+static inline char* VRD_Internal_CopyString(const char* s)
+{
+	return VRD_Internal_CopyString(s, strlen(s));
+}
+
+void VRD_Internal_RecordEntityTransform(VRD_replay_context* ctx, int entityId, VRD_Point* pos, VRD_Quaternion* rot)
+{
+	std::unique_lock<std::mutex> lock;
+	if (ctx->thread_lanes) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+	VRD_EntityState* state = VRD_Internal_GetEntityState(ctx, entityId);
+	if (state == 0) return; // Only missing from keyframes
+	state->xform.translation = pos ? *pos : VRD_PointZero;
+	if (rot) state->xform.rotation = *rot;
+	state->has_xform = 1;
+}
+
+void VRD_Internal_RecordEntityParam(VRD_replay_context* ctx, int entityId, const char* key, const char* str, int strLength, float value)
+{
+	std::unique_lock<std::mutex> lock;
+	if (ctx->thread_lanes) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+	VRD_EntityState* state = VRD_Internal_GetEntityState(ctx, entityId);
+	if (state == 0 || key == 0) return;
+
+	VRD_EntityParam* param = 0;
+	for (int i = 0; i < state->param_count && param == 0; ++i)
+	{
+		if (strcmp(state->params[i].key, key) == 0) param = &state->params[i];
+	}
+	if (param == 0)
+	{
+		if (state->param_count >= state->param_capacity)
+		{
+			int capacity = state->param_capacity > 0 ? state->param_capacity * 2 : 4;
+			VRD_EntityParam* params = static_cast<VRD_EntityParam*>(realloc(state->params, capacity * sizeof(VRD_EntityParam)));
+			if (params == 0) return;
+			state->params = params;
+			state->param_capacity = capacity;
+		}
+		char* keyCopy = VRD_Internal_CopyString(key);
+		if (keyCopy == 0) return;
+		param = &state->params[state->param_count++];
+		param->key = keyCopy;
+		param->str = 0;
+	}
+
+	free(param->str);
+	param->str = str ? VRD_Internal_CopyString(str, strLength) : 0;
+	param->value = value;
+}
+
+static inline int VRD_Internal_QuantizePosition(VRD_replay_context* ctx, float value)
+{
+	float q = value * ctx->inv_position_quantum;
+	if (q > 2147483000.0f) q = 2147483000.0f;
+	if (q < -2147483000.0f) q = -2147483000.0f;
+	return (int)(q < 0 ? q - 0.5f : q + 0.5f);
+}
+
+// Smallest three: the largest component is dropped (and made positive), the others fit in [-1/sqrt(2), 1/sqrt(2)].
+static inline unsigned char VRD_Internal_QuantizeRotation(const VRD_Quaternion* rot, unsigned short* out)
+{
+	float c[4] = { rot->x, rot->y, rot->z, rot->w };
+	float len = sqrtf(c[0] * c[0] + c[1] * c[1] + c[2] * c[2] + c[3] * c[3]);
+	if (len <= 0.0f) { c[3] = 1.0f; len = 1.0f; }
+
+	unsigned char largest = 0;
+	for (unsigned char i = 1; i < 4; ++i)
+	{
+		if (fabsf(c[i]) > fabsf(c[largest])) largest = i;
+	}
+	float scale = (c[largest] < 0 ? -1.0f : 1.0f) / len;
+
+	int n = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (i == largest) continue;
+		float v = (c[i] * scale * 0.70710678f) + 0.5f; // [-1/sqrt(2), 1/sqrt(2)] to [0, 1]
+		if (v < 0) v = 0;
+		if (v > 1) v = 1;
+		out[n++] = (unsigned short)(v * 65535.0f + 0.5f);
+	}
+	return largest;
+}
+
+static inline void VRD_Internal_WriteZigZag(VRD_StagingBuffer* buf, int value)
+{
+	VRD_Internal_Write7BitEncodedInt(buf, (int)(((unsigned int)value << 1) ^ (unsigned int)(value >> 31)));
+}
+
+static inline void VRD_Internal_Write7BitEncodedInt64(VRD_StagingBuffer* buf, unsigned long long value)
+{
+	unsigned char* p = VRD_Internal_Reserve(buf, 10);
+	if (p == 0) return;
+	int len = 0;
+	while (value >= 0x80)
+	{
+		p[len++] = (unsigned char)(value | 0x80);
+		value = value >> 7;
+	}
+	p[len++] = (unsigned char)value;
+	buf->size -= 10 - len;
+}
+
+static inline void VRD_Internal_WriteZigZag64(VRD_StagingBuffer* buf, long long value)
+{
+	VRD_Internal_Write7BitEncodedInt64(buf, ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+// Prefixes the bytes written since start with their size, for data that is only sized once written.
+static inline void VRD_Internal_PrefixSize(VRD_StagingBuffer* buf, int start)
+{
+	int size = buf->size - start;
+	unsigned char prefix[5];
+	int prefixLen = VRD_Internal_Encode7BitEncodedInt(prefix, size);
+	if (VRD_Internal_Reserve(buf, prefixLen) == 0) return;
+	memmove(buf->data + start + prefixLen, buf->data + start, size);
+	memcpy(buf->data + start, prefix, prefixLen);
+}
+
+// Arguments of a printf format, in order: * widths and precisions as zigzag ints, signed integers as zigzag 64 bits, unsigned integers, chars
+// and pointers as 7 bit encoded 64 bits, floating point as doubles and strings inline, up to their precision. Integers are narrowed as printf would (%hhu, %hd...).
+// Stops at the first conversion it does not know, whose arguments can't be skipped.
+static void VRD_Internal_WriteLogArgs(VRD_StagingBuffer* buf, const char* format, va_list args)
+{
+	for (const char* f = format; *f; ++f)
+	{
+		if (*f != '%') continue;
+		if (*++f == '%') continue;
+		while (*f == '-' || *f == '+' || *f == ' ' || *f == '#' || *f == '0') ++f;
+		if (*f == '*') { VRD_Internal_WriteZigZag(buf, va_arg(args, int)); ++f; }
+		else while (*f >= '0' && *f <= '9') ++f;
+		int precision = -1; // Bounds %s, whose string may not be null terminated
+		if (*f == '.')
+		{
+			++f;
+			if (*f == '*') { precision = va_arg(args, int); VRD_Internal_WriteZigZag(buf, precision); ++f; }
+			else for (precision = 0; *f >= '0' && *f <= '9'; ++f) precision = precision * 10 + (*f - '0');
+		}
+
+		char size = 0; // h, H (hh), l, q (ll), L, z, j, t
+		if (*f == 'h') { size = (f[1] == 'h') ? 'H' : 'h'; f += (f[1] == 'h') ? 2 : 1; }
+		else if (*f == 'l') { size = (f[1] == 'l') ? 'q' : 'l'; f += (f[1] == 'l') ? 2 : 1; }
+		else if (*f == 'L' || *f == 'z' || *f == 'j' || *f == 't') size = *f++;
+
+		switch (*f)
+		{
+		case 'd': case 'i':
+		{
+			long long value;
+			switch (size)
+			{
+			case 'l': value = va_arg(args, long); break;
+			case 'q': case 'j': value = va_arg(args, long long); break;
+			case 'z': case 't': value = (long long)va_arg(args, ptrdiff_t); break;
+			case 'h': value = (short)va_arg(args, int); break;
+			case 'H': value = (signed char)va_arg(args, int); break;
+			default: value = va_arg(args, int); break;
+			}
+			VRD_Internal_WriteZigZag64(buf, value);
+			break;
+		}
+		case 'u': case 'o': case 'x': case 'X':
+		{
+			unsigned long long value;
+			switch (size)
+			{
+			case 'l': value = va_arg(args, unsigned long); break;
+			case 'q': case 'j': value = va_arg(args, unsigned long long); break;
+			case 'z': case 't': value = (unsigned long long)va_arg(args, size_t); break;
+			case 'h': value = (unsigned short)va_arg(args, unsigned int); break;
+			case 'H': value = (unsigned char)va_arg(args, unsigned int); break;
+			default: value = va_arg(args, unsigned int); break;
+			}
+			VRD_Internal_Write7BitEncodedInt64(buf, value);
+			break;
+		}
+		case 'c':
+			VRD_Internal_Write7BitEncodedInt64(buf, (unsigned char)va_arg(args, int)); // %lc is narrowed too
+			break;
+		case 'p':
+			VRD_Internal_Write7BitEncodedInt64(buf, (unsigned long long)(size_t)va_arg(args, void*));
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+		{
+			double value = (size == 'L') ? (double)va_arg(args, long double) : va_arg(args, double);
+			VRD_Internal_WriteBytes(buf, &value, 8);
+			break;
+		}
+		case 's':
+			if (size == 'l') { va_arg(args, const wchar_t*); VRD_Internal_WriteString(buf, ""); }
+			else
+			{
+				const char* s = va_arg(args, const char*);
+				if (s == 0) s = "(null)";
+				int len = (int)(precision >= 0 ? strnlen(s, precision) : strlen(s)); // A negative precision is ignored, as printf does
+				VRD_Internal_Write7BitEncodedInt(buf, len);
+				if (len > 0) VRD_Internal_WriteBytes(buf, s, len);
+			}
+			break;
+		case 'n':
+			va_arg(args, void*);
+			break;
+		default:
+			return;
+		}
+	}
+}
+
+void VRD_Internal_WriteEntityTransformDelta(VRD_replay_context* ctx, int entityId, int frame, VRD_Point* pos, VRD_Quaternion* rot);
+
+static inline void VRD_Internal_WriteLabel(VRD_StagingBuffer* buf, const char* s, int stringId)
+{
+	if (stringId > 0)
+	{
+		VRD_Internal_Write7BitEncodedInt(buf, stringId);
+		return;
+	}
+	if (stringId == 0)
+	{
+		VRD_Internal_WriteChar(buf, 0); // inline string follows
+	}
+	VRD_Internal_WriteString(buf, s);
+}
+
+// Category is the draw or log category, for the counters (0 for other blocks).
+static inline VRD_StagingBuffer* VRD_Internal_BeginBlock(VRD_replay_context* ctx, enum VRD_BlockType blockType, const char* category)
+{
+	VRD_StagingBuffer* buf = &ctx->staging;
+	VRD_CaptureCounters* counters = &ctx->counters;
+	if (ctx->thread_lanes)
+	{
+		VRD_ThreadLane* lane = (VRD_TlsLane.context_serial == ctx->serial) ? VRD_TlsLane.lane : VRD_Internal_GetThreadLane(ctx, VRD_AUTO_THREAD_LANE);
+		if (lane)
+		{
+			buf = &lane->staging;
+			counters = &lane->counters;
+		}
+		else
+		{
+			ctx->status = 0; // Out of memory, stop capturing
+		}
+	}
+	counters->block_type = blockType;
+	counters->block_start = buf->size;
+	counters->block_category = VRD_Internal_GetCategoryCounter(counters, category);
+	counters->block_color = -1;
+	return buf;
+}
+
+// Draw and log blocks, their color is counted too.
+static inline VRD_StagingBuffer* VRD_Internal_BeginDrawBlock(VRD_replay_context* ctx, enum VRD_BlockType blockType, const char* category, enum VRD_Color color)
+{
+	VRD_StagingBuffer* buf = VRD_Internal_BeginBlock(ctx, blockType, category);
+	VRD_Internal_Counters(ctx)->block_color = color & 0xff;
+	return buf;
+}
+
+static inline void VRD_Internal_EndBlock(VRD_replay_context* ctx, VRD_StagingBuffer* buf)
+{
+	if (buf->failed)
+	{
+		ctx->status = 0; // Out of memory, stop capturing
+		return;
+	}
+	VRD_CaptureCounters* counters = VRD_Internal_Counters(ctx);
+	if (counters->block_type != None)
+	{
+		int size = buf->size - counters->block_start;
+		VRD_Internal_CountBlock(counters, counters->block_type, size);
+		if (counters->block_category)
+		{
+			counters->block_category->calls += 1;
+			counters->block_category->bytes += size;
+		}
+		if (counters->block_color >= 0)
+		{
+			int kind = (counters->block_type == EntityLog || counters->block_type == EntityLogFormat) ? VRD_SummaryKind_Log : VRD_SummaryKind_Draw;
+			counters->colors[kind][counters->block_color >> 5] |= 1u << (counters->block_color & 31);
+			if (counters->block_category) counters->block_category->kinds |= 1 << kind;
+			else counters->uncategorized |= 1 << kind;
+		}
+		counters->block_type = None;
+	}
+	// Per-thread buffers are only spliced in at frame steps
+	if (buf == &ctx->staging && ctx->flush_threshold > 0 && buf->size >= ctx->flush_threshold)
+	{
+		VRD_Internal_Flush(ctx, false);
+	}
+}
+
+void VRD_Internal_WriteReplayHeader(VRD_replay_context* ctx, VRD_StagingBuffer* buf)
+{
+	if (ctx->encoder.codec == VRD_Codec_None) VRD_Internal_WriteInt(buf, ReplayHeader); // Tells the reader the file is uncompressed
+	else VRD_Internal_Write7BitEncodedInt(buf, ReplayHeader);
+	VRD_Internal_EndBlock(ctx, buf);
+}
+
+int VRD_Internal_FormatFlags(VRD_replay_context* ctx)
+{
+	int flags = 0;
+	if (ctx->intern_strings) flags |= VRD_Format_StringTable;
+	if (ctx->delta_transforms) flags |= VRD_Format_DeltaTransforms;
+	if (sizeof(entityKeyType) != sizeof(int)) flags |= VRD_Format_RecycledIds;
+	return flags;
+}
+
+void VRD_Internal_WriteReplayFormat(VRD_replay_context* ctx, VRD_StagingBuffer* buf)
+{
+	int flags = VRD_Internal_FormatFlags(ctx);
+	VRD_Internal_Write7BitEncodedInt(buf, ReplayFormat);
+	VRD_Internal_Write7BitEncodedInt(buf, flags);
+	if (ctx->delta_transforms) VRD_Internal_WriteFloat(buf, ctx->position_quantum);
+	VRD_Internal_EndBlock(ctx, buf);
+}
+
+static inline void VRD_Internal_WriteEntityHeader(VRD_StagingBuffer* buf, enum VRD_BlockType blockType, int entityId, int frame)
+{
+	VRD_Internal_Write7BitEncodedInt(buf, blockType);
+	VRD_Internal_Write7BitEncodedInt(buf, frame);
+	VRD_Internal_Write7BitEncodedInt(buf, entityId);
+}
+
+///
+/// Block schemas
+///
+
+// Entity blocks of a fixed layout are declared by the types of their fields. Their encoder reserves the worst case size once,
+// known at compile time but for string lengths, writes the fields without further checks and gives back the unused bytes.
+struct VRD_LabelField { const char* str; int id; int len; }; // id from VRD_Internal_InternString, len only when written inline
+struct VRD_StringField { const char* str; int len; };
+
+template <typename T> struct VRD_FieldEncoding;
+
+template <> struct VRD_FieldEncoding<int>
+{
+	static const int max_size = 5;
+	static inline int Extra(int) { return 0; }
+	static inline unsigned char* Put(unsigned char* p, int value) { return p + VRD_Internal_Encode7BitEncodedInt(p, value); }
+};
+
+template <> struct VRD_FieldEncoding<enum VRD_Color>
+{
+	static const int max_size = 5;
+	static inline int Extra(enum VRD_Color) { return 0; }
+	static inline unsigned char* Put(unsigned char* p, enum VRD_Color color) { return p + VRD_Internal_Encode7BitEncodedInt(p, color); }
+};
+
+template <> struct VRD_FieldEncoding<float>
+{
+	static const int max_size = 4;
+	static inline int Extra(float) { return 0; }
+	static inline unsigned char* Put(unsigned char* p, float value) { memcpy(p, &value, 4); return p + 4; }
+};
+
+template <> struct VRD_FieldEncoding<VRD_Point>
+{
+	static const int max_size = 12;
+	static inline int Extra(const VRD_Point&) { return 0; }
+	static inline unsigned char* Put(unsigned char* p, const VRD_Point& point)
+	{
+		memcpy(p + 0, &point.x, 4);
+		memcpy(p + 4, &point.y, 4);
+		memcpy(p + 8, &point.z, 4);
+		return p + 12;
+	}
+};
+
+template <> struct VRD_FieldEncoding<VRD_Transform>
+{
+	static const int max_size = 28;
+	static inline int Extra(const VRD_Transform&) { return 0; }
+	static inline unsigned char* Put(unsigned char* p, const VRD_Transform& xform)
+	{
+		p = VRD_FieldEncoding<VRD_Point>::Put(p, xform.translation);
+		memcpy(p + 0, &xform.rotation.x, 4);
+		memcpy(p + 4, &xform.rotation.y, 4);
+		memcpy(p + 8, &xform.rotation.z, 4);
+		memcpy(p + 12, &xform.rotation.w, 4);
+		return p + 16;
+	}
+};
+
+// Same bytes as VRD_Internal_WriteLabel
+template <> struct VRD_FieldEncoding<VRD_LabelField>
+{
+	static const int max_size = 5;
+	static inline int Extra(const VRD_LabelField& label) { return label.id > 0 ? 0 : label.len + 1; }
+	static inline unsigned char* Put(unsigned char* p, const VRD_LabelField& label)
+	{
+		if (label.id > 0) return p + VRD_Internal_Encode7BitEncodedInt(p, label.id);
+		if (label.id == 0) *p++ = 0; // inline string follows
+		p += VRD_Internal_Encode7BitEncodedInt(p, label.len);
+		if (label.len > 0) memcpy(p, label.str, label.len);
+		return p + label.len;
+	}
+};
+
+// Same bytes as VRD_Internal_WriteString
+template <> struct VRD_FieldEncoding<VRD_StringField>
+{
+	static const int max_size = 5;
+	static inline int Extra(const VRD_StringField& str) { return str.len; }
+	static inline unsigned char* Put(unsigned char* p, const VRD_StringField& str)
+	{
+		p += VRD_Internal_Encode7BitEncodedInt(p, str.len);
+		if (str.len > 0) memcpy(p, str.str, str.len);
+		return p + str.len;
+	}
+};
+
+template <typename... Fields> struct VRD_FieldsMaxSize;
+template <> struct VRD_FieldsMaxSize<> { static const int value = 0; };
+template <typename Field, typename... Rest> struct VRD_FieldsMaxSize<Field, Rest...>
+{
+	static const int value = VRD_FieldEncoding<Field>::max_size + VRD_FieldsMaxSize<Rest...>::value;
+};
+
+static inline int VRD_Internal_FieldsExtra() { return 0; }
+template <typename Field, typename... Rest> static inline int VRD_Internal_FieldsExtra(const Field& field, const Rest&... rest)
+{
+	return VRD_FieldEncoding<Field>::Extra(field) + VRD_Internal_FieldsExtra(rest...);
+}
+
+static inline unsigned char* VRD_Internal_PutFields(unsigned char* p) { return p; }
+template <typename Field, typename... Rest> static inline unsigned char* VRD_Internal_PutFields(unsigned char* p, const Field& field, const Rest&... rest)
+{
+	return VRD_Internal_PutFields(VRD_FieldEncoding<Field>::Put(p, field), rest...);
+}
+
+template <enum VRD_BlockType Type, typename... Fields> struct VRD_EntityBlockSchema
+{
+	static const int max_size = 3 * 5 + VRD_FieldsMaxSize<Fields...>::value; // After the entity header: block type, frame and entity id
+
+	static inline void Write(VRD_StagingBuffer* buf, int entityId, int frame, const Fields&... fields)
+	{
+		int size = max_size + VRD_Internal_FieldsExtra(fields...);
+		unsigned char* start = VRD_Internal_Reserve(buf, size);
+		if (start == 0) return;
+		unsigned char* p = VRD_Internal_PutFields(start, (int)Type, frame, entityId);
+		p = VRD_Internal_PutFields(p, fields...);
+		buf->size -= size - (int)(p - start); // give back unused reserve
+	}
+};
+
+typedef VRD_EntityBlockSchema<EntitySetPos, VRD_Point> VRD_SetPosBlock;
+typedef VRD_EntityBlockSchema<EntitySetTransform, VRD_Transform> VRD_SetTransformBlock;
+typedef VRD_EntityBlockSchema<EntityLog, VRD_LabelField, VRD_StringField, enum VRD_Color> VRD_LogBlock;
+typedef VRD_EntityBlockSchema<EntityParameter, VRD_LabelField, VRD_StringField> VRD_ParameterBlock;
+typedef VRD_EntityBlockSchema<EntityValue, VRD_LabelField, float> VRD_ValueBlock;
+typedef VRD_EntityBlockSchema<EntityLine, VRD_LabelField, VRD_Point, VRD_Point, enum VRD_Color> VRD_LineBlock;
+typedef VRD_EntityBlockSchema<EntityCircle, VRD_LabelField, VRD_Point, VRD_Point, float, enum VRD_Color> VRD_CircleBlock;
+typedef VRD_EntityBlockSchema<EntitySphere, VRD_LabelField, VRD_Point, float, enum VRD_Color> VRD_SphereBlock;
+typedef VRD_EntityBlockSchema<EntityCapsule, VRD_LabelField, VRD_Point, VRD_Point, float, enum VRD_Color> VRD_CapsuleBlock;
+typedef VRD_EntityBlockSchema<EntityBox, VRD_LabelField, VRD_Transform, VRD_Point, enum VRD_Color> VRD_BoxBlock;
+
+// The length of inline labels is only needed when they are not interned.
+static inline VRD_LabelField VRD_Internal_Label(const char* s, int stringId)
+{
+	VRD_LabelField label = { s, stringId, (stringId <= 0 && s) ? (int)strlen(s) : 0 };
+	return label;
+}
+
+static inline VRD_StringField VRD_Internal_String(const char* s, int len)
+{
+	VRD_StringField str = { s, s ? len : 0 };
+	return str;
+}
+
+static inline const VRD_Point& VRD_Internal_PointOrZero(const VRD_Point* point)
+{
+	return point ? *point : VRD_PointZero;
+}
+
+// Copies the block encoded from start, before VRD_Internal_EndBlock which may flush it.
+static inline void VRD_Internal_KeepBlock(VRD_replay_context* ctx, VRD_StagingBuffer* buf, int start)
+{
+	std::unique_lock<std::mutex> lock;
+	if (ctx->thread_lanes) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+	VRD_Internal_WriteBytes(&ctx->kept, buf->data + start, buf->size - start);
+	if (ctx->kept.failed) ctx->status = 0; // Out of memory, stop capturing
+}
+
+void VRD_Internal_WriteFrameStep(VRD_replay_context* ctx, float totalTime)
+{
+	VRD_StagingBuffer* buf = &ctx->staging;
+	int start = buf->size;
+	VRD_Internal_Write7BitEncodedInt(buf, FrameStep);
+	VRD_Internal_WriteFloat(buf, totalTime);
+	VRD_Internal_CountBlock(&ctx->counters, FrameStep, buf->size - start);
+	if (ctx->keep_dropped) VRD_Internal_KeepBlock(ctx, buf, start);
+	VRD_Internal_EndBlock(ctx, buf);
+}
+
+// Deltas since the previous stats block, as 64-bit varints: calls and raw bytes of the block types that were written, flushed and stored bytes, then compression and I/O time in microseconds.
+void VRD_Internal_WriteCaptureStats(VRD_replay_context* ctx)
+{
+	VRD_CaptureStats stats;
+	VRD_GetStats(ctx, &stats, 0, 0);
+	VRD_CaptureStats* last = &ctx->last_stats;
+	int count = 0;
+	for (int i = 0; i < VRD_STATS_BLOCK_TYPE_COUNT; ++i)
+	{
+		if (stats.blocks[i].calls != last->blocks[i].calls) ++count;
+	}
+
+	VRD_StagingBuffer* buf = &ctx->staging;
+	int start = buf->size;
+	VRD_Internal_Write7BitEncodedInt(buf, CaptureStats);
+	VRD_Internal_Write7BitEncodedInt(buf, ctx->frame);
+	VRD_Internal_Write7BitEncodedInt(buf, count);
+	for (int i = 0; i < VRD_STATS_BLOCK_TYPE_COUNT; ++i)
+	{
+		if (stats.blocks[i].calls == last->blocks[i].calls) continue;
+		VRD_Internal_Write7BitEncodedInt(buf, i);
+		VRD_Internal_Write7BitEncodedInt64(buf, (unsigned long long)(stats.blocks[i].calls - last->blocks[i].calls));
+		VRD_Internal_Write7BitEncodedInt64(buf, (unsigned long long)(stats.blocks[i].rawBytes - last->blocks[i].rawBytes));
+	}
+	VRD_Internal_Write7BitEncodedInt64(buf, (unsigned long long)(stats.flushedBytes - last->flushedBytes));
+	VRD_Internal_Write7BitEncodedInt64(buf, (unsigned long long)(stats.storedBytes - last->storedBytes));
+	VRD_Internal_Write7BitEncodedInt64(buf, (unsigned long long)((stats.compressSeconds - last->compressSeconds) * 1e6));
+	VRD_Internal_Write7BitEncodedInt64(buf, (unsigned long long)((stats.ioSeconds - last->ioSeconds) * 1e6));
+	*last = stats;
+	VRD_Internal_CountBlock(&ctx->counters, CaptureStats, buf->size - start);
+	VRD_Internal_EndBlock(ctx, buf);
+}
+
+static inline void VRD_Internal_EncodeEntityDef(VRD_StagingBuffer* buf, int entityId, int frame, const char* name, const char* path, int pathId, const char* type_name, int typeNameId, const char* category_name, int categoryNameId, VRD_Transform* xform, VRD_StringDictPair* staticParams, int staticParamsCount)
+{
+	VRD_Internal_WriteEntityHeader(buf, EntityDef, entityId, frame);
+	VRD_Internal_Write7BitEncodedInt(buf, entityId);
+
+	VRD_Internal_WriteString(buf, name);
+	VRD_Internal_WriteLabel(buf, path, pathId);
+	VRD_Internal_WriteLabel(buf, type_name, typeNameId);
+	VRD_Internal_WriteLabel(buf, category_name, categoryNameId);
+	VRD_Internal_WriteTransform(buf, xform);
+	VRD_Internal_Write7BitEncodedInt(buf, staticParamsCount);
+	for (int i = 0; i < staticParamsCount; ++i)
+	{
+		VRD_Internal_WriteString(buf, staticParams[i].key);
+		VRD_Internal_WriteString(buf, staticParams[i].value);
+	}
+	VRD_Internal_Write7BitEncodedInt(buf, frame);
+}
+
+// Magic, version, then the codec, its level and the zstd dictionary.
+void VRD_Internal_WriteCodecHeader(VRD_replay_context* ctx, const char* magic, int version)
+{
+	int header[4] = { version, ctx->encoder.codec, ctx->encoder.level, ctx->dictionary.size };
+	VRD_Internal_FileWrite(ctx, magic, 4);
+	VRD_Internal_FileWrite(ctx, header, sizeof(header));
+	VRD_Internal_FileWrite(ctx, ctx->dictionary.data, ctx->dictionary.size);
+	ctx->file_offset = 4 + sizeof(header) + ctx->dictionary.size;
+}
+
+void VRD_Internal_WriteChunkedHeader(VRD_replay_context* ctx)
+{
+	VRD_Internal_WriteCodecHeader(ctx, VRD_CHUNKED_MAGIC, ctx->summary ? VRD_CHUNKED_VERSION : VRD_CHUNKED_VERSION_WITHOUT_SUMMARY);
+}
+
+void VRD_Internal_WriteStreamHeader(VRD_replay_context* ctx)
+{
+	if (ctx->encoder.codec == VRD_Codec_LZ4 || ctx->encoder.codec == VRD_Codec_Zstd) VRD_Internal_WriteCodecHeader(ctx, VRD_STREAM_MAGIC, VRD_STREAM_VERSION);
+}
+
+// Starts an independent chunk: fresh string table and transform deltas, then a keyframe that restores all live entities.
+void VRD_Internal_BeginChunk(VRD_replay_context* ctx)
+{
+	ctx->chunk_first_frame = ctx->frame;
+
+	// Cached label pointers validate against the interned copies
+	VRD_Internal_ReleaseStringTable(ctx);
+	VRD_Internal_ReleaseMeshCache(ctx);
+	memset(&ctx->string_cache, 0, sizeof(VRD_StringCache));
+	for (VRD_ThreadLane* it = ctx->thread_lanes ? ctx->thread_lanes->first : 0; it != 0; it = it->next)
+	{
+		memset(&it->string_cache, 0, sizeof(VRD_StringCache));
+	}
+
+	// String defs are prepended to the staged blocks on flush, so the format block leads them
+	VRD_Internal_WriteReplayFormat(ctx, &ctx->strings.defs);
+
+	VRD_StagingBuffer* buf = &ctx->staging;
+	int keyframeStart = buf->size;
+	VRD_Internal_Write7BitEncodedInt(buf, Keyframe);
+	VRD_Internal_Write7BitEncodedInt(buf, ctx->frame);
+	VRD_Internal_WriteFloat(buf, ctx->last_frame_time);
+	int lengthOffset = buf->size;
+	VRD_Internal_WriteInt(buf, 0);
+
+	int inlineId = ctx->intern_strings ? 0 : -1;
+	VRD_EntityStates* states = &ctx->entity_states;
+	for (int i = 0; i < states->capacity; ++i)
+	{
+		VRD_EntityState* state = &states->items[i];
+		if (state->id == 0) continue;
+		state->full_frame = -1;
+		if (state->def.size > 0) VRD_Internal_WriteBytes(buf, state->def.data, state->def.size);
+		if (state->has_xform)
+		{
+			VRD_Internal_WriteEntityHeader(buf, EntitySetTransform, state->id, ctx->frame);
+			VRD_Internal_WriteTransform(buf, &state->xform);
+		}
+		for (int p = 0; p < state->param_count; ++p)
+		{
+			VRD_EntityParam* param = &state->params[p];
+			VRD_Internal_WriteEntityHeader(buf, param->str ? EntityParameter : EntityValue, state->id, ctx->frame);
+			VRD_Internal_WriteLabel(buf, param->key, inlineId);
+			if (param->str) VRD_Internal_WriteString(buf, param->str);
+			else VRD_Internal_WriteFloat(buf, param->value);
+		}
+	}
+
+	if (buf->failed)
+	{
+		ctx->status = 0; // Out of memory, stop capturing
+		return;
+	}
+	int length = buf->size - lengthOffset - 4;
+	memcpy(buf->data + lengthOffset, &length, 4);
+	VRD_Internal_CountBlock(&ctx->counters, Keyframe, buf->size - keyframeStart);
+}
+
+// Footer: first frame, frame count and file offset of every chunk, then the index offset, chunk count and magic.
+void VRD_Internal_WriteChunkIndex(VRD_replay_context* ctx)
+{
+	VRD_ChunkIndex* index = &ctx->chunk_index;
+	if (index->failed) return; // Readers fall back to scanning the chunks
+	for (int i = 0; i < index->count; ++i)
+	{
+		VRD_ChunkIndexEntry* entry = &index->entries[i];
+		VRD_Internal_FileWrite(ctx, &entry->first_frame, 4);
+		VRD_Internal_FileWrite(ctx, &entry->frame_count, 4);
+		VRD_Internal_FileWrite(ctx, &entry->offset, 8);
+	}
+	VRD_Internal_FileWrite(ctx, &ctx->file_offset, 8);
+	VRD_Internal_FileWrite(ctx, &index->count, 4);
+	VRD_Internal_FileWrite(ctx, VRD_CHUNK_INDEX_MAGIC, 4);
+}
+
+void VRD_Internal_FreeRing(VRD_FrameRing* ring)
+{
+	free(ring->def_slots);
+	free(ring->def_next);
+	free(ring->retired);
+	free(ring->scratch.data);
+	free(ring->data);
+	free(ring);
+}
+
+// Nothing is allocated past this, but for the dump prologue and defs larger than any so far.
+VRD_FrameRing* VRD_Internal_CreateRing(int capacity, int defBytes)
+{
+	VRD_FrameRing* ring = static_cast<VRD_FrameRing*>(calloc(1, sizeof(VRD_FrameRing)));
+	if (ring == 0) return 0;
+	int slotCount = defBytes > VRD_RING_DEF_SLOT_SIZE ? defBytes / VRD_RING_DEF_SLOT_SIZE : 1;
+	ring->capacity = capacity;
+	ring->data = static_cast<unsigned char*>(malloc(capacity));
+	ring->def_slots = static_cast<unsigned char*>(malloc(slotCount * VRD_RING_DEF_SLOT_SIZE));
+	ring->def_next = static_cast<int*>(malloc(slotCount * sizeof(int)));
+	ring->retired = static_cast<VRD_RetiredEntityDef*>(malloc(slotCount * sizeof(VRD_RetiredEntityDef)));
+	ring->scratch.data = static_cast<unsigned char*>(malloc(VRD_RING_DEF_SLOT_SIZE * 4));
+	if (ring->data == 0 || ring->def_slots == 0 || ring->def_next == 0 || ring->retired == 0 || ring->scratch.data == 0)
+	{
+		VRD_Internal_FreeRing(ring);
+		return 0;
+	}
+	ring->scratch.capacity = VRD_RING_DEF_SLOT_SIZE * 4;
+	for (int i = 0; i < slotCount; ++i) ring->def_next[i] = i + 1 < slotCount ? i + 1 : -1;
+	ring->def_slot_count = slotCount;
+	ring->def_free = 0;
+	ring->def_free_count = slotCount;
+	return ring;
+}
+
+static inline void VRD_Internal_RingWrite(VRD_FrameRing* ring, const void* data, int len)
+{
+	int offset = (ring->begin + ring->used) % ring->capacity;
+	int first = (len < ring->capacity - offset) ? len : ring->capacity - offset;
+	memcpy(ring->data + offset, data, first);
+	memcpy(ring->data, static_cast<const unsigned char*>(data) + first, len - first);
+	ring->used += len;
+}
+
+static inline void VRD_Internal_RingRead(const VRD_FrameRing* ring, int offset, void* data, int len)
+{
+	offset %= ring->capacity;
+	int first = (len < ring->capacity - offset) ? len : ring->capacity - offset;
+	memcpy(data, ring->data + offset, first);
+	memcpy(static_cast<unsigned char*>(data) + first, ring->data, len - first);
+}
+
+void VRD_Internal_EvictRingFrame(VRD_FrameRing* ring)
+{
+	VRD_RingFrame record;
+	VRD_Internal_RingRead(ring, ring->begin, &record, sizeof(record));
+	int size = (int)sizeof(record) + record.size;
+	ring->begin = (ring->begin + size) % ring->capacity;
+	ring->used -= size;
+	ring->frame_count -= 1;
+	if (ring->frame_count > 0)
+	{
+		VRD_Internal_RingRead(ring, ring->begin, &record, sizeof(record));
+		ring->first_frame = record.frame;
+		ring->first_frame_time = record.start_time;
+	}
+}
+
+void VRD_Internal_FreeRingDef(VRD_FrameRing* ring, VRD_RingDef* def)
+{
+	if (def->size == 0) return;
+	int last = def->first_slot;
+	int slots = 1;
+	for (; ring->def_next[last] >= 0; last = ring->def_next[last]) ++slots;
+	ring->def_next[last] = ring->def_free;
+	ring->def_free = def->first_slot;
+	ring->def_free_count += slots;
+	def->size = 0;
+}
+
+// Drops the retired defs of entities unregistered before the given frame, the ring no longer holds any of their blocks.
+void VRD_Internal_PruneRetiredDefs(VRD_FrameRing* ring, int firstFrame)
+{
+	int count = 0;
+	for (int i = 0; i < ring->retired_count; ++i)
+	{
+		VRD_RetiredEntityDef* retired = &ring->retired[i];
+		if (retired->undef_frame < firstFrame) VRD_Internal_FreeRingDef(ring, &retired->def);
+		else ring->retired[count++] = *retired;
+	}
+	ring->retired_count = count;
+}
+
+// Copies the def to free slots. Without enough, the oldest frames are evicted, until the oldest retired def is no longer needed.
+// Returns false if the defs of live entities fill the slots, the dump then shows the entity without its def.
+bool VRD_Internal_StoreRingDef(VRD_replay_context* ctx, const VRD_StagingBuffer* def, VRD_RingDef* out)
+{
+	VRD_FrameRing* ring = ctx->ring;
+	out->size = 0;
+	int slots = (def->size + VRD_RING_DEF_SLOT_SIZE - 1) / VRD_RING_DEF_SLOT_SIZE;
+	while (ring->def_free_count < slots && ring->frame_count > 0 && ring->retired_count > 0 && ring->retired[0].undef_frame < ctx->frame) // Retired in frame order
+	{
+		VRD_Internal_EvictRingFrame(ring);
+		VRD_Internal_PruneRetiredDefs(ring, ring->frame_count > 0 ? ring->first_frame : ctx->frame);
+	}
+	if (ring->def_free_count < slots || def->size == 0) return false;
+
+	out->first_slot = ring->def_free;
+	out->size = def->size;
+	int slot = ring->def_free;
+	for (int offset = 0; offset < def->size; offset += VRD_RING_DEF_SLOT_SIZE)
+	{
+		int len = (def->size - offset < VRD_RING_DEF_SLOT_SIZE) ? def->size - offset : VRD_RING_DEF_SLOT_SIZE;
+		memcpy(ring->def_slots + slot * VRD_RING_DEF_SLOT_SIZE, def->data + offset, len);
+		int next = ring->def_next[slot];
+		if (offset + len == def->size) ring->def_next[slot] = -1;
+		slot = next;
+	}
+	ring->def_free = slot;
+	ring->def_free_count -= slots;
+	return true;
+}
+
+static void VRD_Internal_WriteRingDef(const VRD_FrameRing* ring, VRD_StagingBuffer* buf, const VRD_RingDef* def)
+{
+	int slot = def->first_slot;
+	for (int offset = 0; offset < def->size; offset += VRD_RING_DEF_SLOT_SIZE, slot = ring->def_next[slot])
+	{
+		int len = (def->size - offset < VRD_RING_DEF_SLOT_SIZE) ? def->size - offset : VRD_RING_DEF_SLOT_SIZE;
+		VRD_Internal_WriteBytes(buf, ring->def_slots + slot * VRD_RING_DEF_SLOT_SIZE, len);
+	}
+}
+
+// Moves the staged frame to the ring, evicting the oldest frames to make room. No allocation, the staging buffer is reused.
+void VRD_Internal_PushRingFrame(VRD_replay_context* ctx, int frame, float startTime)
+{
+	VRD_FrameRing* ring = ctx->ring;
+	VRD_RingFrame record = { ctx->staging.size, frame, startTime };
+	int size = (int)sizeof(record) + record.size;
+	while (ring->frame_count > 0 && ring->used + size > ring->capacity) VRD_Internal_EvictRingFrame(ring);
+	if (size <= ring->capacity)
+	{
+		if (ring->frame_count == 0)
+		{
+			ring->first_frame = frame;
+			ring->first_frame_time = startTime;
+		}
+		VRD_Internal_RingWrite(ring, &record, sizeof(record));
+		VRD_Internal_RingWrite(ring, ctx->staging.data, record.size);
+		ring->frame_count += 1;
+	}
+	else
+	{
+		// Larger than the whole ring, the ring restarts with the next frame
+		ring->first_frame = frame + 1;
+		ring->first_frame_time = ctx->last_frame_time;
+	}
+	VRD_Internal_PruneRetiredDefs(ring, ring->first_frame);
+
+	ctx->staging.size = 0;
+	ctx->strings.defs.size = 0; // The whole string table goes with each dump
+	ctx->frames_since_flush = 0;
+}
+
+// Keeps the def of an entity that is unregistered or registered again, while the ring still holds blocks of it. Caller holds the thread lanes lock, if any.
+void VRD_Internal_RetireEntityDef(VRD_replay_context* ctx, int entityId, int frame)
+{
+	VRD_FrameRing* ring = ctx->ring;
+	VRD_EntityState* state = VRD_Internal_FindEntityState(ctx, entityId);
+	if (state == 0 || state->ring_def.size == 0) return;
+	VRD_RetiredEntityDef* retired = &ring->retired[ring->retired_count++]; // Has room, the def holds a slot
+	retired->def_frame = state->def_frame;
+	retired->undef_frame = frame;
+	retired->def = state->ring_def;
+	state->ring_def.size = 0;
+}
+
+void VRD_Internal_ReleaseRing(VRD_replay_context* ctx)
+{
+	if (ctx->ring == 0) return;
+	VRD_Internal_FreeRing(ctx->ring);
+	ctx->ring = 0;
+}
+
+// Single stream replay: headers, the whole string table, then a keyframe that defines the entities registered before the oldest frame, then the ring frames.
+int VRD_Internal_DumpRing(VRD_replay_context* ctx)
+{
+	VRD_FrameRing* ring = ctx->ring;
+	VRD_Internal_ResetEncoder(&ctx->encoder);
+	VRD_Internal_WriteStreamHeader(ctx);
+
+	VRD_StagingBuffer* buf = &ring->scratch;
+	buf->size = 0;
+	buf->failed = 0;
+	VRD_Internal_WriteReplayHeader(ctx, buf);
+	VRD_Internal_WriteReplayFormat(ctx, buf);
+	VRD_StringTable* table = &ctx->strings;
+	for (int i = 0; i < table->capacity; ++i)
+	{
+		if (table->items[i].id != 0) VRD_Internal_WriteStringDef(buf, &table->items[i]);
+	}
+
+	int firstFrame = ring->frame_count > 0 ? ring->first_frame : ctx->frame;
+	VRD_Internal_Write7BitEncodedInt(buf, Keyframe);
+	VRD_Internal_Write7BitEncodedInt(buf, firstFrame);
+	VRD_Internal_WriteFloat(buf, ring->frame_count > 0 ? ring->first_frame_time : ctx->last_frame_time);
+	int lengthOffset = buf->size;
+	VRD_Internal_WriteInt(buf, 0);
+	for (int i = 0; i < ring->retired_count; ++i)
+	{
+		VRD_RetiredEntityDef* retired = &ring->retired[i];
+		if (retired->def_frame < firstFrame) VRD_Internal_WriteRingDef(ring, buf, &retired->def);
+	}
+	VRD_EntityStates* states = &ctx->entity_states;
+	for (int i = 0; i < states->capacity; ++i)
+	{
+		VRD_EntityState* state = &states->items[i];
+		if (state->id != 0 && state->def_frame < firstFrame) VRD_Internal_WriteRingDef(ring, buf, &state->ring_def);
+	}
+	if (buf->failed) return 0;
+	int length = buf->size - lengthOffset - 4;
+	memcpy(buf->data + lengthOffset, &length, 4);
+	VRD_Internal_Write(ctx, buf->data, buf->size);
+
+	// Frame records, without their headers. A record that wraps around is written in two parts.
+	int offset = ring->begin;
+	for (int i = 0; i < ring->frame_count; ++i)
+	{
+		VRD_RingFrame record;
+		VRD_Internal_RingRead(ring, offset, &record, sizeof(record));
+		int start = (offset + (int)sizeof(record)) % ring->capacity;
+		int first = (record.size < ring->capacity - start) ? record.size : ring->capacity - start;
+		VRD_Internal_Write(ctx, ring->data + start, first);
+		VRD_Internal_Write(ctx, ring->data, record.size - first);
+		offset = (start + record.size) % ring->capacity;
+	}
+
+	VRD_Internal_FinishStream(ctx);
+	return ferror(ctx->fp) == 0;
+}
+
+void VRD_Internal_WriteEntityDef(VRD_replay_context* ctx, int entityId, int frame, const char* name, const char* path, const char* type_name, const char* category_name, VRD_Transform* xform, VRD_StringDictPair* staticParams, int staticParamsCount)
+{
+	if (ctx->value_series.frames) VRD_Internal_WriteEntityValueSeries(ctx, entityId, frame);
+	if (ctx->delta_transforms || ctx->chunk_frames || ctx->ring)
+	{
+		std::unique_lock<std::mutex> lock;
+		if (ctx->thread_lanes) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+		if (ctx->ring) VRD_Internal_RetireEntityDef(ctx, entityId, frame);
+		VRD_Internal_RemoveEntityState(ctx, entityId); // next transform is a full value
+		if (ctx->chunk_frames || ctx->ring)
+		{
+			// Copy for chunk keyframes and ring dumps, which do not use the string table
+			VRD_EntityState* state = VRD_Internal_GetEntityState(ctx, entityId);
+			int inlineId = ctx->intern_strings ? 0 : -1;
+			VRD_StagingBuffer* def = state ? (ctx->ring ? &ctx->ring->scratch : &state->def) : 0;
+			if (def) def->size = def->failed = 0;
+			if (def && def->capacity == 0)
+			{
+				def->data = static_cast<unsigned char*>(malloc(VRD_ENTITY_DEF_INITIAL_SIZE));
+				def->capacity = def->data ? VRD_ENTITY_DEF_INITIAL_SIZE : 0;
+			}
+			if (def) VRD_Internal_EncodeEntityDef(def, entityId, frame, name, path, inlineId, type_name, inlineId, category_name, inlineId, xform, staticParams, staticParamsCount);
+			if (def && ctx->ring && !def->failed) VRD_Internal_StoreRingDef(ctx, def, &state->ring_def);
+			if (state) state->def_frame = frame;
+			if (state && xform) state->xform = *xform;
+			if (state && ctx->summary) state->summary_entity = VRD_Internal_AddSummaryEntity(ctx, entityId, frame, name, path, type_name, category_name);
+		}
+	}
+
+	int pathId = VRD_Internal_InternString(ctx, path);
+	int typeNameId = VRD_Internal_InternString(ctx, type_name);
+	int categoryNameId = VRD_Internal_InternString(ctx, category_name);
+
+	VRD_StagingBuffer* buf = VRD_Internal_BeginBlock(ctx, EntityDef, 0);
+	int start = buf->size;
+	VRD_Internal_EncodeEntityDef(buf, entityId, frame, name, path, pathId, type_name, typeNameId, category_name, categoryNameId, xform, staticParams, staticParamsCount);
+	if (ctx->keep_dropped) VRD_Internal_KeepBlock(ctx, buf, start);
+	VRD_Internal_EndBlock(ctx, buf);
+}
+
+void VRD_Internal_WriteEntityUndef(VRD_replay_context* ctx, int entityId, int frame)
+{
+	if (ctx->value_series.frames) VRD_Internal_WriteEntityValueSeries(ctx, entityId, frame);
+	if (ctx->delta_transforms || ctx->chunk_frames || ctx->ring)
+	{
+		std::unique_lock<std::mutex> lock;
+		if (ctx->thread_lanes) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+		if (ctx->ring) VRD_Internal_RetireEntityDef(ctx, entityId, frame);
+		VRD_EntityState* state = ctx->summary ? VRD_Internal_FindEntityState(ctx, entityId) : 0;
+		if (state && state->summary_entity) ctx->summary->entities[state->summary_entity - 1].undef_frame = frame;
+		VRD_Internal_RemoveEntityState(ctx, entityId);
+	}
+
+	VRD_StagingBuffer* buf = VRD_Internal_BeginBlock(ctx, EntityUndef, 0);
+	int start = buf->size;
+	VRD_Internal_WriteEntityHeader(buf, EntityUndef, entityId, frame);
+	if (ctx->keep_dropped) VRD_Internal_KeepBlock(ctx, buf, start);
+	VRD_Internal_EndBlock(ctx, buf);
+}
+
+void VRD_Internal_WriteEntityLog(VRD_replay_context* ctx, int entityId, int frame, const char* log, int logLength, const char* category, enum VRD_Color color)
+{
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntityLog, category, color);
+	if (ctx->summary) VRD_Internal_PushLogMarker(ctx, entityId, frame); // After the lane of the thread is set
+	VRD_LogBlock::Write(buf, entityId, frame, VRD_Internal_Label(category, categoryId), VRD_Internal_String(log, logLength), color);
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_SetPosition(VRD_replay_context* ctx, entityKeyType entityId, VRD_Point* pos)
+void VRD_Internal_WriteEntityLogFormat(VRD_replay_context* ctx, int entityId, int frame, const char* category, enum VRD_Color color, const char* format, va_list args)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_WriteEntityPosition(ctx, id, ctx->frame, pos);
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	int formatId = VRD_Internal_InternString(ctx, format);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntityLogFormat, category, color);
+	if (ctx->summary) VRD_Internal_PushLogMarker(ctx, entityId, frame); // After the lane of the thread is set
+	VRD_Internal_WriteEntityHeader(buf, EntityLogFormat, entityId, frame);
+	VRD_Internal_WriteLabel(buf, category, categoryId);
+	VRD_Internal_WriteLabel(buf, format, formatId);
+	VRD_Internal_WriteColor(buf, color);
+
+	int start = buf->size;
+	va_list copy;
+	va_copy(copy, args);
+	VRD_Internal_WriteLogArgs(buf, format, copy);
+	va_end(copy);
+	VRD_Internal_PrefixSize(buf, start);
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_SetTransform(VRD_replay_context* ctx, entityKeyType entityId, VRD_Transform* xform)
+void VRD_Internal_WriteEntityPosition(VRD_replay_context* ctx, int entityId, int frame, VRD_Point* pos)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_WriteEntityTransform(ctx, id, ctx->frame, xform);
+	if (ctx->chunk_frames) VRD_Internal_RecordEntityTransform(ctx, entityId, pos, 0);
+	if (ctx->delta_transforms)
+	{
+		VRD_Internal_WriteEntityTransformDelta(ctx, entityId, frame, pos, 0);
+		return;
+	}
+
+	VRD_StagingBuffer* buf = VRD_Internal_BeginBlock(ctx, EntitySetPos, 0);
+	VRD_SetPosBlock::Write(buf, entityId, frame, VRD_Internal_PointOrZero(pos));
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_SetDynamicParamString(VRD_replay_context* ctx, entityKeyType entityId, const char* key, const char* val)
+void VRD_Internal_WriteEntityTransform(VRD_replay_context* ctx, int entityId, int frame, VRD_Transform* xform)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_SetDynamicParamString(ctx, id, ctx->frame, key, val);
+	if (ctx->chunk_frames) VRD_Internal_RecordEntityTransform(ctx, entityId, xform ? &xform->translation : 0, xform ? &xform->rotation : &VRD_Identity.rotation);
+	if (ctx->delta_transforms)
+	{
+		if (xform == 0) xform = &VRD_Identity;
+		VRD_Internal_WriteEntityTransformDelta(ctx, entityId, frame, &xform->translation, &xform->rotation);
+		return;
+	}
+
+	VRD_StagingBuffer* buf = VRD_Internal_BeginBlock(ctx, EntitySetTransform, 0);
+	VRD_SetTransformBlock::Write(buf, entityId, frame, xform ? *xform : VRD_Identity);
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_SetDynamicParamFloat(VRD_replay_context* ctx, entityKeyType entityId, const char* key, float val)
+// Quantized position deltas against the last written value, rotations only when they changed. Nothing is written if the transform did not change.
+void VRD_Internal_WriteEntityTransformDelta(VRD_replay_context* ctx, int entityId, int frame, VRD_Point* pos, VRD_Quaternion* rot)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_SetDynamicParamFloat(ctx, id, ctx->frame, key, val);
+	VRD_EntityState* state = VRD_Internal_GetEntityState(ctx, entityId);
+	if (state == 0)
+	{
+		ctx->status = 0; // Out of memory, stop capturing
+		return;
+	}
+	if (pos == 0) pos = &VRD_PointZero;
+
+	int qpos[3] = { VRD_Internal_QuantizePosition(ctx, pos->x), VRD_Internal_QuantizePosition(ctx, pos->y), VRD_Internal_QuantizePosition(ctx, pos->z) };
+	bool full = state->full_frame < 0 || (frame - state->full_frame) >= ctx->transform_keyframe_interval;
+
+	int flags = full ? VRD_TransformDelta_Full : 0;
+	if (qpos[0] != state->qpos[0]) flags |= VRD_TransformDelta_X;
+	if (qpos[1] != state->qpos[1]) flags |= VRD_TransformDelta_Y;
+	if (qpos[2] != state->qpos[2]) flags |= VRD_TransformDelta_Z;
+
+	unsigned short qrot[3];
+	unsigned char qrotIndex = 0;
+	if (rot)
+	{
+		qrotIndex = VRD_Internal_QuantizeRotation(rot, qrot);
+		if (full || !state->has_rotation || qrotIndex != state->qrot_index || memcmp(qrot, state->qrot, sizeof(qrot)) != 0)
+		{
+			flags |= VRD_TransformDelta_Rotation | (qrotIndex << VRD_TransformDelta_RotationIndexShift);
+		}
+	}
+	if (flags == 0) return; // unchanged
+
+	VRD_StagingBuffer* buf = VRD_Internal_BeginBlock(ctx, EntityTransformDelta, 0);
+	VRD_Internal_WriteEntityHeader(buf, EntityTransformDelta, entityId, frame);
+	VRD_Internal_WriteChar(buf, (char)flags);
+	if (full)
+	{
+		VRD_Internal_WriteZigZag(buf, qpos[0]);
+		VRD_Internal_WriteZigZag(buf, qpos[1]);
+		VRD_Internal_WriteZigZag(buf, qpos[2]);
+		state->full_frame = frame;
+	}
+	else
+	{
+		// Wrapping differences, a jump across the clamped range is still decoded exactly
+		if (flags & VRD_TransformDelta_X) VRD_Internal_WriteZigZag(buf, (int)((unsigned int)qpos[0] - (unsigned int)state->qpos[0]));
+		if (flags & VRD_TransformDelta_Y) VRD_Internal_WriteZigZag(buf, (int)((unsigned int)qpos[1] - (unsigned int)state->qpos[1]));
+		if (flags & VRD_TransformDelta_Z) VRD_Internal_WriteZigZag(buf, (int)((unsigned int)qpos[2] - (unsigned int)state->qpos[2]));
+	}
+	if (flags & VRD_TransformDelta_Rotation)
+	{
+		unsigned char* p = VRD_Internal_Reserve(buf, 6);
+		if (p) memcpy(p, qrot, 6);
+		memcpy(state->qrot, qrot, sizeof(qrot));
+		state->qrot_index = qrotIndex;
+		state->has_rotation = 1;
+	}
+	memcpy(state->qpos, qpos, sizeof(qpos));
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_DrawSphere(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* pos, float radius, enum VRD_Color color)
+void VRD_Internal_SetDynamicParamString(VRD_replay_context* ctx, int entityId, int frame, const char* key, const char* val, int valLength)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_DrawSphere(ctx, id, ctx->frame, category, pos, radius, color);
+	if (ctx->chunk_frames) VRD_Internal_RecordEntityParam(ctx, entityId, key, val ? val : "", val ? valLength : 0, 0);
+	int keyId = VRD_Internal_InternString(ctx, key);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginBlock(ctx, EntityParameter, 0);
+	VRD_ParameterBlock::Write(buf, entityId, frame, VRD_Internal_Label(key, keyId), VRD_Internal_String(val, valLength));
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_DrawBox(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Transform* xform, VRD_Point* dimensions, enum VRD_Color color)
+void VRD_Internal_SetDynamicParamFloat(VRD_replay_context* ctx, int entityId, int frame, const char* key, float val)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_DrawBox(ctx, id, ctx->frame, category, xform, dimensions, color);
+	if (ctx->chunk_frames) VRD_Internal_RecordEntityParam(ctx, entityId, key, 0, 0, val);
+	int keyId = VRD_Internal_InternString(ctx, key);
+	if (ctx->value_series.frames && key != 0 && VRD_Internal_PushValueSample(ctx, entityId, frame, key, keyId, val)) return;
+	VRD_StagingBuffer* buf = VRD_Internal_BeginBlock(ctx, EntityValue, 0);
+	VRD_ValueBlock::Write(buf, entityId, frame, VRD_Internal_Label(key, keyId), val);
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_DrawCapsule(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* p1, VRD_Point* p2, float radius, enum VRD_Color color)
+void VRD_Internal_DrawSphere(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* pos, float radius, enum VRD_Color color)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_DrawCapsule(ctx, id, ctx->frame, category, p1, p2, radius, color);
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntitySphere, category, color);
+	VRD_SphereBlock::Write(buf, entityId, frame, VRD_Internal_Label(category, categoryId), VRD_Internal_PointOrZero(pos), radius, color);
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_DrawMesh(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* verts, int vertCount, enum VRD_Color color)
+void VRD_Internal_DrawBox(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Transform* xform, VRD_Point* dimensions, enum VRD_Color color)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_DrawMesh(ctx, id, ctx->frame, category, verts, vertCount, color);
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntityBox, category, color);
+	VRD_BoxBlock::Write(buf, entityId, frame, VRD_Internal_Label(category, categoryId), xform ? *xform : VRD_Identity, VRD_Internal_PointOrZero(dimensions), color);
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_DrawLine(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* p1, VRD_Point* p2, enum VRD_Color color)
+void VRD_Internal_DrawCapsule(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* p1, VRD_Point* p2, float radius, enum VRD_Color color)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_DrawLine(ctx, id, ctx->frame, category, p1, p2, color);
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntityCapsule, category, color);
+	VRD_CapsuleBlock::Write(buf, entityId, frame, VRD_Internal_Label(category, categoryId), VRD_Internal_PointOrZero(p1), VRD_Internal_PointOrZero(p2), radius, color);
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_DrawCircle(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* position, VRD_Point* up, float radius, enum VRD_Color color)
+void VRD_Internal_DrawMesh(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* verts, int vertCount, enum VRD_Color color)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	int id = VRD_Internal_EntityMap(ctx, entityId);
-	VRD_Internal_DrawCircle(ctx, id, ctx->frame, category, position, up, radius, color);
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntityMesh, category, color);
+	VRD_Internal_WriteEntityHeader(buf, EntityMesh, entityId, frame);
+	VRD_Internal_WriteLabel(buf, category, categoryId);
+	VRD_Internal_WriteInt(buf, vertCount);
+	if (vertCount > 0)
+	{
+		VRD_Internal_WriteBytes(buf, verts, vertCount * (int)sizeof(VRD_Point));
+	}
+	VRD_Internal_WriteColor(buf, color);
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_StepFrame(VRD_replay_context* ctx, float totalTime)
+// Mesh in its own space, transformed as it is written, for contexts without a mesh cache.
+void VRD_Internal_DrawMeshTransformed(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* verts, int vertCount, VRD_Transform* xform, enum VRD_Color color)
 {
-	if (ctx == 0 || ctx->status == 0) return;
-	VRD_Internal_WriteFrameStep(ctx, totalTime);
-	ctx->frame += 1;
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntityMesh, category, color);
+	VRD_Internal_WriteEntityHeader(buf, EntityMesh, entityId, frame);
+	VRD_Internal_WriteLabel(buf, category, categoryId);
+	VRD_Internal_WriteInt(buf, vertCount);
+	const VRD_Point* t = &xform->translation;
+	const VRD_Quaternion* q = &xform->rotation;
+	for (int i = 0; i < vertCount; ++i)
+	{
+		// v + 2w(q x v) + 2q x (q x v)
+		const VRD_Point* v = &verts[i];
+		float cx = 2 * (q->y * v->z - q->z * v->y);
+		float cy = 2 * (q->z * v->x - q->x * v->z);
+		float cz = 2 * (q->x * v->y - q->y * v->x);
+		VRD_Point p;
+		p.x = v->x + q->w * cx + (q->y * cz - q->z * cy) + t->x;
+		p.y = v->y + q->w * cy + (q->z * cx - q->x * cz) + t->y;
+		p.z = v->z + q->w * cz + (q->x * cy - q->y * cx) + t->z;
+		VRD_Internal_WritePoint(buf, &p);
+	}
+	VRD_Internal_WriteColor(buf, color);
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-/// 
-/// Internal
-///
-
-enum VRD_BlockType
+// Reference to a cached mesh, its MeshDef block is written on first use. Meshes that do not fit in the cache are written whole.
+void VRD_Internal_DrawMeshRef(VRD_replay_context* ctx, int entityId, int frame, const char* category, unsigned long long meshKey, VRD_Point* verts, int vertCount, VRD_Transform* xform, enum VRD_Color color)
 {
-	None = 0,
-	FrameStep,
-	EntityDef,
-	EntityUndef,
-	EntitySetPos,
-	EntitySetTransform,
-	EntityLog,
-	EntityParameter,
-	EntityValue,
-	EntityLine,
-	EntityCircle,
-	EntitySphere,
-	EntityCapsule,
-	EntityMesh,
-	EntityBox,
-
-	ReplayHeader = 0xFF
-};
+	int meshId = 0;
+	if (ctx->meshes.budget > 0 && verts != 0 && vertCount > 0)
+	{
+		VRD_CaptureCounters* counters = &ctx->counters;
+		std::unique_lock<std::mutex> lock;
+		if (ctx->thread_lanes)
+		{
+			VRD_ThreadLane* lane = (VRD_TlsLane.context_serial == ctx->serial) ? VRD_TlsLane.lane : VRD_Internal_GetThreadLane(ctx, VRD_AUTO_THREAD_LANE);
+			if (lane) counters = &lane->counters;
+			lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+		}
+		meshId = VRD_Internal_LookupMesh(ctx, meshKey, verts, vertCount, counters);
+	}
+	if (meshId == 0)
+	{
+		if (xform) VRD_Internal_DrawMeshTransformed(ctx, entityId, frame, category, verts, vertCount, xform, color);
+		else VRD_Internal_DrawMesh(ctx, entityId, frame, category, verts, vertCount, color);
+		return;
+	}
 
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntityMeshRef, category, color);
+	VRD_Internal_WriteEntityHeader(buf, EntityMeshRef, entityId, frame);
+	VRD_Internal_WriteLabel(buf, category, categoryId);
+	VRD_Internal_Write7BitEncodedInt(buf, (meshId << 1) | (xform ? 1 : 0)); // low bit: a transform follows
+	if (xform) VRD_Internal_WriteTransform(buf, xform);
+	VRD_Internal_WriteColor(buf, color);
+	VRD_Internal_EndBlock(ctx, buf);
+}
 
-int VRD_Internal_EntityMap(VRD_replay_context* ctx, entityKeyType entityAddr)
+void VRD_Internal_DrawLine(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* p1, VRD_Point* p2, enum VRD_Color color)
 {
-	if (ctx == 0 || ctx->status == 0) return -1;
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntityLine, category, color);
+	VRD_LineBlock::Write(buf, entityId, frame, VRD_Internal_Label(category, categoryId), VRD_Internal_PointOrZero(p1), VRD_Internal_PointOrZero(p2), color);
+	VRD_Internal_EndBlock(ctx, buf);
+}
 
-	if (sizeof(entityKeyType) == sizeof(int)) return (entityAddr + 1); // No need to map if key is 32 bits
+void VRD_Internal_DrawCircle(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* position, VRD_Point* up, float radius, enum VRD_Color color)
+{
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntityCircle, category, color);
+	VRD_CircleBlock::Write(buf, entityId, frame, VRD_Internal_Label(category, categoryId), VRD_Internal_PointOrZero(position), VRD_Internal_PointOrZero(up), radius, color);
+	VRD_Internal_EndBlock(ctx, buf);
+}
 
-	// Note: This could be replaced with a hash-map
-	// *BUT* if this becomes a bottleneck, it means we have way too many entities
+// Batch blocks: frame, count, entity ids (zigzag deltas from the previous id), then every float component as a packed array.
+// Ids are mapped under a single entity map lock. Caller already began the block, so that its lane is set up.
+static inline void VRD_Internal_WriteBatchIds(VRD_replay_context* ctx, VRD_StagingBuffer* buf, const entityKeyType* entityIds, int count)
+{
+	VRD_Internal_Write7BitEncodedInt(buf, count);
+	unsigned char* p = VRD_Internal_Reserve(buf, count * 5);
+	if (p == 0) return;
 
-	// find id in map
-	if (ctx->entity_map_count > 0)
+	std::unique_lock<std::mutex> lock;
+	if (ctx->thread_lanes && sizeof(entityKeyType) != sizeof(int)) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+	int len = 0;
+	unsigned int last = 0;
+	for (int i = 0; i < count; ++i)
 	{
-		VRD_EntityMapItem* it = ctx->entity_map;
-		int nb = ctx->entity_map_count;
-		for (int i = 0; i < nb; ++i)
-		{
-			if (it->address == entityAddr) return (i + 1);
-			++it;
-		}
+		unsigned int id = (unsigned int)VRD_Internal_EntityMapLocked(ctx, entityIds[i]);
+		unsigned int delta = id - last; // Wraps around, ids of 32-bit keys cover the whole int range
+		len += VRD_Internal_Encode7BitEncodedInt(p + len, (int)((delta << 1) ^ (0u - (delta >> 31))));
+		last = id;
 	}
-	// Not found
+	buf->size -= count * 5 - len; // give back unused reserve
+}
 
-	// Make sure there is room in the map
-	const int entityMapGrowthSize = 16 << 10;
-	if (ctx->entity_map == 0)
+// One component of an array of structs, stride in floats.
+static inline void VRD_Internal_WriteComponents(VRD_StagingBuffer* buf, const float* first, int stride, int count)
+{
+	unsigned char* p = VRD_Internal_Reserve(buf, count * 4);
+	if (p == 0) return;
+	for (int i = 0; i < count; ++i)
 	{
-		ctx->entity_map = static_cast<VRD_EntityMapItem*>(malloc(entityMapGrowthSize * sizeof(VRD_EntityMapItem)));
-		ctx->entity_map_capacity = entityMapGrowthSize;
-		ctx->entity_map_count = 0;
+		memcpy(p + i * 4, first + i * stride, 4);
 	}
-	else if (ctx->entity_map_count >= ctx->entity_map_capacity)
+}
+
+static inline void VRD_Internal_WritePoints(VRD_StagingBuffer* buf, const VRD_Point* points, int count)
+{
+	VRD_Internal_WriteComponents(buf, &points->x, 3, count);
+	VRD_Internal_WriteComponents(buf, &points->y, 3, count);
+	VRD_Internal_WriteComponents(buf, &points->z, 3, count);
+}
+
+// Chunk keyframes need the last transform of each entity.
+static inline void VRD_Internal_RecordBatchTransforms(VRD_replay_context* ctx, const entityKeyType* entityIds, const VRD_Point* positions, const VRD_Transform* xforms, int count)
+{
+	for (int i = 0; i < count; ++i)
 	{
-		VRD_EntityMapItem* orig = ctx->entity_map;
-		ctx->entity_map = static_cast<VRD_EntityMapItem*>(realloc(orig, (ctx->entity_map_capacity + entityMapGrowthSize) * sizeof(VRD_EntityMapItem)));
-		// TODO: handle realloc fail here.
-		ctx->entity_map_capacity += entityMapGrowthSize;
+		int id = VRD_Internal_EntityMap(ctx, entityIds[i]);
+		if (positions) VRD_Internal_RecordEntityTransform(ctx, id, const_cast<VRD_Point*>(&positions[i]), 0);
+		else VRD_Internal_RecordEntityTransform(ctx, id, const_cast<VRD_Point*>(&xforms[i].translation), const_cast<VRD_Quaternion*>(&xforms[i].rotation));
 	}
+}
 
-	// insert in map
-	VRD_EntityMapItem addr = { entityAddr };
-	if (ctx->entity_map != 0)
+void VRD_Internal_WritePositionBatch(VRD_replay_context* ctx, int frame, const entityKeyType* entityIds, const VRD_Point* positions, int count)
+{
+	if (ctx->delta_transforms)
 	{
-		int index = ctx->entity_map_count;
-		ctx->entity_map[index] = addr;
-		ctx->entity_map_count += 1;
-		return (index + 1);
+		// Deltas are per entity anyway, and unchanged entities are skipped
+		for (int i = 0; i < count; ++i) VRD_Internal_WriteEntityPosition(ctx, VRD_Internal_EntityMap(ctx, entityIds[i]), frame, const_cast<VRD_Point*>(&positions[i]));
+		return;
 	}
 
-	return -1;
+	VRD_StagingBuffer* buf = VRD_Internal_BeginBlock(ctx, EntitySetPosBatch, 0);
+	VRD_Internal_Write7BitEncodedInt(buf, EntitySetPosBatch);
+	VRD_Internal_Write7BitEncodedInt(buf, frame);
+	VRD_Internal_WriteBatchIds(ctx, buf, entityIds, count);
+	VRD_Internal_WritePoints(buf, positions, count);
+	VRD_Internal_EndBlock(ctx, buf);
+	if (ctx->chunk_frames) VRD_Internal_RecordBatchTransforms(ctx, entityIds, positions, 0, count);
 }
 
-void VRD_Internal_Write(VRD_replay_context* ctx, void* buffer, int buffer_len)
+void VRD_Internal_WriteTransformBatch(VRD_replay_context* ctx, int frame, const entityKeyType* entityIds, const VRD_Transform* xforms, int count)
 {
-#ifdef VRD_USE_ZLIB
-	ctx->z_strm.avail_in = buffer_len;
-	ctx->z_strm.next_in = buffer;
-	ctx->z_strm.avail_out = VRD_ZLIB_COMPRESSION_BUFFER_SIZE;
-	ctx->z_strm.next_out = ctx->z_compression_buffer;
-	if (deflate(&ctx->z_strm, Z_NO_FLUSH) != Z_STREAM_ERROR)
+	if (ctx->delta_transforms)
 	{
-		int writeCount = VRD_ZLIB_COMPRESSION_BUFFER_SIZE - ctx->z_strm.avail_out;
-		fwrite(ctx->z_compression_buffer, writeCount, 1, ctx->fp);
+		for (int i = 0; i < count; ++i) VRD_Internal_WriteEntityTransform(ctx, VRD_Internal_EntityMap(ctx, entityIds[i]), frame, const_cast<VRD_Transform*>(&xforms[i]));
+		return;
 	}
-#else
-	fwrite(buffer, buffer_len, 1, ctx->fp);
-#endif
-}
 
-void VRD_Internal_WriteChar(VRD_replay_context* ctx, char value)
-{
-	VRD_Internal_Write(ctx, &value, 1);
+	const int stride = sizeof(VRD_Transform) / sizeof(float);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginBlock(ctx, EntitySetTransformBatch, 0);
+	VRD_Internal_Write7BitEncodedInt(buf, EntitySetTransformBatch);
+	VRD_Internal_Write7BitEncodedInt(buf, frame);
+	VRD_Internal_WriteBatchIds(ctx, buf, entityIds, count);
+	VRD_Internal_WriteComponents(buf, &xforms->translation.x, stride, count);
+	VRD_Internal_WriteComponents(buf, &xforms->translation.y, stride, count);
+	VRD_Internal_WriteComponents(buf, &xforms->translation.z, stride, count);
+	VRD_Internal_WriteComponents(buf, &xforms->rotation.x, stride, count);
+	VRD_Internal_WriteComponents(buf, &xforms->rotation.y, stride, count);
+	VRD_Internal_WriteComponents(buf, &xforms->rotation.z, stride, count);
+	VRD_Internal_WriteComponents(buf, &xforms->rotation.w, stride, count);
+	VRD_Internal_EndBlock(ctx, buf);
+	if (ctx->chunk_frames) VRD_Internal_RecordBatchTransforms(ctx, entityIds, 0, xforms, count);
 }
 
-void VRD_Internal_WriteInt(VRD_replay_context* ctx, int value)
+// Draw batches: category and color, shared by the whole batch, before the count.
+void VRD_Internal_DrawLineBatch(VRD_replay_context* ctx, int frame, const entityKeyType* entityIds, const char* category, const VRD_Point* p1, const VRD_Point* p2, int count, enum VRD_Color color)
 {
-	VRD_Internal_Write(ctx, &value, 4);
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntityLineBatch, category, color);
+	VRD_Internal_Write7BitEncodedInt(buf, EntityLineBatch);
+	VRD_Internal_Write7BitEncodedInt(buf, frame);
+	VRD_Internal_WriteLabel(buf, category, categoryId);
+	VRD_Internal_WriteColor(buf, color);
+	VRD_Internal_WriteBatchIds(ctx, buf, entityIds, count);
+	VRD_Internal_WritePoints(buf, p1, count);
+	VRD_Internal_WritePoints(buf, p2, count);
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_Internal_WriteFloat(VRD_replay_context* ctx, float value)
+void VRD_Internal_DrawSphereBatch(VRD_replay_context* ctx, int frame, const entityKeyType* entityIds, const char* category, const VRD_Point* centers, const float* radii, int count, enum VRD_Color color)
 {
-	VRD_Internal_Write(ctx, &value, 4);
+	int categoryId = VRD_Internal_InternString(ctx, category);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginDrawBlock(ctx, EntitySphereBatch, category, color);
+	VRD_Internal_Write7BitEncodedInt(buf, EntitySphereBatch);
+	VRD_Internal_Write7BitEncodedInt(buf, frame);
+	VRD_Internal_WriteLabel(buf, category, categoryId);
+	VRD_Internal_WriteColor(buf, color);
+	VRD_Internal_WriteBatchIds(ctx, buf, entityIds, count);
+	VRD_Internal_WritePoints(buf, centers, count);
+	VRD_Internal_WriteComponents(buf, radii, 1, count);
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_Internal_Write7BitEncodedInt(VRD_replay_context* ctx, int value)
+///
+/// Value series
+///
+
+VRD_EntitySeries* VRD_Internal_FindEntitySeries(VRD_ValueSeriesTable* table, int entityId)
 {
-	int num = (int)value;
-	while (num >= 0x80)
+	if (table->count == 0) return 0;
+	int index = VRD_Internal_HashInt(entityId) & (table->capacity - 1);
+	while (table->items[index].id != 0)
 	{
-		VRD_Internal_WriteChar(ctx, (char)(num | 0x80));
-		num = num >> 7;
+		if (table->items[index].id == entityId) return &table->items[index];
+		index = (index + 1) & (table->capacity - 1);
 	}
-	VRD_Internal_WriteChar(ctx, (char)num);
+	return 0;
 }
 
-void VRD_Internal_WriteColor(VRD_replay_context* ctx, enum VRD_Color color)
+static inline void VRD_Internal_InsertEntitySeries(VRD_EntitySeries* items, int capacity, const VRD_EntitySeries* item)
 {
-	VRD_Internal_Write7BitEncodedInt(ctx, color);
+	int index = VRD_Internal_HashInt(item->id) & (capacity - 1);
+	while (items[index].id != 0) index = (index + 1) & (capacity - 1);
+	items[index] = *item;
 }
 
-void VRD_Internal_WriteString(VRD_replay_context* ctx, const char* s)
+VRD_EntitySeries* VRD_Internal_GetEntitySeries(VRD_ValueSeriesTable* table, int entityId)
 {
-	int len = 0;
-	if (s) { len = strlen(s); }
-	VRD_Internal_Write7BitEncodedInt(ctx, len);
-	if (len > 0)
+	VRD_EntitySeries* item = VRD_Internal_FindEntitySeries(table, entityId);
+	if (item) return item;
+	if ((table->count + 1) * 2 > table->capacity)
 	{
-		VRD_Internal_Write(ctx, (void*)s, len);
+		int capacity = table->capacity > 0 ? table->capacity * 2 : 256;
+		VRD_EntitySeries* items = static_cast<VRD_EntitySeries*>(calloc(capacity, sizeof(VRD_EntitySeries)));
+		VRD_EntitySeries* spare = static_cast<VRD_EntitySeries*>(malloc(capacity * sizeof(VRD_EntitySeries)));
+		if (items == 0 || spare == 0)
+		{
+			free(items);
+			free(spare);
+			return 0;
+		}
+		for (int i = 0; i < table->capacity; ++i)
+		{
+			if (table->items[i].id != 0) VRD_Internal_InsertEntitySeries(items, capacity, &table->items[i]);
+		}
+		free(table->items);
+		free(table->spare);
+		table->items = items;
+		table->spare = spare;
+		table->capacity = capacity;
 	}
-}
 
-static VRD_Point VRD_PointZero = { 0,0,0 };
-static VRD_Transform VRD_Identity = { {0,0,0},{0,0,0,1} };
+	int index = VRD_Internal_HashInt(entityId) & (table->capacity - 1);
+	while (table->items[index].id != 0) index = (index + 1) & (table->capacity - 1);
+	item = &table->items[index];
+	memset(item, 0, sizeof(VRD_EntitySeries));
+	item->id = entityId;
+	table->count += 1;
+	return item;
+}
 
-void VRD_Internal_WritePoint(VRD_replay_context* ctx, VRD_Point* point)
+void VRD_Internal_FreeEntitySeries(VRD_EntitySeries* item)
 {
-	if (point == 0)
+	for (int i = 0; i < item->series_count; ++i)
 	{
-		point = &VRD_PointZero;
+		free(item->series[i].key);
+		free(item->series[i].frames);
+		free(item->series[i].values);
 	}
-
-	VRD_Internal_WriteFloat(ctx, point->x);
-	VRD_Internal_WriteFloat(ctx, point->y);
-	VRD_Internal_WriteFloat(ctx, point->z);
+	free(item->series);
 }
 
-void VRD_Internal_WriteTransform(VRD_replay_context* ctx, VRD_Transform* xform)
+// Returns false when out of memory, the value is then written as a single value block.
+bool VRD_Internal_PushValueSample(VRD_replay_context* ctx, int entityId, int frame, const char* key, int keyId, float value)
 {
-	if (xform == 0)
+	std::unique_lock<std::mutex> lock;
+	if (ctx->thread_lanes) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+	VRD_EntitySeries* item = VRD_Internal_GetEntitySeries(&ctx->value_series, entityId);
+	if (item == 0) return false;
+
+	VRD_ValueSeries* series = 0;
+	for (int i = 0; i < item->series_count && series == 0; ++i)
 	{
-		xform = &VRD_Identity;
+		int index = (item->cursor + i) % item->series_count;
+		if (strcmp(item->series[index].key, key) == 0)
+		{
+			series = &item->series[index];
+			item->cursor = index + 1;
+		}
+	}
+	if (series == 0)
+	{
+		if (item->series_count >= item->series_capacity)
+		{
+			int capacity = item->series_capacity > 0 ? item->series_capacity * 2 : 4;
+			VRD_ValueSeries* grown = static_cast<VRD_ValueSeries*>(realloc(item->series, capacity * sizeof(VRD_ValueSeries)));
+			if (grown == 0) return false;
+			item->series = grown;
+			item->series_capacity = capacity;
+		}
+		char* keyCopy = VRD_Internal_CopyString(key);
+		if (keyCopy == 0) return false;
+		series = &item->series[item->series_count++];
+		memset(series, 0, sizeof(VRD_ValueSeries));
+		series->key = keyCopy;
+		item->cursor = item->series_count;
 	}
 
-	VRD_Internal_WriteFloat(ctx, xform->translation.x);
-	VRD_Internal_WriteFloat(ctx, xform->translation.y);
-	VRD_Internal_WriteFloat(ctx, xform->translation.z);
-	VRD_Internal_WriteFloat(ctx, xform->rotation.x);
-	VRD_Internal_WriteFloat(ctx, xform->rotation.y);
-	VRD_Internal_WriteFloat(ctx, xform->rotation.z);
-	VRD_Internal_WriteFloat(ctx, xform->rotation.w);
+	if (series->count >= series->capacity)
+	{
+		int capacity = series->capacity > 0 ? series->capacity * 2 : 16;
+		int* frames = static_cast<int*>(realloc(series->frames, capacity * sizeof(int)));
+		if (frames == 0) return false;
+		series->frames = frames;
+		float* values = static_cast<float*>(realloc(series->values, capacity * sizeof(float)));
+		if (values == 0) return false;
+		series->values = values;
+		series->capacity = capacity;
+	}
+	series->key_id = keyId;
+	series->frames[series->count] = frame;
+	series->values[series->count] = value;
+	series->count += 1;
+	item->active = 1;
+	return true;
 }
 
-void VRD_Internal_WriteReplayHeader(VRD_replay_context* ctx)
+// Bits are packed from the least significant bit of each byte.
+struct VRD_BitWriter
 {
-#ifdef VRD_USE_ZLIB
-	VRD_Internal_Write7BitEncodedInt(ctx, ReplayHeader);
-#else
-	VRD_Internal_WriteInt(ctx, ReplayHeader);
-#endif
+	unsigned char* p;
+	unsigned long long bits;
+	int count;
+};
+
+static inline void VRD_Internal_WriteBits(VRD_BitWriter* w, unsigned int value, int n)
+{
+	w->bits |= (unsigned long long)value << w->count;
+	w->count += n;
+	while (w->count >= 8)
+	{
+		*w->p++ = (unsigned char)w->bits;
+		w->bits >>= 8;
+		w->count -= 8;
+	}
 }
 
-void VRD_Internal_WriteEntityHeader(VRD_replay_context* ctx, enum VRD_BlockType blockType, int entityId, int frame)
+static inline int VRD_Internal_LeadingZeros(unsigned int x)
 {
-	VRD_Internal_Write7BitEncodedInt(ctx, blockType);
-	VRD_Internal_Write7BitEncodedInt(ctx, frame);
-	VRD_Internal_Write7BitEncodedInt(ctx, entityId);
+	int n = 0;
+	while ((x & 0x80000000u) == 0) { x <<= 1; ++n; }
+	return n;
 }
 
-void VRD_Internal_WriteFrameStep(VRD_replay_context* ctx, float totalTime)
+static inline int VRD_Internal_TrailingZeros(unsigned int x)
 {
-	VRD_Internal_Write7BitEncodedInt(ctx, FrameStep);
-	VRD_Internal_WriteFloat(ctx, totalTime);
+	int n = 0;
+	while ((x & 1) == 0) { x >>= 1; ++n; }
+	return n;
 }
 
-void VRD_Internal_WriteEntityDef(VRD_replay_context* ctx, int entityId, int frame, const char* name, const char* path, const char* type_name, const char* category_name, VRD_Transform* xform, VRD_StringDictPair* staticParams, int staticParamsCount)
+// Entity header, key, sample count, frames back from the block frame to the first sample, then the size of the sample bits. The first value is written whole,
+// then per sample the delta of frame deltas (0, or 7, 9, 12 or 32 bits behind a 2 to 4 bit prefix) and the XOR of the value with the previous one (Gorilla):
+// 0 when equal, else its meaningful bits, within the previous leading and trailing zeros when they fit, or behind 5 bits of leading zeros and 5 of length.
+static void VRD_Internal_EncodeValueSeries(VRD_StagingBuffer* buf, int entityId, int frame, const VRD_ValueSeries* series)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntityDef, entityId, frame);
-	VRD_Internal_Write7BitEncodedInt(ctx, entityId);
+	VRD_Internal_WriteEntityHeader(buf, EntityValueSeries, entityId, frame);
+	VRD_Internal_WriteLabel(buf, series->key, series->key_id);
+	VRD_Internal_Write7BitEncodedInt(buf, series->count);
+	VRD_Internal_Write7BitEncodedInt(buf, frame - series->frames[0]);
 
-	VRD_Internal_WriteString(ctx, name);
-	VRD_Internal_WriteString(ctx, path);
-	VRD_Internal_WriteString(ctx, type_name);
-	VRD_Internal_WriteString(ctx, category_name);
-	VRD_Internal_WriteTransform(ctx, xform);
-	VRD_Internal_Write7BitEncodedInt(ctx, staticParamsCount);
-	for (int i = 0; i < staticParamsCount; ++i)
+	int start = buf->size;
+	int reserve = series->count * 10 + 5; // at most 36 frame bits and 44 value bits per sample
+	unsigned char* p = VRD_Internal_Reserve(buf, reserve);
+	if (p == 0) return;
+	VRD_BitWriter w = { p, 0, 0 };
+	unsigned int previous;
+	memcpy(&previous, &series->values[0], 4);
+	VRD_Internal_WriteBits(&w, previous, 32);
+	int previousDelta = 1;
+	int previousLeading = -1, previousTrailing = 0;
+	for (int i = 1; i < series->count; ++i)
 	{
-		VRD_Internal_WriteString(ctx, staticParams[i].key);
-		VRD_Internal_WriteString(ctx, staticParams[i].value);
-	}
-	VRD_Internal_Write7BitEncodedInt(ctx, frame);
+		int delta = series->frames[i] - series->frames[i - 1];
+		int dod = delta - previousDelta;
+		previousDelta = delta;
+		if (dod == 0) VRD_Internal_WriteBits(&w, 0, 1);
+		else if (dod >= -63 && dod <= 64) { VRD_Internal_WriteBits(&w, 0x1, 2); VRD_Internal_WriteBits(&w, dod + 63, 7); }
+		else if (dod >= -255 && dod <= 256) { VRD_Internal_WriteBits(&w, 0x3, 3); VRD_Internal_WriteBits(&w, dod + 255, 9); }
+		else if (dod >= -2047 && dod <= 2048) { VRD_Internal_WriteBits(&w, 0x7, 4); VRD_Internal_WriteBits(&w, dod + 2047, 12); }
+		else { VRD_Internal_WriteBits(&w, 0xf, 4); VRD_Internal_WriteBits(&w, (unsigned int)dod, 32); }
 
+		unsigned int value;
+		memcpy(&value, &series->values[i], 4);
+		unsigned int x = value ^ previous;
+		previous = value;
+		if (x == 0)
+		{
+			VRD_Internal_WriteBits(&w, 0, 1);
+			continue;
+		}
+		int leading = VRD_Internal_LeadingZeros(x);
+		int trailing = VRD_Internal_TrailingZeros(x);
+		if (previousLeading >= 0 && leading >= previousLeading && trailing >= previousTrailing)
+		{
+			VRD_Internal_WriteBits(&w, 0x1, 2);
+			VRD_Internal_WriteBits(&w, x >> previousTrailing, 32 - previousLeading - previousTrailing);
+		}
+		else
+		{
+			int length = 32 - leading - trailing;
+			VRD_Internal_WriteBits(&w, 0x3, 2);
+			VRD_Internal_WriteBits(&w, leading, 5);
+			VRD_Internal_WriteBits(&w, length - 1, 5);
+			VRD_Internal_WriteBits(&w, x >> trailing, length);
+			previousLeading = leading;
+			previousTrailing = trailing;
+		}
+	}
+	if (w.count > 0) *w.p++ = (unsigned char)w.bits;
+	buf->size -= reserve - (int)(w.p - p); // give back unused reserve
+	VRD_Internal_PrefixSize(buf, start);
 }
 
-void VRD_Internal_WriteEntityUndef(VRD_replay_context* ctx, int entityId, int frame)
+static void VRD_Internal_WriteSeriesOf(VRD_StagingBuffer* buf, VRD_CaptureCounters* counters, VRD_EntitySeries* item, int frame)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntityUndef, entityId, frame);
+	for (int i = 0; i < item->series_count; ++i)
+	{
+		VRD_ValueSeries* series = &item->series[i];
+		if (series->count == 0) continue;
+		int start = buf->size;
+		VRD_Internal_EncodeValueSeries(buf, item->id, frame, series);
+		VRD_Internal_CountBlock(counters, EntityValueSeries, buf->size - start);
+		series->count = 0;
+	}
+	item->active = 0;
 }
 
-void VRD_Internal_WriteEntityLog(VRD_replay_context* ctx, int entityId, int frame, const char* log, const char* category, enum VRD_Color color)
+// Before the entity is defined again or undefined, so that the samples go to the entity that was live when they were set.
+void VRD_Internal_WriteEntityValueSeries(VRD_replay_context* ctx, int entityId, int frame)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntityLog, entityId, frame);
-	VRD_Internal_WriteString(ctx, category);
-	VRD_Internal_WriteString(ctx, log);
-	VRD_Internal_WriteColor(ctx, color);
+	VRD_StagingBuffer* buf = VRD_Internal_BeginBlock(ctx, None, 0); // Counted per series
+	VRD_CaptureCounters* counters = VRD_Internal_Counters(ctx);
+	{
+		std::unique_lock<std::mutex> lock;
+		if (ctx->thread_lanes) lock = std::unique_lock<std::mutex>(ctx->thread_lanes->mutex);
+		VRD_EntitySeries* item = VRD_Internal_FindEntitySeries(&ctx->value_series, entityId);
+		if (item && item->active) VRD_Internal_WriteSeriesOf(buf, counters, item, frame);
+	}
+	VRD_Internal_EndBlock(ctx, buf);
 }
 
-void VRD_Internal_WriteEntityPosition(VRD_replay_context* ctx, int entityId, int frame, VRD_Point* pos)
+// All series, at the end of a series window. Entities without samples in the window are dropped.
+void VRD_Internal_WriteValueSeries(VRD_replay_context* ctx)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntitySetPos, entityId, frame);
-	VRD_Internal_WritePoint(ctx, pos);
+	VRD_ValueSeriesTable* table = &ctx->value_series;
+	table->first_frame = ctx->frame + 1;
+	if (table->count == 0) return;
+
+	VRD_EntitySeries* items = table->spare;
+	memset(items, 0, table->capacity * sizeof(VRD_EntitySeries));
+	int count = 0;
+	for (int i = 0; i < table->capacity; ++i)
+	{
+		VRD_EntitySeries* item = &table->items[i];
+		if (item->id == 0) continue;
+		if (!item->active)
+		{
+			VRD_Internal_FreeEntitySeries(item);
+			continue;
+		}
+		VRD_Internal_WriteSeriesOf(&ctx->staging, &ctx->counters, item, ctx->frame);
+		VRD_Internal_InsertEntitySeries(items, table->capacity, item);
+		count += 1;
+	}
+	table->spare = table->items;
+	table->items = items;
+	table->count = count;
+	VRD_Internal_EndBlock(ctx, &ctx->staging);
 }
 
-void VRD_Internal_WriteEntityTransform(VRD_replay_context* ctx, int entityId, int frame, VRD_Transform* xform)
+void VRD_Internal_ReleaseValueSeries(VRD_replay_context* ctx)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntitySetTransform, entityId, frame);
-	VRD_Internal_WriteTransform(ctx, xform);
+	VRD_ValueSeriesTable* table = &ctx->value_series;
+	for (int i = 0; i < table->capacity; ++i)
+	{
+		if (table->items[i].id != 0) VRD_Internal_FreeEntitySeries(&table->items[i]);
+	}
+	free(table->items);
+	free(table->spare);
+	table->items = 0;
+	table->spare = 0;
+	table->capacity = 0;
+	table->count = 0;
 }
 
-void VRD_Internal_SetDynamicParamString(VRD_replay_context* ctx, int entityId, int frame, const char* key, const char* val)
+///
+/// Summary footer
+///
+
+static VRD_SummaryEntity* VRD_Internal_PushSummaryEntity(VRD_Summary* summary, int entityId, int frame)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntityParameter, entityId, frame);
-	VRD_Internal_WriteString(ctx, key);
-	VRD_Internal_WriteString(ctx, val);
+	if (summary->entity_count >= summary->entity_capacity)
+	{
+		int capacity = summary->entity_capacity > 0 ? summary->entity_capacity * 2 : 1024;
+		VRD_SummaryEntity* entities = static_cast<VRD_SummaryEntity*>(realloc(summary->entities, capacity * sizeof(VRD_SummaryEntity)));
+		if (entities == 0)
+		{
+			summary->failed = 1;
+			return 0;
+		}
+		summary->entities = entities;
+		summary->entity_capacity = capacity;
+	}
+	VRD_SummaryEntity* entity = &summary->entities[summary->entity_count++];
+	entity->id = entityId;
+	entity->def_frame = frame;
+	entity->undef_frame = -1;
+	entity->strings = -1;
+	entity->strings_size = 0;
+	return entity;
 }
 
-void VRD_Internal_SetDynamicParamFloat(VRD_replay_context* ctx, int entityId, int frame, const char* key, float val)
+// Returns the index + 1 of the entity in the table, 0 when out of memory. Caller holds the thread lanes lock, if any.
+int VRD_Internal_AddSummaryEntity(VRD_replay_context* ctx, int entityId, int frame, const char* name, const char* path, const char* type_name, const char* category_name)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntityValue, entityId, frame);
-	VRD_Internal_WriteString(ctx, key);
-	VRD_Internal_WriteFloat(ctx, val);
+	VRD_Summary* summary = ctx->summary;
+	VRD_SummaryEntity* entity = VRD_Internal_PushSummaryEntity(summary, entityId, frame);
+	if (entity == 0) return 0;
+	entity->strings = summary->strings.size;
+	VRD_Internal_WriteString(&summary->strings, name);
+	VRD_Internal_WriteString(&summary->strings, path);
+	VRD_Internal_WriteString(&summary->strings, type_name);
+	VRD_Internal_WriteString(&summary->strings, category_name);
+	entity->strings_size = summary->strings.size - entity->strings;
+	if (summary->strings.failed) summary->failed = 1;
+	return summary->entity_count;
 }
 
-void VRD_Internal_DrawSphere(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* pos, float radius, enum VRD_Color color)
+void VRD_Internal_PushFrameTime(VRD_replay_context* ctx, float totalTime)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntitySphere, entityId, frame);
-	VRD_Internal_WriteString(ctx, category);
-	VRD_Internal_WritePoint(ctx, pos);
-	VRD_Internal_WriteFloat(ctx, radius);
-	VRD_Internal_WriteColor(ctx, color);
+	VRD_Summary* summary = ctx->summary;
+	if (summary->frame_count >= summary->frame_capacity)
+	{
+		int capacity = summary->frame_capacity > 0 ? summary->frame_capacity * 2 : 1024;
+		float* times = static_cast<float*>(realloc(summary->frame_times, capacity * sizeof(float)));
+		if (times == 0)
+		{
+			summary->failed = 1;
+			return;
+		}
+		summary->frame_times = times;
+		summary->frame_capacity = capacity;
+	}
+	summary->frame_times[summary->frame_count++] = totalTime;
 }
 
-void VRD_Internal_DrawBox(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Transform* xform, VRD_Point* dimensions, enum VRD_Color color)
+// Logs are only marked per thread, they are matched with the entity table when the footer is written.
+void VRD_Internal_PushLogMarker(VRD_replay_context* ctx, int entityId, int frame)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntityValue, entityId, frame);
-	VRD_Internal_WriteString(ctx, category);
-	VRD_Internal_WriteTransform(ctx, xform);
-	VRD_Internal_WritePoint(ctx, dimensions);
-	VRD_Internal_WriteColor(ctx, color);
+	VRD_CaptureCounters* counters = VRD_Internal_Counters(ctx);
+	if (counters->log_marker_count > 0)
+	{
+		const VRD_LogMarker* last = &counters->log_markers[counters->log_marker_count - 1];
+		if (last->entity_id == entityId && last->frame == frame) return;
+	}
+	if (counters->log_marker_count >= counters->log_marker_capacity)
+	{
+		int capacity = counters->log_marker_capacity > 0 ? counters->log_marker_capacity * 2 : 1024;
+		VRD_LogMarker* markers = static_cast<VRD_LogMarker*>(realloc(counters->log_markers, capacity * sizeof(VRD_LogMarker)));
+		if (markers == 0)
+		{
+			ctx->summary->failed = 1;
+			return;
+		}
+		counters->log_markers = markers;
+		counters->log_marker_capacity = capacity;
+	}
+	VRD_LogMarker* marker = &counters->log_markers[counters->log_marker_count++];
+	marker->entity_id = entityId;
+	marker->frame = frame;
 }
 
-void VRD_Internal_DrawCapsule(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* p1, VRD_Point* p2, float radius, enum VRD_Color color)
+// Structs of two ints, by the first then the second.
+static int VRD_Internal_CompareIntPairs(const void* a, const void* b)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntityCapsule, entityId, frame);
-	VRD_Internal_WriteString(ctx, category);
-	VRD_Internal_WritePoint(ctx, p1);
-	VRD_Internal_WritePoint(ctx, p2);
-	VRD_Internal_WriteFloat(ctx, radius);
-	VRD_Internal_WriteColor(ctx, color);
+	const int* x = static_cast<const int*>(a);
+	const int* y = static_cast<const int*>(b);
+	if (x[0] != y[0]) return x[0] < y[0] ? -1 : 1;
+	return (x[1] > y[1]) - (x[1] < y[1]);
 }
 
-void VRD_Internal_DrawMesh(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* verts, int vertCount, enum VRD_Color color)
+static void VRD_Internal_WriteSummaryCategories(VRD_StagingBuffer* buf, const VRD_CaptureCounters* counters, int kind)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntityMesh, entityId, frame);
-	VRD_Internal_WriteString(ctx, category);
-	VRD_Internal_WriteInt(ctx, vertCount);
-	for (int i = 0; i < vertCount; ++i)
+	int count = (counters->uncategorized >> kind) & 1;
+	for (int i = 0; i < counters->category_capacity; ++i)
+	{
+		if (counters->categories[i].name != 0 && (counters->categories[i].kinds >> kind) & 1) ++count;
+	}
+	VRD_Internal_Write7BitEncodedInt(buf, count);
+	if ((counters->uncategorized >> kind) & 1) VRD_Internal_WriteString(buf, "");
+	for (int i = 0; i < counters->category_capacity; ++i)
 	{
-		VRD_Internal_WritePoint(ctx, &verts[i]);
+		const VRD_CategoryCounter* item = &counters->categories[i];
+		if (item->name != 0 && (item->kinds >> kind) & 1) VRD_Internal_WriteString(buf, item->name);
 	}
-	VRD_Internal_WriteColor(ctx, color);
 }
 
-void VRD_Internal_DrawLine(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* p1, VRD_Point* p2, enum VRD_Color color)
+// Between the last chunk and the chunk index: format flags (of the entity ids), frame count and frame times, log then draw colors (8 words of VRD_Color bits each), log then draw categories,
+// then the entities in def order (id, flags, def frame, undef frame + 1, name, path, type and category, then the log frame count and frame deltas).
+// Followed by its offset (8 bytes) and magic. Readers find it from the index, so it is not written without one.
+void VRD_Internal_WriteSummary(VRD_replay_context* ctx)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntityLine, entityId, frame);
-	VRD_Internal_WriteString(ctx, category);
-	VRD_Internal_WritePoint(ctx, p1);
-	VRD_Internal_WritePoint(ctx, p2);
-	VRD_Internal_WriteColor(ctx, color);
+	VRD_Summary* summary = ctx->summary;
+	VRD_Internal_MergeLaneCounters(ctx);
+	if (summary->failed || ctx->chunk_index.failed || ctx->fp == 0) return;
+
+	// Logs by entity id then frame, once per frame
+	VRD_CaptureCounters* counters = &ctx->counters;
+	VRD_LogMarker* markers = counters->log_markers;
+	int markerCount = 0;
+	if (counters->log_marker_count > 0) qsort(markers, counters->log_marker_count, sizeof(VRD_LogMarker), VRD_Internal_CompareIntPairs);
+	for (int i = 0; i < counters->log_marker_count; ++i)
+	{
+		if (markerCount == 0 || markers[i].entity_id != markers[markerCount - 1].entity_id || markers[i].frame != markers[markerCount - 1].frame) markers[markerCount++] = markers[i];
+	}
+
+	// Defs by entity id, in def order (def frames never decrease along the table)
+	int defCount = summary->entity_count;
+	int* defs = static_cast<int*>(malloc((defCount * 2 + 1) * sizeof(int)));
+	int* owners = static_cast<int*>(malloc((markerCount + 1) * sizeof(int)));
+	if (defs == 0 || owners == 0)
+	{
+		free(defs);
+		free(owners);
+		return;
+	}
+	for (int i = 0; i < defCount; ++i)
+	{
+		defs[i * 2] = summary->entities[i].id;
+		defs[i * 2 + 1] = i;
+	}
+	qsort(defs, defCount, sizeof(int) * 2, VRD_Internal_CompareIntPairs);
+
+	// A log belongs to the last def of its id up to its frame (the first one for logs before any def), like readers match them.
+	// Logs of entities that were never registered get an entity without def.
+	bool ok = true;
+	for (int i = 0, d = 0; i < markerCount && ok;)
+	{
+		int id = markers[i].entity_id;
+		while (d < defCount && defs[d * 2] < id) ++d;
+		int placeholder = -1;
+		if (d == defCount || defs[d * 2] != id)
+		{
+			ok = VRD_Internal_PushSummaryEntity(summary, id, markers[i].frame) != 0;
+			placeholder = summary->entity_count - 1;
+		}
+		for (int k = d; i < markerCount && markers[i].entity_id == id; ++i)
+		{
+			while (placeholder < 0 && k + 1 < defCount && defs[(k + 1) * 2] == id && summary->entities[defs[(k + 1) * 2 + 1]].def_frame <= markers[i].frame) ++k;
+			owners[i] = placeholder >= 0 ? placeholder : defs[k * 2 + 1];
+		}
+	}
+	free(defs);
+
+	// The logs of an entity are contiguous, its first log and count
+	int* logs = ok ? static_cast<int*>(calloc(summary->entity_count * 2 + 1, sizeof(int))) : 0;
+	if (logs == 0)
+	{
+		free(owners);
+		return;
+	}
+	for (int i = markerCount - 1; i >= 0; --i)
+	{
+		logs[owners[i] * 2] = i;
+		logs[owners[i] * 2 + 1] += 1;
+	}
+	free(owners);
+
+	VRD_StagingBuffer buf;
+	memset(&buf, 0, sizeof(VRD_StagingBuffer));
+	VRD_Internal_Write7BitEncodedInt(&buf, sizeof(entityKeyType) != sizeof(int) ? VRD_Format_RecycledIds : 0);
+	VRD_Internal_Write7BitEncodedInt(&buf, summary->frame_count);
+	VRD_Internal_WriteBytes(&buf, summary->frame_times, summary->frame_count * (int)sizeof(float));
+	for (int kind = 0; kind < VRD_SummaryKind_Count; ++kind)
+	{
+		for (int i = 0; i < 8; ++i) VRD_Internal_WriteInt(&buf, (int)counters->colors[kind][i]);
+	}
+	for (int kind = 0; kind < VRD_SummaryKind_Count; ++kind) VRD_Internal_WriteSummaryCategories(&buf, counters, kind);
+	VRD_Internal_Write7BitEncodedInt(&buf, summary->entity_count);
+	for (int i = 0; i < summary->entity_count; ++i)
+	{
+		const VRD_SummaryEntity* entity = &summary->entities[i];
+		VRD_Internal_Write7BitEncodedInt(&buf, entity->id);
+		VRD_Internal_Write7BitEncodedInt(&buf, entity->strings >= 0 ? VRD_SummaryEntity_Registered : 0);
+		VRD_Internal_Write7BitEncodedInt(&buf, entity->def_frame);
+		VRD_Internal_Write7BitEncodedInt(&buf, entity->undef_frame + 1);
+		if (entity->strings >= 0) VRD_Internal_WriteBytes(&buf, summary->strings.data + entity->strings, entity->strings_size);
+		VRD_Internal_Write7BitEncodedInt(&buf, logs[i * 2 + 1]);
+		int previous = 0;
+		for (int j = logs[i * 2]; j < logs[i * 2] + logs[i * 2 + 1]; ++j)
+		{
+			VRD_Internal_Write7BitEncodedInt(&buf, markers[j].frame - previous);
+			previous = markers[j].frame;
+		}
+	}
+	free(logs);
+
+	if (!buf.failed)
+	{
+		long long offset = ctx->file_offset;
+		VRD_Internal_FileWrite(ctx, buf.data, buf.size);
+		VRD_Internal_FileWrite(ctx, &offset, 8);
+		VRD_Internal_FileWrite(ctx, VRD_SUMMARY_MAGIC, 4);
+		ctx->file_offset += buf.size + 12;
+	}
+	free(buf.data);
 }
 
-void VRD_Internal_DrawCircle(VRD_replay_context* ctx, int entityId, int frame, const char* category, VRD_Point* position, VRD_Point* up, float radius, enum VRD_Color color)
+void VRD_Internal_ReleaseSummary(VRD_replay_context* ctx)
 {
-	VRD_Internal_WriteEntityHeader(ctx, EntityCircle, entityId, frame);
-	VRD_Internal_WriteString(ctx, category);
-	VRD_Internal_WritePoint(ctx, position);
-	VRD_Internal_WritePoint(ctx, up);
-	VRD_Internal_WriteFloat(ctx, radius);
-	VRD_Internal_WriteColor(ctx, color);
-}
\ No newline at end of file
+	VRD_Summary* summary = ctx->summary;
+	if (summary == 0) return;
+	free(summary->entities);
+	free(summary->strings.data);
+	free(summary->frame_times);
+	delete summary;
+	ctx->summary = 0;
+}
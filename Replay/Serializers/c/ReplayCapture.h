@@ -1,7 +1,11 @@
 // SPDX-License-Identifier: MIT
 #pragma once
 
+#include <stdarg.h>
+
 // Note: define VRD_USE_ZLIB and link with zlib (static or dll), in order to get more compact file (5:1 approx)
+// Define VRD_USE_LZ4 (lz4frame) and/or VRD_USE_ZSTD to make those codecs available too. The codec is then picked per context.
+// Define VRD_USE_SOCKETS (and link ws2_32 on Windows) for live streaming to a local socket.
 
 struct VRD_replay_context;
 enum VRD_Color { AliceBlue, PaleGoldenrod, Orchid, OrangeRed, Orange, OliveDrab, Olive, OldLace, Navy, NavajoWhite, Moccasin, MistyRose, MintCream, MidnightBlue, MediumVioletRed, MediumTurquoise, MediumSpringGreen, MediumSlateBlue, LightSkyBlue, LightSlateGray, LightSteelBlue, LightYellow, Lime, LimeGreen, PaleGreen, Linen, Maroon, MediumAquamarine, MediumBlue, MediumOrchid, MediumPurple, MediumSeaGreen, Magenta, PaleTurquoise, PaleVioletRed, PapayaWhip, SlateGray, Snow, SpringGreen, SteelBlue, Tan, Teal, SlateBlue, Thistle, Transparent, Turquoise, Violet, Wheat, White, WhiteSmoke, Tomato, LightSeaGreen, SkyBlue, Sienna, PeachPuff, Peru, Pink, Plum, PowderBlue, Purple, Silver, Red, RoyalBlue, SaddleBrown, Salmon, SandyBrown, SeaGreen, SeaShell, RosyBrown, Yellow, LightSalmon, LightGreen, DarkRed, DarkOrchid, DarkOrange, DarkOliveGreen, DarkMagenta, DarkKhaki, DarkGreen, DarkGray, DarkGoldenrod, DarkCyan, DarkBlue, Cyan, Crimson, Cornsilk, CornflowerBlue, Coral, Chocolate, AntiqueWhite, Aqua, Aquamarine, Azure, Beige, Bisque, DarkSalmon, Black, Blue, BlueViolet, Brown, BurlyWood, CadetBlue, Chartreuse, BlanchedAlmond, DarkSeaGreen, DarkSlateBlue, DarkSlateGray, HotPink, IndianRed, Indigo, Ivory, Khaki, Lavender, Honeydew, LavenderBlush, LemonChiffon, LightBlue, LightCoral, LightCyan, LightGoldenrodYellow, LightGray, LawnGreen, LightPink, GreenYellow, Gray, DarkTurquoise, DarkViolet, DeepPink, DeepSkyBlue, DimGray, DodgerBlue, Green, Firebrick, ForestGreen, Fuchsia, Gainsboro, GhostWhite, Gold, Goldenrod, FloralWhite, YellowGreen };
@@ -13,19 +17,161 @@ typedef struct VRD_StringDictPair_s { const char* key, * value; } VRD_StringDict
 
 typedef uint32 entityKeyType;
 
+// What an async context does when the writer thread falls behind and all queued frame buffers are in flight.
+enum VRD_BackpressurePolicy
+{
+	VRD_Backpressure_Block,     // Wait for the writer thread to free a buffer
+	VRD_Backpressure_DropFrame, // Discard the staged blocks (entity defs, undefs and frame steps are kept, so entities and frame timing stay valid)
+	VRD_Backpressure_Grow,      // Keep staging in memory, and hand it off with the next flush
+};
+
+// What a live stream does when its consumer falls behind and the stream buffer is full. The capture never waits on the consumer.
+enum VRD_StreamOverflow
+{
+	VRD_StreamOverflow_Drop,  // Discard whole chunks, the consumer gets a gap marker then resumes at the next keyframe
+	VRD_StreamOverflow_Spill, // Queue the chunks in streamSpillFile, sent once the consumer caught up
+};
+
+// Live stream sink, called from the stream thread with the next bytes of the replay. Returns 0 to close the stream.
+typedef int (*VRD_StreamCallback)(void* userData, const void* data, int size);
+
+// Compression codec of a context. Codecs that were not compiled in fall back to VRD_Codec_None.
+enum VRD_Codec
+{
+	VRD_Codec_None,
+	VRD_Codec_Deflate, // Legacy compressed format (VRD_USE_ZLIB)
+	VRD_Codec_LZ4,     // Cheapest on CPU (VRD_USE_LZ4)
+	VRD_Codec_Zstd,    // Best ratio, optionally with a trained dictionary (VRD_USE_ZSTD)
+};
+
+// Files written with internStrings, statsFrameInterval, meshCacheBytes, valueSeriesFrames or summaryFooter use format flags and blocks that older viewers reject.
+typedef struct VRD_ContextOptions_s
+{
+	int compressed;         // VRD_Codec, so 0 is uncompressed and 1 deflate
+	int compressionLevel;   // 0 for the codec default
+	const void* dictionary; // Zstd dictionary, copied and stored in the file header for the reader
+	int dictionarySize;
+	int async;              // Compression and file I/O are done on a dedicated writer thread
+	int asyncQueueLength;   // Number of frame buffers that can be in flight to the writer thread
+	enum VRD_BackpressurePolicy backpressure;
+	int multithreaded;      // Capture calls can come from any thread, blocks are staged per thread and spliced in at VRD_StepFrame
+	int internStrings;      // Labels (categories, parameter keys, entity paths and types, log formats) are written once, then referenced by id (on by default, but not with VRD_CreateContext)
+	int deltaTransforms;    // Positions are quantized and delta encoded per entity, unchanged transforms are skipped (not with multithreaded)
+	float positionQuantum;  // Position precision of delta encoded transforms, in world units
+	int transformKeyframeInterval; // Frames between full values of a delta encoded entity transform
+	int chunkFrames;        // Seekable file of independently compressed chunks of this many frames, each starting with a keyframe of all live entities (0 for a single stream)
+	int compressionThreads; // Chunks are compressed in parallel by this many worker threads, and written in order (implies async, and chunks of 60 frames if chunkFrames is 0)
+	int ringBufferBytes;    // Flight recorder: nothing is written, the last frames are kept in a memory ring of this size and saved with VRD_DumpRing (filename can be 0, no chunks, async or delta transforms)
+	int ringDefBytes;       // Flight recorder: entity defs the dump may need are kept in this many more bytes, allocated with the ring (0 for an eighth of ringBufferBytes, at least 16 KB)
+	int statsFrameInterval; // Writes a CaptureStats block every this many frames, so the viewer can plot capture overhead (0 for none)
+	int meshCacheBytes;     // Mesh vertex data is written once, later draws of the same verts only reference it. Bounds the verts kept to compare against (0 for none, not with ringBufferBytes)
+	int valueSeriesFrames;  // Dynamic float params are buffered per entity and key, and written as one compressed series every this many frames and at chunk ends (0 to write each value when set, not with ringBufferBytes)
+	int summaryFooter;      // Chunked files end with a summary of the entities and their lifetimes, categories, colors, frame times and log frames, so viewers show them before reading any chunk (implies chunks of 60 frames if chunkFrames is 0, not with ringBufferBytes or streams)
+
+	// Live streaming, instead of a file: to a viewer listening on filename "unix:<socket path>" or "tcp:<port>" (localhost), or to streamCallback (filename is then ignored).
+	// Streams are chunked files without an index, one frame per chunk unless chunkFrames is set. Read them with VRD_FollowReplay. Not with ringBufferBytes.
+	VRD_StreamCallback streamCallback;
+	void* streamUserData;
+	int streamBufferBytes;  // Chunks queued for the consumer, past this the overflow policy applies
+	enum VRD_StreamOverflow streamOverflow;
+	const char* streamSpillFile; // Temporary file of VRD_StreamOverflow_Spill, chunks are dropped without it
+} VRD_ContextOptions;
+
+// Capture counters, indexed by block type (the wire values, see VRD_ReplayBlockType in ReplayCaptureReader.h).
+#define VRD_STATS_BLOCK_TYPE_COUNT 32
+
+typedef struct VRD_BlockStats_s
+{
+	long long calls;
+	long long rawBytes;        // Encoded, before compression
+	long long compressedBytes; // Estimate: rawBytes at the ratio of storedBytes to flushedBytes (0 until the compressor outputs anything)
+} VRD_BlockStats;
+
+// Draw and log categories.
+typedef struct VRD_CategoryStats_s
+{
+	const char* category; // Valid until the context is released
+	long long calls;
+	long long rawBytes;
+} VRD_CategoryStats;
+
+typedef struct VRD_CaptureStats_s
+{
+	VRD_BlockStats blocks[VRD_STATS_BLOCK_TYPE_COUNT];
+	long long flushedBytes;  // Handed to the compressor/file
+	long long storedBytes;   // Written to the file, headers included
+	double compressSeconds;  // Summed over all threads that compress
+	double ioSeconds;
+	int categoryCount;
+} VRD_CaptureStats;
+
+void VRD_InitContextOptions(VRD_ContextOptions* options);
 VRD_replay_context* VRD_CreateContext(const char* filename, int compressed);
+VRD_replay_context* VRD_CreateContextWithOptions(const char* filename, const VRD_ContextOptions* options);
 void VRD_ReleaseContext(VRD_replay_context* ctx);
+// Blocks are staged in memory and handed to the compressor/file on frame steps. Flush every flushFrameInterval frames, or whenever flushThresholdBytes are staged (0 to disable).
+void VRD_SetFlushPolicy(VRD_replay_context* ctx, int flushThresholdBytes, int flushFrameInterval);
+// Multithreaded contexts: per-thread blocks are spliced in ascending lane order at VRD_StepFrame, so give each worker a stable lane for a deterministic stream.
+// The thread that created the context is spliced first, threads without a lane last (in order of their first capture call). VRD_StepFrame and VRD_ReleaseContext must not overlap other capture calls.
+void VRD_SetThreadLane(VRD_replay_context* ctx, int lane);
+// Category filters, checked before anything of the call is encoded: draws, batched draws and logs are filtered by category, dynamic params by key.
+// maxPerFrame bounds the calls kept per frame (0 for no limit), sampleEvery keeps one call out of every N (0 or 1 for all). A null category sets the filter
+// of all categories without their own, which share its limits. Must not overlap other capture calls, like VRD_StepFrame.
+void VRD_SetCategoryFilter(VRD_replay_context* ctx, const char* category, int enabled, int maxPerFrame, int sampleEvery);
+// Sets filters from a text file, one per line: a category (* for all others), then any of on, off, max=N and every=N. Lines starting with # are comments.
+// Returns the number of filters set, -1 if the file could not be read.
+int VRD_LoadCategoryFilters(VRD_replay_context* ctx, const char* filename);
 void VRD_RegisterEntity(VRD_replay_context* ctx, entityKeyType entityId, const char* name, const char* path, const char* type_name, const char* category_name, VRD_Transform* xform, VRD_StringDictPair* staticParams, int staticParamsCount);
 void VRD_UnRegisterEntity(VRD_replay_context* ctx, entityKeyType entityId);
 void VRD_SetLog(VRD_replay_context* ctx, entityKeyType entityId, const char* log, const char* category, enum VRD_Color color);
+// Deferred formatting: only the format string (a label, see internStrings) and the raw arguments are written, readers format the message.
+// Supports the printf conversions but %n; wide strings (%ls) are written empty.
+#if defined(__GNUC__) || defined(__clang__)
+void VRD_SetLogf(VRD_replay_context* ctx, entityKeyType entityId, const char* category, enum VRD_Color color, const char* format, ...) __attribute__((format(printf, 5, 6)));
+#else
+void VRD_SetLogf(VRD_replay_context* ctx, entityKeyType entityId, const char* category, enum VRD_Color color, const char* format, ...);
+#endif
+void VRD_SetLogv(VRD_replay_context* ctx, entityKeyType entityId, const char* category, enum VRD_Color color, const char* format, va_list args);
 void VRD_SetPosition(VRD_replay_context* ctx, entityKeyType entityId, VRD_Point* pos);
 void VRD_SetTransform(VRD_replay_context* ctx, entityKeyType entityId, VRD_Transform* xform);
 void VRD_SetDynamicParamString(VRD_replay_context* ctx, entityKeyType entityId, const char* key, const char* val);
 void VRD_SetDynamicParamFloat(VRD_replay_context* ctx, entityKeyType entityId, const char* key, float val);
+// With the length of the message or value, which is not read past it and needs no terminating NUL (labels still do).
+void VRD_SetLogN(VRD_replay_context* ctx, entityKeyType entityId, const char* log, int logLength, const char* category, enum VRD_Color color);
+void VRD_SetDynamicParamStringN(VRD_replay_context* ctx, entityKeyType entityId, const char* key, const char* val, int valLength);
 void VRD_DrawSphere(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* pos, float radius, enum VRD_Color color);
 void VRD_DrawBox(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Transform* xform, VRD_Point* dimensions, enum VRD_Color color);
 void VRD_DrawCapsule(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* p1, VRD_Point* p2, float radius, enum VRD_Color color);
 void VRD_DrawMesh(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* verts, int vertCount, enum VRD_Color color);
+// Verts in mesh space, placed by xform (0 for world space verts). A non zero meshKey identifies the verts, so they are only read when not cached (0 to hash them).
+void VRD_DrawMeshInstance(VRD_replay_context* ctx, entityKeyType entityId, const char* category, unsigned long long meshKey, VRD_Point* verts, int vertCount, VRD_Transform* xform, enum VRD_Color color);
 void VRD_DrawLine(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* p1, VRD_Point* p2, enum VRD_Color color);
 void VRD_DrawCircle(VRD_replay_context* ctx, entityKeyType entityId, const char* category, VRD_Point* position, VRD_Point* up, float radius, enum VRD_Color color);
+// Batched updates, for entities kept in contiguous arrays: count entities in one call, written as a single block that readers expand to per-entity updates.
+// Draw batches share one category and color. With delta transforms, positions and transforms are still written per entity.
+void VRD_SetPositions(VRD_replay_context* ctx, const entityKeyType* entityIds, const VRD_Point* positions, int count);
+void VRD_SetTransforms(VRD_replay_context* ctx, const entityKeyType* entityIds, const VRD_Transform* xforms, int count);
+void VRD_DrawLines(VRD_replay_context* ctx, const entityKeyType* entityIds, const char* category, const VRD_Point* p1, const VRD_Point* p2, int count, enum VRD_Color color);
+void VRD_DrawSpheres(VRD_replay_context* ctx, const entityKeyType* entityIds, const char* category, const VRD_Point* centers, const float* radii, int count, enum VRD_Color color);
 void VRD_StepFrame(VRD_replay_context* ctx, float totalTime);
+// Flight recorder contexts: writes the frames held in the ring as a standalone replay, with defs for the entities registered before them. Returns 0 on failure.
+// Frames still being captured are not included. Must not overlap other capture calls, like VRD_StepFrame.
+int VRD_DumpRing(VRD_replay_context* ctx, const char* filename);
+// Counters since the context was created. Fills up to maxCategories category counters (categories can be 0), and returns the number of categories.
+// Multithreaded contexts: must not overlap other capture calls, like VRD_StepFrame.
+int VRD_GetStats(VRD_replay_context* ctx, VRD_CaptureStats* stats, VRD_CategoryStats* categories, int maxCategories);
+
+// Compile-time category stripping, for shipping builds: VRD_CATEGORY_CALL(name, call) compiles to nothing when VRD_STRIP_CATEGORY_<name> is defined to 1,
+// or when VRD_STRIP_ALL_CATEGORIES is. name is an identifier, unrelated to the label passed to the call, and the call is still type checked. e.g.
+//   VRD_CATEGORY_CALL(ai, VRD_SetLog(ctx, id, "path blocked", "AI", Red)); // stripped with -DVRD_STRIP_CATEGORY_ai=1
+#ifndef VRD_STRIP_ALL_CATEGORIES
+#define VRD_STRIP_ALL_CATEGORIES 0
+#endif
+#define VRD_CATEGORY_CALL(name, call) do { if (!VRD_CATEGORY_STRIPPED(name)) { call; } } while (0)
+#define VRD_CATEGORY_STRIPPED(name) (VRD_STRIP_ALL_CATEGORIES || VRD_Internal_IsOne(VRD_STRIP_CATEGORY_##name))
+// 1 if value expands to 1, 0 for anything else (an undefined macro name included)
+#define VRD_Internal_IsOne(value) VRD_Internal_IsOne_(value)
+#define VRD_Internal_IsOne_(value) VRD_Internal_Apply(VRD_Internal_Second, (VRD_Internal_One_##value 1, 0, ~))
+#define VRD_Internal_One_1 ~,
+#define VRD_Internal_Apply(macro, args) macro args
+#define VRD_Internal_Second(a, b, ...) b
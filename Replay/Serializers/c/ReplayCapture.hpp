@@ -0,0 +1,237 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+// Header only C++ frontend of ReplayCapture.h: one object per capture, string views and spans instead of NUL terminated strings
+// and pointer/count pairs, references instead of pointers. Same files and same costs as the C calls it forwards to.
+// Define VRD_ENABLED to 0 to compile every call to nothing: arguments are still type checked, but no C function is referenced,
+// so the capture library need not be linked.
+//
+//   VRD::Capture capture("game.vrd");
+//   capture.RegisterEntity(id, "player", "world/player", "Pawn", "pawns");
+//   capture.SetLog(id, message, "AI", Red);          // std::string, std::string_view or const char*
+//   capture.SetPositions(ids, positions);             // std::vector, std::array, C arrays or std::span
+//   capture.StepFrame(time);
+//
+// Labels (categories, parameter keys, entity paths and types) are interned by address, so they stay NUL terminated C strings:
+// pass literals or strings that outlive the capture.
+
+#include "ReplayCapture.h"
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#ifndef VRD_ENABLED
+#define VRD_ENABLED 1
+#endif
+
+#if defined(_MSVC_LANG)
+#define VRD_CPP_VERSION _MSVC_LANG
+#else
+#define VRD_CPP_VERSION __cplusplus
+#endif
+#if VRD_CPP_VERSION >= 201703L
+#include <string_view>
+#endif
+#if VRD_CPP_VERSION >= 202002L
+#include <span>
+#endif
+
+// Disabled calls are only type checked, in an unevaluated operand
+#if VRD_ENABLED
+#define VRD_Internal_Call(call) do { if (ctx_) { call; } } while (0)
+#else
+#define VRD_Internal_Call(call) ((void)sizeof((call), 0))
+#endif
+
+namespace VRD
+{
+	// String and length, the string needs no terminating NUL.
+	struct StringRef
+	{
+		const char* data = nullptr;
+		int length = 0;
+
+		StringRef() = default;
+		StringRef(const char* s) : data(s), length(s ? (int)strlen(s) : 0) {}
+		StringRef(const char* s, size_t len) : data(s), length((int)len) {}
+		StringRef(const std::string& s) : data(s.data()), length((int)s.size()) {}
+#if VRD_CPP_VERSION >= 201703L
+		StringRef(std::string_view s) : data(s.data()), length((int)s.size()) {}
+#endif
+	};
+
+	// Contiguous items: C arrays, std::vector, std::array, std::span or pointer and count.
+	template <typename T> struct Span
+	{
+		const T* data = nullptr;
+		int count = 0;
+
+		Span() = default;
+		Span(const T* items, int itemCount) : data(items), count(itemCount) {}
+		template <size_t N> Span(const T (&items)[N]) : data(items), count((int)N) {}
+		template <typename Container, typename = decltype(static_cast<const T*>(std::declval<const Container&>().data()))>
+		Span(const Container& items) : data(items.data()), count((int)items.size()) {}
+	};
+
+	// Arguments SetLogf can pass through the C varargs: a std::string or any other class would be undefined behavior there.
+	template <typename... Args> struct IsLogfArgs : std::true_type {};
+	template <typename Arg, typename... Args> struct IsLogfArgs<Arg, Args...>
+		: std::integral_constant<bool, (std::is_arithmetic<Arg>::value || std::is_enum<Arg>::value || std::is_pointer<Arg>::value || std::is_same<Arg, std::nullptr_t>::value) && IsLogfArgs<Args...>::value> {};
+
+	// Owns a capture context, released (and the file completed) with the object.
+	class Capture
+	{
+	public:
+		Capture() = default;
+		explicit Capture(const char* filename, int compressed = 1)
+		{
+#if VRD_ENABLED
+			ctx_ = VRD_CreateContext(filename, compressed);
+#else
+			(void)filename;
+			(void)compressed;
+#endif
+		}
+		Capture(const char* filename, const VRD_ContextOptions& options)
+		{
+#if VRD_ENABLED
+			ctx_ = VRD_CreateContextWithOptions(filename, &options);
+#else
+			(void)filename;
+			(void)options;
+#endif
+		}
+		// Takes ownership of a context created with the C API
+		explicit Capture(VRD_replay_context* ctx)
+		{
+#if VRD_ENABLED
+			ctx_ = ctx;
+#else
+			(void)ctx;
+#endif
+		}
+		~Capture() { Release(); }
+
+		Capture(const Capture&) = delete;
+		Capture& operator=(const Capture&) = delete;
+		Capture(Capture&& other) noexcept : ctx_(other.ctx_) { other.ctx_ = nullptr; }
+		Capture& operator=(Capture&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Release();
+				ctx_ = other.ctx_;
+				other.ctx_ = nullptr;
+			}
+			return *this;
+		}
+
+		// False when disabled, or when the context could not be created
+		explicit operator bool() const { return ctx_ != nullptr; }
+		// For the calls only the C API has (flush policy, thread lanes, ring dumps, stats)
+		VRD_replay_context* Context() const { return ctx_; }
+
+		// Gives up ownership of the context, without releasing it
+		VRD_replay_context* Detach()
+		{
+			VRD_replay_context* ctx = ctx_;
+			ctx_ = nullptr;
+			return ctx;
+		}
+
+		void Release()
+		{
+			VRD_Internal_Call(VRD_ReleaseContext(ctx_));
+			ctx_ = nullptr;
+		}
+
+		void StepFrame(float totalTime) { VRD_Internal_Call(VRD_StepFrame(ctx_, totalTime)); }
+
+		void SetCategoryFilter(const char* category, bool enabled, int maxPerFrame = 0, int sampleEvery = 0)
+		{
+			VRD_Internal_Call(VRD_SetCategoryFilter(ctx_, category, enabled ? 1 : 0, maxPerFrame, sampleEvery));
+		}
+
+		void RegisterEntity(entityKeyType entityId, const char* name, const char* path, const char* typeName, const char* categoryName, const VRD_Transform* xform = nullptr, Span<VRD_StringDictPair> staticParams = {})
+		{
+			VRD_Internal_Call(VRD_RegisterEntity(ctx_, entityId, name, path, typeName, categoryName, const_cast<VRD_Transform*>(xform), const_cast<VRD_StringDictPair*>(staticParams.data), staticParams.count));
+		}
+		void UnRegisterEntity(entityKeyType entityId) { VRD_Internal_Call(VRD_UnRegisterEntity(ctx_, entityId)); }
+
+		void SetLog(entityKeyType entityId, StringRef log, const char* category, enum VRD_Color color)
+		{
+			VRD_Internal_Call(VRD_SetLogN(ctx_, entityId, log.data, log.length, category, color));
+		}
+		// Deferred formatting, see VRD_SetLogf
+		template <typename... Args> void SetLogf(entityKeyType entityId, const char* category, enum VRD_Color color, const char* format, Args... args)
+		{
+			static_assert(IsLogfArgs<Args...>::value, "SetLogf arguments must be arithmetic, enums, pointers or nullptr (pass strings with c_str())");
+			VRD_Internal_Call(VRD_SetLogf(ctx_, entityId, category, color, format, args...));
+		}
+
+		void SetPosition(entityKeyType entityId, const VRD_Point& pos) { VRD_Internal_Call(VRD_SetPosition(ctx_, entityId, const_cast<VRD_Point*>(&pos))); }
+		void SetTransform(entityKeyType entityId, const VRD_Transform& xform) { VRD_Internal_Call(VRD_SetTransform(ctx_, entityId, const_cast<VRD_Transform*>(&xform))); }
+
+		void SetDynamicParam(entityKeyType entityId, const char* key, StringRef val)
+		{
+			VRD_Internal_Call(VRD_SetDynamicParamStringN(ctx_, entityId, key, val.data, val.length));
+		}
+		void SetDynamicParam(entityKeyType entityId, const char* key, float val) { VRD_Internal_Call(VRD_SetDynamicParamFloat(ctx_, entityId, key, val)); }
+
+		void DrawSphere(entityKeyType entityId, const char* category, const VRD_Point& pos, float radius, enum VRD_Color color)
+		{
+			VRD_Internal_Call(VRD_DrawSphere(ctx_, entityId, category, const_cast<VRD_Point*>(&pos), radius, color));
+		}
+		void DrawBox(entityKeyType entityId, const char* category, const VRD_Transform& xform, const VRD_Point& dimensions, enum VRD_Color color)
+		{
+			VRD_Internal_Call(VRD_DrawBox(ctx_, entityId, category, const_cast<VRD_Transform*>(&xform), const_cast<VRD_Point*>(&dimensions), color));
+		}
+		void DrawCapsule(entityKeyType entityId, const char* category, const VRD_Point& p1, const VRD_Point& p2, float radius, enum VRD_Color color)
+		{
+			VRD_Internal_Call(VRD_DrawCapsule(ctx_, entityId, category, const_cast<VRD_Point*>(&p1), const_cast<VRD_Point*>(&p2), radius, color));
+		}
+		void DrawLine(entityKeyType entityId, const char* category, const VRD_Point& p1, const VRD_Point& p2, enum VRD_Color color)
+		{
+			VRD_Internal_Call(VRD_DrawLine(ctx_, entityId, category, const_cast<VRD_Point*>(&p1), const_cast<VRD_Point*>(&p2), color));
+		}
+		void DrawCircle(entityKeyType entityId, const char* category, const VRD_Point& position, const VRD_Point& up, float radius, enum VRD_Color color)
+		{
+			VRD_Internal_Call(VRD_DrawCircle(ctx_, entityId, category, const_cast<VRD_Point*>(&position), const_cast<VRD_Point*>(&up), radius, color));
+		}
+		void DrawMesh(entityKeyType entityId, const char* category, Span<VRD_Point> verts, enum VRD_Color color)
+		{
+			VRD_Internal_Call(VRD_DrawMesh(ctx_, entityId, category, const_cast<VRD_Point*>(verts.data), verts.count, color));
+		}
+		void DrawMeshInstance(entityKeyType entityId, const char* category, unsigned long long meshKey, Span<VRD_Point> verts, const VRD_Transform* xform, enum VRD_Color color)
+		{
+			VRD_Internal_Call(VRD_DrawMeshInstance(ctx_, entityId, category, meshKey, const_cast<VRD_Point*>(verts.data), verts.count, const_cast<VRD_Transform*>(xform), color));
+		}
+
+		// Batches: the shorter span sets the count
+		void SetPositions(Span<entityKeyType> entityIds, Span<VRD_Point> positions)
+		{
+			VRD_Internal_Call(VRD_SetPositions(ctx_, entityIds.data, positions.data, Count(entityIds.count, positions.count)));
+		}
+		void SetTransforms(Span<entityKeyType> entityIds, Span<VRD_Transform> xforms)
+		{
+			VRD_Internal_Call(VRD_SetTransforms(ctx_, entityIds.data, xforms.data, Count(entityIds.count, xforms.count)));
+		}
+		void DrawLines(Span<entityKeyType> entityIds, const char* category, Span<VRD_Point> p1, Span<VRD_Point> p2, enum VRD_Color color)
+		{
+			VRD_Internal_Call(VRD_DrawLines(ctx_, entityIds.data, category, p1.data, p2.data, Count(Count(entityIds.count, p1.count), p2.count), color));
+		}
+		void DrawSpheres(Span<entityKeyType> entityIds, const char* category, Span<VRD_Point> centers, Span<float> radii, enum VRD_Color color)
+		{
+			VRD_Internal_Call(VRD_DrawSpheres(ctx_, entityIds.data, category, centers.data, radii.data, Count(Count(entityIds.count, centers.count), radii.count), color));
+		}
+
+	private:
+		static int Count(int a, int b) { return a < b ? a : b; }
+
+		VRD_replay_context* ctx_ = nullptr;
+	};
+}
+
+#undef VRD_Internal_Call
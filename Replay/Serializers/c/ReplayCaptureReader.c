@@ -0,0 +1,1672 @@
+// SPDX-License-Identifier: MIT
+#include "ReplayCaptureReader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Decoded bytes of a compressed stream held at once. Grows if a single block is larger.
+#ifndef VRD_READER_WINDOW_SIZE
+#define VRD_READER_WINDOW_SIZE (1<<20)
+#endif
+
+#ifdef VRD_USE_ZLIB
+#ifndef VRD_ZLIB_HEADER
+#define VRD_ZLIB_HEADER "ThirdParty/zlib/zlib-1.2.5/Inc/zlib.h"
+#endif
+#include VRD_ZLIB_HEADER
+#endif //VRD_USE_ZLIB
+
+#ifdef VRD_USE_LZ4
+#ifndef VRD_LZ4_HEADER
+#define VRD_LZ4_HEADER <lz4frame.h>
+#endif
+#include VRD_LZ4_HEADER
+#endif //VRD_USE_LZ4
+
+#ifdef VRD_USE_ZSTD
+#ifndef VRD_ZSTD_HEADER
+#define VRD_ZSTD_HEADER <zstd.h>
+#endif
+#include VRD_ZSTD_HEADER
+#endif //VRD_USE_ZSTD
+
+// File layout constants, see ReplayCapture.c
+#define VRD_CHUNKED_MAGIC "VRDC"
+#define VRD_CHUNK_INDEX_MAGIC "VRDI"
+#define VRD_SUMMARY_MAGIC "VRDF"
+#define VRD_CHUNKED_VERSION 3
+#define VRD_STREAM_MAGIC "VRDS"
+#define VRD_STREAM_VERSION 1
+#define VRD_CHUNK_HEADER_SIZE 16
+
+enum VRD_ReaderFormatFlags
+{
+	VRD_ReaderFormat_StringTable = 1 << 0,
+	VRD_ReaderFormat_DeltaTransforms = 1 << 1,
+	VRD_ReaderFormat_RecycledIds = 1 << 2,
+	VRD_ReaderFormat_Supported = VRD_ReaderFormat_StringTable | VRD_ReaderFormat_DeltaTransforms | VRD_ReaderFormat_RecycledIds,
+};
+
+enum VRD_ReaderSummaryFlags
+{
+	VRD_ReaderSummary_Registered = 1 << 0,
+};
+
+enum VRD_ReaderTransformDeltaFlags
+{
+	VRD_ReaderDelta_X = 1 << 0,
+	VRD_ReaderDelta_Y = 1 << 1,
+	VRD_ReaderDelta_Z = 1 << 2,
+	VRD_ReaderDelta_Rotation = 1 << 3,
+	VRD_ReaderDelta_RotationIndexShift = 4,
+	VRD_ReaderDelta_Full = 1 << 6,
+};
+
+// Codec ids of the file headers, same values as VRD_Codec.
+enum VRD_ReaderCodec
+{
+	VRD_ReaderCodec_None,
+	VRD_ReaderCodec_Deflate,
+	VRD_ReaderCodec_LZ4,
+	VRD_ReaderCodec_Zstd,
+};
+
+struct VRD_ReaderBuffer
+{
+	unsigned char* data;
+	size_t size;
+	size_t capacity;
+};
+
+// Last transform of an entity, for transform deltas.
+struct VRD_ReaderEntity
+{
+	int id; // 0 marks an empty slot
+	int qpos[3];
+	VRD_Transform xform;
+};
+
+struct VRD_ReaderEntities
+{
+	VRD_ReaderEntity* items; // open addressing, keyed by entity id
+	int capacity;
+	int count;
+};
+
+// Batch block being expanded, copied out of the decode window
+struct VRD_ReaderBatch
+{
+	enum VRD_ReplayBlockType type;
+	int frame;
+	int count;
+	int index; // Next entity to return
+	int capacity;
+	int* ids;
+	float* floats; // Packed per component, count floats each
+	char* category;
+	int category_capacity;
+	VRD_StringView categoryView;
+	enum VRD_Color color;
+};
+
+struct VRD_ReaderMesh
+{
+	VRD_Point* verts; // Copied, mesh refs outlive the decode window
+	int vertCount;
+};
+
+struct VRD_ReaderString
+{
+	VRD_StringView view;
+	char* copy; // Set when the view would not outlive the decode window
+};
+
+struct VRD_replay_reader
+{
+	const unsigned char* map;
+	size_t map_size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+
+	const unsigned char* pos; // Next block, in the map, the decode window or the current chunk
+	const unsigned char* end;
+	int stable; // The blocks stay in place for the whole pass (mapped file or whole chunk), views do not need copies
+	size_t skip; // Bytes of a skipped keyframe still to consume
+
+	int codec;
+	const unsigned char* in; // Compressed input, in the map
+	const unsigned char* in_end;
+	int chunked;
+	const unsigned char* summary; // Summary footer, in the map
+	const unsigned char* summary_end;
+	int stream_done;
+	int follow;
+	struct VRD_ReaderBuffer received; // Follow mode: fed bytes, from the next chunk on
+	int gap_first_frame;
+	int gap_frame_count; // Stream gap to return before the next chunk
+	struct VRD_ReaderBuffer window;
+	const unsigned char* dictionary;
+	int dictionary_size;
+#ifdef VRD_USE_ZLIB
+	z_stream z_strm;
+#endif
+#ifdef VRD_USE_LZ4
+	LZ4F_dctx* lz4;
+#endif
+#ifdef VRD_USE_ZSTD
+	ZSTD_DCtx* zstd;
+#endif
+
+	int string_table;
+	int delta_transforms;
+	float position_quantum;
+	struct VRD_ReaderString* strings;
+	int string_capacity;
+	struct VRD_ReaderMesh* meshes; // Indexed by mesh id
+	int mesh_capacity;
+	int keyframe_applied;
+	struct VRD_ReaderEntities entities;
+
+	// Raw transform delta of the block being decoded
+	int delta_q[3];
+	unsigned short delta_rot[3];
+
+	struct VRD_ReaderBatch batch;
+};
+
+///
+/// Cursor, every read is bounds checked and an overrun marks the block incomplete
+///
+
+struct VRD_Cursor
+{
+	const unsigned char* p;
+	const unsigned char* end;
+	int overrun;
+};
+
+static inline const unsigned char* VRD_Cursor_Take(VRD_Cursor* c, size_t len)
+{
+	if ((size_t)(c->end - c->p) < len)
+	{
+		c->overrun = 1;
+		c->p = c->end;
+		return 0;
+	}
+	const unsigned char* p = c->p;
+	c->p += len;
+	return p;
+}
+
+static inline int VRD_Cursor_Read7BitEncodedInt(VRD_Cursor* c)
+{
+	unsigned int value = 0;
+	for (int shift = 0; shift < 35; shift += 7)
+	{
+		if (c->p >= c->end)
+		{
+			c->overrun = 1;
+			return 0;
+		}
+		unsigned char b = *c->p++;
+		value |= (unsigned int)(b & 0x7f) << shift;
+		if (b < 0x80) return (int)value;
+	}
+	return (int)value;
+}
+
+static inline unsigned long long VRD_Cursor_Read7BitEncodedInt64(VRD_Cursor* c)
+{
+	unsigned long long value = 0;
+	for (int shift = 0; shift < 70; shift += 7)
+	{
+		if (c->p >= c->end)
+		{
+			c->overrun = 1;
+			return 0;
+		}
+		unsigned char b = *c->p++;
+		value |= (unsigned long long)(b & 0x7f) << shift;
+		if (b < 0x80) return value;
+	}
+	return value;
+}
+
+static inline int VRD_Cursor_ReadZigZag(VRD_Cursor* c)
+{
+	unsigned int value = (unsigned int)VRD_Cursor_Read7BitEncodedInt(c);
+	return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+static inline int VRD_Cursor_ReadInt(VRD_Cursor* c)
+{
+	int value = 0;
+	const unsigned char* p = VRD_Cursor_Take(c, 4);
+	if (p) memcpy(&value, p, 4);
+	return value;
+}
+
+static inline float VRD_Cursor_ReadFloat(VRD_Cursor* c)
+{
+	float value = 0;
+	const unsigned char* p = VRD_Cursor_Take(c, 4);
+	if (p) memcpy(&value, p, 4);
+	return value;
+}
+
+static inline VRD_StringView VRD_Cursor_ReadString(VRD_Cursor* c)
+{
+	VRD_StringView view = { "", 0 };
+	int len = VRD_Cursor_Read7BitEncodedInt(c);
+	if (len <= 0) return view;
+	const unsigned char* p = VRD_Cursor_Take(c, len);
+	if (p)
+	{
+		view.data = reinterpret_cast<const char*>(p);
+		view.length = len;
+	}
+	return view;
+}
+
+static inline VRD_Point VRD_Cursor_ReadPoint(VRD_Cursor* c)
+{
+	VRD_Point point = { 0, 0, 0 };
+	const unsigned char* p = VRD_Cursor_Take(c, 12);
+	if (p) memcpy(&point, p, 12);
+	return point;
+}
+
+static inline VRD_Transform VRD_Cursor_ReadTransform(VRD_Cursor* c)
+{
+	VRD_Transform xform = { { 0, 0, 0 }, { 0, 0, 0, 1 } };
+	const unsigned char* p = VRD_Cursor_Take(c, 28);
+	if (p)
+	{
+		memcpy(&xform.translation, p, 12);
+		memcpy(&xform.rotation, p + 12, 16);
+	}
+	return xform;
+}
+
+static inline enum VRD_Color VRD_Cursor_ReadColor(VRD_Cursor* c)
+{
+	return (enum VRD_Color)VRD_Cursor_Read7BitEncodedInt(c);
+}
+
+// Interned id, or 0 and an inline string. Inline strings only without a string table.
+static inline VRD_StringView VRD_Cursor_ReadLabel(VRD_replay_reader* reader, VRD_Cursor* c, int* invalid)
+{
+	if (!reader->string_table) return VRD_Cursor_ReadString(c);
+	int id = VRD_Cursor_Read7BitEncodedInt(c);
+	if (id == 0) return VRD_Cursor_ReadString(c);
+	if (id < 0 || id >= reader->string_capacity || reader->strings[id].view.data == 0)
+	{
+		if (!c->overrun) *invalid = 1;
+		VRD_StringView empty = { "", 0 };
+		return empty;
+	}
+	return reader->strings[id].view;
+}
+
+const unsigned char* VRD_ReadStaticParam(const unsigned char* p, VRD_StringView* key, VRD_StringView* value)
+{
+	VRD_Cursor c = { p, p + 0x7fffffff, 0 }; // Bounds were checked when the def was read
+	*key = VRD_Cursor_ReadString(&c);
+	*value = VRD_Cursor_ReadString(&c);
+	return c.p;
+}
+
+// Each conversion is rebuilt as %<flags>*.*<ll><conversion>, the width is 0 and the precision -1 (as if omitted) when the format has none.
+int VRD_FormatLog(const VRD_ReplayBlock* block, char* text, int size)
+{
+	if (size < 0) size = 0;
+	const char* f = block->logFormat.format.data;
+	const char* end = f + block->logFormat.format.length;
+	VRD_Cursor c = { block->logFormat.args, block->logFormat.args + block->logFormat.argsSize, 0 };
+	int len = 0;
+	while (f < end)
+	{
+		if (*f != '%' || f + 1 == end || f[1] == '%')
+		{
+			if (len < size) text[len] = *f;
+			++len;
+			f += (*f == '%' && f + 1 < end) ? 2 : 1; // %%
+			continue;
+		}
+
+		const char* conversion = f++;
+		char spec[16] = "%";
+		int specLen = 1;
+		while (f < end && (*f == '-' || *f == '+' || *f == ' ' || *f == '#' || *f == '0'))
+		{
+			if (specLen < 6) spec[specLen++] = *f;
+			++f;
+		}
+		int width = 0, precision = -1;
+		if (f < end && *f == '*') { width = VRD_Cursor_ReadZigZag(&c); ++f; }
+		else while (f < end && *f >= '0' && *f <= '9') width = width * 10 + (*f++ - '0');
+		if (f < end && *f == '.')
+		{
+			++f;
+			precision = 0;
+			if (f < end && *f == '*') { precision = VRD_Cursor_ReadZigZag(&c); ++f; }
+			else while (f < end && *f >= '0' && *f <= '9') precision = precision * 10 + (*f++ - '0');
+		}
+		while (f < end && (*f == 'h' || *f == 'l' || *f == 'L' || *f == 'z' || *f == 'j' || *f == 't')) ++f;
+		if (f >= end) break;
+		char type = *f++;
+		memcpy(spec + specLen, "*.*", 3);
+		specLen += 3;
+		if (type == 'd' || type == 'i' || type == 'u' || type == 'o' || type == 'x' || type == 'X')
+		{
+			spec[specLen++] = 'l';
+			spec[specLen++] = 'l';
+		}
+		spec[specLen++] = type;
+		spec[specLen] = 0;
+
+		char* out = (len < size) ? text + len : 0;
+		size_t room = (len < size) ? (size_t)(size - len) : 0;
+		int n = 0;
+		switch (type)
+		{
+		case 'd': case 'i':
+		{
+			unsigned long long value = VRD_Cursor_Read7BitEncodedInt64(&c);
+			n = snprintf(out, room, spec, width, precision, (long long)(value >> 1) ^ -(long long)(value & 1));
+			break;
+		}
+		case 'u': case 'o': case 'x': case 'X':
+			n = snprintf(out, room, spec, width, precision, VRD_Cursor_Read7BitEncodedInt64(&c));
+			break;
+		case 'c':
+			n = snprintf(out, room, spec, width, precision, (int)VRD_Cursor_Read7BitEncodedInt64(&c));
+			break;
+		case 'p':
+			n = snprintf(out, room, spec, width, precision, (void*)(size_t)VRD_Cursor_Read7BitEncodedInt64(&c));
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+		{
+			double value = 0;
+			const unsigned char* p = VRD_Cursor_Take(&c, 8);
+			if (p) memcpy(&value, p, 8);
+			n = snprintf(out, room, spec, width, precision, value);
+			break;
+		}
+		case 's':
+		{
+			VRD_StringView s = VRD_Cursor_ReadString(&c);
+			n = snprintf(out, room, spec, width, (precision < 0 || precision > s.length) ? s.length : precision, s.data);
+			break;
+		}
+		case 'n':
+			break;
+		default:
+			// Unknown conversion, the capture stopped writing arguments there: the rest is written as is
+			for (const char* l = conversion; l < end; ++l, ++len)
+				if (len < size) text[len] = *l;
+			f = end;
+			break;
+		}
+		if (n > 0) len += n;
+	}
+	if (size > 0) text[len < size ? len : size - 1] = 0;
+	return len;
+}
+
+// Bits are packed from the least significant bit of each byte. Reads past the end are zeros, and flag the reader.
+struct VRD_BitReader
+{
+	const unsigned char* p;
+	const unsigned char* end;
+	unsigned long long bits;
+	int count;
+	int overrun;
+};
+
+static inline unsigned int VRD_BitReader_Read(VRD_BitReader* r, int n)
+{
+	while (r->count < n)
+	{
+		if (r->p < r->end) r->bits |= (unsigned long long)*r->p++ << r->count;
+		else r->overrun = 1;
+		r->count += 8;
+	}
+	unsigned int value = (unsigned int)(r->bits & ((1ull << n) - 1));
+	r->bits >>= n;
+	r->count -= n;
+	return value;
+}
+
+// See VRD_Internal_EncodeValueSeries
+int VRD_ReadValueSeries(const VRD_ReplayBlock* block, int* frames, float* values)
+{
+	int count = block->valueSeries.count;
+	if (count <= 0) return count;
+	VRD_BitReader r = { block->valueSeries.bits, block->valueSeries.bits + block->valueSeries.bitsSize, 0, 0, 0 };
+	unsigned int previous = VRD_BitReader_Read(&r, 32);
+	memcpy(&values[0], &previous, 4);
+	frames[0] = block->valueSeries.firstFrame;
+	int delta = 1;
+	int leading = 0, trailing = 0;
+	for (int i = 1; i < count; ++i)
+	{
+		if (VRD_BitReader_Read(&r, 1) != 0)
+		{
+			if (VRD_BitReader_Read(&r, 1) == 0) delta += (int)VRD_BitReader_Read(&r, 7) - 63;
+			else if (VRD_BitReader_Read(&r, 1) == 0) delta += (int)VRD_BitReader_Read(&r, 9) - 255;
+			else if (VRD_BitReader_Read(&r, 1) == 0) delta += (int)VRD_BitReader_Read(&r, 12) - 2047;
+			else delta += (int)VRD_BitReader_Read(&r, 32);
+		}
+		frames[i] = frames[i - 1] + delta;
+
+		if (VRD_BitReader_Read(&r, 1) != 0)
+		{
+			if (VRD_BitReader_Read(&r, 1) != 0)
+			{
+				leading = (int)VRD_BitReader_Read(&r, 5);
+				trailing = 32 - leading - ((int)VRD_BitReader_Read(&r, 5) + 1);
+				if (trailing < 0) return -1;
+			}
+			previous ^= VRD_BitReader_Read(&r, 32 - leading - trailing) << trailing;
+		}
+		memcpy(&values[i], &previous, 4);
+	}
+	if (r.overrun || frames[count - 1] > block->frame) return -1;
+	return count;
+}
+
+///
+/// Summary footer
+///
+
+static void VRD_Internal_ReadSummaryEntity(VRD_Cursor* c, VRD_ReplaySummaryEntity* entity)
+{
+	memset(entity, 0, sizeof(VRD_ReplaySummaryEntity));
+	entity->entityId = VRD_Cursor_Read7BitEncodedInt(c);
+	entity->registered = VRD_Cursor_Read7BitEncodedInt(c) & VRD_ReaderSummary_Registered;
+	entity->defFrame = VRD_Cursor_Read7BitEncodedInt(c);
+	entity->undefFrame = VRD_Cursor_Read7BitEncodedInt(c) - 1;
+	if (entity->registered)
+	{
+		entity->name = VRD_Cursor_ReadString(c);
+		entity->path = VRD_Cursor_ReadString(c);
+		entity->typeName = VRD_Cursor_ReadString(c);
+		entity->categoryName = VRD_Cursor_ReadString(c);
+	}
+	entity->logFrameCount = VRD_Cursor_Read7BitEncodedInt(c);
+	entity->logFrames = c->p;
+	for (int i = 0; i < entity->logFrameCount && !c->overrun; ++i) VRD_Cursor_Read7BitEncodedInt(c);
+}
+
+int VRD_ReadSummary(VRD_replay_reader* reader, VRD_ReplaySummary* summary)
+{
+	memset(summary, 0, sizeof(VRD_ReplaySummary));
+	if (reader->summary == 0) return 0;
+	VRD_Cursor c = { reader->summary, reader->summary_end, 0 };
+	summary->recycledIds = (VRD_Cursor_Read7BitEncodedInt(&c) & VRD_ReaderFormat_RecycledIds) != 0;
+	summary->frameCount = VRD_Cursor_Read7BitEncodedInt(&c);
+	if (summary->frameCount < 0) return -1;
+	summary->frameTimes = VRD_Cursor_Take(&c, (size_t)summary->frameCount * 4);
+	for (int i = 0; i < 8; ++i) summary->logColors[i] = (unsigned int)VRD_Cursor_ReadInt(&c);
+	for (int i = 0; i < 8; ++i) summary->drawColors[i] = (unsigned int)VRD_Cursor_ReadInt(&c);
+	summary->logCategoryCount = VRD_Cursor_Read7BitEncodedInt(&c);
+	summary->logCategories = c.p;
+	for (int i = 0; i < summary->logCategoryCount && !c.overrun; ++i) VRD_Cursor_ReadString(&c);
+	summary->drawCategoryCount = VRD_Cursor_Read7BitEncodedInt(&c);
+	summary->drawCategories = c.p;
+	for (int i = 0; i < summary->drawCategoryCount && !c.overrun; ++i) VRD_Cursor_ReadString(&c);
+	summary->entityCount = VRD_Cursor_Read7BitEncodedInt(&c);
+	summary->entities = c.p;
+	for (int i = 0; i < summary->entityCount && !c.overrun; ++i)
+	{
+		VRD_ReplaySummaryEntity entity;
+		VRD_Internal_ReadSummaryEntity(&c, &entity);
+		if (entity.logFrameCount < 0) return -1;
+	}
+	if (c.overrun || summary->logCategoryCount < 0 || summary->drawCategoryCount < 0 || summary->entityCount < 0) return -1;
+	return 1;
+}
+
+const unsigned char* VRD_ReadSummaryLabel(const unsigned char* p, VRD_StringView* label)
+{
+	VRD_Cursor c = { p, p + 0x7fffffff, 0 }; // Bounds were checked by VRD_ReadSummary
+	*label = VRD_Cursor_ReadString(&c);
+	return c.p;
+}
+
+const unsigned char* VRD_ReadSummaryEntity(const unsigned char* p, VRD_ReplaySummaryEntity* entity)
+{
+	VRD_Cursor c = { p, p + 0x7fffffff, 0 };
+	VRD_Internal_ReadSummaryEntity(&c, entity);
+	return c.p;
+}
+
+void VRD_ReadSummaryLogFrames(const VRD_ReplaySummaryEntity* entity, int* frames)
+{
+	VRD_Cursor c = { entity->logFrames, entity->logFrames + 0x7fffffff, 0 };
+	int frame = 0;
+	for (int i = 0; i < entity->logFrameCount; ++i)
+	{
+		frame += VRD_Cursor_Read7BitEncodedInt(&c);
+		frames[i] = frame;
+	}
+}
+
+///
+/// Block decoding
+///
+
+// Floats per entity in a batch block.
+static inline int VRD_Internal_BatchComponents(enum VRD_ReplayBlockType type)
+{
+	switch (type)
+	{
+	case VRD_Block_EntitySetPosBatch: return 3;
+	case VRD_Block_EntitySetTransformBatch: return 7;
+	case VRD_Block_EntityLineBatch: return 6;
+	case VRD_Block_EntitySphereBatch: return 4;
+	default: return 0;
+	}
+}
+
+// Returns 1 with the block, 0 if the block goes past the end of the buffer, -1 on invalid data. Reader state is only updated once the block is complete, by VRD_Internal_ApplyBlock.
+int VRD_Internal_ParseBlock(VRD_replay_reader* reader, VRD_Cursor* c, VRD_ReplayBlock* block)
+{
+	int invalid = 0;
+	int type = VRD_Cursor_Read7BitEncodedInt(c);
+	if (c->overrun) return 0;
+	block->type = (enum VRD_ReplayBlockType)type;
+	block->frame = 0;
+	block->entityId = 0;
+
+	switch (type)
+	{
+	case VRD_Block_ReplayHeader:
+		break;
+	case VRD_Block_ReplayFormat:
+		block->format.flags = VRD_Cursor_Read7BitEncodedInt(c);
+		block->format.positionQuantum = (block->format.flags & VRD_ReaderFormat_DeltaTransforms) ? VRD_Cursor_ReadFloat(c) : 0;
+		if ((block->format.flags & ~VRD_ReaderFormat_Supported) != 0) invalid = 1; // Written by a newer version
+		break;
+	case VRD_Block_StringDef:
+		block->stringDef.id = VRD_Cursor_Read7BitEncodedInt(c);
+		block->stringDef.str = VRD_Cursor_ReadString(c);
+		if (block->stringDef.id <= 0) invalid = 1;
+		break;
+	case VRD_Block_FrameStep:
+		block->frameStep.totalTime = VRD_Cursor_ReadFloat(c);
+		break;
+	case VRD_Block_MeshDef:
+	{
+		block->meshDef.id = VRD_Cursor_Read7BitEncodedInt(c);
+		int vertCount = VRD_Cursor_Read7BitEncodedInt(c);
+		if (block->meshDef.id <= 0 || vertCount < 0)
+		{
+			invalid = 1;
+			vertCount = 0;
+		}
+		block->meshDef.vertCount = vertCount;
+		block->meshDef.verts = VRD_Cursor_Take(c, (size_t)vertCount * 12);
+		break;
+	}
+	case VRD_Block_Keyframe:
+		block->frame = VRD_Cursor_Read7BitEncodedInt(c);
+		block->keyframe.totalTime = VRD_Cursor_ReadFloat(c);
+		block->keyframe.length = VRD_Cursor_ReadInt(c);
+		if (block->keyframe.length < 0) invalid = 1;
+		break;
+	case VRD_Block_CaptureStats:
+	{
+		block->frame = VRD_Cursor_Read7BitEncodedInt(c);
+		memset(block->stats.calls, 0, sizeof(block->stats.calls));
+		memset(block->stats.rawBytes, 0, sizeof(block->stats.rawBytes));
+		int count = VRD_Cursor_Read7BitEncodedInt(c);
+		for (int i = 0; i < count && !c->overrun && !invalid; ++i)
+		{
+			int statsType = VRD_Cursor_Read7BitEncodedInt(c);
+			if (statsType < 0 || statsType >= VRD_STATS_BLOCK_TYPE_COUNT)
+			{
+				invalid = 1;
+				break;
+			}
+			block->stats.calls[statsType] = (long long)VRD_Cursor_Read7BitEncodedInt64(c);
+			block->stats.rawBytes[statsType] = (long long)VRD_Cursor_Read7BitEncodedInt64(c);
+		}
+		block->stats.flushedBytes = (long long)VRD_Cursor_Read7BitEncodedInt64(c);
+		block->stats.storedBytes = (long long)VRD_Cursor_Read7BitEncodedInt64(c);
+		block->stats.compressSeconds = (float)(VRD_Cursor_Read7BitEncodedInt64(c) * 1e-6);
+		block->stats.ioSeconds = (float)(VRD_Cursor_Read7BitEncodedInt64(c) * 1e-6);
+		break;
+	}
+	case VRD_Block_EntitySetPosBatch:
+	case VRD_Block_EntitySetTransformBatch:
+	case VRD_Block_EntityLineBatch:
+	case VRD_Block_EntitySphereBatch:
+	{
+		block->frame = VRD_Cursor_Read7BitEncodedInt(c);
+		block->batch.category.data = "";
+		block->batch.category.length = 0;
+		block->batch.color = (enum VRD_Color)0;
+		if (type == VRD_Block_EntityLineBatch || type == VRD_Block_EntitySphereBatch)
+		{
+			block->batch.category = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->batch.color = VRD_Cursor_ReadColor(c);
+		}
+		int count = VRD_Cursor_Read7BitEncodedInt(c);
+		if (count < 0)
+		{
+			invalid = 1;
+			count = 0;
+		}
+		block->batch.count = count;
+		block->batch.ids = c->p;
+		for (int i = 0; i < count && !c->overrun; ++i) VRD_Cursor_Read7BitEncodedInt(c);
+		block->batch.floats = VRD_Cursor_Take(c, (size_t)count * 4 * VRD_Internal_BatchComponents(block->type));
+		break;
+	}
+	default:
+	{
+		if ((type < VRD_Block_FrameStep || type > VRD_Block_Keyframe) && (type < VRD_Block_EntityMeshRef || type > VRD_Block_EntityValueSeries)) return -1;
+		block->frame = VRD_Cursor_Read7BitEncodedInt(c);
+		block->entityId = VRD_Cursor_Read7BitEncodedInt(c);
+		switch (type)
+		{
+		case VRD_Block_EntityDef:
+		case VRD_Block_EntityDefWithParent:
+		{
+			block->def.parentId = (type == VRD_Block_EntityDefWithParent) ? VRD_Cursor_Read7BitEncodedInt(c) : -1;
+			VRD_Cursor_Read7BitEncodedInt(c); // id, again
+			block->def.name = VRD_Cursor_ReadString(c);
+			block->def.path = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->def.typeName = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->def.categoryName = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->def.xform = VRD_Cursor_ReadTransform(c);
+			block->def.staticParamCount = VRD_Cursor_Read7BitEncodedInt(c);
+			block->def.staticParams = c->p;
+			for (int i = 0; i < block->def.staticParamCount && !c->overrun; ++i)
+			{
+				VRD_Cursor_ReadString(c);
+				VRD_Cursor_ReadString(c);
+			}
+			block->def.creationFrame = VRD_Cursor_Read7BitEncodedInt(c);
+			break;
+		}
+		case VRD_Block_EntityUndef:
+			break;
+		case VRD_Block_EntitySetPos:
+			block->setPos.pos = VRD_Cursor_ReadPoint(c);
+			break;
+		case VRD_Block_EntitySetTransform:
+			block->transform.xform = VRD_Cursor_ReadTransform(c);
+			block->transform.flags = 0;
+			break;
+		case VRD_Block_EntityTransformDelta:
+		{
+			int flags = 0;
+			const unsigned char* p = VRD_Cursor_Take(c, 1);
+			if (p) flags = *p;
+			block->transform.flags = flags;
+			bool full = (flags & VRD_ReaderDelta_Full) != 0;
+			for (int i = 0; i < 3; ++i)
+			{
+				reader->delta_q[i] = (full || (flags & (VRD_ReaderDelta_X << i))) ? VRD_Cursor_ReadZigZag(c) : 0;
+			}
+			if (flags & VRD_ReaderDelta_Rotation)
+			{
+				p = VRD_Cursor_Take(c, 6);
+				if (p) memcpy(reader->delta_rot, p, 6);
+			}
+			if (!reader->delta_transforms) invalid = 1;
+			break;
+		}
+		case VRD_Block_EntityLog:
+			block->log.category = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->log.message = VRD_Cursor_ReadString(c);
+			block->log.color = VRD_Cursor_ReadColor(c);
+			break;
+		case VRD_Block_EntityLogFormat:
+		{
+			block->logFormat.category = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->logFormat.format = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->logFormat.color = VRD_Cursor_ReadColor(c);
+			int argsSize = VRD_Cursor_Read7BitEncodedInt(c);
+			if (argsSize < 0)
+			{
+				invalid = 1;
+				argsSize = 0;
+			}
+			block->logFormat.argsSize = argsSize;
+			block->logFormat.args = VRD_Cursor_Take(c, argsSize);
+			break;
+		}
+		case VRD_Block_EntityParameter:
+			block->parameter.key = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->parameter.value = VRD_Cursor_ReadString(c);
+			break;
+		case VRD_Block_EntityValue:
+			block->value.key = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->value.value = VRD_Cursor_ReadFloat(c);
+			break;
+		case VRD_Block_EntityValueSeries:
+		{
+			block->valueSeries.key = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			int count = VRD_Cursor_Read7BitEncodedInt(c);
+			int back = VRD_Cursor_Read7BitEncodedInt(c);
+			int bitsSize = VRD_Cursor_Read7BitEncodedInt(c);
+			if (count <= 0 || back < 0 || back > block->frame || bitsSize < 0)
+			{
+				invalid = 1;
+				count = 0;
+				bitsSize = 0;
+			}
+			block->valueSeries.count = count;
+			block->valueSeries.bitsSize = bitsSize;
+			block->valueSeries.bits = VRD_Cursor_Take(c, bitsSize);
+			block->valueSeries.firstFrame = block->frame - back;
+			break;
+		}
+		case VRD_Block_EntityLine:
+			block->draw.category = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->draw.p1 = VRD_Cursor_ReadPoint(c);
+			block->draw.p2 = VRD_Cursor_ReadPoint(c);
+			block->draw.color = VRD_Cursor_ReadColor(c);
+			break;
+		case VRD_Block_EntityCircle:
+			block->draw.category = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->draw.p1 = VRD_Cursor_ReadPoint(c);
+			block->draw.p2 = VRD_Cursor_ReadPoint(c);
+			block->draw.radius = VRD_Cursor_ReadFloat(c);
+			block->draw.color = VRD_Cursor_ReadColor(c);
+			break;
+		case VRD_Block_EntitySphere:
+			block->draw.category = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->draw.p1 = VRD_Cursor_ReadPoint(c);
+			block->draw.radius = VRD_Cursor_ReadFloat(c);
+			block->draw.color = VRD_Cursor_ReadColor(c);
+			break;
+		case VRD_Block_EntityCapsule:
+			block->draw.category = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->draw.p1 = VRD_Cursor_ReadPoint(c);
+			block->draw.p2 = VRD_Cursor_ReadPoint(c);
+			block->draw.radius = VRD_Cursor_ReadFloat(c);
+			block->draw.color = VRD_Cursor_ReadColor(c);
+			break;
+		case VRD_Block_EntityMesh:
+		{
+			block->draw.category = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			int vertCount = VRD_Cursor_ReadInt(c);
+			if (vertCount < 0)
+			{
+				invalid = 1;
+				vertCount = 0;
+			}
+			block->draw.vertCount = vertCount;
+			block->draw.verts = VRD_Cursor_Take(c, (size_t)vertCount * 12);
+			block->draw.color = VRD_Cursor_ReadColor(c);
+			break;
+		}
+		case VRD_Block_EntityMeshRef:
+		{
+			block->draw.category = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			int ref = VRD_Cursor_Read7BitEncodedInt(c);
+			int meshId = ref >> 1;
+			if (ref & 1)
+			{
+				block->draw.xform = VRD_Cursor_ReadTransform(c);
+			}
+			else
+			{
+				VRD_Transform identity = { { 0, 0, 0 }, { 0, 0, 0, 1 } };
+				block->draw.xform = identity;
+			}
+			block->draw.color = VRD_Cursor_ReadColor(c);
+			block->draw.verts = 0;
+			block->draw.vertCount = 0;
+			if (meshId <= 0 || meshId >= reader->mesh_capacity || reader->meshes[meshId].verts == 0)
+			{
+				if (!c->overrun) invalid = 1;
+				break;
+			}
+			block->draw.verts = reader->meshes[meshId].verts;
+			block->draw.vertCount = reader->meshes[meshId].vertCount;
+			break;
+		}
+		case VRD_Block_EntityBox:
+			block->draw.category = VRD_Cursor_ReadLabel(reader, c, &invalid);
+			block->draw.xform = VRD_Cursor_ReadTransform(c);
+			block->draw.p2 = VRD_Cursor_ReadPoint(c);
+			block->draw.color = VRD_Cursor_ReadColor(c);
+			break;
+		default:
+			return -1;
+		}
+		break;
+	}
+	}
+
+	if (c->overrun) return 0;
+	return invalid ? -1 : 1;
+}
+
+static inline unsigned int VRD_Internal_ReaderHashInt(unsigned int x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+VRD_ReaderEntity* VRD_Internal_GetReaderEntity(VRD_replay_reader* reader, int entityId)
+{
+	VRD_ReaderEntities* entities = &reader->entities;
+	if ((entities->count + 1) * 2 > entities->capacity)
+	{
+		int capacity = entities->capacity > 0 ? entities->capacity * 2 : 1024;
+		VRD_ReaderEntity* items = static_cast<VRD_ReaderEntity*>(calloc(capacity, sizeof(VRD_ReaderEntity)));
+		if (items == 0) return 0;
+		for (int i = 0; i < entities->capacity; ++i)
+		{
+			if (entities->items[i].id == 0) continue;
+			int index = VRD_Internal_ReaderHashInt(entities->items[i].id) & (capacity - 1);
+			while (items[index].id != 0) index = (index + 1) & (capacity - 1);
+			items[index] = entities->items[i];
+		}
+		free(entities->items);
+		entities->items = items;
+		entities->capacity = capacity;
+	}
+
+	int index = VRD_Internal_ReaderHashInt(entityId) & (entities->capacity - 1);
+	while (entities->items[index].id != 0)
+	{
+		if (entities->items[index].id == entityId) return &entities->items[index];
+		index = (index + 1) & (entities->capacity - 1);
+	}
+	VRD_ReaderEntity* entity = &entities->items[index];
+	memset(entity, 0, sizeof(VRD_ReaderEntity));
+	entity->id = entityId;
+	entity->xform.rotation.w = 1;
+	entities->count += 1;
+	return entity;
+}
+
+void VRD_Internal_ResetStringTable(VRD_replay_reader* reader)
+{
+	for (int i = 0; i < reader->string_capacity; ++i)
+	{
+		free(reader->strings[i].copy);
+	}
+	if (reader->strings) memset(reader->strings, 0, reader->string_capacity * sizeof(VRD_ReaderString));
+}
+
+bool VRD_Internal_DefineString(VRD_replay_reader* reader, int id, VRD_StringView str)
+{
+	if (id >= reader->string_capacity)
+	{
+		int capacity = reader->string_capacity > 0 ? reader->string_capacity : 1024;
+		while (capacity <= id) capacity *= 2;
+		VRD_ReaderString* strings = static_cast<VRD_ReaderString*>(realloc(reader->strings, capacity * sizeof(VRD_ReaderString)));
+		if (strings == 0) return false;
+		memset(strings + reader->string_capacity, 0, (capacity - reader->string_capacity) * sizeof(VRD_ReaderString));
+		reader->strings = strings;
+		reader->string_capacity = capacity;
+	}
+
+	VRD_ReaderString* item = &reader->strings[id];
+	free(item->copy);
+	item->copy = 0;
+	item->view = str;
+	if (!reader->stable)
+	{
+		// The decode window moves on, labels must outlive it
+		item->copy = static_cast<char*>(malloc(str.length + 1));
+		if (item->copy == 0) return false;
+		memcpy(item->copy, str.data, str.length);
+		item->copy[str.length] = 0;
+		item->view.data = item->copy;
+	}
+	return true;
+}
+
+bool VRD_Internal_CopyBatch(VRD_replay_reader* reader, VRD_ReplayBlock* block);
+
+void VRD_Internal_ResetMeshes(VRD_replay_reader* reader)
+{
+	for (int i = 0; i < reader->mesh_capacity; ++i)
+	{
+		free(reader->meshes[i].verts);
+	}
+	if (reader->meshes) memset(reader->meshes, 0, reader->mesh_capacity * sizeof(VRD_ReaderMesh));
+}
+
+bool VRD_Internal_DefineMesh(VRD_replay_reader* reader, int id, const void* verts, int vertCount)
+{
+	if (id >= reader->mesh_capacity)
+	{
+		int capacity = reader->mesh_capacity > 0 ? reader->mesh_capacity : 256;
+		while (capacity <= id) capacity *= 2;
+		VRD_ReaderMesh* meshes = static_cast<VRD_ReaderMesh*>(realloc(reader->meshes, capacity * sizeof(VRD_ReaderMesh)));
+		if (meshes == 0) return false;
+		memset(meshes + reader->mesh_capacity, 0, (capacity - reader->mesh_capacity) * sizeof(VRD_ReaderMesh));
+		reader->meshes = meshes;
+		reader->mesh_capacity = capacity;
+	}
+
+	VRD_ReaderMesh* mesh = &reader->meshes[id];
+	free(mesh->verts);
+	mesh->verts = static_cast<VRD_Point*>(malloc(vertCount > 0 ? (size_t)vertCount * sizeof(VRD_Point) : 1));
+	mesh->vertCount = mesh->verts ? vertCount : 0;
+	if (mesh->verts == 0) return false;
+	if (vertCount > 0) memcpy(mesh->verts, verts, (size_t)vertCount * sizeof(VRD_Point));
+	return true;
+}
+
+// Side effects of a decoded block on the reader. Returns false when out of memory.
+bool VRD_Internal_ApplyBlock(VRD_replay_reader* reader, VRD_ReplayBlock* block)
+{
+	switch (block->type)
+	{
+	case VRD_Block_ReplayFormat:
+		reader->string_table = (block->format.flags & VRD_ReaderFormat_StringTable) != 0;
+		reader->delta_transforms = (block->format.flags & VRD_ReaderFormat_DeltaTransforms) != 0;
+		reader->position_quantum = block->format.positionQuantum;
+		VRD_Internal_ResetStringTable(reader);
+		VRD_Internal_ResetMeshes(reader);
+		return true;
+	case VRD_Block_StringDef:
+		return VRD_Internal_DefineString(reader, block->stringDef.id, block->stringDef.str);
+	case VRD_Block_MeshDef:
+		return VRD_Internal_DefineMesh(reader, block->meshDef.id, block->meshDef.verts, block->meshDef.vertCount);
+	case VRD_Block_Keyframe:
+		// Only the first keyframe read restores the live entities, the others carry on from the previous chunk
+		if (reader->keyframe_applied) reader->skip = block->keyframe.length;
+		reader->keyframe_applied = 1;
+		return true;
+	case VRD_Block_EntitySetPos:
+	case VRD_Block_EntitySetTransform:
+	{
+		if (!reader->delta_transforms) return true; // Only tracked as the base of deltas
+		VRD_ReaderEntity* entity = VRD_Internal_GetReaderEntity(reader, block->entityId);
+		if (entity == 0) return false;
+		if (block->type == VRD_Block_EntitySetPos) entity->xform.translation = block->setPos.pos;
+		else entity->xform = block->transform.xform;
+		return true;
+	}
+	case VRD_Block_EntityTransformDelta:
+	{
+		VRD_ReaderEntity* entity = VRD_Internal_GetReaderEntity(reader, block->entityId);
+		if (entity == 0) return false;
+		int flags = block->transform.flags;
+		for (int i = 0; i < 3; ++i)
+		{
+			if (flags & VRD_ReaderDelta_Full) entity->qpos[i] = reader->delta_q[i];
+			else entity->qpos[i] = (int)((unsigned int)entity->qpos[i] + (unsigned int)reader->delta_q[i]); // Wraps around, like the writer
+		}
+		float quantum = reader->position_quantum;
+		entity->xform.translation.x = entity->qpos[0] * quantum;
+		entity->xform.translation.y = entity->qpos[1] * quantum;
+		entity->xform.translation.z = entity->qpos[2] * quantum;
+		if (flags & VRD_ReaderDelta_Rotation)
+		{
+			// Smallest three, the largest component is positive and restored from the unit length
+			int largest = (flags >> VRD_ReaderDelta_RotationIndexShift) & 3;
+			float q[4];
+			float sum = 0;
+			for (int i = 0, n = 0; i < 4; ++i)
+			{
+				if (i == largest) continue;
+				q[i] = (reader->delta_rot[n++] / 65535.0f - 0.5f) * 1.41421356f;
+				sum += q[i] * q[i];
+			}
+			q[largest] = sqrtf(sum < 1 ? 1 - sum : 0);
+			entity->xform.rotation.x = q[0];
+			entity->xform.rotation.y = q[1];
+			entity->xform.rotation.z = q[2];
+			entity->xform.rotation.w = q[3];
+		}
+		block->transform.xform = entity->xform;
+		return true;
+	}
+	case VRD_Block_EntitySetPosBatch:
+	case VRD_Block_EntitySetTransformBatch:
+	case VRD_Block_EntityLineBatch:
+	case VRD_Block_EntitySphereBatch:
+		return VRD_Internal_CopyBatch(reader, block);
+	default:
+		return true;
+	}
+}
+
+// Keeps a batch for VRD_ReadBlock to expand, the decode window may move on before it is done.
+bool VRD_Internal_CopyBatch(VRD_replay_reader* reader, VRD_ReplayBlock* block)
+{
+	VRD_ReaderBatch* batch = &reader->batch;
+	int count = block->batch.count;
+	int components = VRD_Internal_BatchComponents(block->type);
+	if (count > batch->capacity)
+	{
+		int* ids = static_cast<int*>(realloc(batch->ids, (size_t)count * sizeof(int)));
+		if (ids == 0) return false;
+		batch->ids = ids;
+		float* floats = static_cast<float*>(realloc(batch->floats, (size_t)count * 7 * sizeof(float)));
+		if (floats == 0) return false;
+		batch->floats = floats;
+		batch->capacity = count;
+	}
+	int category_length = block->batch.category.length;
+	if (category_length + 1 > batch->category_capacity)
+	{
+		char* category = static_cast<char*>(realloc(batch->category, category_length + 1));
+		if (category == 0) return false;
+		batch->category = category;
+		batch->category_capacity = category_length + 1;
+	}
+
+	VRD_Cursor c = { block->batch.ids, block->batch.floats, 0 }; // Bounds were checked when the block was read
+	int id = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		id = (int)((unsigned int)id + (unsigned int)VRD_Cursor_ReadZigZag(&c)); // Wraps around, like the writer
+		batch->ids[i] = id;
+	}
+	if (count > 0) memcpy(batch->floats, block->batch.floats, (size_t)count * components * sizeof(float));
+	if (category_length > 0) memcpy(batch->category, block->batch.category.data, category_length);
+	batch->category[category_length] = 0;
+	batch->categoryView.data = batch->category;
+	batch->categoryView.length = category_length;
+	batch->type = block->type;
+	batch->frame = block->frame;
+	batch->color = block->batch.color;
+	batch->count = count;
+	batch->index = 0;
+	return true;
+}
+
+// Next entity of the batch, as its single entity block.
+void VRD_Internal_NextBatchBlock(VRD_replay_reader* reader, VRD_ReplayBlock* block)
+{
+	VRD_ReaderBatch* batch = &reader->batch;
+	int i = batch->index++;
+	int n = batch->count;
+	const float* f = batch->floats + i;
+	block->frame = batch->frame;
+	block->entityId = batch->ids[i];
+	switch (batch->type)
+	{
+	case VRD_Block_EntitySetPosBatch:
+		block->type = VRD_Block_EntitySetPos;
+		block->setPos.pos.x = f[0];
+		block->setPos.pos.y = f[n];
+		block->setPos.pos.z = f[2 * n];
+		break;
+	case VRD_Block_EntitySetTransformBatch:
+		block->type = VRD_Block_EntitySetTransform;
+		block->transform.xform.translation.x = f[0];
+		block->transform.xform.translation.y = f[n];
+		block->transform.xform.translation.z = f[2 * n];
+		block->transform.xform.rotation.x = f[3 * n];
+		block->transform.xform.rotation.y = f[4 * n];
+		block->transform.xform.rotation.z = f[5 * n];
+		block->transform.xform.rotation.w = f[6 * n];
+		block->transform.flags = 0;
+		break;
+	case VRD_Block_EntityLineBatch:
+		memset(&block->draw, 0, sizeof(block->draw));
+		block->type = VRD_Block_EntityLine;
+		block->draw.category = batch->categoryView;
+		block->draw.p1.x = f[0];
+		block->draw.p1.y = f[n];
+		block->draw.p1.z = f[2 * n];
+		block->draw.p2.x = f[3 * n];
+		block->draw.p2.y = f[4 * n];
+		block->draw.p2.z = f[5 * n];
+		block->draw.color = batch->color;
+		break;
+	default:
+		memset(&block->draw, 0, sizeof(block->draw));
+		block->type = VRD_Block_EntitySphere;
+		block->draw.category = batch->categoryView;
+		block->draw.p1.x = f[0];
+		block->draw.p1.y = f[n];
+		block->draw.p1.z = f[2 * n];
+		block->draw.radius = f[3 * n];
+		block->draw.color = batch->color;
+		break;
+	}
+}
+
+///
+/// Sources
+///
+
+// Decodes more of a compressed single stream at the end of the window. Returns the number of bytes decoded.
+size_t VRD_Internal_DecodeStream(VRD_replay_reader* reader)
+{
+	unsigned char* out = reader->window.data + reader->window.size;
+	size_t room = reader->window.capacity - reader->window.size;
+	size_t produced = 0;
+	switch (reader->codec)
+	{
+#ifdef VRD_USE_ZLIB
+	case VRD_ReaderCodec_Deflate:
+	{
+		size_t available = reader->in_end - reader->in;
+		reader->z_strm.next_in = const_cast<unsigned char*>(reader->in);
+		reader->z_strm.avail_in = (uInt)(available < (1u << 30) ? available : (1u << 30));
+		reader->z_strm.next_out = out;
+		reader->z_strm.avail_out = (uInt)room;
+		int ret = inflate(&reader->z_strm, Z_NO_FLUSH);
+		produced = room - reader->z_strm.avail_out;
+		reader->in = reader->z_strm.next_in;
+		if (ret != Z_OK || (produced == 0 && reader->in == reader->in_end)) reader->stream_done = 1;
+		break;
+	}
+#endif
+#ifdef VRD_USE_LZ4
+	case VRD_ReaderCodec_LZ4:
+	{
+		size_t outSize = room;
+		size_t inSize = reader->in_end - reader->in;
+		size_t ret = LZ4F_decompress(reader->lz4, out, &outSize, reader->in, &inSize, 0);
+		produced = outSize;
+		reader->in += inSize;
+		if (LZ4F_isError(ret) || ret == 0 || (produced == 0 && reader->in == reader->in_end)) reader->stream_done = 1;
+		break;
+	}
+#endif
+#ifdef VRD_USE_ZSTD
+	case VRD_ReaderCodec_Zstd:
+	{
+		ZSTD_outBuffer zout = { out, room, 0 };
+		ZSTD_inBuffer zin = { reader->in, (size_t)(reader->in_end - reader->in), 0 };
+		size_t ret = ZSTD_decompressStream(reader->zstd, &zout, &zin);
+		produced = zout.pos;
+		reader->in += zin.pos;
+		if (ZSTD_isError(ret) || (produced == 0 && reader->in == reader->in_end)) reader->stream_done = 1;
+		break;
+	}
+#endif
+	default:
+		(void)out; // Only used by the codecs compiled in
+		(void)room;
+		reader->stream_done = 1; // Codec not compiled in
+		break;
+	}
+	reader->window.size += produced;
+	return produced;
+}
+
+bool VRD_Internal_ReserveWindow(VRD_replay_reader* reader, size_t capacity)
+{
+	if (reader->window.capacity >= capacity) return true;
+	unsigned char* data = static_cast<unsigned char*>(realloc(reader->window.data, capacity));
+	if (data == 0) return false;
+	reader->window.data = data;
+	reader->window.capacity = capacity;
+	return true;
+}
+
+// Decodes a whole chunk in the window. Returns false if it is truncated or the codec is not compiled in.
+bool VRD_Internal_DecodeChunk(VRD_replay_reader* reader, const unsigned char* stored, int storedSize, int rawSize)
+{
+	if (!VRD_Internal_ReserveWindow(reader, rawSize > 0 ? rawSize : 1)) return false;
+	reader->window.size = rawSize;
+	switch (reader->codec)
+	{
+#ifdef VRD_USE_ZLIB
+	case VRD_ReaderCodec_Deflate:
+	{
+		inflateReset(&reader->z_strm);
+		reader->z_strm.next_in = const_cast<unsigned char*>(stored);
+		reader->z_strm.avail_in = storedSize;
+		reader->z_strm.next_out = reader->window.data;
+		reader->z_strm.avail_out = rawSize;
+		int ret = inflate(&reader->z_strm, Z_FINISH);
+		return ret == Z_STREAM_END || (ret == Z_BUF_ERROR && reader->z_strm.avail_out == 0);
+	}
+#endif
+#ifdef VRD_USE_LZ4
+	case VRD_ReaderCodec_LZ4:
+	{
+		LZ4F_resetDecompressionContext(reader->lz4);
+		size_t outSize = rawSize;
+		size_t inSize = storedSize;
+		size_t ret = LZ4F_decompress(reader->lz4, reader->window.data, &outSize, stored, &inSize, 0);
+		return !LZ4F_isError(ret) && outSize == (size_t)rawSize;
+	}
+#endif
+#ifdef VRD_USE_ZSTD
+	case VRD_ReaderCodec_Zstd:
+	{
+		size_t ret = ZSTD_decompressDCtx(reader->zstd, reader->window.data, rawSize, stored, storedSize);
+		return !ZSTD_isError(ret) && ret == (size_t)rawSize;
+	}
+#endif
+	default:
+		(void)stored; // Only used by the codecs compiled in
+		(void)storedSize;
+		return false;
+	}
+}
+
+bool VRD_Internal_NextChunk(VRD_replay_reader* reader)
+{
+	if ((size_t)(reader->in_end - reader->in) < VRD_CHUNK_HEADER_SIZE) return false;
+	int header[4]; // first frame, frame count, raw size, stored size
+	memcpy(header, reader->in, sizeof(header));
+	int rawSize = header[2];
+	int storedSize = header[3];
+	const unsigned char* stored = reader->in + VRD_CHUNK_HEADER_SIZE;
+	if (rawSize < 0 || storedSize < 0 || (size_t)(reader->in_end - stored) < (size_t)storedSize) return false;
+	reader->in = stored + storedSize;
+
+	if (rawSize == 0 && storedSize == 0)
+	{
+		// Gap marker: the live entities may have changed, so the next keyframe restores them
+		reader->gap_first_frame = header[0];
+		reader->gap_frame_count = header[1] > 0 ? header[1] : 1;
+		reader->keyframe_applied = 0;
+		reader->pos = reader->end = reader->in;
+		return true;
+	}
+	if (reader->codec == VRD_ReaderCodec_None && reader->follow)
+	{
+		// Fed bytes move on the next feed, keep the chunk in the window
+		if (!VRD_Internal_ReserveWindow(reader, storedSize)) return false;
+		memcpy(reader->window.data, stored, storedSize);
+		reader->pos = reader->window.data;
+		reader->end = reader->window.data + storedSize;
+		return true;
+	}
+	if (reader->codec == VRD_ReaderCodec_None)
+	{
+		reader->pos = stored;
+		reader->end = stored + storedSize;
+		return true;
+	}
+	if (!VRD_Internal_DecodeChunk(reader, stored, storedSize, rawSize)) return false;
+	reader->pos = reader->window.data;
+	reader->end = reader->window.data + rawSize;
+	return true;
+}
+
+// Makes more blocks available. With incomplete set, the bytes left are the start of a block and are kept. Returns false at the end of the replay.
+bool VRD_Internal_Refill(VRD_replay_reader* reader, bool incomplete)
+{
+	if (reader->chunked)
+	{
+		if (incomplete) return false; // Blocks never span chunks
+		return VRD_Internal_NextChunk(reader);
+	}
+	if (reader->follow) return false; // Header not fed yet
+	if (reader->stable || reader->stream_done) return false;
+
+	size_t keep = reader->end - reader->pos;
+	if (keep > 0) memmove(reader->window.data, reader->pos, keep);
+	reader->window.size = keep;
+	if (keep == reader->window.capacity && !VRD_Internal_ReserveWindow(reader, reader->window.capacity * 2)) return false;
+
+	size_t produced = 0;
+	while (produced == 0 && !reader->stream_done) produced = VRD_Internal_DecodeStream(reader);
+	reader->pos = reader->window.data;
+	reader->end = reader->window.data + reader->window.size;
+	return produced > 0;
+}
+
+bool VRD_Internal_MapFile(VRD_replay_reader* reader, const char* filename)
+{
+#ifdef _WIN32
+	reader->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (reader->file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(reader->file, &size) || size.QuadPart == 0) return false;
+	reader->mapping = CreateFileMappingA(reader->file, 0, PAGE_READONLY, 0, 0, 0);
+	if (reader->mapping == 0) return false;
+	reader->map = static_cast<const unsigned char*>(MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, 0));
+	reader->map_size = (size_t)size.QuadPart;
+	return reader->map != 0;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	void* map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return false;
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	reader->map = static_cast<const unsigned char*>(map);
+	reader->map_size = st.st_size;
+	return true;
+#endif
+}
+
+void VRD_Internal_UnmapFile(VRD_replay_reader* reader)
+{
+#ifdef _WIN32
+	if (reader->map) UnmapViewOfFile(reader->map);
+	if (reader->mapping) CloseHandle(reader->mapping);
+	if (reader->file != INVALID_HANDLE_VALUE && reader->file != 0) CloseHandle(reader->file);
+#else
+	if (reader->map) munmap(const_cast<unsigned char*>(reader->map), reader->map_size);
+#endif
+}
+
+bool VRD_Internal_InitDecoder(VRD_replay_reader* reader, int codec)
+{
+	reader->codec = codec;
+	switch (codec)
+	{
+	case VRD_ReaderCodec_None:
+		return true;
+#ifdef VRD_USE_ZLIB
+	case VRD_ReaderCodec_Deflate:
+		reader->z_strm.zalloc = 0;
+		reader->z_strm.zfree = 0;
+		reader->z_strm.opaque = 0;
+		reader->z_strm.next_in = 0;
+		reader->z_strm.avail_in = 0;
+		return inflateInit2(&reader->z_strm, -15) == Z_OK; // raw stream, without zlib header
+#endif
+#ifdef VRD_USE_LZ4
+	case VRD_ReaderCodec_LZ4:
+		return !LZ4F_isError(LZ4F_createDecompressionContext(&reader->lz4, LZ4F_VERSION));
+#endif
+#ifdef VRD_USE_ZSTD
+	case VRD_ReaderCodec_Zstd:
+		reader->zstd = ZSTD_createDCtx();
+		if (reader->zstd == 0) return false;
+		return reader->dictionary_size <= 0 || !ZSTD_isError(ZSTD_DCtx_loadDictionary(reader->zstd, reader->dictionary, reader->dictionary_size));
+#endif
+	default:
+		reader->codec = -1; // Not compiled in, nothing to release
+		return false;
+	}
+}
+
+// Codec, level, dictionary size, then the dictionary. Returns false if the header is truncated.
+bool VRD_Internal_ReadCodecHeader(VRD_replay_reader* reader, const unsigned char** p, const unsigned char* end)
+{
+	int header[3];
+	if ((size_t)(end - *p) < sizeof(header)) return false;
+	memcpy(header, *p, sizeof(header));
+	*p += sizeof(header);
+	if (header[2] < 0 || (size_t)(end - *p) < (size_t)header[2]) return false;
+	reader->dictionary = *p;
+	reader->dictionary_size = header[2];
+	*p += header[2];
+	return VRD_Internal_InitDecoder(reader, header[0]);
+}
+
+// Magic, version, then the codec header. Returns 1 past it, 0 if it is truncated, -1 if it is invalid.
+int VRD_Internal_ReadChunkedHeader(VRD_replay_reader* reader, const unsigned char** p, const unsigned char* end)
+{
+	const unsigned char* it = *p;
+	if (end - it < 4) return 0;
+	if (memcmp(it, VRD_CHUNKED_MAGIC, 4) != 0) return -1;
+	int version;
+	if (end - it < 12) return 0;
+	memcpy(&version, it + 4, 4);
+	it += 8;
+	if (version > VRD_CHUNKED_VERSION) return -1; // Written by a newer version
+	if (version < 2)
+	{
+		int flags;
+		memcpy(&flags, it, 4);
+		it += 4;
+		if (!VRD_Internal_InitDecoder(reader, (flags & 1) ? VRD_ReaderCodec_Deflate : VRD_ReaderCodec_None)) return -1;
+	}
+	else
+	{
+		int header[3];
+		if ((size_t)(end - it) < sizeof(header)) return 0;
+		memcpy(header, it, sizeof(header));
+		if (header[2] > 0 && (size_t)(end - it) < sizeof(header) + header[2]) return 0;
+		if (!VRD_Internal_ReadCodecHeader(reader, &it, end)) return -1;
+	}
+	*p = it;
+	return 1;
+}
+
+bool VRD_Internal_OpenChunked(VRD_replay_reader* reader)
+{
+	const unsigned char* p = reader->map;
+	const unsigned char* end = reader->map + reader->map_size;
+	if (VRD_Internal_ReadChunkedHeader(reader, &p, end) <= 0) return false;
+
+	// Footer index, missing if the capture did not end cleanly
+	reader->in = p;
+	reader->in_end = end;
+	if (end - p >= 16 && memcmp(end - 4, VRD_CHUNK_INDEX_MAGIC, 4) == 0)
+	{
+		long long indexOffset;
+		int count;
+		memcpy(&indexOffset, end - 16, 8);
+		memcpy(&count, end - 8, 4);
+		if (indexOffset >= p - reader->map && indexOffset + count * 16LL + 16 == (long long)reader->map_size) reader->in_end = reader->map + indexOffset;
+	}
+
+	// Summary footer, right before the index
+	int version;
+	memcpy(&version, reader->map + 4, 4);
+	if (version >= 3 && reader->in_end != end && reader->in_end - p >= 12 && memcmp(reader->in_end - 4, VRD_SUMMARY_MAGIC, 4) == 0)
+	{
+		long long summaryOffset;
+		memcpy(&summaryOffset, reader->in_end - 12, 8);
+		if (summaryOffset >= p - reader->map && summaryOffset <= reader->in_end - 12 - reader->map)
+		{
+			reader->summary = reader->map + summaryOffset;
+			reader->summary_end = reader->in_end - 12;
+			reader->in_end = reader->summary;
+		}
+	}
+	reader->chunked = 1;
+	reader->stable = 1; // Each chunk restarts the string table
+	reader->pos = reader->end = p;
+	return true;
+}
+
+VRD_replay_reader* VRD_OpenReplay(const char* filename)
+{
+	VRD_replay_reader* reader = static_cast<VRD_replay_reader*>(calloc(1, sizeof(VRD_replay_reader)));
+	if (reader == 0) return 0;
+	if (!VRD_Internal_MapFile(reader, filename) || reader->map_size < 4)
+	{
+		VRD_CloseReplay(reader);
+		return 0;
+	}
+
+	bool ok = true;
+	const unsigned char* p = reader->map;
+	int header;
+	memcpy(&header, p, 4);
+	if (memcmp(p, VRD_CHUNKED_MAGIC, 4) == 0)
+	{
+		ok = VRD_Internal_OpenChunked(reader);
+	}
+	else if (header == VRD_Block_ReplayHeader)
+	{
+		// Uncompressed, blocks are read in place
+		reader->stable = 1;
+		reader->pos = p + 4;
+		reader->end = p + reader->map_size;
+	}
+	else
+	{
+		if (memcmp(reader->map, VRD_STREAM_MAGIC, 4) == 0)
+		{
+			int version = 0;
+			if (reader->map_size >= 8) memcpy(&version, p + 4, 4);
+			p += 8;
+			ok = version > 0 && version <= VRD_STREAM_VERSION && VRD_Internal_ReadCodecHeader(reader, &p, reader->map + reader->map_size);
+		}
+		else
+		{
+			ok = VRD_Internal_InitDecoder(reader, VRD_ReaderCodec_Deflate); // Legacy compressed replay, raw deflate without header
+		}
+		reader->in = p;
+		reader->in_end = reader->map + reader->map_size;
+		ok = ok && VRD_Internal_ReserveWindow(reader, VRD_READER_WINDOW_SIZE);
+		reader->pos = reader->end = reader->window.data;
+	}
+
+	if (!ok)
+	{
+		VRD_CloseReplay(reader);
+		return 0;
+	}
+	return reader;
+}
+
+VRD_replay_reader* VRD_FollowReplay(void)
+{
+	VRD_replay_reader* reader = static_cast<VRD_replay_reader*>(calloc(1, sizeof(VRD_replay_reader)));
+	if (reader == 0) return 0;
+	reader->follow = 1;
+	reader->codec = -1; // Until the header is fed
+	return reader;
+}
+
+int VRD_FeedReplay(VRD_replay_reader* reader, const void* data, int size)
+{
+	if (reader == 0 || !reader->follow || size < 0) return 0;
+	struct VRD_ReaderBuffer* received = &reader->received;
+
+	// Chunks already read are dropped
+	size_t consumed = reader->in ? reader->in - received->data : 0;
+	if (consumed > 0)
+	{
+		memmove(received->data, reader->in, received->size - consumed);
+		received->size -= consumed;
+	}
+	if (received->size + size > received->capacity)
+	{
+		size_t capacity = received->capacity > 0 ? received->capacity : VRD_READER_WINDOW_SIZE;
+		while (capacity < received->size + size) capacity *= 2;
+		unsigned char* grown = static_cast<unsigned char*>(realloc(received->data, capacity));
+		if (grown == 0) return 0;
+		received->data = grown;
+		received->capacity = capacity;
+	}
+	if (size > 0) memcpy(received->data + received->size, data, size);
+	received->size += size;
+	reader->in = received->data;
+	reader->in_end = received->data + received->size;
+
+	if (!reader->chunked)
+	{
+		const unsigned char* p = reader->in;
+		int ret = VRD_Internal_ReadChunkedHeader(reader, &p, reader->in_end);
+		if (ret < 0) return 0;
+		if (ret == 0) return 1; // Wait for the rest of the header
+		reader->dictionary = 0; // Loaded by the decoder, the fed copy goes away
+		reader->in = p;
+		reader->chunked = 1;
+		reader->stable = 1;
+		reader->pos = reader->end = p;
+	}
+	return 1;
+}
+
+void VRD_CloseReplay(VRD_replay_reader* reader)
+{
+	if (reader == 0) return;
+	switch (reader->codec)
+	{
+#ifdef VRD_USE_ZLIB
+	case VRD_ReaderCodec_Deflate: inflateEnd(&reader->z_strm); break;
+#endif
+#ifdef VRD_USE_LZ4
+	case VRD_ReaderCodec_LZ4: LZ4F_freeDecompressionContext(reader->lz4); break;
+#endif
+#ifdef VRD_USE_ZSTD
+	case VRD_ReaderCodec_Zstd: ZSTD_freeDCtx(reader->zstd); break;
+#endif
+	default: break;
+	}
+	VRD_Internal_ResetStringTable(reader);
+	free(reader->strings);
+	VRD_Internal_ResetMeshes(reader);
+	free(reader->meshes);
+	free(reader->entities.items);
+	free(reader->batch.ids);
+	free(reader->batch.floats);
+	free(reader->batch.category);
+	free(reader->window.data);
+	free(reader->received.data);
+	VRD_Internal_UnmapFile(reader);
+	memset(reader, 0, sizeof(VRD_replay_reader));
+	free(reader);
+}
+
+int VRD_ReadBlock(VRD_replay_reader* reader, VRD_ReplayBlock* block)
+{
+	if (reader == 0 || block == 0) return -1;
+	while (true)
+	{
+		if (reader->batch.index < reader->batch.count)
+		{
+			VRD_Internal_NextBatchBlock(reader, block);
+			if (!VRD_Internal_ApplyBlock(reader, block)) return -1;
+			return 1;
+		}
+		if (reader->gap_frame_count > 0)
+		{
+			block->type = VRD_Block_StreamGap;
+			block->frame = reader->gap_first_frame;
+			block->entityId = 0;
+			block->gap.frameCount = reader->gap_frame_count;
+			reader->gap_frame_count = 0;
+			return 1;
+		}
+		if (reader->skip > 0)
+		{
+			size_t available = reader->end - reader->pos;
+			size_t n = reader->skip < available ? reader->skip : available;
+			reader->pos += n;
+			reader->skip -= n;
+			if (reader->skip > 0 && !VRD_Internal_Refill(reader, false)) return 0;
+			continue;
+		}
+		if (reader->pos == reader->end)
+		{
+			if (!VRD_Internal_Refill(reader, false)) return 0;
+			continue;
+		}
+
+		VRD_Cursor c = { reader->pos, reader->end, 0 };
+		int ret = VRD_Internal_ParseBlock(reader, &c, block);
+		if (ret < 0) return -1;
+		if (ret == 0)
+		{
+			if (!VRD_Internal_Refill(reader, true)) return 0; // Truncated last block
+			continue;
+		}
+		reader->pos = c.p;
+		if (!VRD_Internal_ApplyBlock(reader, block)) return -1;
+		if (block->type == VRD_Block_ReplayHeader) continue; // Framing only
+		if (VRD_Internal_BatchComponents(block->type) > 0) continue; // Expanded above
+		return 1;
+	}
+}
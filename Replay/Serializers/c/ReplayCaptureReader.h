@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+// Streaming reader of .vrd replays, for tools that run without the viewer.
+// Uncompressed replays (and uncompressed chunks) are memory mapped and decoded in place, without copies.
+// Compressed replays are decoded incrementally: define the same VRD_USE_ZLIB / VRD_USE_LZ4 / VRD_USE_ZSTD as the capture side to read them.
+// Live streams are read in follow mode, from the bytes fed as they arrive.
+
+#include "ReplayCapture.h"
+
+struct VRD_replay_reader;
+
+// Same values as the block types on the wire.
+enum VRD_ReplayBlockType
+{
+	VRD_Block_FrameStep = 1,
+	VRD_Block_EntityDef,
+	VRD_Block_EntityUndef,
+	VRD_Block_EntitySetPos,
+	VRD_Block_EntitySetTransform,
+	VRD_Block_EntityLog,
+	VRD_Block_EntityParameter,
+	VRD_Block_EntityValue,
+	VRD_Block_EntityLine,
+	VRD_Block_EntityCircle,
+	VRD_Block_EntitySphere,
+	VRD_Block_EntityCapsule,
+	VRD_Block_EntityMesh,
+	VRD_Block_EntityBox,
+	VRD_Block_EntityDefWithParent,
+	VRD_Block_ReplayFormat,
+	VRD_Block_StringDef,
+	VRD_Block_EntityTransformDelta,
+	VRD_Block_Keyframe,
+	VRD_Block_CaptureStats,
+	// Batches are expanded by VRD_ReadBlock to EntitySetPos, EntitySetTransform, EntityLine and EntitySphere blocks, they are never returned
+	VRD_Block_EntitySetPosBatch,
+	VRD_Block_EntitySetTransformBatch,
+	VRD_Block_EntityLineBatch,
+	VRD_Block_EntitySphereBatch,
+	VRD_Block_MeshDef,
+	VRD_Block_EntityMeshRef, // Cached mesh, in draw.verts, placed by draw.xform
+	VRD_Block_EntityLogFormat, // VRD_SetLogf, the message is formatted by VRD_FormatLog
+	VRD_Block_EntityValueSeries, // Buffered values of a key, decoded by VRD_ReadValueSeries. Their frames are up to the block frame, not after
+	VRD_Block_StreamGap = 0xFE, // Not on the wire: frames a live stream dropped. The next keyframe is returned whole, its entity defs replace the live entities
+	VRD_Block_ReplayHeader = 0xFF,
+};
+
+// Not null terminated. Points into the mapped file or the decode buffer, valid until the next VRD_ReadBlock.
+typedef struct VRD_StringView_s { const char* data; int length; } VRD_StringView;
+
+typedef struct VRD_ReplayBlock_s
+{
+	enum VRD_ReplayBlockType type;
+	int frame;    // Entity blocks, keyframes and capture stats, first frame dropped for stream gaps
+	int entityId; // Entity blocks
+	union
+	{
+		struct { int flags; float positionQuantum; } format;
+		struct { int id; VRD_StringView str; } stringDef;
+		struct { int id; const void* verts; int vertCount; } meshDef; // Packed VRD_Point, not aligned
+		struct { float totalTime; } frameStep;
+		struct { int frameCount; } gap;
+		struct { float totalTime; int length; } keyframe; // Entity blocks of the keyframe follow, they are skipped for all but the first keyframe read
+		struct
+		{
+			// Since the previous stats block, indexed by block type
+			long long calls[VRD_STATS_BLOCK_TYPE_COUNT];
+			long long rawBytes[VRD_STATS_BLOCK_TYPE_COUNT];
+			long long flushedBytes, storedBytes;
+			float compressSeconds, ioSeconds;
+		} stats;
+		struct
+		{
+			int count;
+			const unsigned char* ids;    // Zigzag deltas
+			const unsigned char* floats; // Packed per component
+			VRD_StringView category;
+			enum VRD_Color color;
+		} batch; // Internal
+		struct
+		{
+			int parentId; // -1 without parent
+			VRD_StringView name, path, typeName, categoryName;
+			VRD_Transform xform;
+			int staticParamCount;
+			const unsigned char* staticParams; // Read with VRD_ReadStaticParam
+			int creationFrame;
+		} def;
+		struct { VRD_Point pos; } setPos;
+		struct { VRD_Transform xform; int flags; } transform; // Transform deltas are decoded to the absolute transform, flags are 0 for EntitySetTransform
+		struct { VRD_StringView category, message; enum VRD_Color color; } log;
+		struct { VRD_StringView category, format; enum VRD_Color color; const unsigned char* args; int argsSize; } logFormat;
+		struct { VRD_StringView key, value; } parameter;
+		struct { VRD_StringView key; float value; } value;
+		struct { VRD_StringView key; int count; int firstFrame; const unsigned char* bits; int bitsSize; } valueSeries;
+		struct
+		{
+			VRD_StringView category;
+			VRD_Transform xform; // Box, mesh ref (identity when it has none)
+			VRD_Point p1, p2;    // Line and capsule ends, circle position and up, box dimensions, sphere center in p1
+			float radius;
+			const void* verts;   // Mesh and mesh ref, packed VRD_Point, not aligned
+			int vertCount;
+			enum VRD_Color color;
+		} draw;
+	};
+} VRD_ReplayBlock;
+
+// Summary footer of chunked replays captured with summaryFooter, read without decoding any chunk. Points into the mapped file, valid until the reader is closed.
+typedef struct VRD_ReplaySummary_s
+{
+	int recycledIds; // An entity def after an undef is a new entity, the same one otherwise
+	int frameCount;
+	const void* frameTimes;      // frameCount packed floats, the totalTime of each frame step
+	unsigned int logColors[8];   // VRD_Color bit sets
+	unsigned int drawColors[8];
+	int logCategoryCount;
+	const unsigned char* logCategories; // Read with VRD_ReadSummaryLabel, uncategorized blocks as an empty label
+	int drawCategoryCount;
+	const unsigned char* drawCategories;
+	int entityCount;
+	const unsigned char* entities; // Read with VRD_ReadSummaryEntity, in def order
+} VRD_ReplaySummary;
+
+typedef struct VRD_ReplaySummaryEntity_s
+{
+	int entityId;
+	int registered;  // 0 for entities that were logged to but never registered, without name, path, type and category
+	int defFrame;    // First log frame when not registered
+	int undefFrame;  // -1 when still registered at the end of the capture
+	VRD_StringView name, path, typeName, categoryName;
+	int logFrameCount;
+	const unsigned char* logFrames; // Read with VRD_ReadSummaryLogFrames
+} VRD_ReplaySummaryEntity;
+
+VRD_replay_reader* VRD_OpenReplay(const char* filename);
+void VRD_CloseReplay(VRD_replay_reader* reader);
+// Follow mode, for live streams: bytes are fed as they are received (from the socket, the stream callback or a growing file), and kept only until their chunk is read.
+VRD_replay_reader* VRD_FollowReplay(void);
+// Returns 0 when out of memory, or if the bytes fed so far do not start a live stream.
+int VRD_FeedReplay(VRD_replay_reader* reader, const void* data, int size);
+// Returns 1 with the next block, 0 at the end of the replay (a truncated last block ends it too), -1 on invalid data.
+// Follow mode: 0 once all complete chunks fed so far were read, call again after feeding more.
+int VRD_ReadBlock(VRD_replay_reader* reader, VRD_ReplayBlock* block);
+// Reads the static parameter of an entity def at p (staticParams for the first one), returns the next one.
+const unsigned char* VRD_ReadStaticParam(const unsigned char* p, VRD_StringView* key, VRD_StringView* value);
+// Formats the message of an EntityLogFormat block, like snprintf: returns the length of the whole message, text is null terminated when size > 0.
+int VRD_FormatLog(const VRD_ReplayBlock* block, char* text, int size);
+// Decodes the samples of an EntityValueSeries block, frames and values hold valueSeries.count items. Returns the count, -1 on invalid data.
+int VRD_ReadValueSeries(const VRD_ReplayBlock* block, int* frames, float* values);
+// Returns 1 with the summary footer (checked whole), 0 if the replay has none, -1 if it is invalid. Can be called before or between VRD_ReadBlock calls.
+int VRD_ReadSummary(VRD_replay_reader* reader, VRD_ReplaySummary* summary);
+// Read the label or entity at p (logCategories, drawCategories or entities for the first one), return the next one.
+const unsigned char* VRD_ReadSummaryLabel(const unsigned char* p, VRD_StringView* label);
+const unsigned char* VRD_ReadSummaryEntity(const unsigned char* p, VRD_ReplaySummaryEntity* entity);
+// Frames of the logs of an entity, ascending, frames holds logFrameCount items.
+void VRD_ReadSummaryLogFrames(const VRD_ReplaySummaryEntity* entity, int* frames);
@@ -0,0 +1,1080 @@
+// SPDX-License-Identifier: MIT
+// Capture overhead benchmark: synthetic workloads through the capture API, for every codec compiled in.
+// Reports ns per capture call, bytes per frame, compression ratio and peak heap, then reads every replay back to check it.
+// The *_cpp workloads make the same calls through the C++ frontend (ReplayCapture.hpp), to compare both.
+// The lookup_* workloads register a fixed number of entities, whatever --entities is, to show how entity lookups scale.
+//
+// Build (from Replay/Serializers/c), with the same defines as the game build, e.g. with the system zlib:
+//   c++ -O2 -std=c++17 -include stdint.h -Duint32=uint32_t -DVRD_USE_ZLIB -DVRD_ZLIB_HEADER='<zlib.h>' -I. bench/ReplayCaptureBench.c ReplayCapture.c ReplayCaptureReader.c -lz -lpthread -o vrd_bench
+// ReplayCapture.h expects the engine uint32 typedef, defined on the command line when building standalone (-Duint32=uint64_t for 64-bit keys).
+//
+// Usage: vrd_bench [--frames N] [--entities N] [--dir path] [--out results.json] [--baseline baseline.json] [--tolerance percent]
+// With a baseline, results more than tolerance percent slower or larger are reported, and the exit code is 1.
+// Baseline fields set to 0 are not compared, like the peak heap of the async workloads and the size of async_drop, which depend on the writer thread timing.
+
+#include "ReplayCapture.h"
+#include "ReplayCapture.hpp"
+#include "ReplayCaptureReader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#define VRD_BENCH_MAX_RESULTS 128
+#define VRD_BENCH_TILE_VERTS 384
+#define VRD_BENCH_LOOKUPS_PER_FRAME 1000
+#define VRD_BENCH_POSITION_QUANTUM (1.0f / 1024)
+#define VRD_BENCH_THREAD_LANES 4
+#define VRD_BENCH_FILTER_MAX_LINES 64
+#define VRD_BENCH_FILTER_BOX_SAMPLE 4
+
+struct VRD_BenchConfig
+{
+	int frames;
+	int entities;
+	const char* dir;
+	const char* out;
+	const char* baseline;
+	double tolerance;
+};
+
+// Counted per block type while capturing, checked against the replay read back.
+struct VRD_BenchCounts
+{
+	long long blocks[256];
+	long long calls;
+};
+
+struct VRD_BenchResult
+{
+	char name[64];
+	double ns_per_call;
+	double bytes_per_frame;
+	double compression_ratio;
+	long long peak_bytes;
+	long long file_bytes;
+	int roundtrip_ok;
+};
+
+// Inputs of the batch workloads, one item per entity. Only allocated for them, so that the heap of the other runs is laid out as before.
+struct VRD_BenchArrays
+{
+	entityKeyType* keys;
+	VRD_Point* points;
+	VRD_Point* points2;
+	VRD_Transform* xforms;
+	float* radii;
+	VRD_Point* tiles; // Navmesh tiles, VRD_BENCH_TILE_VERTS each
+};
+
+// Entity ids read back to workload entity indices, from the names of their defs. Open addressing, id 0 marks an empty slot.
+struct VRD_BenchIndexMap
+{
+	int* ids;
+	int* indices;
+	int capacity;
+	int count;
+};
+
+struct VRD_BenchLanes;
+
+struct VRD_BenchRun
+{
+	VRD_replay_context* ctx;
+	VRD::Capture* capture; // Same context, for the *_cpp workloads
+	const VRD_BenchConfig* config;
+	VRD_BenchCounts counts;
+	long long heap_base;
+	long long heap_peak;
+	VRD_BenchArrays* arrays;
+	bool mesh_cache;
+	VRD_BenchLanes* lanes;
+	VRD_BenchIndexMap index_map; // For the checks
+	int check_frame; // Last frame and value seen by the checks, for those of the block order
+	int check_value;
+	VRD_ContextOptions options;
+};
+
+static long long VRD_Bench_HeapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	return (long long)mallinfo2().uordblks;
+#else
+	return 0; // Peak memory is only reported with glibc
+#endif
+}
+
+static inline void VRD_Bench_Count(VRD_BenchRun* run, enum VRD_ReplayBlockType type)
+{
+	run->counts.blocks[type] += 1;
+	run->counts.calls += 1;
+}
+
+static inline entityKeyType VRD_Bench_Key(int i)
+{
+	return (entityKeyType)(0x9E3779B97F4A7C15ull * (unsigned long long)(i + 1)); // Spread over the key range, like pointers
+}
+
+static inline unsigned int VRD_Bench_IndexSlot(const VRD_BenchIndexMap* map, int entityId)
+{
+	unsigned int slot = ((unsigned int)entityId * 2654435761u) & (map->capacity - 1);
+	while (map->ids[slot] != 0 && map->ids[slot] != entityId) slot = (slot + 1) & (map->capacity - 1);
+	return slot;
+}
+
+// Maps the entity of a def read back to its index (recycled ids to the latest), returns -1 for entities without a def.
+static int VRD_Bench_EntityIndex(VRD_BenchRun* run, const VRD_ReplayBlock* block)
+{
+	VRD_BenchIndexMap* map = &run->index_map;
+	if ((map->count + 1) * 2 > map->capacity)
+	{
+		VRD_BenchIndexMap grown = { 0, 0, map->capacity > 0 ? map->capacity * 2 : 1024, map->count };
+		grown.ids = static_cast<int*>(calloc(grown.capacity, sizeof(int)));
+		grown.indices = static_cast<int*>(malloc(grown.capacity * sizeof(int)));
+		for (int i = 0; i < map->capacity; ++i)
+		{
+			if (map->ids[i] == 0) continue;
+			unsigned int slot = VRD_Bench_IndexSlot(&grown, map->ids[i]);
+			grown.ids[slot] = map->ids[i];
+			grown.indices[slot] = map->indices[i];
+		}
+		free(map->ids);
+		free(map->indices);
+		*map = grown;
+	}
+	unsigned int slot = VRD_Bench_IndexSlot(map, block->entityId);
+	if (block->type == VRD_Block_EntityDef)
+	{
+		char name[32];
+		int len = block->def.name.length < (int)sizeof(name) - 1 ? block->def.name.length : (int)sizeof(name) - 1;
+		memcpy(name, block->def.name.data, len);
+		name[len] = 0;
+		int index;
+		if (sscanf(name, "entity%d", &index) != 1) return -1;
+		if (map->ids[slot] == 0) map->count += 1;
+		map->ids[slot] = block->entityId;
+		map->indices[slot] = index;
+	}
+	return map->ids[slot] != 0 ? map->indices[slot] : -1;
+}
+
+static void VRD_Bench_Register(VRD_BenchRun* run, int i)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "entity%d", i);
+	VRD_Transform xform = { { (float)i, 0, 0 }, { 0, 0, 0, 1 } };
+	VRD_RegisterEntity(run->ctx, VRD_Bench_Key(i), name, "world.actors", "Actor", (i & 1) ? "npc" : "prop", &xform, 0, 0);
+	VRD_Bench_Count(run, VRD_Block_EntityDef);
+}
+
+///
+/// Workloads, one frame of capture calls each
+///
+
+static inline VRD_Transform VRD_Bench_TransformAt(int i, int frame)
+{
+	float a = frame * 0.02f + i;
+	VRD_Transform xform = { { (float)i + sinf(a), cosf(a) * 4, frame * 0.1f }, { 0, sinf(a * 0.5f), 0, cosf(a * 0.5f) } };
+	return xform;
+}
+
+static void VRD_Bench_Transforms(VRD_BenchRun* run, int frame)
+{
+	if (frame == 0) for (int i = 0; i < run->config->entities; ++i) VRD_Bench_Register(run, i);
+	for (int i = 0; i < run->config->entities; ++i)
+	{
+		VRD_Transform xform = VRD_Bench_TransformAt(i, frame);
+		VRD_SetTransform(run->ctx, VRD_Bench_Key(i), &xform);
+		VRD_Bench_Count(run, VRD_Block_EntitySetTransform);
+	}
+}
+
+static void VRD_Bench_Draws(VRD_BenchRun* run, int frame)
+{
+	static VRD_Point mesh[36];
+	int count = run->config->entities / 4 > 0 ? run->config->entities / 4 : 1;
+	if (frame == 0) for (int i = 0; i < count; ++i) VRD_Bench_Register(run, i);
+	for (int i = 0; i < count; ++i)
+	{
+		VRD_Point p1 = { (float)i, frame * 0.1f, 0 };
+		VRD_Point p2 = { (float)i, frame * 0.1f, 1 };
+		VRD_DrawLine(run->ctx, VRD_Bench_Key(i), "debug.lines", &p1, &p2, Red);
+		VRD_DrawLine(run->ctx, VRD_Bench_Key(i), "debug.lines", &p2, &p1, Blue);
+		VRD_DrawSphere(run->ctx, VRD_Bench_Key(i), "debug.spheres", &p1, 0.5f, Green);
+		VRD_Bench_Count(run, VRD_Block_EntityLine);
+		VRD_Bench_Count(run, VRD_Block_EntityLine);
+		VRD_Bench_Count(run, VRD_Block_EntitySphere);
+		if (i % 8 == 0)
+		{
+			for (int v = 0; v < 36; ++v) mesh[v] = { (float)(v % 3), (float)(v / 3 % 4), (float)i };
+			VRD_DrawMesh(run->ctx, VRD_Bench_Key(i), "debug.meshes", mesh, 36, Orange);
+			VRD_Bench_Count(run, VRD_Block_EntityMesh);
+			VRD_Transform box = { p1, { 0, 0, 0, 1 } };
+			VRD_Point dims = { 1, 1, 1 };
+			VRD_DrawBox(run->ctx, VRD_Bench_Key(i), "debug.boxes", &box, &dims, Yellow);
+			VRD_Bench_Count(run, VRD_Block_EntityBox);
+		}
+	}
+}
+
+// Draws under category filters: spheres disabled, lines capped per frame, boxes sampled. Only the calls the filters keep are counted.
+static void VRD_Bench_DrawsFiltered(VRD_BenchRun* run, int frame)
+{
+	int count = run->config->entities / 4 > 0 ? run->config->entities / 4 : 1;
+	int boxes = (count + 7) / 8;
+	if (frame == 0)
+	{
+		for (int i = 0; i < count; ++i) VRD_Bench_Register(run, i);
+		VRD_SetCategoryFilter(run->ctx, "debug.spheres", 0, 0, 0);
+		VRD_SetCategoryFilter(run->ctx, "debug.lines", 1, VRD_BENCH_FILTER_MAX_LINES, 0);
+		VRD_SetCategoryFilter(run->ctx, "debug.boxes", 1, 0, VRD_BENCH_FILTER_BOX_SAMPLE);
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		VRD_Point p1 = { (float)i, frame * 0.1f, 0 };
+		VRD_Point p2 = { (float)i, frame * 0.1f, 1 };
+		VRD_DrawLine(run->ctx, VRD_Bench_Key(i), "debug.lines", &p1, &p2, Red);
+		VRD_DrawSphere(run->ctx, VRD_Bench_Key(i), "debug.spheres", &p1, 0.5f, Green);
+		if (i < VRD_BENCH_FILTER_MAX_LINES) VRD_Bench_Count(run, VRD_Block_EntityLine);
+		if (i % 8 == 0)
+		{
+			VRD_Transform box = { p1, { 0, 0, 0, 1 } };
+			VRD_Point dims = { 1, 1, 1 };
+			VRD_DrawBox(run->ctx, VRD_Bench_Key(i), "debug.boxes", &box, &dims, Yellow);
+			if ((frame * boxes + i / 8) % VRD_BENCH_FILTER_BOX_SAMPLE == 0) VRD_Bench_Count(run, VRD_Block_EntityBox); // Sampled over all frames
+		}
+	}
+}
+
+// Formatted logs are either formatted here (snprintf then VRD_SetLog), or deferred to the reader (VRD_SetLogf).
+static void VRD_Bench_Logs(VRD_BenchRun* run, int frame, bool deferred)
+{
+	int count = run->config->entities / 4 > 0 ? run->config->entities / 4 : 1;
+	if (frame == 0) for (int i = 0; i < count; ++i) VRD_Bench_Register(run, i);
+	char msg[96];
+	for (int i = 0; i < count; ++i)
+	{
+		if (deferred)
+		{
+			VRD_SetLogf(run->ctx, VRD_Bench_Key(i), (i & 1) ? "ai" : "gameplay", Black, "frame %d: entity %d picked target %d", frame, i, (i * 31 + frame) % 97);
+		}
+		else
+		{
+			snprintf(msg, sizeof(msg), "frame %d: entity %d picked target %d", frame, i, (i * 31 + frame) % 97);
+			VRD_SetLog(run->ctx, VRD_Bench_Key(i), msg, (i & 1) ? "ai" : "gameplay", Black);
+		}
+		VRD_SetDynamicParamFloat(run->ctx, VRD_Bench_Key(i), "health", 100.0f - (frame % 100));
+		VRD_SetDynamicParamFloat(run->ctx, VRD_Bench_Key(i), "speed", sinf(frame * 0.1f + i));
+		VRD_SetDynamicParamString(run->ctx, VRD_Bench_Key(i), "state", (frame / 30 + i) % 3 == 0 ? "idle" : "moving");
+		VRD_Bench_Count(run, deferred ? VRD_Block_EntityLogFormat : VRD_Block_EntityLog);
+		VRD_Bench_Count(run, VRD_Block_EntityValue);
+		VRD_Bench_Count(run, VRD_Block_EntityValue);
+		VRD_Bench_Count(run, VRD_Block_EntityParameter);
+	}
+}
+
+// %.*s over a tag that is not null terminated: only the precision bounds the copy.
+static char VRD_BenchTags[8] = { 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h' };
+
+static void VRD_Bench_LogsPrecision(VRD_BenchRun* run, int frame)
+{
+	int count = run->config->entities / 4 > 0 ? run->config->entities / 4 : 1;
+	if (frame == 0) for (int i = 0; i < count; ++i) VRD_Bench_Register(run, i);
+	for (int i = 0; i < count; ++i)
+	{
+		VRD_SetLogf(run->ctx, VRD_Bench_Key(i), "gameplay", Black, "frame %d: tag %.*s", frame, frame % 8 + 1, VRD_BenchTags);
+		VRD_Bench_Count(run, VRD_Block_EntityLogFormat);
+	}
+}
+
+static bool VRD_Bench_CheckLogsPrecision(VRD_BenchRun* run, const VRD_ReplayBlock* block)
+{
+	(void)run;
+	if (block->type != VRD_Block_EntityLogFormat) return true;
+	char text[64], expected[64];
+	VRD_FormatLog(block, text, sizeof(text));
+	snprintf(expected, sizeof(expected), "frame %d: tag %.*s", block->frame, block->frame % 8 + 1, VRD_BenchTags);
+	return strcmp(text, expected) == 0;
+}
+
+static void VRD_Bench_LogsAndParams(VRD_BenchRun* run, int frame)
+{
+	VRD_Bench_Logs(run, frame, false);
+}
+
+static void VRD_Bench_LogsDeferred(VRD_BenchRun* run, int frame)
+{
+	VRD_Bench_Logs(run, frame, true);
+}
+
+// Delta encoded transforms decode within the position quantum, and rotations within their smallest three step.
+static void VRD_Bench_DeltaTransformsOptions(VRD_ContextOptions* options)
+{
+	options->deltaTransforms = 1;
+	options->positionQuantum = VRD_BENCH_POSITION_QUANTUM;
+}
+
+static bool VRD_Bench_CheckTransforms(VRD_BenchRun* run, const VRD_ReplayBlock* block)
+{
+	int i = VRD_Bench_EntityIndex(run, block);
+	if (block->type != VRD_Block_EntitySetTransform && block->type != VRD_Block_EntityTransformDelta) return true;
+	if (i < 0) return false;
+	VRD_Transform expected = VRD_Bench_TransformAt(i, block->frame);
+	const VRD_Transform* xform = &block->transform.xform;
+	const float* p = &xform->translation.x;
+	const float* e = &expected.translation.x;
+	for (int c = 0; c < 3; ++c) if (fabsf(p[c] - e[c]) > VRD_BENCH_POSITION_QUANTUM) return false;
+	const float* q = &xform->rotation.x;
+	const float* r = &expected.rotation.x;
+	float sign = (q[0] * r[0] + q[1] * r[1] + q[2] * r[2] + q[3] * r[3]) < 0 ? -1.0f : 1.0f; // q and -q are the same rotation
+	for (int c = 0; c < 4; ++c) if (fabsf(q[c] * sign - r[c]) > 1.0f / 1024) return false;
+	return true;
+}
+
+// Worker threads that live for the whole run, as lanes are kept per thread.
+struct VRD_BenchLanes
+{
+	std::thread workers[VRD_BENCH_THREAD_LANES];
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	int frame = -1; // Frame to capture, -1 to stop
+	int generation = 0;
+	int pending = 0;
+};
+
+static void VRD_Bench_LaneWorker(VRD_BenchRun* run, int lane)
+{
+	VRD_BenchLanes* lanes = run->lanes;
+	VRD_SetThreadLane(run->ctx, lane);
+	int count = run->config->entities;
+	for (int generation = 1; ; ++generation)
+	{
+		int frame;
+		{
+			std::unique_lock<std::mutex> lock(lanes->mutex);
+			lanes->wake.wait(lock, [&] { return lanes->generation >= generation; });
+			frame = lanes->frame;
+		}
+		if (frame < 0) return;
+		for (int i = lane * count / VRD_BENCH_THREAD_LANES; i < (lane + 1) * count / VRD_BENCH_THREAD_LANES; ++i)
+		{
+			VRD_Transform xform = VRD_Bench_TransformAt(i, frame);
+			VRD_SetTransform(run->ctx, VRD_Bench_Key(i), &xform);
+		}
+		std::lock_guard<std::mutex> lock(lanes->mutex);
+		if (--lanes->pending == 0) lanes->done.notify_one();
+	}
+}
+
+static void VRD_Bench_RunLanes(VRD_BenchLanes* lanes, int frame)
+{
+	std::unique_lock<std::mutex> lock(lanes->mutex);
+	lanes->frame = frame;
+	lanes->generation += 1;
+	lanes->pending = VRD_BENCH_THREAD_LANES;
+	lanes->wake.notify_all();
+	if (frame >= 0) lanes->done.wait(lock, [&] { return lanes->pending == 0; });
+}
+
+// Transforms set from worker threads, each with its lane and a contiguous range of entities.
+static void VRD_Bench_TransformsLanes(VRD_BenchRun* run, int frame)
+{
+	int count = run->config->entities;
+	if (frame == 0)
+	{
+		for (int i = 0; i < count; ++i) VRD_Bench_Register(run, i);
+		run->lanes = new VRD_BenchLanes();
+		for (int lane = 0; lane < VRD_BENCH_THREAD_LANES; ++lane) run->lanes->workers[lane] = std::thread(VRD_Bench_LaneWorker, run, lane);
+	}
+	VRD_Bench_RunLanes(run->lanes, frame);
+	for (int i = 0; i < count; ++i) VRD_Bench_Count(run, VRD_Block_EntitySetTransform);
+	if (frame + 1 == run->config->frames)
+	{
+		VRD_Bench_RunLanes(run->lanes, -1);
+		for (std::thread& worker : run->lanes->workers) worker.join();
+		delete run->lanes;
+		run->lanes = 0;
+	}
+}
+
+static void VRD_Bench_LanesOptions(VRD_ContextOptions* options)
+{
+	options->multithreaded = 1;
+}
+
+// Lanes are spliced in ascending order, so the entities of each frame read back in order, with the transforms captured.
+static bool VRD_Bench_CheckLanes(VRD_BenchRun* run, const VRD_ReplayBlock* block)
+{
+	int i = VRD_Bench_EntityIndex(run, block);
+	if (block->type != VRD_Block_EntitySetTransform) return true;
+	if (block->frame != run->check_frame) run->check_value = -1;
+	bool ordered = i > run->check_value;
+	run->check_frame = block->frame;
+	run->check_value = i;
+	VRD_Transform expected = VRD_Bench_TransformAt(i, block->frame);
+	return i >= 0 && ordered && memcmp(&block->transform.xform, &expected, sizeof(VRD_Transform)) == 0;
+}
+
+static void VRD_Bench_ChunksOptions(VRD_ContextOptions* options)
+{
+	options->chunkFrames = 60;
+}
+
+// Short chunks, so the workers have several in flight and any written out of order shows in the keyframes.
+static void VRD_Bench_PoolOptions(VRD_ContextOptions* options)
+{
+	options->chunkFrames = 30;
+	options->compressionThreads = 4;
+}
+
+// Each chunk starts with a keyframe, chunks are in order and hold the transforms captured.
+static bool VRD_Bench_CheckChunks(VRD_BenchRun* run, const VRD_ReplayBlock* block)
+{
+	int i = VRD_Bench_EntityIndex(run, block);
+	if (block->type == VRD_Block_Keyframe)
+	{
+		bool ok = block->frame == run->check_value;
+		run->check_value += run->options.chunkFrames;
+		return ok;
+	}
+	if (block->type != VRD_Block_EntitySetTransform) return true;
+	VRD_Transform expected = VRD_Bench_TransformAt(i, block->frame);
+	return i >= 0 && memcmp(&block->transform.xform, &expected, sizeof(VRD_Transform)) == 0;
+}
+
+static void VRD_Bench_StatsOptions(VRD_ContextOptions* options)
+{
+	options->statsFrameInterval = 30;
+}
+
+// Stats blocks come at the last frame of every interval, without gaps, and count the defs and transforms of that interval.
+static bool VRD_Bench_CheckStats(VRD_BenchRun* run, const VRD_ReplayBlock* block)
+{
+	if (block->type != VRD_Block_CaptureStats) return true;
+	int interval = run->options.statsFrameInterval;
+	bool ok = block->frame == run->check_frame + interval;
+	run->check_frame = block->frame;
+	int defs = block->frame < interval ? run->config->entities : 0;
+	return ok && block->stats.calls[VRD_Block_EntityDef] == defs && block->stats.calls[VRD_Block_EntitySetTransform] == run->config->entities * interval;
+}
+
+// No disabled category, and no more lines per frame than the filter keeps.
+static bool VRD_Bench_CheckFilters(VRD_BenchRun* run, const VRD_ReplayBlock* block)
+{
+	if (block->type == VRD_Block_EntitySphere) return false;
+	if (block->type != VRD_Block_EntityLine) return true;
+	if (block->frame != run->check_frame) run->check_value = 0;
+	run->check_frame = block->frame;
+	return ++run->check_value <= VRD_BENCH_FILTER_MAX_LINES;
+}
+
+// Mesh refs resolve to the verts of their tile, with the transform of their frame.
+static bool VRD_Bench_CheckMeshInstances(VRD_BenchRun* run, const VRD_ReplayBlock* block)
+{
+	int i = VRD_Bench_EntityIndex(run, block);
+	if (block->type != VRD_Block_EntityMeshRef) return true;
+	if (i < 0 || block->draw.vertCount != VRD_BENCH_TILE_VERTS) return false;
+	VRD_Transform expected = VRD_Bench_TransformAt(i, block->frame);
+	return memcmp(block->draw.verts, &run->arrays->tiles[i * VRD_BENCH_TILE_VERTS], VRD_BENCH_TILE_VERTS * sizeof(VRD_Point)) == 0 && memcmp(&block->draw.xform, &expected, sizeof(VRD_Transform)) == 0;
+}
+
+// Same calls as VRD_Bench_Transforms, VRD_Bench_Draws and VRD_Bench_Logs through the C++ frontend.
+static void VRD_Bench_TransformsCpp(VRD_BenchRun* run, int frame)
+{
+	if (frame == 0) for (int i = 0; i < run->config->entities; ++i) VRD_Bench_Register(run, i);
+	for (int i = 0; i < run->config->entities; ++i)
+	{
+		float a = frame * 0.02f + i;
+		run->capture->SetTransform(VRD_Bench_Key(i), { { (float)i + sinf(a), cosf(a) * 4, frame * 0.1f }, { 0, sinf(a * 0.5f), 0, cosf(a * 0.5f) } });
+		VRD_Bench_Count(run, VRD_Block_EntitySetTransform);
+	}
+}
+
+static void VRD_Bench_DrawsCpp(VRD_BenchRun* run, int frame)
+{
+	static VRD_Point mesh[36];
+	int count = run->config->entities / 4 > 0 ? run->config->entities / 4 : 1;
+	if (frame == 0) for (int i = 0; i < count; ++i) VRD_Bench_Register(run, i);
+	for (int i = 0; i < count; ++i)
+	{
+		VRD_Point p1 = { (float)i, frame * 0.1f, 0 };
+		VRD_Point p2 = { (float)i, frame * 0.1f, 1 };
+		run->capture->DrawLine(VRD_Bench_Key(i), "debug.lines", p1, p2, Red);
+		run->capture->DrawLine(VRD_Bench_Key(i), "debug.lines", p2, p1, Blue);
+		run->capture->DrawSphere(VRD_Bench_Key(i), "debug.spheres", p1, 0.5f, Green);
+		VRD_Bench_Count(run, VRD_Block_EntityLine);
+		VRD_Bench_Count(run, VRD_Block_EntityLine);
+		VRD_Bench_Count(run, VRD_Block_EntitySphere);
+		if (i % 8 == 0)
+		{
+			for (int v = 0; v < 36; ++v) mesh[v] = { (float)(v % 3), (float)(v / 3 % 4), (float)i };
+			run->capture->DrawMesh(VRD_Bench_Key(i), "debug.meshes", mesh, Orange);
+			VRD_Bench_Count(run, VRD_Block_EntityMesh);
+			run->capture->DrawBox(VRD_Bench_Key(i), "debug.boxes", { p1, { 0, 0, 0, 1 } }, { 1, 1, 1 }, Yellow);
+			VRD_Bench_Count(run, VRD_Block_EntityBox);
+		}
+	}
+}
+
+// The message length comes from snprintf, not strlen
+static void VRD_Bench_LogsCpp(VRD_BenchRun* run, int frame)
+{
+	int count = run->config->entities / 4 > 0 ? run->config->entities / 4 : 1;
+	if (frame == 0) for (int i = 0; i < count; ++i) VRD_Bench_Register(run, i);
+	char msg[96];
+	for (int i = 0; i < count; ++i)
+	{
+		int len = snprintf(msg, sizeof(msg), "frame %d: entity %d picked target %d", frame, i, (i * 31 + frame) % 97);
+		run->capture->SetLog(VRD_Bench_Key(i), VRD::StringRef(msg, len < (int)sizeof(msg) ? len : (int)sizeof(msg) - 1), (i & 1) ? "ai" : "gameplay", Black);
+		run->capture->SetDynamicParam(VRD_Bench_Key(i), "health", 100.0f - (frame % 100));
+		run->capture->SetDynamicParam(VRD_Bench_Key(i), "speed", sinf(frame * 0.1f + i));
+		run->capture->SetDynamicParam(VRD_Bench_Key(i), "state", (frame / 30 + i) % 3 == 0 ? "idle" : "moving");
+		VRD_Bench_Count(run, VRD_Block_EntityLog);
+		VRD_Bench_Count(run, VRD_Block_EntityValue);
+		VRD_Bench_Count(run, VRD_Block_EntityValue);
+		VRD_Bench_Count(run, VRD_Block_EntityParameter);
+	}
+}
+
+// Gameplay telemetry: a few float params per entity every frame, written as they are set or as value series.
+static void VRD_Bench_Telemetry(VRD_BenchRun* run, int frame)
+{
+	static const char* keys[] = { "health", "stamina", "speed", "heading", "altitude", "threat", "ammo", "score" };
+	int count = run->config->entities / 4 > 0 ? run->config->entities / 4 : 1;
+	if (frame == 0) for (int i = 0; i < count; ++i) VRD_Bench_Register(run, i);
+	for (int i = 0; i < count; ++i)
+	{
+		entityKeyType key = VRD_Bench_Key(i);
+		VRD_SetDynamicParamFloat(run->ctx, key, keys[0], 100.0f - (float)((frame + i) / 30 % 100));
+		VRD_SetDynamicParamFloat(run->ctx, key, keys[1], 50.0f + 50.0f * sinf(frame * 0.01f + i));
+		VRD_SetDynamicParamFloat(run->ctx, key, keys[2], 4.0f + sinf(frame * 0.1f + i));
+		VRD_SetDynamicParamFloat(run->ctx, key, keys[3], fmodf(frame * 0.5f + i * 10.0f, 360.0f));
+		VRD_SetDynamicParamFloat(run->ctx, key, keys[4], 0.0f);
+		VRD_SetDynamicParamFloat(run->ctx, key, keys[5], (float)((frame / 60 + i) % 3));
+		VRD_SetDynamicParamFloat(run->ctx, key, keys[6], (float)(30 - (frame + i) / 10 % 31));
+		VRD_SetDynamicParamFloat(run->ctx, key, keys[7], (float)(frame * (i % 5)));
+		for (int k = 0; k < 8; ++k) VRD_Bench_Count(run, VRD_Block_EntityValue);
+	}
+}
+
+// Entities live for 16 frames, so keys are registered and unregistered every frame and ids are recycled (64-bit keys).
+static void VRD_Bench_Churn(VRD_BenchRun* run, int frame, int firstKey)
+{
+	int count = run->config->entities / 16 > 0 ? run->config->entities / 16 : 1;
+	for (int i = 0; i < count; ++i)
+	{
+		int key = firstKey + frame * count + i;
+		VRD_Bench_Register(run, key);
+		VRD_Point pos = { (float)i, 0, (float)frame };
+		VRD_SetPosition(run->ctx, VRD_Bench_Key(key), &pos);
+		VRD_Bench_Count(run, VRD_Block_EntitySetPos);
+		if (frame >= 16)
+		{
+			VRD_UnRegisterEntity(run->ctx, VRD_Bench_Key(key - 16 * count));
+			VRD_Bench_Count(run, VRD_Block_EntityUndef);
+		}
+	}
+}
+
+static void VRD_Bench_KeyChurn(VRD_BenchRun* run, int frame)
+{
+	VRD_Bench_Churn(run, frame, 0);
+}
+
+// Async writer under load: transforms and key churn, with a short queue so the backpressure policy applies.
+static void VRD_Bench_AsyncLoad(VRD_BenchRun* run, int frame)
+{
+	VRD_Bench_Transforms(run, frame);
+	VRD_Bench_Churn(run, frame, run->config->entities);
+}
+
+static void VRD_Bench_AsyncDropOptions(VRD_ContextOptions* options)
+{
+	options->async = 1;
+	options->asyncQueueLength = 2;
+	options->backpressure = VRD_Backpressure_DropFrame;
+}
+
+static void VRD_Bench_AsyncGrowOptions(VRD_ContextOptions* options)
+{
+	options->async = 1;
+	options->asyncQueueLength = 2;
+	options->backpressure = VRD_Backpressure_Grow;
+}
+
+// Every entity block read back is of an entity defined before it, and transforms and positions are the ones captured.
+static bool VRD_Bench_CheckAsyncLoad(VRD_BenchRun* run, const VRD_ReplayBlock* block)
+{
+	if (block->type < VRD_Block_EntityDef || block->type > VRD_Block_EntityDefWithParent) return true;
+	int i = VRD_Bench_EntityIndex(run, block);
+	if (i < 0) return false;
+	if (block->type == VRD_Block_EntitySetTransform)
+	{
+		VRD_Transform expected = VRD_Bench_TransformAt(i, block->frame);
+		return i < run->config->entities && memcmp(&block->transform.xform, &expected, sizeof(VRD_Transform)) == 0;
+	}
+	if (block->type == VRD_Block_EntitySetPos) return i >= run->config->entities && block->setPos.pos.z == (float)block->frame;
+	return true;
+}
+
+// Entity lookup cost against the number of registered entities: the same calls every frame, on entities picked all over the key range.
+static void VRD_Bench_Lookup(VRD_BenchRun* run, int frame)
+{
+	int count = run->config->entities;
+	if (frame == 0) for (int i = 0; i < count; ++i) VRD_Bench_Register(run, i);
+	unsigned int pick = (unsigned int)frame * 2654435761u;
+	for (int i = 0; i < VRD_BENCH_LOOKUPS_PER_FRAME; ++i)
+	{
+		pick = pick * 1664525u + 1013904223u;
+		int entity = (int)((pick >> 8) % (unsigned int)count);
+		VRD_Point pos = { (float)entity, 0, (float)frame };
+		VRD_SetPosition(run->ctx, VRD_Bench_Key(entity), &pos);
+		VRD_Bench_Count(run, VRD_Block_EntitySetPos);
+	}
+}
+
+// Same as transforms, through VRD_SetTransforms.
+static void VRD_Bench_TransformsBatch(VRD_BenchRun* run, int frame)
+{
+	VRD_BenchArrays* arrays = run->arrays;
+	int count = run->config->entities;
+	if (frame == 0) for (int i = 0; i < count; ++i) VRD_Bench_Register(run, i);
+	for (int i = 0; i < count; ++i)
+	{
+		float a = frame * 0.02f + i;
+		arrays->keys[i] = VRD_Bench_Key(i);
+		arrays->xforms[i] = { { (float)i + sinf(a), cosf(a) * 4, frame * 0.1f }, { 0, sinf(a * 0.5f), 0, cosf(a * 0.5f) } };
+		VRD_Bench_Count(run, VRD_Block_EntitySetTransform);
+	}
+	VRD_SetTransforms(run->ctx, arrays->keys, arrays->xforms, count);
+}
+
+// Same as draws, lines and spheres through VRD_DrawLines and VRD_DrawSpheres.
+static void VRD_Bench_DrawsBatch(VRD_BenchRun* run, int frame)
+{
+	static VRD_Point mesh[36];
+	VRD_BenchArrays* arrays = run->arrays;
+	int count = run->config->entities / 4 > 0 ? run->config->entities / 4 : 1;
+	if (frame == 0) for (int i = 0; i < count; ++i) VRD_Bench_Register(run, i);
+	for (int i = 0; i < count; ++i)
+	{
+		arrays->keys[i] = VRD_Bench_Key(i);
+		arrays->points[i] = { (float)i, frame * 0.1f, 0 };
+		arrays->points2[i] = { (float)i, frame * 0.1f, 1 };
+		arrays->radii[i] = 0.5f;
+		VRD_Bench_Count(run, VRD_Block_EntityLine);
+		VRD_Bench_Count(run, VRD_Block_EntityLine);
+		VRD_Bench_Count(run, VRD_Block_EntitySphere);
+	}
+	VRD_DrawLines(run->ctx, arrays->keys, "debug.lines", arrays->points, arrays->points2, count, Red);
+	VRD_DrawLines(run->ctx, arrays->keys, "debug.lines", arrays->points2, arrays->points, count, Blue);
+	VRD_DrawSpheres(run->ctx, arrays->keys, "debug.spheres", arrays->points, arrays->radii, count, Green);
+	for (int i = 0; i < count; i += 8)
+	{
+		for (int v = 0; v < 36; ++v) mesh[v] = { (float)(v % 3), (float)(v / 3 % 4), (float)i };
+		VRD_DrawMesh(run->ctx, VRD_Bench_Key(i), "debug.meshes", mesh, 36, Orange);
+		VRD_Bench_Count(run, VRD_Block_EntityMesh);
+		VRD_Transform box = { arrays->points[i], { 0, 0, 0, 1 } };
+		VRD_Point dims = { 1, 1, 1 };
+		VRD_DrawBox(run->ctx, VRD_Bench_Key(i), "debug.boxes", &box, &dims, Yellow);
+		VRD_Bench_Count(run, VRD_Block_EntityBox);
+	}
+}
+
+// The same navmesh tiles every frame, written whole or referenced with the mesh cache.
+static void VRD_Bench_Navmesh(VRD_BenchRun* run, int frame)
+{
+	VRD_BenchArrays* arrays = run->arrays;
+	int count = run->config->entities / 16 > 0 ? run->config->entities / 16 : 1;
+	if (frame == 0)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			VRD_Bench_Register(run, i);
+			for (int v = 0; v < VRD_BENCH_TILE_VERTS; ++v) arrays->tiles[i * VRD_BENCH_TILE_VERTS + v] = { (float)(i * 8 + v % 3), (float)(v / 3 % 8), sinf(v * 0.1f + i) };
+		}
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		VRD_DrawMesh(run->ctx, VRD_Bench_Key(i), "navmesh", &arrays->tiles[i * VRD_BENCH_TILE_VERTS], VRD_BENCH_TILE_VERTS, Green);
+		VRD_Bench_Count(run, run->mesh_cache ? VRD_Block_EntityMeshRef : VRD_Block_EntityMesh);
+	}
+}
+
+// Navmesh tiles in tile space, placed by a transform that moves every frame. The cache is smaller than the tiles, so they are evicted and defined again.
+static void VRD_Bench_NavmeshInstanced(VRD_BenchRun* run, int frame)
+{
+	VRD_BenchArrays* arrays = run->arrays;
+	int count = run->config->entities / 16 > 0 ? run->config->entities / 16 : 1;
+	if (frame == 0)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			VRD_Bench_Register(run, i);
+			for (int v = 0; v < VRD_BENCH_TILE_VERTS; ++v) arrays->tiles[i * VRD_BENCH_TILE_VERTS + v] = { (float)(v % 3), (float)(v / 3 % 8), sinf(v * 0.1f + i) };
+		}
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		VRD_Transform xform = VRD_Bench_TransformAt(i, frame);
+		VRD_DrawMeshInstance(run->ctx, VRD_Bench_Key(i), "navmesh", (unsigned long long)i + 1, &arrays->tiles[i * VRD_BENCH_TILE_VERTS], VRD_BENCH_TILE_VERTS, &xform, Green);
+		VRD_Bench_Count(run, VRD_Block_EntityMeshRef);
+	}
+}
+
+struct VRD_BenchWorkload
+{
+	const char* name;
+	void (*frame)(VRD_BenchRun* run, int frame);
+	bool arrays;
+	int mesh_cache_bytes;
+	int value_series_frames;
+	bool summary_footer;
+	int entities; // Instead of --entities, 0 for that
+	void (*options)(VRD_ContextOptions* options); // Options of the capture mode measured, 0 for the defaults
+	bool (*check)(VRD_BenchRun* run, const VRD_ReplayBlock* block); // Checks the blocks read back, besides their numbers, 0 for none
+};
+
+static const VRD_BenchWorkload VRD_BenchWorkloads[] =
+{
+	{ "transforms", VRD_Bench_Transforms, false, 0, 0, false, 0, 0, 0 },
+	{ "transforms_lanes", VRD_Bench_TransformsLanes, false, 0, 0, false, 0, VRD_Bench_LanesOptions, VRD_Bench_CheckLanes },
+	{ "transforms_chunks", VRD_Bench_Transforms, false, 0, 0, false, 0, VRD_Bench_ChunksOptions, VRD_Bench_CheckChunks },
+	{ "transforms_pool", VRD_Bench_Transforms, false, 0, 0, false, 0, VRD_Bench_PoolOptions, VRD_Bench_CheckChunks },
+	{ "transforms_stats", VRD_Bench_Transforms, false, 0, 0, false, 0, VRD_Bench_StatsOptions, VRD_Bench_CheckStats },
+	{ "transforms_delta", VRD_Bench_Transforms, false, 0, 0, false, 0, VRD_Bench_DeltaTransformsOptions, VRD_Bench_CheckTransforms },
+	{ "draws", VRD_Bench_Draws, false, 0, 0, false, 0, 0, 0 },
+	{ "draws_filtered", VRD_Bench_DrawsFiltered, false, 0, 0, false, 0, 0, VRD_Bench_CheckFilters },
+	{ "logs_params", VRD_Bench_LogsAndParams, false, 0, 0, false, 0, 0, 0 },
+	{ "logs_params_deferred", VRD_Bench_LogsDeferred, false, 0, 0, false, 0, 0, 0 },
+	{ "logs_precision", VRD_Bench_LogsPrecision, false, 0, 0, false, 0, 0, VRD_Bench_CheckLogsPrecision },
+	{ "key_churn", VRD_Bench_KeyChurn, false, 0, 0, false, 0, 0, 0 },
+	{ "async_drop", VRD_Bench_AsyncLoad, false, 0, 0, false, 0, VRD_Bench_AsyncDropOptions, VRD_Bench_CheckAsyncLoad },
+	{ "async_grow", VRD_Bench_AsyncLoad, false, 0, 0, false, 0, VRD_Bench_AsyncGrowOptions, VRD_Bench_CheckAsyncLoad },
+	{ "transforms_batch", VRD_Bench_TransformsBatch, true, 0, 0, false, 0, 0, 0 },
+	{ "draws_batch", VRD_Bench_DrawsBatch, true, 0, 0, false, 0, 0, 0 },
+	{ "navmesh", VRD_Bench_Navmesh, true, 0, 0, false, 0, 0, 0 },
+	{ "navmesh_cached", VRD_Bench_Navmesh, true, 4 << 20, 0, false, 0, 0, 0 },
+	{ "navmesh_instanced", VRD_Bench_NavmeshInstanced, true, 128 << 10, 0, false, 0, 0, VRD_Bench_CheckMeshInstances },
+	{ "telemetry", VRD_Bench_Telemetry, false, 0, 0, false, 0, 0, 0 },
+	{ "telemetry_series", VRD_Bench_Telemetry, false, 0, 60, false, 0, 0, 0 },
+	{ "logs_params_summary", VRD_Bench_LogsAndParams, false, 0, 0, true, 0, 0, 0 },
+	{ "transforms_cpp", VRD_Bench_TransformsCpp, false, 0, 0, false, 0, 0, 0 },
+	{ "draws_cpp", VRD_Bench_DrawsCpp, false, 0, 0, false, 0, 0, 0 },
+	{ "logs_params_cpp", VRD_Bench_LogsCpp, false, 0, 0, false, 0, 0, 0 },
+	{ "lookup_1k", VRD_Bench_Lookup, false, 0, 0, false, 1000, 0, 0 },
+	{ "lookup_10k", VRD_Bench_Lookup, false, 0, 0, false, 10000, 0, 0 },
+	{ "lookup_100k", VRD_Bench_Lookup, false, 0, 0, false, 100000, 0, 0 },
+};
+
+struct VRD_BenchCodec
+{
+	const char* name;
+	enum VRD_Codec codec;
+};
+
+static const VRD_BenchCodec VRD_BenchCodecs[] =
+{
+	{ "none", VRD_Codec_None },
+#ifdef VRD_USE_ZLIB
+	{ "deflate", VRD_Codec_Deflate },
+#endif
+#ifdef VRD_USE_LZ4
+	{ "lz4", VRD_Codec_LZ4 },
+#endif
+#ifdef VRD_USE_ZSTD
+	{ "zstd", VRD_Codec_Zstd },
+#endif
+};
+
+static long long VRD_Bench_FileSize(const char* path)
+{
+	FILE* fp = fopen(path, "rb");
+	if (fp == 0) return 0;
+	fseek(fp, 0, SEEK_END);
+	long long size = ftell(fp);
+	fclose(fp);
+	return size;
+}
+
+// Reads the replay back: every block captured must be there, in the same numbers, and frame steps must be consecutive.
+// The summary footer, if any, must have every frame and entity def.
+static bool VRD_Bench_RoundTrip(const char* path, VRD_BenchRun* run, const VRD_BenchWorkload* workload)
+{
+	const VRD_BenchCounts* expected = &run->counts;
+	int frames = run->config->frames;
+	bool summaryFooter = workload->summary_footer;
+	VRD_replay_reader* reader = VRD_OpenReplay(path);
+	if (reader == 0) return false;
+	VRD_ReplaySummary summary;
+	bool summaryOk = VRD_ReadSummary(reader, &summary) == (summaryFooter ? 1 : 0);
+	if (summaryFooter && summaryOk)
+	{
+		long long defs = 0;
+		const unsigned char* p = summary.entities;
+		for (int i = 0; i < summary.entityCount; ++i)
+		{
+			VRD_ReplaySummaryEntity entity;
+			p = VRD_ReadSummaryEntity(p, &entity);
+			defs += entity.registered;
+		}
+		summaryOk = summary.frameCount == frames && defs == expected->blocks[VRD_Block_EntityDef];
+	}
+	if (!summaryOk) fprintf(stderr, "  %s: summary footer does not match\n", path);
+	long long counts[256] = {};
+	int frameSteps = 0;
+	int lastFrame = 0;
+	bool ordered = true;
+	bool checked = true;
+	VRD_ReplayBlock block;
+	int ret;
+	while ((ret = VRD_ReadBlock(reader, &block)) > 0)
+	{
+		if (workload->check && !workload->check(run, &block))
+		{
+			if (checked) fprintf(stderr, "  %s: block type %d of frame %d does not match the capture\n", path, block.type, block.frame);
+			checked = false;
+		}
+		if (block.type == VRD_Block_EntityValueSeries) counts[VRD_Block_EntityValue] += block.valueSeries.count; // Each sample was a value
+		else if (block.type == VRD_Block_EntityTransformDelta) counts[VRD_Block_EntitySetTransform] += 1;
+		else counts[block.type & 0xff] += 1;
+		if (block.type == VRD_Block_FrameStep) ++frameSteps;
+		else if (block.type != VRD_Block_ReplayFormat && block.type != VRD_Block_StringDef && block.type != VRD_Block_MeshDef && block.type != VRD_Block_Keyframe)
+		{
+			ordered &= block.frame == frameSteps && block.frame >= lastFrame;
+			lastFrame = block.frame;
+		}
+	}
+	VRD_CloseReplay(reader);
+
+	bool ok = ret == 0 && ordered && frameSteps == frames && summaryOk && checked;
+	bool dropping = run->options.async && run->options.backpressure == VRD_Backpressure_DropFrame; // Dropped frames only keep their defs and undefs
+	for (int type = VRD_Block_EntityDef; type <= VRD_Block_EntityValueSeries; ++type)
+	{
+		bool entityBlock = type <= VRD_Block_EntityDefWithParent || type >= VRD_Block_EntityMeshRef; // Batches read back as entity blocks
+		bool kept = !dropping || type == VRD_Block_EntityDef || type == VRD_Block_EntityUndef;
+		if (entityBlock && (kept ? counts[type] != expected->blocks[type] : counts[type] > expected->blocks[type]))
+		{
+			fprintf(stderr, "  %s: block type %d, %lld read, %lld captured\n", path, type, counts[type], expected->blocks[type]);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+static void VRD_Bench_FreeArrays(VRD_BenchArrays* arrays)
+{
+	free(arrays->keys);
+	free(arrays->points);
+	free(arrays->points2);
+	free(arrays->xforms);
+	free(arrays->radii);
+	free(arrays->tiles);
+}
+
+static VRD_BenchResult VRD_Bench_Run(const VRD_BenchConfig* config, const VRD_BenchWorkload* workload, const VRD_BenchCodec* codec, long long rawBytes)
+{
+	VRD_BenchResult result;
+	memset(&result, 0, sizeof(result));
+	snprintf(result.name, sizeof(result.name), "%s/%s", workload->name, codec->name);
+
+	char path[512];
+	snprintf(path, sizeof(path), "%s/vrd_bench_%s_%s.vrd", config->dir, workload->name, codec->name);
+
+	VRD_BenchConfig runConfig = *config;
+	if (workload->entities > 0) runConfig.entities = workload->entities;
+	config = &runConfig;
+
+	VRD_BenchRun run;
+	memset(&run, 0, sizeof(run));
+	run.config = config;
+	run.check_frame = -1;
+	VRD_BenchArrays arrays;
+	memset(&arrays, 0, sizeof(arrays));
+	if (workload->arrays)
+	{
+		arrays.keys = static_cast<entityKeyType*>(malloc(config->entities * sizeof(entityKeyType)));
+		arrays.points = static_cast<VRD_Point*>(malloc(config->entities * sizeof(VRD_Point)));
+		arrays.points2 = static_cast<VRD_Point*>(malloc(config->entities * sizeof(VRD_Point)));
+		arrays.xforms = static_cast<VRD_Transform*>(malloc(config->entities * sizeof(VRD_Transform)));
+		arrays.radii = static_cast<float*>(malloc(config->entities * sizeof(float)));
+		arrays.tiles = static_cast<VRD_Point*>(malloc((config->entities / 16 + 1) * VRD_BENCH_TILE_VERTS * sizeof(VRD_Point)));
+	}
+	run.arrays = &arrays;
+	run.heap_base = VRD_Bench_HeapInUse();
+
+	VRD_ContextOptions* options = &run.options;
+	VRD_InitContextOptions(options);
+	options->compressed = codec->codec;
+	options->meshCacheBytes = workload->mesh_cache_bytes;
+	options->valueSeriesFrames = workload->value_series_frames;
+	options->summaryFooter = workload->summary_footer;
+	if (workload->options) workload->options(options);
+	run.mesh_cache = workload->mesh_cache_bytes > 0;
+	run.ctx = VRD_CreateContextWithOptions(path, options);
+	if (run.ctx == 0)
+	{
+		fprintf(stderr, "  could not create %s\n", path);
+		VRD_Bench_FreeArrays(&arrays);
+		return result;
+	}
+	VRD::Capture capture(run.ctx);
+	run.capture = &capture;
+
+	// Only the capture calls are timed, not the heap sampling
+	long long ns = 0;
+	for (int frame = 0; frame < config->frames; ++frame)
+	{
+		auto start = std::chrono::steady_clock::now();
+		workload->frame(&run, frame);
+		auto pause = std::chrono::steady_clock::now();
+		long long staged = VRD_Bench_HeapInUse(); // The staging buffer is fullest right before the frame step
+		auto resume = std::chrono::steady_clock::now();
+		VRD_StepFrame(run.ctx, frame * (1.0f / 60));
+		auto end = std::chrono::steady_clock::now();
+		ns += std::chrono::duration_cast<std::chrono::nanoseconds>((pause - start) + (end - resume)).count();
+		if (staged > run.heap_peak) run.heap_peak = staged;
+		run.counts.calls += 1;
+	}
+	auto start = std::chrono::steady_clock::now();
+	capture.Release();
+	ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+	result.file_bytes = VRD_Bench_FileSize(path);
+	result.ns_per_call = run.counts.calls > 0 ? (double)ns / run.counts.calls : 0;
+	result.bytes_per_frame = (double)result.file_bytes / config->frames;
+	result.compression_ratio = (rawBytes > 0 && result.file_bytes > 0) ? (double)rawBytes / result.file_bytes : 1.0;
+	result.peak_bytes = run.heap_peak > run.heap_base ? run.heap_peak - run.heap_base : 0;
+	result.roundtrip_ok = VRD_Bench_RoundTrip(path, &run, workload);
+	remove(path);
+	VRD_Bench_FreeArrays(&arrays);
+	free(run.index_map.ids);
+	free(run.index_map.indices);
+	return result;
+}
+
+static void VRD_Bench_WriteJson(FILE* fp, const VRD_BenchConfig* config, const VRD_BenchResult* results, int count)
+{
+	// One result per line, so that baselines can be read back without a JSON parser
+	fprintf(fp, "{\n\"frames\": %d, \"entities\": %d,\n\"results\": [\n", config->frames, config->entities);
+	for (int i = 0; i < count; ++i)
+	{
+		const VRD_BenchResult* r = &results[i];
+		fprintf(fp, "{\"name\": \"%s\", \"ns_per_call\": %.2f, \"bytes_per_frame\": %.1f, \"compression_ratio\": %.3f, \"peak_bytes\": %lld, \"roundtrip\": %s}%s\n",
+			r->name, r->ns_per_call, r->bytes_per_frame, r->compression_ratio, r->peak_bytes, r->roundtrip_ok ? "true" : "false", i + 1 < count ? "," : "");
+	}
+	fprintf(fp, "]\n}\n");
+}
+
+static int VRD_Bench_ReadBaseline(const char* path, VRD_BenchResult* results, int capacity)
+{
+	FILE* fp = fopen(path, "r");
+	if (fp == 0) return -1;
+	int count = 0;
+	char line[512];
+	while (count < capacity && fgets(line, sizeof(line), fp))
+	{
+		VRD_BenchResult* r = &results[count];
+		memset(r, 0, sizeof(VRD_BenchResult));
+		if (sscanf(line, " {\"name\": \"%63[^\"]\", \"ns_per_call\": %lf, \"bytes_per_frame\": %lf, \"compression_ratio\": %lf, \"peak_bytes\": %lld",
+			r->name, &r->ns_per_call, &r->bytes_per_frame, &r->compression_ratio, &r->peak_bytes) == 5) ++count;
+	}
+	fclose(fp);
+	return count;
+}
+
+// Returns the number of regressions: slower, larger per frame or more memory than the baseline, past the tolerance.
+static int VRD_Bench_Compare(const VRD_BenchConfig* config, const VRD_BenchResult* results, int count)
+{
+	VRD_BenchResult baseline[VRD_BENCH_MAX_RESULTS];
+	int baselineCount = VRD_Bench_ReadBaseline(config->baseline, baseline, VRD_BENCH_MAX_RESULTS);
+	if (baselineCount < 0)
+	{
+		fprintf(stderr, "could not read baseline %s\n", config->baseline);
+		return 1;
+	}
+
+	int regressions = 0;
+	double limit = 1.0 + config->tolerance / 100.0;
+	printf("\nvs %s (tolerance %.0f%%)\n", config->baseline, config->tolerance);
+	for (int i = 0; i < count; ++i)
+	{
+		const VRD_BenchResult* r = &results[i];
+		const VRD_BenchResult* b = 0;
+		for (int j = 0; j < baselineCount && b == 0; ++j)
+		{
+			if (strcmp(baseline[j].name, r->name) == 0) b = &baseline[j];
+		}
+		if (b == 0)
+		{
+			printf("%-24s new\n", r->name);
+			continue;
+		}
+		bool slower = b->ns_per_call > 0 && r->ns_per_call > b->ns_per_call * limit;
+		bool larger = b->bytes_per_frame > 0 && r->bytes_per_frame > b->bytes_per_frame * limit;
+		bool heavier = b->peak_bytes > 0 && r->peak_bytes > b->peak_bytes * limit;
+		printf("%-24s %+7.1f%% ns/call %+7.1f%% bytes/frame %+7.1f%% peak%s\n", r->name,
+			b->ns_per_call > 0 ? (r->ns_per_call / b->ns_per_call - 1) * 100 : 0,
+			b->bytes_per_frame > 0 ? (r->bytes_per_frame / b->bytes_per_frame - 1) * 100 : 0,
+			b->peak_bytes > 0 ? ((double)r->peak_bytes / b->peak_bytes - 1) * 100 : 0,
+			(slower || larger || heavier) ? "  REGRESSION" : "");
+		if (slower || larger || heavier) ++regressions;
+	}
+	return regressions;
+}
+
+int main(int argc, char** argv)
+{
+	VRD_BenchConfig config = { 600, 1000, ".", 0, 0, 10.0 };
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--frames") == 0) config.frames = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--entities") == 0) config.entities = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--dir") == 0) config.dir = argv[i + 1];
+		else if (strcmp(argv[i], "--out") == 0) config.out = argv[i + 1];
+		else if (strcmp(argv[i], "--baseline") == 0) config.baseline = argv[i + 1];
+		else if (strcmp(argv[i], "--tolerance") == 0) config.tolerance = atof(argv[i + 1]);
+		else
+		{
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (config.frames <= 0 || config.entities <= 0) return 2;
+
+	VRD_BenchResult results[VRD_BENCH_MAX_RESULTS];
+	int count = 0;
+	bool roundtrip = true;
+	printf("%d frames, %d entities, %d bit keys\n\n", config.frames, config.entities, (int)sizeof(entityKeyType) * 8);
+	printf("%-24s %10s %14s %8s %12s %s\n", "workload/codec", "ns/call", "bytes/frame", "ratio", "peak bytes", "roundtrip");
+	for (const VRD_BenchWorkload& workload : VRD_BenchWorkloads)
+	{
+		long long rawBytes = 0; // Uncompressed size, for the ratio of the other codecs
+		for (const VRD_BenchCodec& codec : VRD_BenchCodecs)
+		{
+			VRD_BenchResult* r = &results[count++];
+			*r = VRD_Bench_Run(&config, &workload, &codec, rawBytes);
+			if (codec.codec == VRD_Codec_None) rawBytes = r->file_bytes;
+			roundtrip &= r->roundtrip_ok != 0;
+			printf("%-24s %10.1f %14.1f %8.2f %12lld %s\n", r->name, r->ns_per_call, r->bytes_per_frame, r->compression_ratio, r->peak_bytes, r->roundtrip_ok ? "ok" : "FAILED");
+		}
+	}
+
+	if (config.out)
+	{
+		FILE* fp = fopen(config.out, "w");
+		if (fp == 0) return 2;
+		VRD_Bench_WriteJson(fp, &config, results, count);
+		fclose(fp);
+	}
+	int regressions = config.baseline ? VRD_Bench_Compare(&config, results, count) : 0;
+	return (!roundtrip || regressions > 0) ? 1 : 0;
+}
@@ -383,10 +383,54 @@ internal enum BlockType
     EntityBox,
 
     EntityDefWithParent,
+    ReplayFormat,
+    StringDef,
+    EntityTransformDelta,
+    Keyframe,
+    CaptureStats,
+    EntitySetPosBatch,
+    EntitySetTransformBatch,
+    EntityLineBatch,
+    EntitySphereBatch,
+    MeshDef,
+    EntityMeshRef,
+    EntityLogFormat,
+    EntityValueSeries,
 
     ReplayHeader = 0xFF
 }
 
+[Flags]
+internal enum ReplayFormatFlags
+{
+    None = 0,
+    StringTable = 1 << 0, // Labels are StringDef ids, 0 followed by an inline string otherwise
+    DeltaTransforms = 1 << 1, // Followed by the position quantum, transforms are EntityTransformDelta blocks
+    RecycledIds = 1 << 2, // Ids of undefined entities are reused, an EntityDef after an EntityUndef is a new entity
+
+    Supported = StringTable | DeltaTransforms | RecycledIds
+}
+
+// Compression codec of a replay, recorded in the file header of chunked and VRDS replays
+internal enum ReplayCodec
+{
+    None,
+    Deflate,
+    LZ4,
+    Zstd,
+}
+
+[Flags]
+internal enum TransformDeltaFlags
+{
+    X = 1 << 0,
+    Y = 1 << 1,
+    Z = 1 << 2,
+    Rotation = 1 << 3, // Smallest three, index of the dropped component in bits 4-5
+    RotationIndexMask = 3 << 4,
+    Full = 1 << 6, // Absolute position
+}
+
 public class Entity
 {
     public int Id;
@@ -41,6 +41,7 @@ public class ReplayViewportContent // TODO: Make IDisposable
     readonly Dictionary<Entity, ScreenSpaceLines3D> EntityPaths = new();
 
     readonly Dictionary<Model3D, Entity> EntityModelsIndex = new();
+    readonly Dictionary<ReplayCapture.Point[], MeshGeometry3D> MeshGeometries = new(); // Keyed by the verts array, shared by the draws of a cached mesh
 
     Entity CameraEntity;
     ModelVisual3D CameraIndicator;
@@ -327,6 +328,7 @@ public class ReplayViewportContent // TODO: Make IDisposable
         Model3DGroup.Children.Clear();
         EntityPaths.Clear();
         EntityModels.Clear();
+        MeshGeometries.Clear();
         CameraIndicator = null;
         CameraEntity = null;
 
@@ -386,7 +388,13 @@ public class ReplayViewportContent // TODO: Make IDisposable
                         //geom = new MeshVisual3D() { Mesh = meshDef, VertexResolution = 0 };
 
                         // Much faster, but not as pretty
-                        geom = new SimpleMeshVisual3D(creationDrawCommand.verts.Select(x => x.ToPoint()));
+                        if (!MeshGeometries.TryGetValue(creationDrawCommand.verts, out var meshGeometry))
+                        {
+                            meshGeometry = SimpleMeshVisual3D.CreateGeometry(creationDrawCommand.verts.Select(x => x.ToPoint()));
+                            MeshGeometries.Add(creationDrawCommand.verts, meshGeometry);
+                        }
+                        geom = new SimpleMeshVisual3D(meshGeometry);
+                        modelTransform = creationDrawCommand.xform.ToTransform3D(); // Cached meshes are placed by their draw
                     }
 
                     if (geom is MeshElement3D meshgeom)
@@ -16,14 +16,33 @@ namespace HelixToolkit.Wpf
     {
 
         private Point3D[] _verts;
+        private MeshGeometry3D _geometry;
         public SimpleMeshVisual3D(IEnumerable<Point3D> verts) : base()
         {
             _verts = verts.ToArray();
             UpdateModel();
         }
 
+        // Shares the geometry, for meshes drawn many times
+        public SimpleMeshVisual3D(MeshGeometry3D geometry) : base()
+        {
+            _geometry = geometry;
+            UpdateModel();
+        }
+
+        public static MeshGeometry3D CreateGeometry(IEnumerable<Point3D> verts)
+        {
+            var builder = new MeshBuilder(false, false);
+            var points = verts.ToArray();
+            builder.Append(points, Enumerable.Range(0, points.Length).ToArray());
+            var geometry = builder.ToMesh();
+            geometry.Freeze();
+            return geometry;
+        }
+
         protected override MeshGeometry3D Tessellate()
         {
+            if (_geometry != null) return _geometry;
             var builder = new MeshBuilder(false, false);
             if (_verts != null)
             {